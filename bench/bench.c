@@ -0,0 +1,68 @@
+/*
+ *    Common code of the benchmarks.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "bench.h"
+
+int bench_scale=1;
+
+static int nresults;
+
+u_int64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+void bench_begin(const char *suite)
+{
+	printf("{ \"suite\": \"%s\", \"time\": %ld, \"scale\": %d, "
+			"\"results\": [\n", suite, (long)time(NULL),
+			bench_scale);
+	nresults=0;
+}
+
+void bench_result(const char *name, long long ops, u_int64_t ns,
+		const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%s  { \"name\": \"%s\", \"ops\": %lld, \"ns\": %llu, "
+			"\"ns_per_op\": %.1f", nresults ? ",\n" : "", name,
+			ops, (unsigned long long)ns,
+			ops ? (double)ns/ops : 0.0);
+	if (fmt != NULL) {
+		printf(", ");
+		va_start(ap, fmt);
+		vprintf(fmt, ap);
+		va_end(ap);
+	}
+	printf(" }");
+	fflush(stdout);
+	nresults++;
+}
+
+void bench_end(void)
+{
+	printf("\n] }\n");
+}
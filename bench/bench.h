@@ -0,0 +1,63 @@
+/*
+ *    Common code of the benchmarks.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Every benchmark program writes one JSON document to stdout:
+ *
+ *	{ "suite": "rpc", "time": 1700000000, "scale": 1, "results": [
+ *	  { "name": "xid_get", "ops": 65536, "ns": 1234567,
+ *	    "ns_per_op": 18.8, "entries": 65536 },
+ *	  ...
+ *	] }
+ *
+ * name identifies what was measured, ops and ns are the raw numbers,
+ * and any further fields describe the case (sizes, window) or give
+ * derived results (MB/s, percentiles). Progress and errors go to
+ * stderr, so the output can be piped straight into a file.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Multiplies the iteration counts, set with -s */
+extern int bench_scale;
+
+/* Monotonic clock in nanoseconds */
+extern u_int64_t bench_now(void);
+
+extern void bench_begin(const char *suite);
+
+/* Emits one result. fmt, if not NULL, gives further fields as
+ * "\"key\": value" pairs separated by commas.
+ */
+extern void bench_result(const char *name, long long ops, u_int64_t ns,
+		const char *fmt, ...);
+
+extern void bench_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
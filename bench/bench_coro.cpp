@@ -0,0 +1,163 @@
+/*
+ *    Round trips through the C++20 front end.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The NULL and GETATTR round trips of bench_nfs, made by coroutines
+ * through nfs::client and nfs::executor: one coroutine awaiting one
+ * call at a time, and a window of coroutines doing the same. The
+ * difference to bench_nfs is what the front end costs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <nfsclient.hpp>
+#include "bench.h"
+
+#define DEFAULT_PORT 20490
+
+char *progname;
+nfs_fh3 root;
+char rootbuf[NFS3_FHSIZE];
+
+/* The run in progress */
+int proc;
+int total;
+int sent;
+int errors;
+
+nfs::task<> worker(nfs::client &c)
+{
+	GETATTR3args args;
+
+	args.object=root;
+	while (sent < total) {
+		sent++;
+		if (proc == NFS3_NULL) {
+			auto res=co_await c.null();
+			if (!res)
+				errors++;
+		} else {
+			auto res=co_await c.getattr(args);
+			if (!res || res->status != NFS3_OK)
+				errors++;
+		}
+	}
+}
+
+void run(nfs::executor &ex, nfs::client &c, const char *name, int p,
+		int window, int count)
+{
+	u_int64_t t0, ns;
+	int i;
+
+	proc=p;
+	total=count;
+	sent=errors=0;
+
+	t0=bench_now();
+	for (i=0; i<window; i++)
+		ex.spawn(worker(c));
+	ex.run();
+	ns=bench_now()-t0;
+
+	bench_result(name, count, ns, "\"window\": %d, \"errors\": %d",
+			window, errors);
+}
+
+nfs::task<int> mount(nfs::client &c, const char *export_)
+{
+	auto res=co_await c.mnt(export_);
+	fhandle3 *fh;
+
+	if (!res)
+		co_return -1;
+	if (res->fhs_status != MNT3_OK)
+		co_return res->fhs_status;
+	fh=&res->mountres3_u.mountinfo.fhandle;
+	if (fh->fhandle3_len > NFS3_FHSIZE)
+		co_return -1;
+	memcpy(rootbuf, fh->fhandle3_val, fh->fhandle3_len);
+	root.data.data_val=rootbuf;
+	root.data.data_len=fh->fhandle3_len;
+	co_return 0;
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-s scale] [-h address] [-p port] "
+			"[-x export]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host="127.0.0.1", *export_="/export";
+	struct sockaddr_in srv;
+	int port=DEFAULT_PORT, n, err;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		switch (argv[1][1]) {
+		case 's': bench_scale=atoi(argv[2]); break;
+		case 'h': host=argv[2]; break;
+		case 'p': port=atoi(argv[2]); break;
+		case 'x': export_=argv[2]; break;
+		default: return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc != 1 || bench_scale < 1)
+		return usage();
+
+	/* The port is used for MOUNT as well, fakenfsd serves both */
+	memset(&srv, 0, sizeof srv);
+	srv.sin_family=AF_INET;
+	srv.sin_port=htons(port);
+	if (inet_aton(host, &srv.sin_addr) == 0)
+		return usage();
+
+	nfs::executor ex;
+	nfs::client c(ex, &srv);
+
+	if (!c) {
+		fprintf(stderr, "%s: cannot connect to %s:%d\n", progname,
+				host, port);
+		return 1;
+	}
+	if ((err=ex.run(mount(c, export_))) != 0) {
+		fprintf(stderr, "%s: cannot mount %s: %d\n", progname,
+				export_, err);
+		return 1;
+	}
+
+	n=20000*bench_scale;
+	bench_begin("coro");
+	run(ex, c, "coro_null", NFS3_NULL, 1, n);
+	run(ex, c, "coro_null", NFS3_NULL, 32, n);
+	run(ex, c, "coro_getattr", NFS3_GETATTR, 1, n);
+	run(ex, c, "coro_getattr", NFS3_GETATTR, 32, n);
+	bench_end();
+	return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ *    Benchmarks of the ght hash functions.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Every hash function on keys shaped like what the tools hash: file
+ * handles of 32 and 64 bytes, which share a long prefix (fsid, export)
+ * and differ in the inode and generation numbers, and file names. For
+ * each, "hash" is the function alone and "get" a ght_get() from a table
+ * holding all the keys. empty_pct and max_bucket tell how well the keys
+ * spread over as many buckets as there are keys; a random function
+ * leaves 36.8% empty.
+ *
+ * "grow" inserts into a table that starts small and doubles as it
+ * fills, rehashing either incrementally (ght_set_rehash()) or all at
+ * once with ght_rehash(), and reports the slowest insert besides the
+ * average.
+ *
+ * "shared_get" has NTHREADS threads looking up 32 byte handles in one
+ * table, which is either an ordinary one behind a single mutex or one
+ * made by ght_create_sharded(). ns is the wall clock time per lookup
+ * of all threads together.
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <ght_hash_table.h>
+#include "bench.h"
+
+#define NKEYS		65536
+#define MAXKEY		64
+#define NTHREADS	4
+#define NSHARDS		64
+
+char *progname;
+
+struct hashfn {
+	char *name;
+	ght_fn_hash_t fn;
+} hashfns[]={
+	{ "one_at_a_time", ght_one_at_a_time_hash },
+	{ "rotating", ght_rotating_hash },
+	{ "crc", ght_crc_hash },
+	{ "crc32c", ght_crc32c_hash },
+	{ "wy", ght_wy_hash },
+};
+
+#define NHASHFNS	(int)(sizeof hashfns/sizeof hashfns[0])
+
+static unsigned char keys[NKEYS][MAXKEY];
+static unsigned int keylen[NKEYS];
+static int buckets[NKEYS];
+
+/* A Linux style handle: fsid and export the same for all, then inode
+ * and generation, padded with zeros up to size.
+ */
+void make_fh(int size)
+{
+	u_int32_t ino, gen;
+	int i;
+
+	for (i=0; i<NKEYS; i++) {
+		memset(keys[i], 0, size);
+		memcpy(keys[i], "\001\000\006\001\x9e\x21\xb5\x4a"
+				"\x5c\x3d\x44\x8e\x91\x0e\x2b\x77", 16);
+		ino=1000+i*7;
+		gen=0x5a000000+(i*2654435761U>>20);
+		memcpy(keys[i]+16, &ino, 4);
+		memcpy(keys[i]+20, &gen, 4);
+		keylen[i]=size;
+	}
+}
+
+void make_names(void)
+{
+	static char *fmt[]={ "file%05d.txt", "IMG_%d.JPG", "%d",
+		"core.%d", ".#lock-%x", "very_long_directory_name_%07d" };
+	int i;
+
+	for (i=0; i<NKEYS; i++)
+		keylen[i]=snprintf((char *)keys[i], MAXKEY,
+				fmt[i%(sizeof fmt/sizeof fmt[0])], i);
+}
+
+void run(char *keyname, struct hashfn *h, int rounds)
+{
+	ght_hash_table_t *t;
+	ght_hash_key_t key;
+	ght_uint32_t sum=0;
+	u_int64_t t0, ns;
+	int i, r, empty=0, max=0;
+
+	t0=bench_now();
+	for (r=0; r<rounds; r++)
+		for (i=0; i<NKEYS; i++) {
+			key.i_size=keylen[i];
+			key.p_key=keys[i];
+			sum+=(*h->fn)(&key);
+		}
+	ns=bench_now()-t0;
+
+	memset(buckets, 0, sizeof buckets);
+	for (i=0; i<NKEYS; i++) {
+		key.i_size=keylen[i];
+		key.p_key=keys[i];
+		buckets[(*h->fn)(&key)&(NKEYS-1)]++;
+	}
+	for (i=0; i<NKEYS; i++) {
+		if (buckets[i] == 0)
+			empty++;
+		if (buckets[i] > max)
+			max=buckets[i];
+	}
+	bench_result("hash", (long long)rounds*NKEYS, ns, "\"function\": "
+			"\"%s\", \"keys\": \"%s\", \"empty_pct\": %.1f, "
+			"\"max_bucket\": %d, \"sum\": %u", h->name, keyname,
+			100.0*empty/NKEYS, max, sum);
+
+	t=ght_create(NKEYS);
+	ght_set_hash(t, h->fn);
+	for (i=0; i<NKEYS; i++)
+		ght_insert(t, keys[i], keylen[i], keys[i]);
+	t0=bench_now();
+	for (r=0; r<rounds; r++)
+		for (i=0; i<NKEYS; i++)
+			if (ght_get(t, keylen[i], keys[i]) != keys[i]) {
+				fprintf(stderr, "%s: %s lost a key\n",
+						progname, h->name);
+				exit(1);
+			}
+	ns=bench_now()-t0;
+	ght_finalize(t);
+	bench_result("get", (long long)rounds*NKEYS, ns, "\"function\": "
+			"\"%s\", \"keys\": \"%s\"", h->name, keyname);
+}
+
+void grow(int incremental, int n)
+{
+	ght_hash_table_t *t;
+	u_int64_t t0, t1, ns=0, max=0;
+	u_int64_t key;
+	int i;
+
+#ifdef __GLIBC__
+	/* Otherwise glibc sorts the entries freed by the previous run
+	 * in the first larger malloc() made here, the bucket array of the
+	 * first rehash, which takes longer than any rehash.
+	 */
+	malloc_trim(0);
+#endif
+
+	t=ght_create(16);
+	ght_set_rehash(t, incremental);
+	for (i=0; i<n; i++) {
+		key=(u_int64_t)i*0x9e3779b97f4a7c15ULL;
+		t0=bench_now();
+		if (!incremental && ght_size(t) > 2*ght_table_size(t))
+			ght_rehash(t, 2*ght_table_size(t));
+		ght_insert(t, t, sizeof key, &key);
+		t1=bench_now()-t0;
+		ns+=t1;
+		if (t1 > max)
+			max=t1;
+	}
+	ght_finalize(t);
+	bench_result("grow", n, ns, "\"rehash\": \"%s\", \"max_ns\": %llu",
+			incremental ? "incremental" : "at_once",
+			(unsigned long long)max);
+}
+
+struct shared {
+	ght_hash_table_t *t;
+	pthread_mutex_t *mutex;	/* NULL for a sharded table */
+	int rounds;
+	int first;
+};
+
+void *shared_worker(void *arg)
+{
+	struct shared *s=arg;
+	void *p;
+	int r, i, k;
+
+	for (r=0; r<s->rounds; r++)
+		for (i=0; i<NKEYS; i++) {
+			/* Each thread walks the keys from elsewhere */
+			k=(i+s->first)%NKEYS;
+			if (s->mutex)
+				pthread_mutex_lock(s->mutex);
+			p=ght_get(s->t, keylen[k], keys[k]);
+			if (s->mutex)
+				pthread_mutex_unlock(s->mutex);
+			if (p == NULL) {
+				fprintf(stderr, "%s: lost a key\n", progname);
+				exit(1);
+			}
+		}
+	return NULL;
+}
+
+void shared_get(int sharded, int rounds)
+{
+	static pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
+	struct shared s[NTHREADS];
+	pthread_t thread[NTHREADS];
+	ght_hash_table_t *t;
+	u_int64_t t0, ns;
+	int i;
+
+	if (sharded)
+		t=ght_create_sharded(NKEYS, NSHARDS);
+	else
+		t=ght_create(NKEYS);
+	for (i=0; i<NKEYS; i++)
+		ght_insert(t, keys[i], keylen[i], keys[i]);
+	t0=bench_now();
+	for (i=0; i<NTHREADS; i++) {
+		s[i].t=t;
+		s[i].mutex=sharded ? NULL : &mutex;
+		s[i].rounds=rounds;
+		s[i].first=i*(NKEYS/NTHREADS);
+		if (pthread_create(&thread[i], NULL, shared_worker, &s[i])) {
+			fprintf(stderr, "%s: pthread_create failed\n",
+					progname);
+			exit(1);
+		}
+	}
+	for (i=0; i<NTHREADS; i++)
+		pthread_join(thread[i], NULL);
+	ns=bench_now()-t0;
+	ght_finalize(t);
+	bench_result("shared_get", (long long)NTHREADS*rounds*NKEYS, ns,
+			"\"table\": \"%s\", \"threads\": %d",
+			sharded ? "sharded" : "mutex", NTHREADS);
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-s scale]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, rounds;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		switch (argv[1][1]) {
+		case 's': bench_scale=atoi(argv[2]); break;
+		default: return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc != 1 || bench_scale < 1)
+		return usage();
+	rounds=20*bench_scale;
+
+	bench_begin("hash");
+	for (i=0; i<NHASHFNS; i++)
+		if (ght_fastest_hash() == hashfns[i].fn)
+			bench_result("fastest", 0, 0, "\"function\": \"%s\"",
+					hashfns[i].name);
+	make_fh(32);
+	for (i=0; i<NHASHFNS; i++)
+		run("fh32", &hashfns[i], rounds);
+	make_fh(64);
+	for (i=0; i<NHASHFNS; i++)
+		run("fh64", &hashfns[i], rounds);
+	make_names();
+	for (i=0; i<NHASHFNS; i++)
+		run("name", &hashfns[i], rounds);
+	grow(0, 1000000*bench_scale);
+	grow(1, 1000000*bench_scale);
+	make_fh(32);
+	shared_get(0, rounds);
+	shared_get(1, rounds);
+	bench_end();
+	return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ *    End-to-end benchmarks against an NFS server, usually fakenfsd.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * NULL, GETATTR and READ round trips, one at a time and with a window
+ * of calls in flight. Replies are decoded like a real caller would.
+ * Besides the rate, the latency percentiles from the client's call
+ * statistics are reported, in microseconds.
+ *
+ * "rt_null" makes the same NULL calls through an nfs_rt runtime, over
+ * several connections each keeping a window of calls in flight, first
+ * on one worker and then on one worker per CPU.
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <nfsclient.h>
+#include <nfs_rt.h>
+#include "bench.h"
+
+#define DEFAULT_PORT 20490
+
+char *progname;
+struct sockaddr_in srv;
+nfs_ctx *ctx;
+nfs_fh3 root, file;
+u_int64_t filesize;
+
+/* The run in progress */
+int proc;
+int total;
+int sent;
+int done;
+int errors;
+u_int64_t rxbytes;
+u_int64_t nextoff;
+int batching;		/* Calls are made by execute_batch() */
+
+void send_one(void);
+
+void reply_cb(void *msg, int len, void *priv)
+{
+	GETATTR3res *gres;
+	READ3res *rres;
+
+	done++;
+	if (msg == NULL) {
+		errors++;
+	} else if (proc == NFS3_GETATTR) {
+		gres=xdr_to_GETATTR3res(msg, len);
+		if (gres == NULL || gres->status != NFS3_OK)
+			errors++;
+		else if (filesize == 0)
+			filesize=gres->GETATTR3res_u.resok.obj_attributes.size;
+		if (gres != NULL)
+			free_GETATTR3res(gres);
+	} else if (proc == NFS3_READ) {
+		rres=xdr_to_READ3res(msg, len, NFS3_DATA_NO_DEXDR);
+		if (rres == NULL || rres->status != NFS3_OK)
+			errors++;
+		else
+			rxbytes+=(u_int32_t)rres->READ3res_u.resok.count;
+		if (rres != NULL)
+			free_READ3res(rres, NFS3_DATA_NO_DEXDR);
+	}
+	if (!batching)
+		send_one();
+}
+
+void send_one(void)
+{
+	GETATTR3args gargs;
+	READ3args rargs;
+	enum clnt_stat stat;
+
+	if (sent >= total)
+		return;
+	sent++;
+	if (proc == NFS3_NULL) {
+		stat=nfs3_null(ctx, reply_cb, NULL);
+	} else if (proc == NFS3_GETATTR) {
+		gargs.object=file;
+		stat=nfs3_getattr(&gargs, ctx, reply_cb, NULL);
+	} else {
+		rargs.file=file;
+		rargs.offset=nextoff;
+		rargs.count=ctx->nfs_rsize;
+		nextoff+=ctx->nfs_rsize;
+		if (nextoff >= filesize)
+			nextoff=0;
+		stat=nfs3_read(&rargs, ctx, reply_cb, NULL);
+	}
+	if (stat != RPC_SUCCESS) {
+		done++;
+		errors++;
+	}
+}
+
+/* Sends count calls of proc p, window at a time. Returns the time
+ * taken until the last reply.
+ */
+u_int64_t execute(int p, int window, int count)
+{
+	u_int64_t t0;
+	int i;
+
+	proc=p;
+	total=count;
+	sent=done=errors=0;
+	rxbytes=0;
+	nextoff=0;
+	nfs_reset_stats(ctx);
+
+	t0=bench_now();
+	for (i=0; i<window; i++)
+		send_one();
+	while (done < total)
+		if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	if (done < total) {
+		fprintf(stderr, "%s: connection lost\n", progname);
+		exit(1);
+	}
+	return bench_now()-t0;
+}
+
+void run(char *name, int p, int window, int count)
+{
+	struct clnt_proc_stats *ps;
+	u_int64_t ns;
+
+	ns=execute(p, window, count);
+	ps=nfs_proc_stats(ctx, NFS_PROGRAM, p);
+	bench_result(name, done, ns, "\"window\": %d, \"errors\": %d, "
+			"\"ops_per_s\": %.0f, \"mb_per_s\": %.1f, "
+			"\"p50_us\": %u, \"p99_us\": %u, \"max_us\": %u",
+			window, errors, (double)done/ns*1e9,
+			(double)rxbytes/ns*1000,
+			ps ? clnt_stats_percentile(ps, 50) : 0,
+			ps ? clnt_stats_percentile(ps, 99) : 0,
+			ps ? ps->ps_max_us : 0);
+}
+
+/* Sends count GETATTR calls in batches of batch with
+ * nfs_submit_batch(), each after the replies to the one before.
+ */
+u_int64_t execute_batch(int batch, int count)
+{
+	GETATTR3args gargs;
+	nfs_op *ops;
+	u_int64_t t0;
+	int i, n;
+
+	ops=calloc(batch, sizeof(nfs_op));
+	if (ops == NULL) {
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	gargs.object=file;
+	for (i=0; i<batch; i++) {
+		ops[i].op_proc=NFS3_GETATTR;
+		ops[i].op_args=&gargs;
+		ops[i].op_cb=reply_cb;
+	}
+
+	proc=NFS3_GETATTR;
+	total=count;
+	sent=done=errors=0;
+	rxbytes=0;
+	batching=1;
+	nfs_reset_stats(ctx);
+
+	t0=bench_now();
+	while (sent < total) {
+		n=batch;
+		if (total-sent < n)
+			n=total-sent;
+		i=nfs_submit_batch(ctx, ops, n);
+		sent+=n;
+		done+=n-i;
+		errors+=n-i;
+		while (done < sent)
+			if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+				break;
+		if (done < sent) {
+			fprintf(stderr, "%s: connection lost\n", progname);
+			exit(1);
+		}
+	}
+	batching=0;
+	free(ops);
+	return bench_now()-t0;
+}
+
+void run_batch(char *name, int batch, int count)
+{
+	struct clnt_proc_stats *ps;
+	u_int64_t ns;
+
+	ns=execute_batch(batch, count);
+	ps=nfs_proc_stats(ctx, NFS_PROGRAM, NFS3_GETATTR);
+	bench_result(name, done, ns, "\"batch\": %d, \"errors\": %d, "
+			"\"ops_per_s\": %.0f, \"p50_us\": %u, \"p99_us\": %u",
+			batch, errors, (double)done/ns*1e9,
+			ps ? clnt_stats_percentile(ps, 50) : 0,
+			ps ? clnt_stats_percentile(ps, 99) : 0);
+}
+
+/* A connection of the runtime benchmark, only used by its worker */
+struct rt_conn {
+	nfs_ctx *ctx;
+	int window;
+	int left;		/* Calls still to make */
+	int inflight;
+	int errors;
+};
+
+pthread_mutex_t rt_mutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t rt_cond=PTHREAD_COND_INITIALIZER;
+int rt_running;
+
+void rt_reply_cb(void *msg, int len, void *priv);
+
+void rt_finish(struct rt_conn *c)
+{
+	if (c->inflight > 0 || c->left > 0)
+		return;
+	pthread_mutex_lock(&rt_mutex);
+	if (--rt_running == 0)
+		pthread_cond_signal(&rt_cond);
+	pthread_mutex_unlock(&rt_mutex);
+}
+
+void rt_send(struct rt_conn *c)
+{
+	if (c->left == 0)
+		return;
+	c->left--;
+	c->inflight++;
+	if (nfs3_null(c->ctx, rt_reply_cb, c) != RPC_SUCCESS) {
+		/* Give up on the rest */
+		c->inflight--;
+		c->errors+=c->left+1;
+		c->left=0;
+	}
+}
+
+void rt_reply_cb(void *msg, int len, void *priv)
+{
+	struct rt_conn *c=priv;
+
+	c->inflight--;
+	if (msg == NULL)
+		c->errors++;
+	rt_send(c);
+	rt_finish(c);
+}
+
+void rt_start(nfs_ctx *ctx, void *arg)
+{
+	struct rt_conn *c=arg;
+	int i;
+
+	c->ctx=ctx;
+	if (ctx == NULL) {
+		c->errors=c->left;
+		c->left=0;
+	}
+	for (i=0; i<c->window; i++)
+		rt_send(c);
+	rt_finish(c);
+}
+
+void run_rt(int workers, int conns, int window, int count)
+{
+	struct rt_conn *c;
+	nfs_rt *rt;
+	u_int64_t t0, ns;
+	int i, errs=0;
+
+	rt=nfs_rt_create(workers, NFS_RT_PIN, NFSC_CFL_DISABLE_NAGLE);
+	c=calloc(conns, sizeof(struct rt_conn));
+	if (rt == NULL || c == NULL) {
+		fprintf(stderr, "%s: cannot start the runtime\n", progname);
+		exit(1);
+	}
+	rt_running=conns;
+	t0=bench_now();
+	for (i=0; i<conns; i++) {
+		c[i].window=window;
+		c[i].left=count/conns;
+		if (nfs_rt_submit(rt, &srv, i, rt_start, &c[i]) < 0) {
+			fprintf(stderr, "%s: cannot submit\n", progname);
+			exit(1);
+		}
+	}
+	pthread_mutex_lock(&rt_mutex);
+	while (rt_running > 0)
+		pthread_cond_wait(&rt_cond, &rt_mutex);
+	pthread_mutex_unlock(&rt_mutex);
+	ns=bench_now()-t0;
+
+	for (i=0; i<conns; i++)
+		errs+=c[i].errors;
+	bench_result("rt_null", (long long)conns*(count/conns), ns,
+			"\"workers\": %d, \"conns\": %d, \"window\": %d, "
+			"\"errors\": %d, \"ops_per_s\": %.0f",
+			nfs_rt_workers(rt), conns, window, errs,
+			(double)conns*(count/conns)/ns*1e9);
+	nfs_rt_destroy(rt);
+	free(c);
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-s scale] [-h address] [-p port] "
+			"[-x export] [-f file]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	char *host="127.0.0.1", *export="/export", *path="testfile";
+	int port=DEFAULT_PORT, n, err;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		switch (argv[1][1]) {
+		case 's': bench_scale=atoi(argv[2]); break;
+		case 'h': host=argv[2]; break;
+		case 'p': port=atoi(argv[2]); break;
+		case 'x': export=argv[2]; break;
+		case 'f': path=argv[2]; break;
+		default: return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc != 1 || bench_scale < 1)
+		return usage();
+
+	/* The port is used for MOUNT as well, fakenfsd serves both */
+	memset(&srv, 0, sizeof srv);
+	srv.sin_family=AF_INET;
+	srv.sin_port=htons(port);
+	if (inet_aton(host, &srv.sin_addr) == 0)
+		return usage();
+	ctx=nfs_init(&srv, IPPROTO_TCP, NFSC_CFL_NONBLOCKING
+			| NFSC_CFL_DISABLE_NAGLE);
+	if (ctx == NULL) {
+		fprintf(stderr, "%s: cannot connect to %s:%d\n", progname,
+				host, port);
+		return 1;
+	}
+	if ((err=nfs_mount(ctx, export, &root)) != 0) {
+		fprintf(stderr, "%s: cannot mount %s: %d\n", progname, export,
+				err);
+		return 1;
+	}
+	if ((err=nfs_resolve_path(ctx, &root, path, &file)) != NFS3_OK) {
+		fprintf(stderr, "%s: %s: %s\n", progname, path,
+				nfsstat3_strerror(err));
+		return 1;
+	}
+	/* Learn the file size */
+	execute(NFS3_GETATTR, 1, 1);
+	if (filesize == 0) {
+		fprintf(stderr, "%s: %s is empty\n", progname, path);
+		return 1;
+	}
+
+	n=20000*bench_scale;
+	bench_begin("nfs");
+	run("null", NFS3_NULL, 1, n);
+	run("null", NFS3_NULL, 32, n);
+	run("getattr", NFS3_GETATTR, 1, n);
+	run("getattr", NFS3_GETATTR, 32, n);
+	run_batch("getattr_batch", 32, n);
+	/* The replies of one read send the calls they make together */
+	nfs_set_cork(ctx, 65536);
+	run("getattr_cork", NFS3_GETATTR, 32, n);
+	nfs_set_cork(ctx, 0);
+	run("read", NFS3_READ, 1, n/8);
+	run("read", NFS3_READ, 8, n/8);
+	run_rt(1, 8, 32, n*4);
+	run_rt(0, 32, 32, n*4);
+	bench_end();
+
+	nfs_destroy(ctx);
+	return 0;
+}
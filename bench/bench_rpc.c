@@ -0,0 +1,467 @@
+/*
+ *    Microbenchmarks of the RPC client hot path.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The client is connected to us over a socketpair, with this program
+ * playing the server: the calls are read back to learn their xids,
+ * and replies are built by hand, so the fragment layout can be chosen
+ * freely. Only the time spent inside the library is counted:
+ *
+ *	call		clnttcp_nb_call(), i.e. encoding a call into the
+ *			record stream and handing it to the socket
+ *	receive		clnttcp_nb_receive() on a stream of replies, i.e.
+ *			the record reassembly in update_frag_state() and
+ *			collate_buf_list(), the xid lookup and the
+ *			dispatch through call_user_cb(), for different
+ *			reply sizes, fragment sizes and read sizes
+ *	dispatch	the same for NULL replies with different numbers
+ *			of calls outstanding, which is what the xid
+ *			table sees
+ *	xid_*		ght_insert(), ght_get() and ght_remove() with
+ *			xid keys, as the client uses them, in the flat
+ *			table and the chained one it replaced
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include <nfsclient.h>
+#include "bench.h"
+
+#define SOCKBUF (4*1024*1024)
+
+char *progname;
+
+struct loop {
+	CLIENT *cl;
+	int fd;
+
+	/* Calls read back from the client */
+	char *in;
+	int inlen;
+	int incap;
+	int midrecord;
+	u_int32_t *xids;
+	int nxids;
+	int xidcap;
+
+	/* Replies not yet written */
+	char *out;
+	int outlen;
+	int outcap;
+	int outoff;
+};
+
+int replies;
+
+void count_cb(void *msg, int len, void *priv)
+{
+	replies++;
+}
+
+void die(char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", progname, what, strerror(errno));
+	exit(1);
+}
+
+void grow(char **buf, int *cap, int need)
+{
+	int ncap=*cap ? *cap : 65536;
+
+	if (need <= *cap)
+		return;
+	while (ncap < need)
+		ncap*=2;
+	if ((*buf=realloc(*buf, ncap)) == NULL)
+		die("realloc");
+	*cap=ncap;
+}
+
+void loop_create(struct loop *lp, u_int sbufsz, u_int rbufsz)
+{
+	struct sockaddr_in sin;
+	int sv[2], bufsz=SOCKBUF, i;
+
+	memset(lp, 0, sizeof(struct loop));
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		die("socketpair");
+	for (i=0; i<2; i++) {
+		setsockopt(sv[i], SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof bufsz);
+		setsockopt(sv[i], SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof bufsz);
+	}
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+
+	/* A port keeps the client from asking the portmapper */
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family=AF_INET;
+	sin.sin_port=htons(2049);
+	sin.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	lp->cl=clnttcp_nb_create(&sin, NFS_PROGRAM, NFS_V3, &sv[0],
+			sbufsz, rbufsz);
+	if (lp->cl == NULL)
+		die("clnttcp_nb_create");
+	lp->fd=sv[1];
+}
+
+void loop_destroy(struct loop *lp)
+{
+	clnttcp_nb_destroy(lp->cl);
+	close(lp->fd);
+	free(lp->in);
+	free(lp->xids);
+	free(lp->out);
+}
+
+/* Reads the calls sent so far and remembers their xids */
+void loop_drain(struct loop *lp)
+{
+	u_int32_t hdr, flen, xid;
+	int n, off;
+
+	for (;;) {
+		grow(&lp->in, &lp->incap, lp->inlen+65536);
+		n=read(lp->fd, lp->in+lp->inlen, lp->incap-lp->inlen);
+		if (n <= 0)
+			break;
+		lp->inlen+=n;
+	}
+	for (off=0; lp->inlen-off >= 4; off+=4+flen) {
+		memcpy(&hdr, lp->in+off, 4);
+		hdr=ntohl(hdr);
+		flen=FRAG_SIZE(hdr);
+		if (lp->inlen-off-4 < flen)
+			break;
+		if (!lp->midrecord) {
+			memcpy(&xid, lp->in+off+4, 4);
+			if (lp->nxids == lp->xidcap) {
+				lp->xidcap=lp->xidcap ? lp->xidcap*2 : 1024;
+				lp->xids=realloc(lp->xids,
+						lp->xidcap*sizeof(u_int32_t));
+				if (lp->xids == NULL)
+					die("realloc");
+			}
+			lp->xids[lp->nxids++]=xid;
+		}
+		lp->midrecord=!LAST_FRAG(hdr);
+	}
+	memmove(lp->in, lp->in+off, lp->inlen-off);
+	lp->inlen-=off;
+}
+
+/* Appends an accepted reply with a body of bodylen zero bytes for
+ * every call seen, split into fragments of at most frag bytes.
+ */
+void loop_reply_all(struct loop *lp, int bodylen, int frag)
+{
+	u_int32_t hdr[6], mark;
+	int i, len, off, n;
+	char *p;
+
+	for (i=0; i<lp->nxids; i++) {
+		len=sizeof hdr+bodylen;
+		grow(&lp->out, &lp->outcap, lp->outlen+len+4*(len/frag+1));
+		memset(hdr, 0, sizeof hdr);
+		hdr[0]=lp->xids[i];
+		hdr[1]=htonl(REPLY);
+		/* MSG_ACCEPTED, AUTH_NULL verifier, SUCCESS are all 0 */
+		for (off=0; off < len; off+=n) {
+			n=(len-off > frag) ? frag : len-off;
+			mark=htonl(n | ((off+n == len) ? 0x80000000U : 0));
+			memcpy(lp->out+lp->outlen, &mark, 4);
+			lp->outlen+=4;
+			p=lp->out+lp->outlen;
+			if (off < sizeof hdr) {
+				if (n <= sizeof hdr-off) {
+					memcpy(p, (char *)hdr+off, n);
+				} else {
+					memcpy(p, (char *)hdr+off, sizeof hdr-off);
+					memset(p+sizeof hdr-off, 0,
+						n-(sizeof hdr-off));
+				}
+			} else
+				memset(p, 0, n);
+			lp->outlen+=n;
+		}
+	}
+	lp->nxids=0;
+}
+
+/* Writes the replies while the client reads them, until want
+ * callbacks have been made. Returns the time spent in the client.
+ * Once everything is written, the client may block for the rest.
+ */
+u_int64_t loop_deliver(struct loop *lp, int want)
+{
+	u_int64_t t, ns=0;
+	int n, flag;
+
+	while (replies < want) {
+		flag=RPC_BLOCKING_WAIT;
+		if (lp->outoff < lp->outlen) {
+			n=write(lp->fd, lp->out+lp->outoff,
+					lp->outlen-lp->outoff);
+			if (n < 0 && errno != EAGAIN)
+				die("write");
+			if (n > 0)
+				lp->outoff+=n;
+			if (lp->outoff < lp->outlen)
+				flag=RPC_NONBLOCK_WAIT;
+		}
+		t=bench_now();
+		if (clnttcp_nb_receive(lp->cl, flag) < 0)
+			die("clnttcp_nb_receive");
+		ns+=bench_now()-t;
+	}
+	lp->outlen=lp->outoff=0;
+	return ns;
+}
+
+/* clnttcp_nb_call() for NULL, GETATTR and WRITE calls */
+void bench_call(char *variant, int proc, int payload, int iterations)
+{
+	struct loop lp;
+	GETATTR3args gargs;
+	WRITE3args wargs;
+	char fh[32], *data;
+	xdrproc_t xproc;
+	caddr_t args;
+	u_int64_t t, ns=0;
+	int i, batch, done;
+
+	data=calloc(1, payload+1);
+	memset(fh, 0x5a, sizeof fh);
+	gargs.object.data.data_len=sizeof fh;
+	gargs.object.data.data_val=fh;
+	memset(&wargs, 0, sizeof wargs);
+	wargs.file=gargs.object;
+	wargs.count=payload;
+	wargs.stable=UNSTABLE;
+	wargs.data.data_len=payload;
+	wargs.data.data_val=data;
+	if (proc == NFS3_NULL) {
+		xproc=(xdrproc_t)xdr_void;
+		args=NULL;
+	} else if (proc == NFS3_GETATTR) {
+		xproc=(xdrproc_t)xdr_GETATTR3args;
+		args=(caddr_t)&gargs;
+	} else {
+		xproc=(xdrproc_t)xdr_WRITE3args;
+		args=(caddr_t)&wargs;
+	}
+
+	loop_create(&lp, NFSC_BUFSZ(payload), 0);
+	batch=(payload > 4096) ? 8 : 256;
+	replies=0;
+	for (done=0; done < iterations; done+=batch) {
+		t=bench_now();
+		for (i=0; i<batch; i++)
+			if (clnttcp_nb_call(lp.cl, proc, xproc, args, count_cb,
+						NULL) != RPC_SUCCESS)
+				die("clnttcp_nb_call");
+		ns+=bench_now()-t;
+		/* Answer them, to keep the xid table at its usual size */
+		while (lp.nxids < batch) {
+			clnttcp_nb_receive(lp.cl, RPC_NONBLOCK_WAIT
+					| RPC_NO_RX);
+			loop_drain(&lp);
+		}
+		loop_reply_all(&lp, 0, 1 << 30);
+		loop_deliver(&lp, done+batch);
+	}
+	bench_result("call", done, ns, "\"proc\": \"%s\", \"payload\": %d, "
+			"\"mb_per_s\": %.1f", variant, payload,
+			payload ? (double)payload*done/ns*1000 : 0.0);
+	loop_destroy(&lp);
+	free(data);
+}
+
+/* Receiving replies of bodylen bytes, in fragments of frag bytes,
+ * with reads of rbufsz bytes, outstanding calls at a time.
+ */
+u_int64_t run_receive(int bodylen, int frag, int rbufsz, int outstanding,
+		int iterations, int *ops)
+{
+	struct loop lp;
+	u_int64_t ns=0;
+	int i, done;
+
+	loop_create(&lp, 0, rbufsz);
+	replies=0;
+	for (done=0; done < iterations; done+=outstanding) {
+		for (i=0; i<outstanding; i++)
+			if (clnttcp_nb_call(lp.cl, NFS3_NULL,
+					(xdrproc_t)xdr_void, NULL, count_cb,
+					NULL) != RPC_SUCCESS)
+				die("clnttcp_nb_call");
+		while (lp.nxids < outstanding) {
+			clnttcp_nb_receive(lp.cl, RPC_NONBLOCK_WAIT
+					| RPC_NO_RX);
+			loop_drain(&lp);
+		}
+		loop_reply_all(&lp, bodylen, frag);
+		ns+=loop_deliver(&lp, done+outstanding);
+	}
+	loop_destroy(&lp);
+	*ops=done;
+	return ns;
+}
+
+void bench_receive(int iterations)
+{
+	int bodies[]={ 0, 4096, 65536 };
+	int frags[]={ 1 << 30, 8192, 1400 };
+	int rbufs[]={ 4096, 65536, 1024*1024 };
+	int b, f, r, ops, n;
+	u_int64_t ns;
+
+	for (b=0; b<3; b++)
+		for (f=0; f<3; f++)
+			for (r=0; r<3; r++) {
+				if (frags[f] < (1 << 30) && frags[f] >= bodies[b]+24)
+					continue;
+				n=iterations;
+				if (bodies[b] >= 65536)
+					n/=16;
+				ns=run_receive(bodies[b], frags[f], rbufs[r], 64,
+						n, &ops);
+				bench_result("receive", ops, ns,
+					"\"body\": %d, \"frag\": %d, "
+					"\"rbufsz\": %d, \"mb_per_s\": %.1f",
+					bodies[b], (frags[f] < (1 << 30))
+						? frags[f] : 0, rbufs[r],
+					(double)(bodies[b]+28)*ops/ns*1000);
+			}
+}
+
+void bench_dispatch(int iterations)
+{
+	int windows[]={ 1, 64, 4096 };
+	int w, ops;
+	u_int64_t ns;
+
+	for (w=0; w<3; w++) {
+		ns=run_receive(0, 1 << 30, 65536, windows[w],
+				windows[w] == 1 ? iterations/4 : iterations,
+				&ops);
+		bench_result("dispatch", ops, ns, "\"outstanding\": %d",
+				windows[w]);
+	}
+}
+
+/* The xid table, keyed like in clnttcp_nb_call(). With flat unset it
+ * is the chained table the client used before, with its 100000 buckets.
+ */
+void bench_xid(int flat, int entries, int rounds)
+{
+	ght_hash_table_t *t;
+	u_int32_t xid0=0x12345678, xid;
+	u_int64_t t0, tins, tget, trem;
+	char *table=flat ? "flat" : "chained";
+	int i, r, dummy;
+
+	if (flat)
+		t=ght_create_flat(BUCKET_XID, sizeof(u_int32_t), FALSE);
+	else
+		t=ght_create(100000);
+	if (t == NULL)
+		die("ght_create");
+
+	t0=bench_now();
+	for (i=0; i<entries; i++) {
+		xid=xid0-i;
+		ght_insert(t, &dummy, sizeof(u_int32_t), &xid);
+	}
+	tins=bench_now()-t0;
+
+	t0=bench_now();
+	for (r=0; r<rounds; r++)
+		for (i=0; i<entries; i++) {
+			xid=xid0-i;
+			if (ght_get(t, sizeof(u_int32_t), &xid) == NULL)
+				die("ght_get");
+		}
+	tget=bench_now()-t0;
+
+	t0=bench_now();
+	for (i=0; i<entries; i++) {
+		xid=xid0-i;
+		ght_remove(t, sizeof(u_int32_t), &xid);
+	}
+	trem=bench_now()-t0;
+	ght_finalize(t);
+
+	bench_result("xid_insert", entries, tins,
+			"\"table\": \"%s\", \"entries\": %d", table, entries);
+	bench_result("xid_get", (long long)entries*rounds, tget,
+			"\"table\": \"%s\", \"entries\": %d", table, entries);
+	bench_result("xid_remove", entries, trem,
+			"\"table\": \"%s\", \"entries\": %d", table, entries);
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-s scale]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	int n, flat;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		if (argv[1][1] == 's')
+			bench_scale=atoi(argv[2]);
+		else
+			return usage();
+		argc-=2;
+		argv+=2;
+	}
+	if (argc != 1 || bench_scale < 1)
+		return usage();
+	signal(SIGPIPE, SIG_IGN);
+
+	n=20000*bench_scale;
+	bench_begin("rpc");
+	bench_call("null", NFS3_NULL, 0, n);
+	bench_call("getattr", NFS3_GETATTR, 0, n);
+	bench_call("write", NFS3_WRITE, 4096, n/4);
+	bench_call("write", NFS3_WRITE, 65536, n/16);
+	bench_receive(n);
+	bench_dispatch(n);
+	for (flat=0; flat<2; flat++) {
+		bench_xid(flat, 64, 1000*bench_scale);
+		bench_xid(flat, 4096, 16*bench_scale);
+		bench_xid(flat, 65536, bench_scale);
+	}
+	bench_end();
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ *    Microbenchmarks of the NFSv3 and MOUNT encoders and decoders.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * For every type a set of random valid messages is made and checked
+ * with xdrgen_check() first, a type that does not round trip is
+ * reported and not timed. Then encoding with the rpcgen routine and
+ * decoding plus freeing with the library decoder are timed, the latter
+ * as the reference decoder too where there is no library one. Besides
+ * ns/op, the calls to malloc and friends per operation are counted,
+ * by replacing them with wrappers around glibc's own. Elsewhere, and
+ * under sanitizers that replace them themselves, allocs_per_op is -1.
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <nfs3.h>
+#include "bench.h"
+#include "xdrgen.h"
+
+#define NSAMPLES	64
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define NO_ALLOC_COUNT
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define NO_ALLOC_COUNT
+#endif
+#endif
+#ifndef __GLIBC__
+#define NO_ALLOC_COUNT
+#endif
+
+long allocs;
+
+#ifndef NO_ALLOC_COUNT
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+char *progname;
+
+static char samples[NSAMPLES][XDRGEN_MAXMSG];
+static int lengths[NSAMPLES];
+static void *objs[NSAMPLES];
+
+void *decode(struct xdrtype *t, char *msg, int len)
+{
+	if (t->decode != NULL)
+		return (*t->decode)(msg, len);
+	return xdrgen_decode(t, msg, len);
+}
+
+void release(struct xdrtype *t, void *obj)
+{
+	if (t->decode != NULL)
+		(*t->release)(obj);
+	else
+		xdrgen_release(t, obj);
+}
+
+double per_op(long count, long ops)
+{
+#ifdef NO_ALLOC_COUNT
+	return -1;
+#else
+	return (double)count/ops;
+#endif
+}
+
+void run(struct xdrtype *t, unsigned short rs[3], int rounds)
+{
+	static char buf[XDRGEN_MAXMSG];
+	void *obj;
+	u_int64_t t0, ns;
+	long a0, ops, bytes=0;
+	int i, r;
+
+	for (i=0; i<NSAMPLES; i++) {
+		lengths[i]=xdrgen_valid(t, rs, samples[i]);
+		bytes+=lengths[i];
+		if (xdrgen_check(t, samples[i], lengths[i], 1) < 0) {
+			bench_result("check", i, 0, "\"type\": \"%s\", "
+					"\"errors\": 1", t->name);
+			return;
+		}
+	}
+	ops=(long)rounds*NSAMPLES;
+
+	for (i=0; i<NSAMPLES; i++)
+		objs[i]=xdrgen_decode(t, samples[i], lengths[i]);
+	a0=allocs;
+	t0=bench_now();
+	for (r=0; r<rounds; r++)
+		for (i=0; i<NSAMPLES; i++)
+			xdrgen_encode(t, objs[i], buf, sizeof buf);
+	ns=bench_now()-t0;
+	bench_result("encode", ops, ns, "\"type\": \"%s\", \"bytes\": %ld, "
+			"\"allocs_per_op\": %.2f", t->name, bytes/NSAMPLES,
+			per_op(allocs-a0, ops));
+	for (i=0; i<NSAMPLES; i++)
+		xdrgen_release(t, objs[i]);
+
+	a0=allocs;
+	t0=bench_now();
+	for (r=0; r<rounds; r++)
+		for (i=0; i<NSAMPLES; i++)
+			/* NULL is an empty list here */
+			if ((obj=decode(t, samples[i], lengths[i])) != NULL)
+				release(t, obj);
+	ns=bench_now()-t0;
+	bench_result("decode", ops, ns, "\"type\": \"%s\", \"bytes\": %ld, "
+			"\"allocs_per_op\": %.2f, \"reference\": %s",
+			t->name, bytes/NSAMPLES, per_op(allocs-a0, ops),
+			t->decode ? "false" : "true");
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-s scale] [-t type]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	struct xdrtype *t=NULL;
+	unsigned short rs[3]={ 0x330e, 1, 0 };
+	int i;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		switch (argv[1][1]) {
+		case 's': bench_scale=atoi(argv[2]); break;
+		case 't':
+			if ((t=xdrgen_lookup(argv[2])) == NULL) {
+				fprintf(stderr, "%s: unknown type %s\n",
+						progname, argv[2]);
+				return 3;
+			}
+			break;
+		default: return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc != 1 || bench_scale < 1)
+		return usage();
+
+	bench_begin("xdr");
+	for (i=0; i<nxdrtypes; i++)
+		if (t == NULL || t == &xdrtypes[i])
+			run(&xdrtypes[i], rs, 500*bench_scale);
+	bench_end();
+	return 0;
+}
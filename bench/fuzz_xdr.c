@@ -0,0 +1,209 @@
+/*
+ *    Fuzz driver for the NFSv3 and MOUNT decoders.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * An input is one byte selecting the type followed by the message.
+ * Built with -DFUZZ_LIBFUZZER this is just the libFuzzer entry point,
+ * see the fuzz_xdr_libfuzzer target in the Makefile. Otherwise main()
+ * either replays the inputs named on the command line, or generates
+ * valid messages, checks that they round trip exactly and then feeds
+ * damaged copies of them to the decoders. Build it with
+ * -fsanitize=address to catch what does not crash outright; leaks
+ * count as failures, a monitor running for months must not have any.
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <nfs3.h>
+#include "xdrgen.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct xdrtype *t;
+	char *msg;
+
+	if (size < 1 || size > XDRGEN_MAXMSG+1)
+		return 0;
+	t=&xdrtypes[data[0]%nxdrtypes];
+	/* A copy of exactly the right size, so that reading past the end
+	 * is caught.
+	 */
+	msg=malloc(size-1 ? size-1 : 1);
+	memcpy(msg, data+1, size-1);
+	if (xdrgen_check(t, msg, size-1, 0) < 0)
+		abort();
+	free(msg);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+char *progname;
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-n iterations] [-R seed] [-t type] "
+			"[-c corpusdir]\n"
+			"       %s file...\n", progname, progname);
+	return 3;
+}
+
+int replay(char *path)
+{
+	static uint8_t buf[XDRGEN_MAXMSG+1];
+	int fd, len;
+
+	if ((fd=open(path, O_RDONLY)) < 0) {
+		perror(path);
+		return 1;
+	}
+	len=read(fd, buf, sizeof buf);
+	close(fd);
+	if (len < 0) {
+		perror(path);
+		return 1;
+	}
+	LLVMFuzzerTestOneInput(buf, len);
+	return 0;
+}
+
+/* Keeps a message that failed the check, for replaying it */
+int save_failure(struct xdrtype *t, char *msg, int len)
+{
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof path, "failed-%s", t->name);
+	if ((f=fopen(path, "w")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	putc(t-xdrtypes, f);
+	fwrite(msg, 1, len, f);
+	fclose(f);
+	fprintf(stderr, "%s: input written to %s\n", progname, path);
+	return 1;
+}
+
+/* Writes valid messages of every type, a starting point for libFuzzer */
+int write_corpus(char *dir, int n, unsigned short rs[3])
+{
+	static char buf[XDRGEN_MAXMSG+1];
+	char path[1024];
+	int i, j, fd, len;
+
+	for (i=0; i<nxdrtypes; i++) {
+		for (j=0; j<n; j++) {
+			buf[0]=i;
+			len=xdrgen_valid(&xdrtypes[i], rs, buf+1);
+			snprintf(path, sizeof path, "%s/%s-%d", dir,
+					xdrtypes[i].name, j);
+			if ((fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0
+					|| write(fd, buf, len+1) != len+1) {
+				perror(path);
+				return 1;
+			}
+			close(fd);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static char valid[XDRGEN_MAXMSG], msg[XDRGEN_MAXMSG];
+	struct xdrtype *t=NULL;
+	unsigned short rs[3];
+	char *corpus=NULL;
+	long iterations=10000, i;
+	long decoded=0, rejected=0;
+	int seed=time(NULL), len, mlen, m, ret;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		switch (argv[1][1]) {
+		case 'n': iterations=atol(argv[2]); break;
+		case 'R': seed=atoi(argv[2]); break;
+		case 'c': corpus=argv[2]; break;
+		case 't':
+			if ((t=xdrgen_lookup(argv[2])) == NULL) {
+				fprintf(stderr, "%s: unknown type %s\n",
+						progname, argv[2]);
+				return 3;
+			}
+			break;
+		default: return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc > 1 && argv[1][0] == '-')
+		return usage();
+
+	if (argc > 1) {
+		for (ret=0; argc > 1; argc--, argv++)
+			ret|=replay(argv[1]);
+		return ret;
+	}
+
+	rs[0]=0x330e;
+	rs[1]=seed;
+	rs[2]=seed>>16;
+	if (corpus != NULL)
+		return write_corpus(corpus, 8, rs);
+
+	fprintf(stderr, "%s: seed %d\n", progname, seed);
+	for (i=0; i<iterations; i++) {
+		struct xdrtype *tt=t ? t : &xdrtypes[i%nxdrtypes];
+
+		len=xdrgen_valid(tt, rs, valid);
+		if (xdrgen_check(tt, valid, len, 1) < 0)
+			return save_failure(tt, valid, len);
+		for (m=0; m<8; m++) {
+			memcpy(msg, valid, len);
+			mlen=xdrgen_mutate(rs, msg, len);
+			if (m & 1)
+				mlen=xdrgen_mutate(rs, msg, mlen);
+			ret=xdrgen_check(tt, msg, mlen, 0);
+			if (ret < 0)
+				return save_failure(tt, msg, mlen);
+			if (ret)
+				decoded++;
+			else
+				rejected++;
+		}
+	}
+	fprintf(stderr, "%s: %ld messages, %ld damaged copies decoded, "
+			"%ld rejected\n", progname, iterations, decoded,
+			rejected);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ *    Random encodings of the NFSv3 and MOUNT types.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Valid encodings are made by letting the reference decoder loose on a
+ * buffer of random words, most of them 0 or 1 or small, and encoding
+ * whatever it managed to decode. That way every union arm, optional and
+ * list length of every type turns up without a generator per type, and
+ * the result is canonical even where the words were not (strings with
+ * NULs in them, booleans other than 0 and 1).
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <nfs3.h>
+#include "xdrgen.h"
+
+/* Random words offered to the reference decoder */
+#define GEN_WORDS	4096
+#define GEN_ATTEMPTS	10000
+
+static void *decode_READ3res(char *msg, int len)
+{
+	return xdr_to_READ3res(msg, len, NFS3_DATA_DEXDR);
+}
+
+static void release_READ3res(void *obj)
+{
+	free_READ3res(obj, NFS3_DATA_DEXDR);
+}
+
+static void *decode_WRITE3args(char *msg, int len)
+{
+	return xdr_to_WRITE3args(msg, len, NFS3_DATA_DEXDR);
+}
+
+static void release_WRITE3args(void *obj)
+{
+	free_WRITE3args(obj, NFS3_DATA_DEXDR);
+}
+
+/* The list decoders return the head, xdr_mountlist and xdr_exports
+ * want a pointer to it.
+ */
+static void *decode_mountlist(char *msg, int len)
+{
+	mountlist *lp;
+	mountlist ml;
+
+	if ((ml=xdr_to_mountlist(msg, len)) == NULL)
+		return NULL;
+	lp=malloc(sizeof *lp);
+	*lp=ml;
+	return lp;
+}
+
+static void release_mountlist(void *obj)
+{
+	free_mountlist(*(mountlist *)obj);
+	free(obj);
+}
+
+static void *decode_exports(char *msg, int len)
+{
+	exports *ep;
+	exports ex;
+
+	if ((ex=xdr_to_exports(msg, len)) == NULL)
+		return NULL;
+	ep=malloc(sizeof *ep);
+	*ep=ex;
+	return ep;
+}
+
+static void release_exports(void *obj)
+{
+	free_exports(*(exports *)obj);
+	free(obj);
+}
+
+#define NFS3(type) { #type, (xdrproc_t)xdr_##type, sizeof(type), \
+	(xdrgen_decode_t)xdr_to_##type, (xdrgen_free_t)free_##type, 0 }
+#define WRAPPED(type, list) { #type, (xdrproc_t)xdr_##type, sizeof(type), \
+	decode_##type, release_##type, list }
+#define REFONLY(type) { #type, (xdrproc_t)xdr_##type, sizeof(type), \
+	NULL, NULL, 0 }
+
+struct xdrtype xdrtypes[] = {
+	NFS3(GETATTR3args),	NFS3(GETATTR3res),
+	NFS3(SETATTR3args),	NFS3(SETATTR3res),
+	NFS3(LOOKUP3args),	NFS3(LOOKUP3res),
+	NFS3(ACCESS3args),	NFS3(ACCESS3res),
+	NFS3(READLINK3args),	NFS3(READLINK3res),
+	NFS3(READ3args),	WRAPPED(READ3res, 0),
+	WRAPPED(WRITE3args, 0),	NFS3(WRITE3res),
+	NFS3(CREATE3args),	NFS3(CREATE3res),
+	NFS3(MKDIR3args),	NFS3(MKDIR3res),
+	NFS3(SYMLINK3args),	NFS3(SYMLINK3res),
+	NFS3(MKNOD3args),	NFS3(MKNOD3res),
+	NFS3(REMOVE3args),	NFS3(REMOVE3res),
+	NFS3(RMDIR3args),	NFS3(RMDIR3res),
+	NFS3(RENAME3args),	NFS3(RENAME3res),
+	NFS3(LINK3args),	NFS3(LINK3res),
+	NFS3(READDIR3args),	NFS3(READDIR3res),
+	NFS3(READDIRPLUS3args),	NFS3(READDIRPLUS3res),
+	NFS3(FSSTAT3args),	NFS3(FSSTAT3res),
+	NFS3(FSINFOargs),	NFS3(FSINFO3res),
+	NFS3(PATHCONF3args),	NFS3(PATHCONF3res),
+	NFS3(COMMIT3args),	NFS3(COMMIT3res),
+	REFONLY(dirpath),
+	{ "mountres3", (xdrproc_t)xdr_mountres3, sizeof(mountres3),
+		(xdrgen_decode_t)xdr_to_mntres3, (xdrgen_free_t)free_mntres3, 0 },
+	WRAPPED(mountlist, 1),
+	WRAPPED(exports, 1),
+};
+
+int nxdrtypes=sizeof xdrtypes/sizeof xdrtypes[0];
+
+struct xdrtype *xdrgen_lookup(char *name)
+{
+	int i;
+
+	for (i=0; i<nxdrtypes; i++)
+		if (strcmp(xdrtypes[i].name, name) == 0)
+			return &xdrtypes[i];
+	return NULL;
+}
+
+void xdrgen_release(struct xdrtype *t, void *obj)
+{
+	XDR xdr;
+
+	/* Not xdr_free(), it leaves x_public uninitialized and the data
+	 * of READ and WRITE would then be skipped.
+	 */
+	memset(&xdr, 0, sizeof xdr);
+	xdr.x_op=XDR_FREE;
+	xdr.x_public=NULL;
+	(*t->proc)(&xdr, obj);
+	free(obj);
+}
+
+void *xdrgen_decode(struct xdrtype *t, char *msg, int len)
+{
+	XDR xdr;
+	void *obj;
+
+	obj=calloc(1, t->size);
+	xdrmem_create(&xdr, msg, len, XDR_DECODE);
+	xdr.x_public=NULL;
+	if (!(*t->proc)(&xdr, obj)) {
+		/* Whatever was allocated before the failure is linked in,
+		 * the rest is still zero.
+		 */
+		xdrgen_release(t, obj);
+		return NULL;
+	}
+	return obj;
+}
+
+int xdrgen_encode(struct xdrtype *t, void *obj, char *buf, int size)
+{
+	XDR xdr;
+	int len;
+
+	xdrmem_create(&xdr, buf, size, XDR_ENCODE);
+	xdr.x_public=NULL;
+	if (!(*t->proc)(&xdr, obj))
+		return -1;
+	len=xdr_getpos(&xdr);
+	xdr_destroy(&xdr);
+	return len;
+}
+
+static u_int32_t random_word(unsigned short rs[3])
+{
+	int r=nrand48(rs)%100;
+
+	if (r < 35)
+		return 0;
+	if (r < 60)
+		return 1;
+	if (r < 85)
+		return 2+nrand48(rs)%30;
+	if (r < 95)
+		return nrand48(rs)&0xffff;
+	return (u_int32_t)nrand48(rs)<<1 ^ nrand48(rs);
+}
+
+int xdrgen_valid(struct xdrtype *t, unsigned short rs[3], char *buf)
+{
+	static u_int32_t words[GEN_WORDS];
+	void *obj;
+	int i, n, len;
+
+	for (n=0; n<GEN_ATTEMPTS; n++) {
+		for (i=0; i<GEN_WORDS; i++)
+			words[i]=htonl(random_word(rs));
+		obj=xdrgen_decode(t, (char *)words, sizeof words);
+		if (obj == NULL)
+			continue;
+		len=xdrgen_encode(t, obj, buf, XDRGEN_MAXMSG);
+		xdrgen_release(t, obj);
+		if (len >= 0)
+			return len;
+	}
+	fprintf(stderr, "xdrgen: cannot generate %s\n", t->name);
+	exit(1);
+}
+
+/* Values that tend to sit on a boundary when read as a length, a
+ * discriminant or a boolean.
+ */
+static u_int32_t interesting[]={ 0, 1, 2, 3, 4, 7, 8, 64, 65, 255, 256,
+	1024, 1025, 4096, 4097, 65535, 65536, 0x7fffffff, 0x80000000,
+	0xfffffffc, 0xffffffff };
+
+int xdrgen_mutate(unsigned short rs[3], char *buf, int len)
+{
+	u_int32_t word;
+	int pos, n;
+
+	switch (nrand48(rs)%6) {
+	case 0:		/* truncate */
+		return len ? nrand48(rs)%len : 0;
+	case 1:		/* flip a bit */
+		if (len)
+			buf[nrand48(rs)%len]^=1<<nrand48(rs)%8;
+		return len;
+	case 2:		/* replace a word */
+		if (len < 4)
+			return len;
+		word=htonl(interesting[nrand48(rs)%(sizeof interesting
+				/sizeof interesting[0])]);
+		memcpy(buf+(nrand48(rs)%(len/4))*4, &word, 4);
+		return len;
+	case 3:		/* append garbage */
+		n=nrand48(rs)%64;
+		if (len+n > XDRGEN_MAXMSG)
+			return len;
+		while (n-- > 0)
+			buf[len++]=nrand48(rs);
+		return len;
+	case 4:		/* drop a word */
+		if (len < 4)
+			return len;
+		pos=(nrand48(rs)%(len/4))*4;
+		memmove(buf+pos, buf+pos+4, len-pos-4);
+		return len-4;
+	default:	/* duplicate a word */
+		if (len < 4 || len+4 > XDRGEN_MAXMSG)
+			return len;
+		pos=(nrand48(rs)%(len/4))*4;
+		memmove(buf+pos+4, buf+pos, len-pos);
+		return len+4;
+	}
+}
+
+int xdrgen_check(struct xdrtype *t, char *msg, int len, int exact)
+{
+	static char enc1[XDRGEN_MAXMSG], enc2[XDRGEN_MAXMSG];
+	void *ref, *lib, *again;
+	int len1, len2, ret;
+
+	ref=xdrgen_decode(t, msg, len);
+	lib=t->decode ? (*t->decode)(msg, len) : NULL;
+
+	if (ref == NULL) {
+		if (lib != NULL) {
+			fprintf(stderr, "%s: decoded what the reference "
+					"rejects\n", t->name);
+			(*t->release)(lib);
+			return -1;
+		}
+		if (exact) {
+			fprintf(stderr, "%s: valid message rejected\n",
+					t->name);
+			return -1;
+		}
+		return 0;
+	}
+
+	ret=1;
+	len1=xdrgen_encode(t, ref, enc1, sizeof enc1);
+	if (len1 < 0) {
+		fprintf(stderr, "%s: cannot encode what was decoded\n",
+				t->name);
+		ret=-1;
+	} else if (exact && (len1 != len || memcmp(enc1, msg, len) != 0)) {
+		fprintf(stderr, "%s: round trip changed the message\n",
+				t->name);
+		ret=-1;
+	}
+
+	if (t->decode != NULL && lib == NULL) {
+		/* An empty list and a failure look the same */
+		if (!t->listtype || *(void **)ref != NULL) {
+			fprintf(stderr, "%s: rejected what the reference "
+					"decodes\n", t->name);
+			ret=-1;
+		}
+	} else if (lib != NULL && ret > 0) {
+		len2=xdrgen_encode(t, lib, enc2, sizeof enc2);
+		if (len2 != len1 || memcmp(enc1, enc2, len1) != 0) {
+			fprintf(stderr, "%s: decoders disagree\n", t->name);
+			ret=-1;
+		}
+	}
+
+	/* What was decoded once has to survive another round */
+	if (ret > 0 && !exact) {
+		if ((again=xdrgen_decode(t, enc1, len1)) == NULL) {
+			fprintf(stderr, "%s: re-encoding does not decode\n",
+					t->name);
+			ret=-1;
+		} else {
+			len2=xdrgen_encode(t, again, enc2, sizeof enc2);
+			if (len2 != len1 || memcmp(enc1, enc2, len1) != 0) {
+				fprintf(stderr, "%s: re-encoding is not "
+						"stable\n", t->name);
+				ret=-1;
+			}
+			xdrgen_release(t, again);
+		}
+	}
+
+	xdrgen_release(t, ref);
+	if (lib != NULL)
+		(*t->release)(lib);
+	return ret;
+}
@@ -0,0 +1,74 @@
+/*
+ *    Random encodings of the NFSv3 and MOUNT types.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Every type has its rpcgen routine from nfs3_xdr.c, which is the
+ * reference, and usually a decoder from nfs3.c or mount3.c with its free
+ * function. xdrgen_check() decodes a message with both and insists that
+ * they agree, and that what they decoded encodes to the same bytes. A
+ * new decoder is validated by putting it into the table.
+ */
+
+#ifndef _XDRGEN_H_
+#define _XDRGEN_H_
+
+#include <rpc/rpc.h>
+
+typedef void *(*xdrgen_decode_t)(char *msg, int len);
+typedef void (*xdrgen_free_t)(void *obj);
+
+struct xdrtype {
+	char *name;
+	xdrproc_t proc;
+	size_t size;
+	xdrgen_decode_t decode;		/* NULL: only the reference */
+	xdrgen_free_t release;
+	int listtype;			/* decode returns the list head,
+					 * NULL for an empty list */
+};
+
+extern struct xdrtype xdrtypes[];
+extern int nxdrtypes;
+
+/* Largest encoding xdrgen_valid() produces */
+#define XDRGEN_MAXMSG	65536
+
+extern struct xdrtype *xdrgen_lookup(char *name);
+
+/* Reference decode and free. xdrgen_decode returns NULL on failure. */
+extern void *xdrgen_decode(struct xdrtype *t, char *msg, int len);
+extern void xdrgen_release(struct xdrtype *t, void *obj);
+
+/* Encodes obj into buf, returns the length or -1 */
+extern int xdrgen_encode(struct xdrtype *t, void *obj, char *buf, int size);
+
+/* Fills buf with a valid encoding of a random t, returns its length */
+extern int xdrgen_valid(struct xdrtype *t, unsigned short rs[3], char *buf);
+
+/* Damages the len bytes in buf, returns the new length. buf must have
+ * room for XDRGEN_MAXMSG bytes.
+ */
+extern int xdrgen_mutate(unsigned short rs[3], char *buf, int len);
+
+/* Returns 1 if the message decoded, 0 if both decoders rejected it and
+ * -1 if something is wrong, with the reason on stderr. With exact set,
+ * the message has to decode and encode back to the same bytes.
+ */
+extern int xdrgen_check(struct xdrtype *t, char *msg, int len, int exact);
+
+#endif
@@ -33,6 +33,9 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#include <ctype.h>
+#include <fnmatch.h>
+
 #include <nfsclient.h>
 #include <sys/types.h>
 
@@ -43,8 +46,21 @@ char *errmsg=NULL;
 char *progname;
 
 long long tbytes, fbytes, abytes;
+long long tfiles, ffiles, afiles;
 long long argtonum(char *str, long long ref);
 
+char *unitstr="", *perfunitstr="";
+unsigned long long divisor=1;
+unsigned long long perfdivisor=1;
+
+/* Average round trip time in seconds, 0 if there was none */
+double avg_time(struct clnt_proc_stats *ps)
+{
+	if (ps==NULL || ps->ps_calls==0)
+		return 0;
+	return ps->ps_sum_us/1000000.0/ps->ps_calls;
+}
+
 void nfs_fsstat_cb(void *msg, int len, void *priv_ctx)
 {
 	FSSTAT3res *res = NULL;
@@ -69,10 +85,46 @@ void nfs_fsstat_cb(void *msg, int len, void *priv_ctx)
 	tbytes= (long long) res->FSSTAT3res_u.resok.tbytes;
 	fbytes= (long long) res->FSSTAT3res_u.resok.fbytes;
 	abytes= (long long) res->FSSTAT3res_u.resok.abytes;
+	tfiles= (long long) res->FSSTAT3res_u.resok.tfiles;
+	ffiles= (long long) res->FSSTAT3res_u.resok.ffiles;
+	afiles= (long long) res->FSSTAT3res_u.resok.afiles;
 	free_FSSTAT3res(res);
 	return;
 }
 
+/* File slot (inode) thresholds, -W and -K, NULL if not given */
+char *fwarnstr=NULL, *fcritstr=NULL;
+
+/* State of the file slots: 0 unless their thresholds were given and
+ * the server reports any. Sets *w and *c to the thresholds, -1 where
+ * not given.
+ */
+int files_check(long long total, long long avail, long long *w, long long *c)
+{
+	*w=*c=-1;
+	if (total == 0)
+		return 0;
+	if (fwarnstr != NULL)
+		*w=argtonum(fwarnstr, total);
+	if (fcritstr != NULL)
+		*c=argtonum(fcritstr, total);
+	if (avail < *c)
+		return 2;
+	if (avail < *w)
+		return 1;
+	return 0;
+}
+
+/* A threshold for perfdata, empty if not given */
+char *perfnum(char *buf, long long n)
+{
+	if (n < 0)
+		*buf='\0';
+	else
+		sprintf(buf, "%lld", n);
+	return buf;
+}
+
 void nfs_mnt_cb(void *msg, int len, void *priv_ctx)
 {
 	mountres3 *mntres = NULL; 
@@ -109,6 +161,402 @@ void nfs_mnt_cb(void *msg, int len, void *priv_ctx)
 	return;
 }
 
+/* Latency mode (-l): a burst of NULL and GETATTR calls is sent
+ * without waiting for the replies, and the latency percentiles are
+ * taken from the client's call statistics.
+ */
+int latmode=0;
+int probes=20;
+double pct=99;
+int null_replies=0, getattr_replies=0;
+
+void nfs_null_cb(void *msg, int len, void *priv_ctx)
+{
+	null_replies++;
+}
+
+void nfs_getattr_cb(void *msg, int len, void *priv_ctx)
+{
+	GETATTR3res *res = NULL;
+
+	getattr_replies++;
+	res = xdr_to_GETATTR3res(msg, len);
+	if(res == NULL || res->status != NFS3_OK) {
+		exitcode=2;
+		errmsg="getattr failed";
+	}
+	free_GETATTR3res(res);
+}
+
+void mnt_null_cb(void *msg, int len, void *priv_ctx)
+{
+}
+
+double ms(u_int32_t us)
+{
+	return us/1000.0;
+}
+
+int latency_check(nfs_ctx *ctx, double warn, double crit)
+{
+	GETATTR3args args;
+	struct clnt_proc_stats *nullps, *getattrps, *mntps;
+	double nullp, getattrp, worst;
+	int i, code;
+	char *state;
+
+	/* mountd is only asked a few times, one after the other */
+	for(i=0; i<3; i++)
+		if(mount3_null(ctx, mnt_null_cb, NULL) != RPC_SUCCESS) {
+			printf("%s CRITICAL: Could not send MOUNT NULL call\n",
+					progname);
+			return 2;
+		}
+
+	args.object.data.data_len = mntfh.fhandle3_len;
+	args.object.data.data_val = mntfh.fhandle3_val;
+	for(i=0; i<probes; i++) {
+		if(nfs3_null(ctx, nfs_null_cb, NULL) != RPC_SUCCESS
+				|| nfs3_getattr(&args, ctx, nfs_getattr_cb, NULL)
+				!= RPC_SUCCESS) {
+			printf("%s CRITICAL: Could not send NFS call\n", progname);
+			return 2;
+		}
+	}
+
+	while(null_replies+getattr_replies < 2*probes)
+		if(nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+
+	if(null_replies+getattr_replies < 2*probes) {
+		printf("%s CRITICAL: only %d of %d probes answered\n", progname,
+				null_replies+getattr_replies, 2*probes);
+		return 2;
+	}
+	if(exitcode) {
+		printf("%s CRITICAL: %s\n", progname, errmsg);
+		return 2;
+	}
+
+	nullps=nfs_proc_stats(ctx, NFS_PROGRAM, NFS3_NULL);
+	getattrps=nfs_proc_stats(ctx, NFS_PROGRAM, NFS3_GETATTR);
+	mntps=nfs_proc_stats(ctx, MOUNT_PROGRAM, MOUNT3_NULL);
+	if(nullps==NULL || getattrps==NULL || mntps==NULL) {
+		printf("%s UNKNOWN: no call statistics\n", progname);
+		return 3;
+	}
+
+	nullp=ms(clnt_stats_percentile(nullps, pct));
+	getattrp=ms(clnt_stats_percentile(getattrps, pct));
+	worst=(nullp>getattrp) ? nullp : getattrp;
+
+	code=0;
+	if(worst>=warn)
+		code=1;
+	if(worst>=crit)
+		code=2;
+	state=(code==2) ? "CRITICAL" : (code==1) ? "WARNING" : "OK";
+
+	printf("%s %s: p%g latency GETATTR %.3fms, NULL %.3fms, "
+		"MOUNT NULL %.3fms avg over %d probes"
+		"|getattr_min=%.3fms getattr_avg=%.3fms getattr_p95=%.3fms "
+		"getattr_p99=%.3fms getattr=%.3fms;%g;%g;0 "
+		"null_min=%.3fms null_avg=%.3fms null_p95=%.3fms "
+		"null_p99=%.3fms null=%.3fms;%g;%g;0 "
+		"mnt_null=%.3fms\n",
+		progname, state, pct, getattrp, nullp,
+		mntps->ps_sum_us/1000.0/mntps->ps_calls, probes,
+		ms(getattrps->ps_min_us),
+		getattrps->ps_sum_us/1000.0/getattrps->ps_calls,
+		ms(clnt_stats_percentile(getattrps, 95)),
+		ms(clnt_stats_percentile(getattrps, 99)),
+		getattrp, warn, crit,
+		ms(nullps->ps_min_us),
+		nullps->ps_sum_us/1000.0/nullps->ps_calls,
+		ms(clnt_stats_percentile(nullps, 95)),
+		ms(clnt_stats_percentile(nullps, 99)),
+		nullp, warn, crit,
+		mntps->ps_sum_us/1000.0/mntps->ps_calls);
+
+	return code;
+}
+
+/* Export mode (-e): the export list of the server is fetched, and
+ * every export on it the patterns let through is mounted and checked
+ * for free space, all at once. The worst one is reported.
+ */
+int expmode=0;
+char **includes=NULL, **excludes=NULL;
+int nincludes=0, nexcludes=0;
+
+struct export_check {
+	char *dir;
+	fhandle3 fh;
+	char *err;		/* Why it could not be checked, or NULL */
+	char errbuf[128];
+	long long tbytes, fbytes, abytes;
+	long long tfiles, afiles;
+	long long warn, crit, fwarn, fcrit;
+	int bcode, fcode, code;	/* Bytes, file slots, worse of both */
+};
+struct export_check *exps=NULL;
+int nexps=0;
+int exp_replies=0;
+
+void add_pattern(char ***list, int *n, char *pattern)
+{
+	*list=realloc(*list, (*n+1)*sizeof(char *));
+	if (*list == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		exit(3);
+	}
+	(*list)[(*n)++]=pattern;
+}
+
+/* Whether dir matches one of the -i patterns, if any, and none of
+ * the -x ones.
+ */
+int wanted(char *dir)
+{
+	int i, in=(nincludes == 0);
+
+	for (i=0; i<nincludes && !in; i++)
+		if (fnmatch(includes[i], dir, 0) == 0)
+			in=1;
+	for (i=0; i<nexcludes && in; i++)
+		if (fnmatch(excludes[i], dir, 0) == 0)
+			in=0;
+	return in;
+}
+
+void nfs_export_cb(void *msg, int len, void *priv_ctx)
+{
+	exports ex, en;
+
+	if (msg == NULL) {
+		exitcode=2;
+		errmsg="export list failed";
+		return;
+	}
+
+	/* An empty list decodes to NULL as well */
+	ex=xdr_to_exports(msg, len);
+	for (en=ex; en != NULL; en=en->ex_next) {
+		if (!wanted(en->ex_dir))
+			continue;
+		exps=realloc(exps, (nexps+1)*sizeof(struct export_check));
+		if (exps == NULL) {
+			printf("%s UNKNOWN: out of memory\n", progname);
+			exit(3);
+		}
+		memset(&exps[nexps], 0, sizeof(struct export_check));
+		exps[nexps].dir=strdup(en->ex_dir);
+		nexps++;
+	}
+	free_exports(ex);
+}
+
+void exp_mnt_cb(void *msg, int len, void *priv_ctx)
+{
+	struct export_check *e=(struct export_check *)priv_ctx;
+	mountres3 *mntres = NULL;
+	fhandle3 *fh;
+
+	exp_replies++;
+	mntres = xdr_to_mntres3(msg, len);
+	if (mntres == NULL) {
+		e->err="mount failed";
+		return;
+	}
+	if (mntres->fhs_status != MNT3_OK) {
+		snprintf(e->errbuf, sizeof e->errbuf, "Mount failed - error %d (%s)",
+			mntres->fhs_status, strerror(mntres->fhs_status));
+		e->err=e->errbuf;
+		free_mntres3(mntres);
+		return;
+	}
+
+	fh = &mntres->mountres3_u.mountinfo.fhandle;
+	e->fh.fhandle3_val = (char *)mem_alloc(fh->fhandle3_len);
+	if (e->fh.fhandle3_val == NULL) {
+		e->err="out of memory";
+		free_mntres3(mntres);
+		return;
+	}
+	memcpy(e->fh.fhandle3_val, fh->fhandle3_val, fh->fhandle3_len);
+	e->fh.fhandle3_len = fh->fhandle3_len;
+	free_mntres3(mntres);
+}
+
+void exp_fsstat_cb(void *msg, int len, void *priv_ctx)
+{
+	struct export_check *e=(struct export_check *)priv_ctx;
+	FSSTAT3res *res = NULL;
+
+	exp_replies++;
+	res = xdr_to_FSSTAT3res(msg, len);
+	if (res == NULL) {
+		e->err="fsstat failed";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		snprintf(e->errbuf, sizeof e->errbuf, "Fsstat failed - error %d (%s)",
+			res->status, nfsstat3_strerror(res->status));
+		e->err=e->errbuf;
+		free_FSSTAT3res(res);
+		return;
+	}
+
+	e->tbytes= (long long) res->FSSTAT3res_u.resok.tbytes;
+	e->fbytes= (long long) res->FSSTAT3res_u.resok.fbytes;
+	e->abytes= (long long) res->FSSTAT3res_u.resok.abytes;
+	e->tfiles= (long long) res->FSSTAT3res_u.resok.tfiles;
+	e->afiles= (long long) res->FSSTAT3res_u.resok.afiles;
+	free_FSSTAT3res(res);
+}
+
+/* Whether a is worse off than b: a worse state, or the same one and
+ * less space available.
+ */
+int worse(struct export_check *a, struct export_check *b)
+{
+	if (a->code != b->code)
+		return a->code > b->code;
+	if (a->err != NULL || b->err != NULL)
+		return b->err == NULL;
+	return (double)a->abytes/(a->tbytes ? a->tbytes : 1)
+		< (double)b->abytes/(b->tbytes ? b->tbytes : 1);
+}
+
+int export_check(nfs_ctx *ctx, char *warnstr, char *critstr)
+{
+	struct export_check *e, *worst;
+	FSSTAT3args *fs;
+	nfs_op *ops;
+	int i, n, code, warns=0, crits=0;
+	char *state, wbuf[32], cbuf[32];
+
+	if (mount3_export(ctx, nfs_export_cb, NULL) != RPC_SUCCESS || exitcode) {
+		printf("%s CRITICAL: %s\n", progname,
+				errmsg ? errmsg : "Could not send EXPORT call");
+		return 2;
+	}
+	if (nexps == 0) {
+		printf("%s UNKNOWN: no exports%s\n", progname,
+				nincludes+nexcludes ? " match" : "");
+		return 3;
+	}
+
+	/* All MNT calls go out together, then the replies are read */
+	clnttcp_nb_batch_begin(ctx->nfs_mnt_cl);
+	for (i=0; i<nexps; i++)
+		if (mount3_mnt(&exps[i].dir, ctx, exp_mnt_cb, &exps[i])
+				!= RPC_SUCCESS) {
+			exps[i].err="Could not send MNT call";
+			exp_replies++;
+		}
+	clnttcp_nb_batch_end(ctx->nfs_mnt_cl);
+	while (exp_replies < nexps)
+		if (clnttcp_nb_receive(ctx->nfs_mnt_cl, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	if (exp_replies < nexps) {
+		printf("%s CRITICAL: only %d of %d MNT calls answered\n",
+				progname, exp_replies, nexps);
+		return 2;
+	}
+
+	/* And the FSSTAT calls of the exports mounted, likewise */
+	ops=calloc(nexps, sizeof(nfs_op));
+	fs=calloc(nexps, sizeof(FSSTAT3args));
+	if (ops == NULL || fs == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		return 3;
+	}
+	n=0;
+	for (i=0; i<nexps; i++) {
+		if (exps[i].err != NULL)
+			continue;
+		fs[n].fsroot.data.data_len = exps[i].fh.fhandle3_len;
+		fs[n].fsroot.data.data_val = exps[i].fh.fhandle3_val;
+		ops[n].op_proc=NFS3_FSSTAT;
+		ops[n].op_args=&fs[n];
+		ops[n].op_cb=exp_fsstat_cb;
+		ops[n].op_priv=&exps[i];
+		n++;
+	}
+	exp_replies=0;
+	nfs_submit_batch(ctx, ops, n);
+	for (i=0; i<n; i++)
+		if (ops[i].op_stat != RPC_SUCCESS) {
+			((struct export_check *)ops[i].op_priv)->err=
+				"Could not send NFS FSSTAT call";
+			exp_replies++;
+		}
+	while (exp_replies < n)
+		if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	free(ops);
+	free(fs);
+	if (exp_replies < n) {
+		printf("%s CRITICAL: only %d of %d FSSTAT calls answered\n",
+				progname, exp_replies, n);
+		return 2;
+	}
+
+	worst=NULL;
+	for (i=0; i<nexps; i++) {
+		e=&exps[i];
+		if (e->err != NULL) {
+			e->code=2;
+		} else {
+			e->warn=argtonum(warnstr, e->tbytes);
+			e->crit=argtonum(critstr, e->tbytes);
+			e->bcode=(e->abytes<e->crit) ? 2 : (e->abytes<e->warn) ? 1 : 0;
+			e->fcode=files_check(e->tfiles, e->afiles, &e->fwarn,
+					&e->fcrit);
+			e->code=(e->fcode > e->bcode) ? e->fcode : e->bcode;
+		}
+		if (e->code==2)
+			crits++;
+		else if (e->code==1)
+			warns++;
+		if (worst==NULL || worse(e, worst))
+			worst=e;
+	}
+
+	code=worst->code;
+	state=(code==2) ? "CRITICAL" : (code==1) ? "WARNING" : "OK";
+	if (worst->err != NULL)
+		printf("%s %s: %s: %s", progname, state, worst->dir, worst->err);
+	else if (worst->fcode > worst->bcode)
+		printf("%s %s: %s only %lld of %lld file slots free (%lld%%)",
+			progname, state, worst->dir, worst->afiles, worst->tfiles,
+			(long long)100*worst->afiles/worst->tfiles);
+	else
+		printf("%s %s: %s%s %lld%s of %lld%s bytes free (%lld%%)",
+			progname, state, worst->dir, code ? " only" : " has",
+			(long long)worst->abytes/divisor, unitstr,
+			(long long)worst->tbytes/divisor, unitstr,
+			worst->tbytes ? (long long)100*worst->abytes/worst->tbytes : 0LL);
+	printf(", %d critical, %d warning of %d exports|", crits, warns, nexps);
+
+	for (i=0; i<nexps; i++) {
+		e=&exps[i];
+		if (e->err != NULL)
+			printf("'%s'=U '%s files'=U ", e->dir, e->dir);
+		else
+			printf("'%s'=%lld%s,%lld,%lld,%lld,%lld '%s files'=%lld,%s,%s,0,%lld ",
+				e->dir,
+				(long long)e->abytes/perfdivisor, perfunitstr, (long long)e->warn/perfdivisor, (long long)e->crit/perfdivisor, 0LL, (long long)e->tbytes/perfdivisor,
+				e->dir, e->afiles, perfnum(wbuf, e->fwarn),
+				perfnum(cbuf, e->fcrit), e->tfiles);
+	}
+	printf("mnt=%.6fs fsstat=%.6fs\n",
+		avg_time(nfs_proc_stats(ctx, MOUNT_PROGRAM, MOUNT3_MNT)),
+		avg_time(nfs_proc_stats(ctx, NFS_PROGRAM, NFS3_FSSTAT)));
+	return code;
+}
+
 void timeout(int signal) {
 	printf("%s CRITICAL: timeout\n", progname);
 	exit(2);
@@ -120,14 +568,14 @@ int main(int argc, char *argv[])
 	int err;
 	enum clnt_stat stat;
 	nfs_ctx *ctx = NULL;
-	long long warn, crit;
-	char *unitstr="", *perfunitstr="";
-	unsigned long long divisor=1;
-	unsigned long long perfdivisor=1;
+	long long warn, crit, fwarn, fcrit;
+	int code, fcode;
+	char *state, wbuf[32], cbuf[32];
 	int fullpath=0;
 	progname=argv[0];
 	char option;
 	int alarmtime=5;
+	double mnt_time, fsstat_time;
 
 	FSSTAT3args fs;
 
@@ -170,6 +618,38 @@ int main(int argc, char *argv[])
 			fullpath=1;
 			argc--;
 			argv++;
+		} else if (argv[1][1] == 'l') {
+			latmode=1;
+			argc--;
+			argv++;
+		} else if (argv[1][1] == 'W' && argc>2) {
+			fwarnstr=argv[2];
+			argc-=2;
+			argv+=2;
+		} else if (argv[1][1] == 'K' && argc>2) {
+			fcritstr=argv[2];
+			argc-=2;
+			argv+=2;
+		} else if (argv[1][1] == 'e') {
+			expmode=1;
+			argc--;
+			argv++;
+		} else if (argv[1][1] == 'i' && argc>2) {
+			add_pattern(&includes, &nincludes, argv[2]);
+			argc-=2;
+			argv+=2;
+		} else if (argv[1][1] == 'x' && argc>2) {
+			add_pattern(&excludes, &nexcludes, argv[2]);
+			argc-=2;
+			argv+=2;
+		} else if (argv[1][1] == 'n' && argc>2) {
+			probes=atoi(argv[2]);
+			argc-=2;
+			argv+=2;
+		} else if (argv[1][1] == 'q' && argc>2) {
+			pct=atof(argv[2]);
+			argc-=2;
+			argv+=2;
 		} else if (argv[1][1] == 'a') {
 			alarmtime=atoi(argv[2]);
 			argc-=2;
@@ -187,8 +667,10 @@ int main(int argc, char *argv[])
 	if(argc < 4) {
 		printf("%s UNKNOWN: Not enough arguments\n"
 			"Check free space on an NFS directory\n"
-			"USAGE: %s [-U perfunit] [-u unit] <server> <remote_mountpoint> <w> <c>\n",
-			progname, progname);
+			"USAGE: %s [-U perfunit] [-u unit] [-W files_w] [-K files_c] <server> <remote_mountpoint> <w> <c>\n"
+			"       %s -l [-n probes] [-q percentile] <server> <remote_mountpoint> <w_ms> <c_ms>\n"
+			"       %s -e [-i pattern] [-x pattern] [-W files_w] [-K files_c] <server> <w> <c>\n",
+			progname, progname, progname, progname);
 		return 3;
 	}
 
@@ -207,13 +689,21 @@ int main(int argc, char *argv[])
 		exit(2);
 	}
 	
-	ctx = nfs_init((struct sockaddr_in *)srv_addr->ai_addr, IPPROTO_TCP, 0);
+	/* The latency probes and the calls for all exports are sent
+	 * without waiting for replies
+	 */
+	ctx = nfs_init((struct sockaddr_in *)srv_addr->ai_addr, IPPROTO_TCP,
+			latmode || expmode ?
+			NFSC_CFL_NONBLOCKING | NFSC_CFL_DISABLE_NAGLE : 0);
 	if(ctx == NULL) {
 		printf("%s CRITICAL:  Cant init nfs context\n", progname);
 		exit(2);
 	}
 
 	freeaddrinfo(srv_addr);
+	if (expmode)
+		exit(export_check(ctx, argv[2], argv[3]));
+
 	mntfh.fhandle3_len = 0;
 	stat = mount3_mnt(&argv[2], ctx, nfs_mnt_cb, NULL);
 	if (stat == RPC_SUCCESS && exitcode==0)
@@ -223,6 +713,12 @@ int main(int argc, char *argv[])
 		exit(2);
 	}
 
+	if (latmode) {
+		if (probes<1)
+			probes=1;
+		exit(latency_check(ctx, atof(argv[3]), atof(argv[4])));
+	}
+
 	fs.fsroot.data.data_len = mntfh.fhandle3_len;
 	fs.fsroot.data.data_val = mntfh.fhandle3_val;
 	stat = nfs3_fsstat(&fs, ctx, nfs_fsstat_cb, NULL);
@@ -239,34 +735,35 @@ int main(int argc, char *argv[])
 		exit(2);
 	}
 
+	/* Report the round trips separately, a slow mountd and a slow
+	 * nfsd are different problems.
+	 */
+	mnt_time=avg_time(nfs_proc_stats(ctx, MOUNT_PROGRAM, MOUNT3_MNT));
+	fsstat_time=avg_time(nfs_proc_stats(ctx, NFS_PROGRAM, NFS3_FSSTAT));
+
 	warn=argtonum(argv[3], tbytes);
 	crit=argtonum(argv[4], tbytes);
+	code=(abytes<crit) ? 2 : (abytes<warn) ? 1 : 0;
 
-	if (abytes<crit) {
-		printf("%s CRITICAL: only %lld%s of %lld%s bytes free (%lld%%)"
-			"|free=%lld%s,%lld,%lld,%lld,%lld\n",
-			progname,
-			(long long)abytes/divisor, unitstr, (long long)tbytes/divisor, unitstr, (long long)100*abytes/tbytes,
-			(long long)abytes/perfdivisor, perfunitstr, (long long)warn/perfdivisor, (long long)crit/perfdivisor, 0LL, (long long)tbytes/perfdivisor
-			);
-		exit(2);
-	} else if (abytes<warn) {
-		printf("%s WARNING: only %lld%s of %lld%s bytes free (%lld%%)"
-			"|free=%lld%s,%lld,%lld,%lld,%lld\n",
-			progname,
-			(long long)abytes/divisor, unitstr, (long long)tbytes/divisor, unitstr, (long long)100*abytes/tbytes,
-			(long long)abytes/perfdivisor, perfunitstr, (long long)warn/perfdivisor, (long long)crit/perfdivisor, 0LL, (long long)tbytes/perfdivisor
-			);
-		exit(1);
-	} else {
-		printf("%s OK: %lld%s of %lld%s bytes free (%lld%%)"
-			"|free=%lld%s,%lld,%lld,%lld,%lld\n",
-			progname,
-			(long long)abytes/divisor, unitstr, (long long)tbytes/divisor, unitstr, (long long)100*abytes/tbytes,
-			(long long)abytes/perfdivisor, perfunitstr, (long long)warn/perfdivisor, (long long)crit/perfdivisor, 0LL, (long long)tbytes/perfdivisor
-			);
-		exit(0);
-	}
+	/* File slots run out on their own, with plenty of bytes free */
+	fcode=files_check(tfiles, afiles, &fwarn, &fcrit);
+	state=(code==2 || fcode==2) ? "CRITICAL"
+		: (code==1 || fcode==1) ? "WARNING" : "OK";
+
+	printf("%s %s: %s%lld%s of %lld%s bytes free (%lld%%)",
+		progname, state, code ? "only " : "",
+		(long long)abytes/divisor, unitstr, (long long)tbytes/divisor, unitstr, (long long)100*abytes/tbytes);
+	if ((fwarnstr != NULL || fcritstr != NULL) && tfiles > 0)
+		printf(", %s%lld of %lld file slots free (%lld%%)",
+			fcode ? "only " : "", afiles, tfiles,
+			(long long)100*afiles/tfiles);
+	printf("|free=%lld%s,%lld,%lld,%lld,%lld files=%lld,%s,%s,0,%lld "
+		"mnt=%.6fs fsstat=%.6fs\n",
+		(long long)abytes/perfdivisor, perfunitstr, (long long)warn/perfdivisor, (long long)crit/perfdivisor, 0LL, (long long)tbytes/perfdivisor,
+		afiles, perfnum(wbuf, fwarn), perfnum(cbuf, fcrit), tfiles,
+		mnt_time, fsstat_time
+		);
+	exit((code > fcode) ? code : fcode);
 }
 
 long long argtonum(char *str, long long ref) {
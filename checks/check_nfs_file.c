@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/time.h>
 #include <errno.h>
 
 #include <nfsclient.h>
@@ -68,44 +69,63 @@ void nfs_read_cb(void *msg, int len, void *priv_ctx)
 }
 
 
-void nfs_lookup_cb(void *msg, int len, void *priv_ctx)
+/* Per component timings, reported as perfdata */
+#define MAXSTEPS 64
+char *stepname[MAXSTEPS];
+double steptime[MAXSTEPS];
+int nsteps=0;
+double looktime=0;
+char *prefix=NULL;
+int resolved=0;
+
+void nfs_step_cb(char *name, int how, struct timeval *elapsed, void *priv)
 {
-	LOOKUP3res *lookupres = NULL;
-	int fh_length;
-	char *fh;
+	char *label;
+	int len;
+
+	looktime+=elapsed->tv_sec+elapsed->tv_usec/1000000.0;
+	if (nsteps>=MAXSTEPS)
+		return;
 
-	lookupres = xdr_to_LOOKUP3res(msg, len);
-	if (lookupres == NULL) {
+	/* Label each component with the path leading to it */
+	len=(prefix ? strlen(prefix)+1 : 0)+strlen(name)+1;
+	label=malloc(len);
+	if (label==NULL)
+		return;
+	if (prefix)
+		sprintf(label, "%s/%s", prefix, name);
+	else
+		strcpy(label, name);
+	prefix=label;
+
+	stepname[nsteps]=label;
+	steptime[nsteps]=elapsed->tv_sec+elapsed->tv_usec/1000000.0;
+	nsteps++;
+}
+
+void nfs_path_cb(int stat, nfs_fh3 *fh, void *priv)
+{
+	resolved=1;
+	if (stat == -1) {
 		retcode=2;
 		errmsg="Lookup failed - no file handle returned";
 		return;
 	}
-
-	if (lookupres->status != NFS3_OK) {
+	if (stat != NFS3_OK) {
 		retcode=2;
 		errmsg=strdup("Lookup failed - error XXXXXXX");
-		sprintf(errmsg+22, "%d", lookupres->status);
-		mem_free(lookupres, sizeof(LOOKUP3res));
+		sprintf(errmsg+22, "%d", stat);
 		return;
 	}
-	
-	fh_length = lookupres->LOOKUP3res_u.resok.object.data.data_len;
-	fh = lookupres->LOOKUP3res_u.resok.object.data.data_val;
 
-	lfh.fhandle3_len = fh_length;
-	lfh.fhandle3_val = (char *)mem_alloc(fh_length);
+	lfh.fhandle3_len = fh->data.data_len;
+	lfh.fhandle3_val = (char *)mem_alloc(fh->data.data_len);
 	if (lfh.fhandle3_val == NULL) {
 		retcode=2;
 		errmsg="Lookup failed - NULL file handle returned";
-		mem_free(lookupres->LOOKUP3res_u.resok.object.data.data_val, fh_length);
-		mem_free(lookupres, sizeof(LOOKUP3res));
 		return;
 	}
-
-	memcpy(lfh.fhandle3_val, fh, fh_length);
-
-	mem_free(lookupres->LOOKUP3res_u.resok.object.data.data_val, fh_length);
-	mem_free(lookupres, sizeof(LOOKUP3res));
+	memcpy(lfh.fhandle3_val, fh->data.data_val, fh->data.data_len);
 }
 
 void nfs_mnt_cb(void *msg, int len, void *priv_ctx)
@@ -149,6 +169,653 @@ void nfs_mnt_cb(void *msg, int len, void *priv_ctx)
 }
 
 
+/* Parses a byte count with an optional K, M or G suffix */
+long long argtonum(char *str)
+{
+	char *end;
+	long long result;
+
+	result=strtoll(str, &end, 10);
+	switch (*end) {
+	case 'K': case 'k': result*=1024; break;
+	case 'M': case 'm': result*=1024*1024; break;
+	case 'G': case 'g': result*=1024LL*1024*1024; break;
+	}
+	return result;
+}
+
+/* Read throughput mode (-t). A window of READs is kept in flight
+ * until the requested number of bytes has been read, starting over at
+ * the beginning of the file when the end is reached.
+ */
+int tmode=0;
+long long tput_bytes=0;
+int window=8;
+double warn_mbs=0, crit_mbs=0;
+double warn_lat=0, crit_lat=0;
+
+long long filesize=-1;
+int getattr_done=0;
+
+struct io_slot {
+	nfs_ctx *ctx;
+	struct timeval start;
+	long long offset;	/* Of the WRITE in flight */
+	u_int32_t count;
+};
+
+u_int32_t rsize;
+long long sent=0, rcvd=0, nextoff=0;
+int inflight=0;
+double *latency=NULL;
+int nlat=0, maxlat=0;
+
+double elapsed_ms(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec-start->tv_sec)*1000.0
+		+(now.tv_usec-start->tv_usec)/1000.0;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+	double x=*(const double *)a, y=*(const double *)b;
+
+	return (x<y) ? -1 : (x>y);
+}
+
+/* p-th percentile of the sorted array */
+double percentile(double *sorted, int n, double p)
+{
+	int i;
+
+	if (n==0)
+		return 0;
+	i=(int)(p*n/100.0+0.999999)-1;
+	if (i<0)
+		i=0;
+	if (i>=n)
+		i=n-1;
+	return sorted[i];
+}
+
+/* Waits until *done is set. Returns 0, or -1 if the connection went
+ * away before that.
+ */
+int wait_reply(nfs_ctx *ctx, int *done)
+{
+	while (!*done) {
+		if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+void nfs_getattr_cb(void *msg, int len, void *priv_ctx)
+{
+	GETATTR3res *res = NULL;
+
+	getattr_done=1;
+	res = xdr_to_GETATTR3res(msg, len);
+	if (res == NULL) {
+		retcode=2;
+		errmsg="GETATTR failed";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		retcode=2;
+		errmsg=strdup("GETATTR failed - error XXXXXXX");
+		sprintf(errmsg+23, "%d", res->status);
+		free_GETATTR3res(res);
+		return;
+	}
+	filesize=res->GETATTR3res_u.resok.obj_attributes.size;
+	free_GETATTR3res(res);
+}
+
+/* Records the latency of one call. Returns -1 if out of memory. */
+int add_latency(double ms)
+{
+	double *grown;
+	int newmax;
+
+	if (nlat==maxlat) {
+		newmax=maxlat ? maxlat*2 : 1024;
+		grown=realloc(latency, newmax*sizeof(double));
+		if (grown==NULL) {
+			retcode=3;
+			errmsg="Out of memory";
+			return -1;
+		}
+		latency=grown;
+		maxlat=newmax;
+	}
+	latency[nlat++]=ms;
+	return 0;
+}
+
+void nfs_tput_read_cb(void *msg, int len, void *priv_ctx);
+
+void send_read(struct io_slot *slot)
+{
+	READ3args args;
+	u_int32_t count;
+
+	if (retcode!=0 || sent>=tput_bytes)
+		return;
+
+	count=rsize;
+	if (tput_bytes-sent<count)
+		count=tput_bytes-sent;
+	if (filesize-nextoff<count)
+		count=filesize-nextoff;
+
+	args.file.data.data_len = lfh.fhandle3_len;
+	args.file.data.data_val = lfh.fhandle3_val;
+	args.offset = nextoff;
+	args.count = count;
+
+	nextoff+=count;
+	if (nextoff>=filesize)
+		nextoff=0;
+	sent+=count;
+
+	inflight++;
+	gettimeofday(&slot->start, NULL);
+	if (nfs3_read(&args, slot->ctx, nfs_tput_read_cb, slot) != RPC_SUCCESS) {
+		inflight--;
+		retcode=2;
+		errmsg="Could not send NFS READ call";
+	}
+}
+
+void nfs_tput_read_cb(void *msg, int len, void *priv_ctx)
+{
+	struct io_slot *slot=(struct io_slot *)priv_ctx;
+	READ3res *res = NULL;
+	double ms;
+	u_int32_t count;
+
+	ms=elapsed_ms(&slot->start);
+	inflight--;
+
+	/* We only care about the amount of data, so dont copy it */
+	res = xdr_to_READ3res(msg, len, NFS3_DATA_NO_DEXDR);
+	if (res == NULL) {
+		retcode=2;
+		errmsg="Read failed - permission error?";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		retcode=2;
+		errmsg=strdup("Read failed - error XXXXXXX");
+		sprintf(errmsg+20, "%d", res->status);
+		free_READ3res(res, NFS3_DATA_NO_DEXDR);
+		return;
+	}
+	count=(u_int32_t)res->READ3res_u.resok.count;
+	free_READ3res(res, NFS3_DATA_NO_DEXDR);
+
+	/* The file shrunk while we were reading it */
+	if (count==0) {
+		retcode=2;
+		errmsg="Read failed - short read";
+		return;
+	}
+	rcvd+=count;
+	if (add_latency(ms) < 0)
+		return;
+
+	send_read(slot);
+}
+
+/* Formats a threshold for perfdata, leaving it empty if unset */
+void fmt_thr(char *buf, double val)
+{
+	if (val)
+		sprintf(buf, "%.3f", val);
+	else
+		*buf='\0';
+}
+
+int read_throughput(nfs_ctx *ctx, nfs_fh3 *root, char *path, char *progname)
+{
+	GETATTR3args gargs;
+	struct io_slot *slots;
+	struct timeval start;
+	double secs, mbs, iops, p50, p95, p99;
+	int i, code;
+	char *state;
+	char wm[32], cm[32], wl[32], cl[32];
+
+	gargs.object.data.data_len = lfh.fhandle3_len;
+	gargs.object.data.data_val = lfh.fhandle3_val;
+	if (nfs3_getattr(&gargs, ctx, nfs_getattr_cb, NULL) != RPC_SUCCESS
+			|| wait_reply(ctx, &getattr_done) < 0) {
+		printf("%s CRITICAL: GETATTR call failed\n", progname);
+		return 2;
+	}
+	if (retcode!=0) {
+		printf("%s CRITICAL: %s\n", progname, errmsg);
+		return retcode;
+	}
+	if (filesize<=0) {
+		printf("%s UNKNOWN: %s is empty\n", progname, path);
+		return 3;
+	}
+
+	if (tput_bytes<=0)
+		tput_bytes=64LL*1024*1024;
+	/* Set up by nfs_mount() from FSINFO */
+	rsize=ctx->nfs_rsize ? ctx->nfs_rsize : NFS_DEFAULT_XFER;
+
+	slots=calloc(window, sizeof(struct io_slot));
+	if (slots==NULL) {
+		printf("%s UNKNOWN: Out of memory\n", progname);
+		return 3;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i=0; i<window; i++) {
+		slots[i].ctx=ctx;
+		send_read(&slots[i]);
+	}
+	while (inflight>0 && retcode==0) {
+		if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	}
+	/* No use waiting for the rest once one failed */
+	if (retcode!=0) {
+		for (i=0; i<window; i++)
+			inflight-=nfs_cancel(ctx, &slots[i]);
+	}
+	secs=elapsed_ms(&start)/1000.0;
+	free(slots);
+
+	if (inflight>0 && retcode==0) {
+		printf("%s CRITICAL: Connection lost during READ\n", progname);
+		return 2;
+	}
+	if (retcode!=0) {
+		printf("%s CRITICAL: %s\n", progname, errmsg);
+		return retcode;
+	}
+
+	if (secs<=0)
+		secs=0.000001;
+	mbs=rcvd/secs/1000000.0;
+	iops=nlat/secs;
+	qsort(latency, nlat, sizeof(double), cmp_double);
+	p50=percentile(latency, nlat, 50);
+	p95=percentile(latency, nlat, 95);
+	p99=percentile(latency, nlat, 99);
+
+	code=0;
+	if ((warn_mbs && mbs<warn_mbs) || (warn_lat && p99>warn_lat))
+		code=1;
+	if ((crit_mbs && mbs<crit_mbs) || (crit_lat && p99>crit_lat))
+		code=2;
+	state=(code==2) ? "CRITICAL" : (code==1) ? "WARNING" : "OK";
+
+	fmt_thr(wm, warn_mbs);
+	fmt_thr(cm, crit_mbs);
+	fmt_thr(wl, warn_lat);
+	fmt_thr(cl, crit_lat);
+
+	printf("%s %s: read %lld bytes in %.3fs, %.1f MB/s, %.0f IOPS, "
+		"p99 %.3fms (rsize %u, window %d)"
+		"|throughput=%.3f;%s;%s;0 iops=%.1f;;;0 "
+		"p50=%.3fms;;;0 p95=%.3fms;;;0 p99=%.3fms;%s;%s;0 "
+		"max=%.3fms;;;0\n",
+		progname, state, rcvd, secs, mbs, iops, p99, rsize, window,
+		mbs, wm, cm, iops, p50, p95, p99, wl, cl,
+		nlat ? latency[nlat-1] : 0.0);
+	free(latency);
+
+	return code;
+}
+
+
+/* Write probe mode (-W). A scratch file is created in the directory,
+ * written with UNSTABLE WRITEs keeping a window in flight, committed
+ * with a single COMMIT and removed again. The write verifier of every
+ * reply is compared, a change means the server rebooted and may have
+ * lost data it had not yet committed.
+ */
+int wmode=0;
+u_int32_t wsize;
+char *wbuf=NULL;
+char scratch[128];
+fhandle3 sfh;
+char wverf[NFS3_WRITEVERFSIZE];
+int wverf_set=0, wverf_changed=0;
+int create_done=0, commit_done=0, remove_done=0, remove_failed=0;
+struct timeval commit_start;
+double commit_ms=0;
+
+void nfs_write_cb(void *msg, int len, void *priv_ctx);
+
+/* Writes count bytes at offset from the slot */
+void write_range(struct io_slot *slot, long long offset, u_int32_t count)
+{
+	WRITE3args args;
+
+	args.file.data.data_len = sfh.fhandle3_len;
+	args.file.data.data_val = sfh.fhandle3_val;
+	args.offset = offset;
+	args.count = count;
+	args.stable = UNSTABLE;
+	args.data.data_len = count;
+	args.data.data_val = wbuf;
+	slot->offset=offset;
+	slot->count=count;
+
+	inflight++;
+	gettimeofday(&slot->start, NULL);
+	if (nfs3_write(&args, slot->ctx, nfs_write_cb, slot) != RPC_SUCCESS) {
+		inflight--;
+		retcode=2;
+		errmsg="Could not send NFS WRITE call";
+	}
+}
+
+void send_write(struct io_slot *slot)
+{
+	u_int32_t count;
+
+	if (retcode!=0 || sent>=tput_bytes)
+		return;
+
+	count=wsize;
+	if (tput_bytes-sent<count)
+		count=tput_bytes-sent;
+	write_range(slot, sent, count);
+	sent+=count;
+}
+
+void nfs_write_cb(void *msg, int len, void *priv_ctx)
+{
+	struct io_slot *slot=(struct io_slot *)priv_ctx;
+	WRITE3res *res = NULL;
+	double ms;
+	u_int32_t count;
+
+	ms=elapsed_ms(&slot->start);
+	inflight--;
+
+	res = xdr_to_WRITE3res(msg, len);
+	if (res == NULL) {
+		retcode=2;
+		errmsg="Write failed - no reply";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		retcode=2;
+		errmsg=strdup("Write failed - error XXXXXXX");
+		sprintf(errmsg+21, "%d", res->status);
+		free_WRITE3res(res);
+		return;
+	}
+	count=(u_int32_t)res->WRITE3res_u.resok.count;
+	if (!wverf_set) {
+		memcpy(wverf, res->WRITE3res_u.resok.verf, NFS3_WRITEVERFSIZE);
+		wverf_set=1;
+	} else if (memcmp(wverf, res->WRITE3res_u.resok.verf,
+				NFS3_WRITEVERFSIZE))
+		wverf_changed=1;
+	free_WRITE3res(res);
+
+	if (count==0) {
+		retcode=2;
+		errmsg="Write failed - nothing written";
+		return;
+	}
+	if (count>slot->count)
+		count=slot->count;
+	rcvd+=count;
+	if (add_latency(ms) < 0)
+		return;
+
+	/* A short write leaves the rest of the range to write again */
+	if (count<slot->count && retcode==0)
+		write_range(slot, slot->offset+count, slot->count-count);
+	else
+		send_write(slot);
+}
+
+void nfs_create_cb(void *msg, int len, void *priv_ctx)
+{
+	CREATE3res *res = NULL;
+	post_op_fh3 *obj;
+
+	create_done=1;
+	res = xdr_to_CREATE3res(msg, len);
+	if (res == NULL) {
+		retcode=2;
+		errmsg="Create failed - no reply";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		retcode=2;
+		errmsg=strdup("Create failed - error XXXXXXX");
+		sprintf(errmsg+22, "%d", res->status);
+		free_CREATE3res(res);
+		return;
+	}
+
+	/* The server may leave out the handle, we look it up then */
+	obj=&res->CREATE3res_u.resok.obj;
+	if (obj->handle_follows) {
+		sfh.fhandle3_len = obj->post_op_fh3_u.handle.data.data_len;
+		sfh.fhandle3_val = (char *)mem_alloc(sfh.fhandle3_len);
+		if (sfh.fhandle3_val == NULL)
+			sfh.fhandle3_len = 0;
+		else
+			memcpy(sfh.fhandle3_val, obj->post_op_fh3_u.handle.data.data_val,
+					sfh.fhandle3_len);
+	}
+	free_CREATE3res(res);
+}
+
+void nfs_commit_cb(void *msg, int len, void *priv_ctx)
+{
+	COMMIT3res *res = NULL;
+
+	commit_ms=elapsed_ms(&commit_start);
+	commit_done=1;
+	res = xdr_to_COMMIT3res(msg, len);
+	if (res == NULL) {
+		retcode=2;
+		errmsg="Commit failed - no reply";
+		return;
+	}
+	if (res->status != NFS3_OK) {
+		retcode=2;
+		errmsg=strdup("Commit failed - error XXXXXXX");
+		sprintf(errmsg+22, "%d", res->status);
+		free_COMMIT3res(res);
+		return;
+	}
+	if (wverf_set && memcmp(wverf, res->COMMIT3res_u.resok.verf,
+				NFS3_WRITEVERFSIZE))
+		wverf_changed=1;
+	free_COMMIT3res(res);
+}
+
+void nfs_remove_cb(void *msg, int len, void *priv_ctx)
+{
+	REMOVE3res *res = NULL;
+
+	remove_done=1;
+	res = xdr_to_REMOVE3res(msg, len);
+	if (res == NULL || res->status != NFS3_OK)
+		remove_failed=1;
+	free_REMOVE3res(res);
+}
+
+int write_probe(nfs_ctx *ctx, nfs_fh3 *root, char *path, char *progname)
+{
+	CREATE3args cargs;
+	COMMIT3args commit;
+	REMOVE3args rargs;
+	nfs_fh3 dir, fh;
+	struct io_slot *slots;
+	struct timeval start;
+	char hostname[64];
+	double wsecs, secs, mbs, wmbs, iops, p50, p95, p99;
+	int i, code;
+	char *state, *msg;
+	char wm[32], cm[32], wl[32], cl[32];
+
+	if (tput_bytes<=0)
+		tput_bytes=8LL*1024*1024;
+	wsize=ctx->nfs_wsize ? ctx->nfs_wsize : NFS_DEFAULT_XFER;
+
+	wbuf=malloc(wsize);
+	slots=calloc(window, sizeof(struct io_slot));
+	if (wbuf==NULL || slots==NULL) {
+		printf("%s UNKNOWN: Out of memory\n", progname);
+		return 3;
+	}
+	for (i=0; i<wsize; i++)
+		wbuf[i]=i & 0xff;
+
+	/* A name no other instance of this check will use */
+	gethostname(hostname, sizeof hostname);
+	hostname[sizeof hostname - 1]='\0';
+	snprintf(scratch, sizeof scratch, ".check_nfs_file.%s.%d",
+			hostname, (int)getpid());
+
+	dir.data.data_len = lfh.fhandle3_len;
+	dir.data.data_val = lfh.fhandle3_val;
+
+	memset(&cargs, 0, sizeof cargs);
+	cargs.where.dir = dir;
+	cargs.where.name = scratch;
+	cargs.how.mode = GUARDED;
+	cargs.how.createhow3_u.obj_attributes.mode.set_it = TRUE;
+	cargs.how.createhow3_u.obj_attributes.mode.set_mode3_u.mode = 0600;
+
+	sfh.fhandle3_len = 0;
+	if (nfs3_create(&cargs, ctx, nfs_create_cb, NULL) != RPC_SUCCESS
+			|| wait_reply(ctx, &create_done) < 0) {
+		printf("%s CRITICAL: CREATE call failed\n", progname);
+		return 2;
+	}
+	if (retcode!=0) {
+		printf("%s CRITICAL: %s\n", progname, errmsg);
+		return retcode;
+	}
+	if (sfh.fhandle3_len==0) {
+		if (nfs_resolve_path(ctx, &dir, scratch, &fh) != NFS3_OK) {
+			printf("%s CRITICAL: Cannot find created file %s\n",
+					progname, scratch);
+			return 2;
+		}
+		sfh.fhandle3_len = fh.data.data_len;
+		sfh.fhandle3_val = fh.data.data_val;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i=0; i<window; i++) {
+		slots[i].ctx=ctx;
+		send_write(&slots[i]);
+	}
+	while (inflight>0 && retcode==0) {
+		if (nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	}
+	/* No use waiting for the rest once one failed */
+	if (retcode!=0) {
+		for (i=0; i<window; i++)
+			inflight-=nfs_cancel(ctx, &slots[i]);
+	}
+	wsecs=elapsed_ms(&start)/1000.0;
+
+	/* One COMMIT for everything written */
+	if (retcode==0 && inflight==0) {
+		commit.file.data.data_len = sfh.fhandle3_len;
+		commit.file.data.data_val = sfh.fhandle3_val;
+		commit.offset = 0;
+		commit.count = 0;
+		gettimeofday(&commit_start, NULL);
+		if (nfs3_commit(&commit, ctx, nfs_commit_cb, NULL) != RPC_SUCCESS
+				|| wait_reply(ctx, &commit_done) < 0) {
+			retcode=2;
+			errmsg="COMMIT call failed";
+		}
+	}
+	secs=elapsed_ms(&start)/1000.0;
+
+	/* Clean up even if something went wrong */
+	rargs.object.dir = dir;
+	rargs.object.name = scratch;
+	if (nfs3_remove(&rargs, ctx, nfs_remove_cb, NULL) != RPC_SUCCESS
+			|| wait_reply(ctx, &remove_done) < 0)
+		remove_failed=1;
+
+	free(slots);
+	free(wbuf);
+	mem_free(sfh.fhandle3_val, sfh.fhandle3_len);
+
+	if (inflight>0 && retcode==0) {
+		printf("%s CRITICAL: Connection lost during WRITE\n", progname);
+		return 2;
+	}
+	if (retcode!=0) {
+		printf("%s CRITICAL: %s\n", progname, errmsg);
+		return retcode;
+	}
+
+	if (wsecs<=0)
+		wsecs=0.000001;
+	if (secs<=0)
+		secs=0.000001;
+	wmbs=rcvd/wsecs/1000000.0;
+	mbs=rcvd/secs/1000000.0;
+	iops=nlat/wsecs;
+	qsort(latency, nlat, sizeof(double), cmp_double);
+	p50=percentile(latency, nlat, 50);
+	p95=percentile(latency, nlat, 95);
+	p99=percentile(latency, nlat, 99);
+
+	code=0;
+	msg="";
+	if (remove_failed) {
+		code=1;
+		msg=" - could not remove scratch file";
+	}
+	if ((warn_mbs && mbs<warn_mbs) || (warn_lat && p99>warn_lat))
+		code=1;
+	if ((crit_mbs && mbs<crit_mbs) || (crit_lat && p99>crit_lat))
+		code=2;
+	if (wverf_changed) {
+		code=2;
+		msg=" - write verifier changed, server rebooted";
+	}
+	state=(code==2) ? "CRITICAL" : (code==1) ? "WARNING" : "OK";
+
+	fmt_thr(wm, warn_mbs);
+	fmt_thr(cm, crit_mbs);
+	fmt_thr(wl, warn_lat);
+	fmt_thr(cl, crit_lat);
+
+	printf("%s %s: wrote %lld bytes in %.3fs, %.1f MB/s with COMMIT%s "
+		"(WRITE %.1f MB/s, p99 %.3fms; COMMIT %.3fms; wsize %u, window %d)"
+		"|throughput=%.3f;%s;%s;0 write_throughput=%.3f;;;0 iops=%.1f;;;0 "
+		"p50=%.3fms;;;0 p95=%.3fms;;;0 p99=%.3fms;%s;%s;0 "
+		"max=%.3fms;;;0 commit=%.3fms;;;0\n",
+		progname, state, rcvd, secs, mbs, msg, wmbs, p99, commit_ms,
+		wsize, window,
+		mbs, wm, cm, wmbs, iops, p50, p95, p99, wl, cl,
+		nlat ? latency[nlat-1] : 0.0, commit_ms);
+	free(latency);
+
+	return code;
+}
+
 int main(int argc, char *argv[])
 {
 	struct addrinfo *srv_addr, hints;
@@ -159,8 +826,9 @@ int main(int argc, char *argv[])
 	int fullpath=0;
 	int silent=0;
 
-	LOOKUP3args largs;
+	nfs_fh3 root;
 	READ3args read;
+	int i;
 
 	while (argc>1 && argv[1][0] == '-') {
 		if (argv[1][1] == 'p') {
@@ -171,17 +839,46 @@ int main(int argc, char *argv[])
 			silent=1;
 			argc--;
 			argv++;
+		} else if (argv[1][1] == 'W') {
+			wmode=1;
+			argc--;
+			argv++;
+		} else if (argv[1][1] == 't') {
+			tmode=1;
+			argc--;
+			argv++;
+		} else if (argc>2 && strchr("nqwclL", argv[1][1])) {
+			switch (argv[1][1]) {
+			case 'n': tput_bytes=argtonum(argv[2]); break;
+			case 'q': window=atoi(argv[2]); break;
+			case 'w': warn_mbs=atof(argv[2]); break;
+			case 'c': crit_mbs=atof(argv[2]); break;
+			case 'l': warn_lat=atof(argv[2]); break;
+			case 'L': crit_lat=atof(argv[2]); break;
+			}
+			argc-=2;
+			argv+=2;
+		} else {
+			printf("%s UNKNOWN: Unknown option %s\n", progname, argv[1]);
+			return 3;
 		}
 	}
 
+	if (window<1)
+		window=1;
+
 	if (fullpath==0 &&  strrchr(progname, '/')!=NULL)
 		progname=strrchr(progname, '/')+1;
 
 	if(argc < 4) {
 		printf("%s UNKNOWN: Not enough arguments\n"
 			"Test if a file can be read via NFS\n"
-			"USAGE: %s <server> <remote_dir> <filename>\n",
-			progname, progname);
+			"USAGE: %s [-p] [-s] <server> <remote_dir> <path>\n"
+			"       %s -t [-n bytes] [-q window] [-w MB/s] [-c MB/s]\n"
+			"          [-l ms] [-L ms] <server> <remote_dir> <path>\n"
+			"       %s -W [-n bytes] [-q window] [-w MB/s] [-c MB/s]\n"
+			"          [-l ms] [-L ms] <server> <remote_dir> <dir>\n",
+			progname, progname, progname, progname);
 		return 3;
 	}
 
@@ -195,46 +892,73 @@ int main(int argc, char *argv[])
 		exit(2);
 	}
 
-	ctx = nfs_init((struct sockaddr_in *)srv_addr->ai_addr, IPPROTO_TCP, 0);
+	/* Keeping several calls in flight needs a non-blocking context */
+	ctx = nfs_init((struct sockaddr_in *)srv_addr->ai_addr, IPPROTO_TCP,
+			(tmode || wmode) ?
+			NFSC_CFL_NONBLOCKING | NFSC_CFL_DISABLE_NAGLE : 0);
 	if (ctx == NULL) {
 		printf("%s CRITICAL: Cant init nfs context\n", progname);
 		exit(2);
 	}
 
 	freeaddrinfo(srv_addr);
-	mntfh.fhandle3_len = 0;
-	stat = mount3_mnt(&argv[2], ctx, nfs_mnt_cb, NULL);
-	if (stat == RPC_SUCCESS) {
+	if (tmode || wmode) {
+		/* Also picks the transfer sizes from FSINFO */
+		err = nfs_mount(ctx, argv[2], &root);
+		if (err == -1) {
+			printf("%s CRITICAL: Could not send NFS MOUNT call\n", progname);
+			exit(2);
+		}
+		if (err != MNT3_OK) {
+			printf("%s CRITICAL: Mount failed - error %d\n", progname, err);
+			exit(2);
+		}
 	} else {
-		printf("%s CRITICAL: Could not send NFS MOUNT call\n", progname);
-		exit(2);
-	}
-	if (retcode!=0) {
-		printf("%s CRITICAL: %s\n", progname, errmsg);
-		exit(retcode);
+		mntfh.fhandle3_len = 0;
+		stat = mount3_mnt(&argv[2], ctx, nfs_mnt_cb, NULL);
+		if (stat == RPC_SUCCESS) {
+		} else {
+			printf("%s CRITICAL: Could not send NFS MOUNT call\n", progname);
+			exit(2);
+		}
+		if (retcode!=0) {
+			printf("%s CRITICAL: %s\n", progname, errmsg);
+			exit(retcode);
+		}
+		root.data.data_len = mntfh.fhandle3_len;
+		root.data.data_val = mntfh.fhandle3_val;
 	}
 
-	largs.what.dir.data.data_len = mntfh.fhandle3_len;
-	largs.what.dir.data.data_val = mntfh.fhandle3_val;
-	largs.what.name = argv[3];
-
+	/* Resolve the path relative to the mounted directory. Each
+	 * component needs its own LOOKUP, as it depends on the handle
+	 * returned for the previous one.
+	 */
 	lfh.fhandle3_len = 0;
-	stat = nfs3_lookup(&largs, ctx, nfs_lookup_cb, NULL);
-	if (stat == RPC_SUCCESS) {
-		// fprintf(stderr, "NFS LOOKUP Call sent successfully\n");
-	} else {
+	if (nfs_resolve_path_async(ctx, &root, argv[3], 0, nfs_path_cb,
+				nfs_step_cb, NULL) < 0) {
 		printf("%s CRITICAL: Could not send NFS LOOKUP call\n", progname);
 		exit(2);
 	}
 
-	mem_free(mntfh.fhandle3_val, mntfh.fhandle3_len);
-	nfs_complete(ctx, RPC_BLOCKING_WAIT);
-
+	if (wait_reply(ctx, &resolved) < 0) {
+		printf("%s CRITICAL: Connection lost during LOOKUP\n", progname);
+		exit(2);
+	}
 	if (retcode!=0) {
 		printf("%s CRITICAL: %s\n", progname, errmsg);
 		exit(retcode);
 	}
 
+	if (tmode || wmode) {
+		if (wmode)
+			err=write_probe(ctx, &root, argv[3], progname);
+		else
+			err=read_throughput(ctx, &root, argv[3], progname);
+		mem_free(root.data.data_val, root.data.data_len);
+		return err;
+	}
+	mem_free(root.data.data_val, root.data.data_len);
+
 	read.file.data.data_len = lfh.fhandle3_len;
 	read.file.data.data_val = lfh.fhandle3_val;
 	read.offset = 0;
@@ -257,6 +981,9 @@ int main(int argc, char *argv[])
 	printf("%s OK", progname);
 	if (!silent)
 		printf(": got %s", errmsg);
+	printf("|lookup=%.6fs", looktime);
+	for (i=0; i<nsteps; i++)
+		printf(" '%s'=%.6fs", stepname[i], steptime[i]);
 	putchar('\n');
 
 	return 0;
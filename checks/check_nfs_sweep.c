@@ -0,0 +1,639 @@
+/*
+ *    Nagios plugin to sweep many NFS servers at once for ones that are
+ *    slow or down.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Every target (server:/export) gets a MOUNT NULL, a MNT and an
+ * FSSTAT. All server names are resolved at once with getaddrinfo_a()
+ * first. Then a pool of jobs threads works through the targets, each
+ * thread one target at a time, so no more than jobs targets are
+ * probed at any time, and no more than per_server of those on the
+ * same server. The MOUNT calls go through the blocking MOUNT client,
+ * so a hung server holds up the thread probing it, but no other.
+ * Whatever is not done when the timeout runs out counts as down, and
+ * the threads still busy are left behind when the plugin exits.
+ */
+
+#define _GNU_SOURCE
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <nfsclient.h>
+
+#define DEFAULT_JOBS 32
+#define DEFAULT_PER_SERVER 2
+#define DEFAULT_TIMEOUT 5.0
+#define DEFAULT_WARN_MS 100.0
+#define DEFAULT_CRIT_MS 1000.0
+
+/* Targets named in the summary line, per state */
+#define MAX_LISTED 10
+
+struct server {
+	char *name;
+	struct gaicb gai;
+	struct addrinfo hints;
+	struct sockaddr_in addr;
+	char *err;		/* Why it could not be resolved, or NULL */
+	int inflight;		/* Targets of it being probed */
+};
+
+enum { T_QUEUED, T_RUNNING, T_DONE };
+
+struct target {
+	char *server;
+	char *export;
+	struct server *srv;
+	int state;
+
+	/* Set by the thread probing it, read once T_DONE */
+	char *err;		/* Why it is down, NULL if it is up */
+	char errbuf[128];
+	double mnt_null_ms, mnt_ms, fsstat_ms;
+
+	/* Only touched by the thread probing it */
+	nfs_ctx *ctx;
+	fhandle3 rootfh;
+	int replied;
+};
+
+struct server *servers;
+int nservers;
+struct target *targets;
+int ntargets;
+
+int jobs=DEFAULT_JOBS;
+int per_server=DEFAULT_PER_SERVER;
+double timeout_secs=DEFAULT_TIMEOUT;
+double warn_ms=DEFAULT_WARN_MS, crit_ms=DEFAULT_CRIT_MS;
+struct timespec deadline;
+char *progname;
+
+/* Protects the state of the targets and the inflight counts */
+pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t work_cv=PTHREAD_COND_INITIALIZER;
+pthread_cond_t done_cv=PTHREAD_COND_INITIALIZER;
+int nqueued, ndone;
+
+
+/* Milliseconds until the deadline, at least 0 */
+int ms_left(void)
+{
+	struct timespec now;
+	long long left;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	left=(deadline.tv_sec-now.tv_sec)*1000LL
+		+(deadline.tv_nsec-now.tv_nsec)/1000000;
+	return left > 0 ? (int)left : 0;
+}
+
+/* Average round trip time in milliseconds, 0 if there was none */
+double avg_ms(struct clnt_proc_stats *ps)
+{
+	if (ps == NULL || ps->ps_calls == 0)
+		return 0;
+	return ps->ps_sum_us/1000.0/ps->ps_calls;
+}
+
+void fail(struct target *t, char *fmt, char *detail)
+{
+	if (t->err != NULL)
+		return;
+	snprintf(t->errbuf, sizeof t->errbuf, fmt, detail);
+	t->err=t->errbuf;
+}
+
+
+void mnt_null_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+
+	t->replied=1;
+	if (msg == NULL)
+		fail(t, "MOUNT NULL failed", NULL);
+}
+
+void mnt_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+	mountres3 *res = NULL;
+	fhandle3 *fh;
+
+	t->replied=1;
+	res = xdr_to_mntres3(msg, len);
+	if (res == NULL) {
+		fail(t, "MNT failed", NULL);
+		return;
+	}
+	if (res->fhs_status != MNT3_OK) {
+		fail(t, "MNT failed: %s", strerror(res->fhs_status));
+		free_mntres3(res);
+		return;
+	}
+
+	fh = &res->mountres3_u.mountinfo.fhandle;
+	t->rootfh.fhandle3_val = (char *)mem_alloc(fh->fhandle3_len);
+	if (t->rootfh.fhandle3_val == NULL) {
+		fail(t, "out of memory", NULL);
+		free_mntres3(res);
+		return;
+	}
+	memcpy(t->rootfh.fhandle3_val, fh->fhandle3_val, fh->fhandle3_len);
+	t->rootfh.fhandle3_len = fh->fhandle3_len;
+	free_mntres3(res);
+}
+
+void fsstat_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+	FSSTAT3res *res = NULL;
+
+	t->replied=1;
+	res = xdr_to_FSSTAT3res(msg, len);
+	if (res == NULL)
+		fail(t, "FSSTAT failed", NULL);
+	else if (res->status != NFS3_OK)
+		fail(t, "FSSTAT failed: %s", nfsstat3_strerror(res->status));
+	free_FSSTAT3res(res);
+}
+
+
+/* Waits for the FSSTAT reply until the deadline. Returns 0, or -1
+ * if it did not come.
+ */
+int wait_reply(struct target *t)
+{
+	struct pollfd pfd;
+	int left, wait;
+
+	while (!t->replied) {
+		/* Flush what is still queued and pick up the reply */
+		if (nfs_complete(t->ctx, RPC_NONBLOCK_WAIT) > 0)
+			continue;
+
+		left=ms_left();
+		if (left <= 0)
+			return -1;
+
+		/* While reconnecting there may be no socket to wait on */
+		wait=clnttcp_nb_timeout(t->ctx->nfs_cl);
+		if (wait < 0 || wait > left)
+			wait=left;
+		pfd.fd=clnttcp_nb_fd(t->ctx->nfs_cl);
+		pfd.events=clnttcp_nb_events(t->ctx->nfs_cl);
+		if (poll(&pfd, pfd.fd >= 0 ? 1 : 0, wait) < 0 && errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+void probe(struct target *t)
+{
+	FSSTAT3args args;
+
+	t->err=NULL;
+	if (t->srv->err != NULL) {
+		fail(t, "cannot resolve: %s", t->srv->err);
+		return;
+	}
+
+	t->ctx=nfs_init(&t->srv->addr, IPPROTO_TCP,
+			NFSC_CFL_NONBLOCKING | NFSC_CFL_DISABLE_NAGLE);
+	if (t->ctx == NULL) {
+		fail(t, "cannot init nfs context", NULL);
+		return;
+	}
+
+	t->replied=0;
+	if (mount3_null(t->ctx, mnt_null_cb, t) != RPC_SUCCESS || !t->replied)
+		fail(t, "cannot reach mountd", NULL);
+	if (t->err != NULL)
+		goto out;
+
+	t->replied=0;
+	if (mount3_mnt(&t->export, t->ctx, mnt_cb, t) != RPC_SUCCESS
+			|| !t->replied)
+		fail(t, "MNT failed", NULL);
+	if (t->err != NULL)
+		goto out;
+
+	t->replied=0;
+	args.fsroot.data.data_len = t->rootfh.fhandle3_len;
+	args.fsroot.data.data_val = t->rootfh.fhandle3_val;
+	if (nfs3_fsstat(&args, t->ctx, fsstat_cb, t) != RPC_SUCCESS)
+		fail(t, "cannot reach nfsd", NULL);
+	else if (wait_reply(t) < 0)
+		fail(t, "timeout", NULL);
+	if (t->err != NULL)
+		goto out;
+
+	t->mnt_null_ms=avg_ms(nfs_proc_stats(t->ctx, MOUNT_PROGRAM,
+				MOUNT3_NULL));
+	t->mnt_ms=avg_ms(nfs_proc_stats(t->ctx, MOUNT_PROGRAM, MOUNT3_MNT));
+	t->fsstat_ms=avg_ms(nfs_proc_stats(t->ctx, NFS_PROGRAM,
+				NFS3_FSSTAT));
+out:
+	nfs_destroy(t->ctx);
+	t->ctx=NULL;
+	mem_free(t->rootfh.fhandle3_val, t->rootfh.fhandle3_len);
+	t->rootfh.fhandle3_val=NULL;
+	t->rootfh.fhandle3_len=0;
+}
+
+/* The first queued target whose server has room for one more probe,
+ * NULL if there is none. Called with the lock held.
+ */
+struct target *next_target(void)
+{
+	int i;
+
+	for (i=0; i<ntargets; i++)
+		if (targets[i].state == T_QUEUED
+				&& targets[i].srv->inflight < per_server)
+			return &targets[i];
+	return NULL;
+}
+
+void *worker(void *arg)
+{
+	struct target *t;
+
+	pthread_mutex_lock(&lock);
+	while (nqueued > 0) {
+		t=next_target();
+		if (t == NULL) {
+			pthread_cond_wait(&work_cv, &lock);
+			continue;
+		}
+		t->state=T_RUNNING;
+		t->srv->inflight++;
+		nqueued--;
+		pthread_mutex_unlock(&lock);
+
+		probe(t);
+
+		pthread_mutex_lock(&lock);
+		t->state=T_DONE;
+		t->srv->inflight--;
+		ndone++;
+		pthread_cond_broadcast(&work_cv);
+		pthread_cond_signal(&done_cv);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+/* Resolves the names of all servers at once. Names still pending at
+ * the deadline are given up on.
+ */
+void resolve(void)
+{
+	struct gaicb **list, **pending;
+	struct timespec ts;
+	int i, n, err, left;
+
+	list=calloc(nservers, sizeof(struct gaicb *));
+	pending=calloc(nservers, sizeof(struct gaicb *));
+	if (list == NULL || pending == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		exit(3);
+	}
+	for (i=0; i<nservers; i++) {
+		memset(&servers[i].hints, 0, sizeof(struct addrinfo));
+		servers[i].hints.ai_family=AF_INET;
+		servers[i].hints.ai_socktype=SOCK_STREAM;
+		servers[i].gai.ar_name=servers[i].name;
+		servers[i].gai.ar_request=&servers[i].hints;
+		list[i]=&servers[i].gai;
+	}
+	if ((err=getaddrinfo_a(GAI_NOWAIT, list, nservers, NULL)) != 0) {
+		printf("%s UNKNOWN: getaddrinfo_a: %s\n", progname,
+				gai_strerror(err));
+		exit(3);
+	}
+
+	for (;;) {
+		/* gai_suspend() returns at once while any request in the
+		 * list is done, so only the pending ones are passed.
+		 */
+		n=0;
+		for (i=0; i<nservers; i++) {
+			pending[i]=NULL;
+			if (gai_error(list[i]) == EAI_INPROGRESS) {
+				pending[i]=list[i];
+				n++;
+			}
+		}
+		left=ms_left();
+		if (n == 0 || left <= 0)
+			break;
+		ts.tv_sec=left/1000;
+		ts.tv_nsec=(left%1000)*1000000L;
+		gai_suspend((const struct gaicb * const *)pending, nservers, &ts);
+	}
+
+	for (i=0; i<nservers; i++) {
+		err=gai_error(list[i]);
+		if (err == EAI_INPROGRESS) {
+			/* If it cannot be, it finishes into servers[i]
+			 * later, which stays allocated
+			 */
+			gai_cancel(list[i]);
+			servers[i].err="timeout";
+		} else if (err != 0)
+			servers[i].err=(char *)gai_strerror(err);
+		else {
+			memcpy(&servers[i].addr, list[i]->ar_result->ai_addr,
+					sizeof(struct sockaddr_in));
+			freeaddrinfo(list[i]->ar_result);
+		}
+	}
+	free(list);
+	free(pending);
+}
+
+
+/* Room for ntargets servers has to be allocated already */
+struct server *add_server(char *name)
+{
+	int i;
+
+	for (i=0; i<nservers; i++)
+		if (strcmp(servers[i].name, name) == 0)
+			return &servers[i];
+
+	servers[nservers].name=name;
+	return &servers[nservers++];
+}
+
+/* Takes server:/export. Returns 0, or -1 if that is not what spec is. */
+int add_target(char *spec)
+{
+	char *colon;
+
+	colon=strchr(spec, ':');
+	if (colon == NULL || colon == spec || colon[1] != '/')
+		return -1;
+
+	targets=realloc(targets, (ntargets+1)*sizeof(struct target));
+	if (targets == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		exit(3);
+	}
+	memset(&targets[ntargets], 0, sizeof(struct target));
+	targets[ntargets].server=strndup(spec, colon-spec);
+	targets[ntargets].export=strdup(colon+1);
+	if (targets[ntargets].server == NULL
+			|| targets[ntargets].export == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		exit(3);
+	}
+	ntargets++;
+	return 0;
+}
+
+/* Reads targets from file, one per line. Empty lines and lines
+ * starting with # are skipped.
+ */
+int read_targets(char *file)
+{
+	char line[1024], *p;
+	FILE *fp;
+
+	fp=fopen(file, "r");
+	if (fp == NULL) {
+		printf("%s UNKNOWN: %s: %s\n", progname, file, strerror(errno));
+		exit(3);
+	}
+	while (fgets(line, sizeof line, fp) != NULL) {
+		p=line+strspn(line, " \t");
+		p[strcspn(p, " \t\r\n")]='\0';
+		if (*p == '\0' || *p == '#')
+			continue;
+		if (add_target(p) < 0) {
+			printf("%s UNKNOWN: %s: not server:/export: %s\n",
+					progname, file, p);
+			exit(3);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+
+/* Why a target is down, NULL if it is up. Targets not done yet may
+ * still be written to by their thread.
+ */
+char *down_reason(struct target *t)
+{
+	if (t->state != T_DONE)
+		return "timeout";
+	return t->err;
+}
+
+/* The slowest of the round trips of a target that is up */
+double worst_ms(struct target *t)
+{
+	double worst=t->mnt_null_ms;
+
+	if (t->mnt_ms > worst)
+		worst=t->mnt_ms;
+	if (t->fsstat_ms > worst)
+		worst=t->fsstat_ms;
+	return worst;
+}
+
+void report(double secs)
+{
+	struct target *t;
+	char *state;
+	int i, n, down=0, warn=0, crit=0, code;
+
+	for (i=0; i<ntargets; i++) {
+		t=&targets[i];
+		if (down_reason(t) != NULL)
+			down++;
+		else if (worst_ms(t) >= crit_ms)
+			crit++;
+		else if (worst_ms(t) >= warn_ms)
+			warn++;
+	}
+
+	code=0;
+	if (warn)
+		code=1;
+	if (down || crit)
+		code=2;
+	state=(code==2) ? "CRITICAL" : (code==1) ? "WARNING" : "OK";
+
+	printf("%s %s: %d of %d targets up, %d down, %d slow",
+			progname, state, ntargets-down, ntargets, down,
+			warn+crit);
+
+	n=0;
+	for (i=0; i<ntargets; i++) {
+		t=&targets[i];
+		if (down_reason(t) == NULL)
+			continue;
+		if (n++ == MAX_LISTED) {
+			printf(", ...");
+			break;
+		}
+		printf("%s %s:%s (%s)", n == 1 ? "; down:" : ",",
+				t->server, t->export, down_reason(t));
+	}
+
+	n=0;
+	for (i=0; i<ntargets; i++) {
+		t=&targets[i];
+		if (down_reason(t) != NULL || worst_ms(t) < warn_ms)
+			continue;
+		if (n++ == MAX_LISTED) {
+			printf(", ...");
+			break;
+		}
+		printf("%s %s:%s (%.3fms)", n == 1 ? "; slow:" : ",",
+				t->server, t->export, worst_ms(t));
+	}
+
+	printf("|targets=%d down=%d;;1;0;%d slow=%d;1;;0;%d sweep=%.6fs",
+			ntargets, down, ntargets, warn+crit, ntargets, secs);
+	for (i=0; i<ntargets; i++) {
+		t=&targets[i];
+		if (down_reason(t) != NULL) {
+			printf(" '%s:%s mnt_null'=U '%s:%s mnt'=U '%s:%s fsstat'=U",
+					t->server, t->export,
+					t->server, t->export,
+					t->server, t->export);
+			continue;
+		}
+		printf(" '%s:%s mnt_null'=%.3fms;%g;%g;0"
+				" '%s:%s mnt'=%.3fms;%g;%g;0"
+				" '%s:%s fsstat'=%.3fms;%g;%g;0",
+				t->server, t->export, t->mnt_null_ms,
+				warn_ms, crit_ms,
+				t->server, t->export, t->mnt_ms,
+				warn_ms, crit_ms,
+				t->server, t->export, t->fsstat_ms,
+				warn_ms, crit_ms);
+	}
+	printf("\n");
+	exit(code);
+}
+
+int usage(void)
+{
+	printf("%s UNKNOWN: Not enough arguments\n"
+		"Check many NFS exports at once for ones that are slow or down\n"
+		"USAGE: %s [-j jobs] [-s per_server] [-a timeout] [-w warn_ms] "
+		"[-c crit_ms] [-f file] [<server>:<export> ...]\n",
+		progname, progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	pthread_t thread;
+	long long ns;
+	int i, err;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		if (argv[1][1] == 'j')
+			jobs=atoi(argv[2]);
+		else if (argv[1][1] == 's')
+			per_server=atoi(argv[2]);
+		else if (argv[1][1] == 'a')
+			timeout_secs=atof(argv[2]);
+		else if (argv[1][1] == 'w')
+			warn_ms=atof(argv[2]);
+		else if (argv[1][1] == 'c')
+			crit_ms=atof(argv[2]);
+		else if (argv[1][1] == 'f')
+			read_targets(argv[2]);
+		else
+			return usage();
+		argc-=2;
+		argv+=2;
+	}
+	for (i=1; i<argc; i++)
+		if (add_target(argv[i]) < 0)
+			return usage();
+	if (ntargets == 0 || jobs < 1 || per_server < 1 || timeout_secs <= 0)
+		return usage();
+
+	servers=calloc(ntargets, sizeof(struct server));
+	if (servers == NULL) {
+		printf("%s UNKNOWN: out of memory\n", progname);
+		return 3;
+	}
+	for (i=0; i<ntargets; i++)
+		targets[i].srv=add_server(targets[i].server);
+
+	/* Servers closing connections on us should not kill the plugin */
+	signal(SIGPIPE, SIG_IGN);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	ns=deadline.tv_nsec+(long long)(timeout_secs*1e9);
+	deadline.tv_sec+=ns/1000000000;
+	deadline.tv_nsec=ns%1000000000;
+
+	resolve();
+
+	nqueued=ntargets;
+	if (jobs > ntargets)
+		jobs=ntargets;
+	for (i=0; i<jobs; i++) {
+		if ((err=pthread_create(&thread, NULL, worker, NULL)) != 0) {
+			printf("%s UNKNOWN: pthread_create: %s\n", progname,
+					strerror(err));
+			return 3;
+		}
+		pthread_detach(thread);
+	}
+
+	pthread_mutex_lock(&lock);
+	while (ndone < ntargets)
+		if (pthread_cond_timedwait(&done_cv, &lock, &deadline)
+				== ETIMEDOUT)
+			break;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	report(end.tv_sec-start.tv_sec+(end.tv_nsec-start.tv_nsec)/1e9);
+	return 0;
+}
@@ -0,0 +1,665 @@
+/*
+ *    Prometheus exporter for NFS servers, without having to mount.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Each target (server:/export) gets a thread of its own that keeps a
+ * connection open, and refreshes FSSTAT and probes NULL latency every
+ * interval. Results are copied into a snapshot under a mutex. The main
+ * thread serves /metrics from the snapshots only, so a scrape never
+ * waits for an NFS server, and a hung server only stalls its own
+ * thread.
+ */
+
+#include <rpc/rpc.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <nfsclient.h>
+
+#define DEFAULT_PORT 9738
+#define DEFAULT_INTERVAL 15
+#define DEFAULT_TIMEOUT 10
+#define DEFAULT_PROBES 5
+
+/* Procedures we keep call statistics for */
+struct proc_desc {
+	u_long pd_prog;
+	u_long pd_proc;
+	char *pd_name;
+};
+
+struct proc_desc procs[] = {
+	{ MOUNT_PROGRAM, MOUNT3_MNT, "mnt" },
+	{ NFS_PROGRAM, NFS3_NULL, "null" },
+	{ NFS_PROGRAM, NFS3_FSSTAT, "fsstat" },
+};
+#define NPROCS (int)(sizeof(procs) / sizeof(procs[0]))
+
+/* What a scrape gets to see of a target */
+struct snapshot {
+	int up;
+	time_t last_success;
+	unsigned long failures;
+
+	unsigned long long tbytes, fbytes, abytes;
+	unsigned long long tfiles, ffiles, afiles;
+
+	/* Duration of the last refresh */
+	double refresh_seconds;
+
+	/* Call statistics of the current connection */
+	int have_stats[NPROCS];
+	struct clnt_proc_stats stats[NPROCS];
+	int have_rtt;
+	struct clnt_rtt_stats rtt;
+};
+
+struct target {
+	char *server;
+	char *export;
+	pthread_t thread;
+
+	/* The same, escaped for label values */
+	char *lserver, *lexport;
+
+	pthread_mutex_t lock;
+	struct snapshot snap;
+
+	/* Only touched by the target's thread */
+	nfs_ctx *ctx;
+	fhandle3 rootfh;
+	int fsstat_done, null_replies;
+	int failed;
+	FSSTAT3resok fsstat;
+};
+
+struct target *targets;
+int ntargets;
+
+int interval=DEFAULT_INTERVAL;
+int timeout_secs=DEFAULT_TIMEOUT;
+int probes=DEFAULT_PROBES;
+char *progname;
+
+
+void logmsg(struct target *t, char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "%s: %s:%s: ", progname, t->server, t->export);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+
+void mnt_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+	mountres3 *res = NULL;
+	fhandle3 *fh;
+
+	res = xdr_to_mntres3(msg, len);
+	if (res == NULL || res->fhs_status != MNT3_OK) {
+		t->failed=1;
+		free_mntres3(res);
+		return;
+	}
+
+	fh = &res->mountres3_u.mountinfo.fhandle;
+	t->rootfh.fhandle3_val = (char *)mem_alloc(fh->fhandle3_len);
+	if (t->rootfh.fhandle3_val == NULL) {
+		t->failed=1;
+		free_mntres3(res);
+		return;
+	}
+	memcpy(t->rootfh.fhandle3_val, fh->fhandle3_val, fh->fhandle3_len);
+	t->rootfh.fhandle3_len = fh->fhandle3_len;
+	free_mntres3(res);
+}
+
+void fsstat_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+	FSSTAT3res *res = NULL;
+
+	t->fsstat_done=1;
+	res = xdr_to_FSSTAT3res(msg, len);
+	if (res == NULL || res->status != NFS3_OK) {
+		t->failed=1;
+		free_FSSTAT3res(res);
+		return;
+	}
+	t->fsstat=res->FSSTAT3res_u.resok;
+	free_FSSTAT3res(res);
+}
+
+void null_cb(void *msg, int len, void *priv)
+{
+	struct target *t=(struct target *)priv;
+
+	if (msg == NULL)
+		t->failed=1;
+	t->null_replies++;
+}
+
+
+void disconnect(struct target *t)
+{
+	nfs_destroy(t->ctx);
+	t->ctx=NULL;
+	mem_free(t->rootfh.fhandle3_val, t->rootfh.fhandle3_len);
+	t->rootfh.fhandle3_val=NULL;
+	t->rootfh.fhandle3_len=0;
+}
+
+/* Connects and mounts. MNT goes through the blocking MOUNT client,
+ * so a mountd that never answers holds up this thread, but no other.
+ */
+int connect_target(struct target *t)
+{
+	struct addrinfo *addr, hints;
+	int err;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_INET;
+	if ((err = getaddrinfo(t->server, NULL, &hints, &addr)) != 0) {
+		logmsg(t, "cannot resolve: %s", gai_strerror(err));
+		return -1;
+	}
+
+	t->ctx = nfs_init((struct sockaddr_in *)addr->ai_addr, IPPROTO_TCP,
+			NFSC_CFL_NONBLOCKING | NFSC_CFL_DISABLE_NAGLE
+			| NFSC_CFL_RECONNECT | NFSC_CFL_RETRANS);
+	freeaddrinfo(addr);
+	if (t->ctx == NULL)
+		return -1;
+
+	t->failed=0;
+	t->rootfh.fhandle3_len=0;
+	if (mount3_mnt(&t->export, t->ctx, mnt_cb, t) != RPC_SUCCESS
+			|| t->failed || t->rootfh.fhandle3_len == 0) {
+		logmsg(t, "mount failed");
+		disconnect(t);
+		return -1;
+	}
+	return 0;
+}
+
+/* Waits until *count reaches want, for at most timeout_secs seconds
+ * from start. Returns 0, or -1 on timeout. A broken connection is
+ * made again by the client, which calls back with a NULL message
+ * once it gives up on it.
+ */
+int wait_replies(struct target *t, int *count, int want, struct timeval *start)
+{
+	struct timeval now, used;
+	struct pollfd pfd;
+	int left, wait;
+
+	while (*count < want) {
+		/* Flush what is still queued and pick up any replies */
+		if (nfs_complete(t->ctx, RPC_NONBLOCK_WAIT) > 0)
+			continue;
+
+		gettimeofday(&now, NULL);
+		timersub(&now, start, &used);
+		left=timeout_secs*1000-used.tv_sec*1000-used.tv_usec/1000;
+		if (left <= 0)
+			return -1;
+
+		/* While reconnecting there may be no socket to wait on */
+		wait=clnttcp_nb_timeout(t->ctx->nfs_cl);
+		if (wait < 0 || wait > left)
+			wait=left;
+		pfd.fd=clnttcp_nb_fd(t->ctx->nfs_cl);
+		pfd.events=clnttcp_nb_events(t->ctx->nfs_cl);
+		if (poll(&pfd, pfd.fd >= 0 ? 1 : 0, wait) < 0 && errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+int refresh(struct target *t)
+{
+	FSSTAT3args args;
+	struct timeval start;
+	int i;
+
+	t->failed=0;
+	t->fsstat_done=0;
+	t->null_replies=0;
+	gettimeofday(&start, NULL);
+
+	args.fsroot.data.data_len = t->rootfh.fhandle3_len;
+	args.fsroot.data.data_val = t->rootfh.fhandle3_val;
+	if (nfs3_fsstat(&args, t->ctx, fsstat_cb, t) != RPC_SUCCESS)
+		return -1;
+	for (i=0; i<probes; i++)
+		if (nfs3_null(t->ctx, null_cb, t) != RPC_SUCCESS)
+			return -1;
+
+	if (wait_replies(t, &t->fsstat_done, 1, &start) < 0
+			|| wait_replies(t, &t->null_replies, probes, &start) < 0) {
+		logmsg(t, "timeout");
+		return -1;
+	}
+	if (t->failed) {
+		logmsg(t, "FSSTAT or NULL probe failed");
+		return -1;
+	}
+	return 0;
+}
+
+void publish(struct target *t, int ok, double secs)
+{
+	struct clnt_proc_stats *ps;
+	struct clnt_rtt_stats *rs;
+	int i;
+
+	pthread_mutex_lock(&t->lock);
+	t->snap.up=ok;
+	t->snap.refresh_seconds=secs;
+	if (!ok) {
+		t->snap.failures++;
+		pthread_mutex_unlock(&t->lock);
+		return;
+	}
+
+	t->snap.last_success=time(NULL);
+	t->snap.tbytes=t->fsstat.tbytes;
+	t->snap.fbytes=t->fsstat.fbytes;
+	t->snap.abytes=t->fsstat.abytes;
+	t->snap.tfiles=t->fsstat.tfiles;
+	t->snap.ffiles=t->fsstat.ffiles;
+	t->snap.afiles=t->fsstat.afiles;
+	for (i=0; i<NPROCS; i++) {
+		ps=nfs_proc_stats(t->ctx, procs[i].pd_prog, procs[i].pd_proc);
+		t->snap.have_stats[i]=(ps != NULL);
+		if (ps != NULL)
+			t->snap.stats[i]=*ps;
+	}
+	rs=nfs_rtt_stats(t->ctx, NFS_PROGRAM);
+	t->snap.have_rtt=(rs != NULL);
+	if (rs != NULL)
+		t->snap.rtt=*rs;
+	pthread_mutex_unlock(&t->lock);
+}
+
+void *target_thread(void *arg)
+{
+	struct target *t=(struct target *)arg;
+	struct timeval start, end;
+	int ok;
+
+	for (;;) {
+		gettimeofday(&start, NULL);
+		ok=0;
+		if (t->ctx != NULL || connect_target(t) == 0) {
+			ok=(refresh(t) == 0);
+			/* Start over with a fresh connection next time */
+			if (!ok)
+				disconnect(t);
+		}
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &end);
+		publish(t, ok, end.tv_sec+end.tv_usec/1000000.0);
+
+		if (end.tv_sec < interval)
+			sleep(interval-end.tv_sec);
+	}
+	return NULL;
+}
+
+
+/* Output buffer for one scrape */
+struct outbuf {
+	char *buf;
+	size_t len, size;
+};
+
+void out(struct outbuf *o, char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n=vsnprintf(o->buf+o->len, o->size-o->len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && o->len+n < o->size) {
+			o->len+=n;
+			return;
+		}
+		o->size=o->size ? o->size*2 : 16384;
+		o->buf=realloc(o->buf, o->size);
+		if (o->buf == NULL) {
+			fprintf(stderr, "%s: out of memory\n", progname);
+			exit(1);
+		}
+	}
+}
+
+void metrics(struct outbuf *o)
+{
+	struct snapshot *snaps;
+	struct clnt_proc_stats *ps;
+	char *l;
+	int i, j;
+
+	/* Copy everything first, so the locks are held only briefly */
+	snaps=malloc(ntargets*sizeof(struct snapshot));
+	if (snaps == NULL)
+		return;
+	for (i=0; i<ntargets; i++) {
+		pthread_mutex_lock(&targets[i].lock);
+		snaps[i]=targets[i].snap;
+		pthread_mutex_unlock(&targets[i].lock);
+	}
+
+#define LABELS "server=\"%s\",export=\"%s\""
+#define FOR_TARGETS for (i=0; i<ntargets; i++)
+#define T targets[i].lserver, targets[i].lexport
+
+	out(o, "# HELP nfs_up Whether the last refresh succeeded.\n"
+		"# TYPE nfs_up gauge\n");
+	FOR_TARGETS out(o, "nfs_up{" LABELS "} %d\n", T, snaps[i].up);
+
+	out(o, "# HELP nfs_last_success_timestamp_seconds Time of the last successful refresh.\n"
+		"# TYPE nfs_last_success_timestamp_seconds gauge\n");
+	FOR_TARGETS out(o, "nfs_last_success_timestamp_seconds{" LABELS "} %lld\n",
+			T, (long long)snaps[i].last_success);
+
+	out(o, "# HELP nfs_refresh_failures_total Refreshes that failed.\n"
+		"# TYPE nfs_refresh_failures_total counter\n");
+	FOR_TARGETS out(o, "nfs_refresh_failures_total{" LABELS "} %lu\n",
+			T, snaps[i].failures);
+
+	out(o, "# HELP nfs_refresh_duration_seconds Duration of the last refresh.\n"
+		"# TYPE nfs_refresh_duration_seconds gauge\n");
+	FOR_TARGETS out(o, "nfs_refresh_duration_seconds{" LABELS "} %.6f\n",
+			T, snaps[i].refresh_seconds);
+
+#define FSSTAT_METRIC(name, field, help) \
+	out(o, "# HELP " name " " help "\n# TYPE " name " gauge\n"); \
+	FOR_TARGETS if (snaps[i].last_success) \
+		out(o, name "{" LABELS "} %llu\n", T, snaps[i].field);
+
+	FSSTAT_METRIC("nfs_fs_size_bytes", tbytes, "Total size of the file system.")
+	FSSTAT_METRIC("nfs_fs_free_bytes", fbytes, "Free space.")
+	FSSTAT_METRIC("nfs_fs_avail_bytes", abytes, "Free space available to the user.")
+	FSSTAT_METRIC("nfs_fs_files", tfiles, "Total number of file slots.")
+	FSSTAT_METRIC("nfs_fs_files_free", ffiles, "Free file slots.")
+	FSSTAT_METRIC("nfs_fs_files_avail", afiles, "Free file slots available to the user.")
+
+	out(o, "# HELP nfs_rpc_requests_total RPC replies received on the current connection.\n"
+		"# TYPE nfs_rpc_requests_total counter\n");
+	FOR_TARGETS for (j=0; j<NPROCS; j++) {
+		if (!snaps[i].have_stats[j])
+			continue;
+		out(o, "nfs_rpc_requests_total{" LABELS ",proc=\"%s\"} %lu\n",
+			T, procs[j].pd_name, snaps[i].stats[j].ps_calls);
+	}
+
+	out(o, "# HELP nfs_rpc_errors_total RPC level errors on the current connection.\n"
+		"# TYPE nfs_rpc_errors_total counter\n");
+	FOR_TARGETS for (j=0; j<NPROCS; j++) {
+		if (!snaps[i].have_stats[j])
+			continue;
+		out(o, "nfs_rpc_errors_total{" LABELS ",proc=\"%s\"} %lu\n",
+			T, procs[j].pd_name, snaps[i].stats[j].ps_errors);
+	}
+
+	out(o, "# HELP nfs_rpc_latency_seconds RPC round trip time.\n"
+		"# TYPE nfs_rpc_latency_seconds summary\n");
+	FOR_TARGETS for (j=0; j<NPROCS; j++) {
+		if (!snaps[i].have_stats[j])
+			continue;
+		ps=&snaps[i].stats[j];
+		l=procs[j].pd_name;
+		out(o, "nfs_rpc_latency_seconds{" LABELS ",proc=\"%s\",quantile=\"0.5\"} %.6f\n",
+			T, l, clnt_stats_percentile(ps, 50)/1000000.0);
+		out(o, "nfs_rpc_latency_seconds{" LABELS ",proc=\"%s\",quantile=\"0.99\"} %.6f\n",
+			T, l, clnt_stats_percentile(ps, 99)/1000000.0);
+		out(o, "nfs_rpc_latency_seconds{" LABELS ",proc=\"%s\",quantile=\"0.999\"} %.6f\n",
+			T, l, clnt_stats_percentile(ps, 99.9)/1000000.0);
+		out(o, "nfs_rpc_latency_seconds_sum{" LABELS ",proc=\"%s\"} %.6f\n",
+			T, l, ps->ps_sum_us/1000000.0);
+		out(o, "nfs_rpc_latency_seconds_count{" LABELS ",proc=\"%s\"} %lu\n",
+			T, l, ps->ps_calls);
+	}
+
+	out(o, "# HELP nfs_rpc_retransmissions_total Calls sent again after a timeout on the current connection.\n"
+		"# TYPE nfs_rpc_retransmissions_total counter\n");
+	FOR_TARGETS for (j=0; j<NPROCS; j++) {
+		if (!snaps[i].have_stats[j])
+			continue;
+		out(o, "nfs_rpc_retransmissions_total{" LABELS ",proc=\"%s\"} %lu\n",
+			T, procs[j].pd_name, snaps[i].stats[j].ps_retrans);
+	}
+
+	out(o, "# HELP nfs_rpc_srtt_seconds Smoothed round trip time of the NFS connection.\n"
+		"# TYPE nfs_rpc_srtt_seconds gauge\n");
+	FOR_TARGETS if (snaps[i].have_rtt && snaps[i].rtt.rs_samples)
+		out(o, "nfs_rpc_srtt_seconds{" LABELS "} %.6f\n",
+			T, snaps[i].rtt.rs_srtt_us/1000000.0);
+
+	out(o, "# HELP nfs_rpc_rto_seconds Retransmission timeout of the NFS connection.\n"
+		"# TYPE nfs_rpc_rto_seconds gauge\n");
+	FOR_TARGETS if (snaps[i].have_rtt)
+		out(o, "nfs_rpc_rto_seconds{" LABELS "} %.6f\n",
+			T, snaps[i].rtt.rs_rto_us/1000000.0);
+
+	free(snaps);
+}
+
+/* Escapes backslash, double quote and newline, as label values in
+ * the text format need. Returns NULL if out of memory.
+ */
+char *escape_label(const char *s)
+{
+	char *e, *p;
+
+	e=p=malloc(2*strlen(s)+1);
+	if (e == NULL)
+		return NULL;
+	for (; *s; s++) {
+		if (*s == '\\' || *s == '"') {
+			*p++='\\';
+			*p++=*s;
+		} else if (*s == '\n') {
+			*p++='\\';
+			*p++='n';
+		} else {
+			*p++=*s;
+		}
+	}
+	*p='\0';
+	return e;
+}
+
+/* Writes all of buf, returns -1 if the connection failed */
+int write_all(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n=write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf+=n;
+		len-=n;
+	}
+	return 0;
+}
+
+/* Answers one HTTP request. Only GET /metrics is served. */
+void serve(int fd)
+{
+	struct outbuf body, head;
+	struct timeval tv;
+	char req[1024];
+	size_t len=0;
+	ssize_t n;
+
+	/* Dont let a slow client hold up the others for long */
+	tv.tv_sec=5;
+	tv.tv_usec=0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+	/* The request line is all we need */
+	while (len < sizeof(req)-1 && memchr(req, '\n', len) == NULL) {
+		n=read(fd, req+len, sizeof(req)-1-len);
+		if (n <= 0)
+			return;
+		len+=n;
+	}
+	req[len]='\0';
+
+	memset(&body, 0, sizeof body);
+	memset(&head, 0, sizeof head);
+	if (strncmp(req, "GET /metrics ", 13) == 0
+			|| strncmp(req, "GET /metrics?", 13) == 0) {
+		metrics(&body);
+		out(&head, "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n");
+	} else {
+		out(&body, "Not found, try /metrics\n");
+		out(&head, "HTTP/1.0 404 Not Found\r\n"
+			"Content-Type: text/plain\r\n");
+	}
+	out(&head, "Content-Length: %lu\r\nConnection: close\r\n\r\n",
+			(unsigned long)body.len);
+
+	/* A client gone or too slow is simply dropped */
+	if (write_all(fd, head.buf, head.len) == 0)
+		write_all(fd, body.buf, body.len);
+
+	free(head.buf);
+	free(body.buf);
+}
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-l port] [-i interval] [-t timeout] "
+			"[-n probes] <server>:<export> ...\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	struct target *t;
+	char *colon;
+	int port=DEFAULT_PORT;
+	int lfd, fd, i, on=1;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	while (argc>2 && argv[1][0] == '-') {
+		if (argv[1][1] == 'l')
+			port=atoi(argv[2]);
+		else if (argv[1][1] == 'i')
+			interval=atoi(argv[2]);
+		else if (argv[1][1] == 't')
+			timeout_secs=atoi(argv[2]);
+		else if (argv[1][1] == 'n')
+			probes=atoi(argv[2]);
+		else
+			return usage();
+		argc-=2;
+		argv+=2;
+	}
+	if (argc < 2 || interval < 1 || timeout_secs < 1 || probes < 0)
+		return usage();
+
+	ntargets=argc-1;
+	targets=calloc(ntargets, sizeof(struct target));
+	if (targets == NULL) {
+		fprintf(stderr, "%s: out of memory\n", progname);
+		return 1;
+	}
+	for (i=0; i<ntargets; i++) {
+		t=&targets[i];
+		colon=strchr(argv[i+1], ':');
+		if (colon == NULL || colon[1] != '/')
+			return usage();
+		t->server=strdup(argv[i+1]);
+		t->server[colon-argv[i+1]]='\0';
+		t->export=colon+1;
+		t->lserver=escape_label(t->server);
+		t->lexport=escape_label(t->export);
+		if (t->lserver == NULL || t->lexport == NULL) {
+			fprintf(stderr, "%s: out of memory\n", progname);
+			return 1;
+		}
+		pthread_mutex_init(&t->lock, NULL);
+	}
+
+	/* A client hanging up on us should not kill the exporter */
+	signal(SIGPIPE, SIG_IGN);
+
+	lfd=socket(PF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family=AF_INET;
+	sin.sin_port=htons(port);
+	sin.sin_addr.s_addr=htonl(INADDR_ANY);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof sin) < 0
+			|| listen(lfd, 16) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	for (i=0; i<ntargets; i++)
+		if (pthread_create(&targets[i].thread, NULL, target_thread,
+					&targets[i]) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+
+	for (;;) {
+		fd=accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		serve(fd);
+		close(fd);
+	}
+}
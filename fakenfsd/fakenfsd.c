@@ -0,0 +1,2090 @@
+/*
+ *    fakenfsd, a small NFSv3 and MOUNT v3 server for benchmarks and tests.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The server is a single thread around ppoll(). NFS and MOUNT are both
+ * served on one TCP and one UDP port; with -m, the portmapper port is
+ * answered as well, so the checks find the server without options.
+ * Calls and replies are translated with the rpcgen routines from
+ * nfs3_xdr.c, the same ones the client library uses.
+ *
+ * The filesystem lives in memory. It can be seeded from a local
+ * directory, which is copied at startup; nothing is ever written back.
+ * File handles carry the node number and the server start time, so
+ * handles from an earlier run are answered with NFS3ERR_STALE.
+ *
+ * Replies can be delayed by a fixed latency plus a random jitter, and
+ * a percentage of calls can be failed or dropped. Delayed replies are
+ * kept in a list sorted by due time, so with jitter they may go out
+ * in a different order than the calls came in, just as with a real
+ * server. All randomness comes from one generator that can be seeded
+ * with -R, to make runs repeatable.
+ */
+
+#define _GNU_SOURCE
+#include <rpc/rpc.h>
+#include <rpc/pmap_prot.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+
+#include <nfs3.h>
+
+#define DEFAULT_PORT 20490
+#define DEFAULT_EXPORT "/export"
+#define DEFAULT_XFER 65536
+#define DEFAULT_CAPACITY (4LL*1024*1024*1024)
+
+/* Largest READ or WRITE we accept, and the buffer sizes derived from
+ * it. UDP transfers are limited to what fits into a datagram.
+ */
+#define MAXXFER (1024*1024)
+#define MAXMSG (MAXXFER+8192)
+#define MAXUDPXFER 32768
+#define MAXUDPMSG 65536
+
+#define FH_MAGIC 0x46414b45
+#define FH_SIZE 16
+#define FAKE_FSID 0x46414b45
+#define TOTAL_FILES (1<<20)
+
+char *progname;
+
+/* Configuration */
+char *export=DEFAULT_EXPORT;
+int exportlen;
+long long capacity=DEFAULT_CAPACITY;
+u_int32_t xfer_pref=DEFAULT_XFER;
+long latency_us=0;
+long jitter_us=0;
+double error_pct=0;
+double drop_pct=0;
+nfsstat3 error_stat=NFS3ERR_IO;
+int verbose=0;
+
+unsigned short rnd[3];
+u_int32_t boottime;
+
+/*
+ * The filesystem
+ */
+struct fnode;
+
+struct fdirent {
+	char *de_name;
+	struct fnode *de_node;
+	u_int64_t de_cookie;
+	struct fdirent *de_next;
+};
+
+struct fnode {
+	u_int64_t fn_id;
+	ftype3 fn_type;
+	u_int32_t fn_mode;
+	u_int32_t fn_uid;
+	u_int32_t fn_gid;
+	u_int32_t fn_nlink;
+	u_int64_t fn_size;
+
+	/* File contents, or the symlink target */
+	char *fn_data;
+	u_int64_t fn_cap;
+
+	/* Directory entries, in ascending cookie order. Cookies 1 and 2
+	 * are "." and "..".
+	 */
+	struct fdirent *fn_entries;
+	struct fdirent *fn_last;
+	u_int64_t fn_nextcookie;
+	struct fnode *fn_parent;
+
+	/* Verifier of an exclusive create */
+	char fn_verf[NFS3_CREATEVERFSIZE];
+
+	nfstime3 fn_atime;
+	nfstime3 fn_mtime;
+	nfstime3 fn_ctime;
+};
+
+/* Nodes by number. Numbers are never reused. */
+struct fnode **nodes;
+u_int64_t nodecap=0;
+u_int64_t nextid=1;
+u_int64_t nfiles=0;
+u_int64_t usedbytes=0;
+struct fnode *root;
+
+/* Clients that have mounted us, for MOUNT DUMP */
+struct mountent {
+	char *me_host;
+	char *me_dir;
+	struct mountent *me_next;
+};
+struct mountent *mounts;
+
+/* Address of the client whose call is being handled, and whether it
+ * came in over UDP.
+ */
+char *cur_peer;
+int cur_udp;
+
+/* Memory for results that is released after the reply is encoded */
+struct scratch {
+	struct scratch *s_next;
+};
+struct scratch *scratchlist;
+
+void *scratch(size_t len)
+{
+	struct scratch *s;
+
+	s=calloc(1, sizeof(struct scratch)+len);
+	if (s == NULL) {
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	s->s_next=scratchlist;
+	scratchlist=s;
+	return s+1;
+}
+
+void scratch_free(void)
+{
+	struct scratch *s;
+
+	while ((s=scratchlist) != NULL) {
+		scratchlist=s->s_next;
+		free(s);
+	}
+}
+
+void now(nfstime3 *t)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	t->seconds=tv.tv_sec;
+	t->nseconds=tv.tv_usec*1000;
+}
+
+struct fnode *node_new(ftype3 type, u_int32_t mode)
+{
+	struct fnode *n, **nn;
+	u_int64_t cap;
+
+	if (nfiles >= TOTAL_FILES)
+		return NULL;
+	if (nextid >= nodecap) {
+		cap=nodecap ? nodecap*2 : 1024;
+		nn=realloc(nodes, cap*sizeof(struct fnode *));
+		if (nn == NULL)
+			return NULL;
+		memset(nn+nodecap, 0, (cap-nodecap)*sizeof(struct fnode *));
+		nodes=nn;
+		nodecap=cap;
+	}
+	n=calloc(1, sizeof(struct fnode));
+	if (n == NULL)
+		return NULL;
+	n->fn_id=nextid++;
+	n->fn_type=type;
+	n->fn_mode=mode;
+	n->fn_nlink=(type == NF3DIR) ? 2 : 1;
+	n->fn_size=(type == NF3DIR) ? 4096 : 0;
+	n->fn_nextcookie=3;
+	now(&n->fn_atime);
+	n->fn_mtime=n->fn_ctime=n->fn_atime;
+	nodes[n->fn_id]=n;
+	nfiles++;
+	return n;
+}
+
+void node_free(struct fnode *n)
+{
+	nodes[n->fn_id]=NULL;
+	if (n->fn_type == NF3REG)
+		usedbytes-=n->fn_cap;
+	free(n->fn_data);
+	free(n);
+	nfiles--;
+}
+
+/* Sets the size of a regular file, zero filling when it grows */
+nfsstat3 node_resize(struct fnode *n, u_int64_t size)
+{
+	u_int64_t cap;
+	char *data;
+
+	/* Also keeps the doubling below from overflowing */
+	if (size > (u_int64_t)capacity)
+		return NFS3ERR_FBIG;
+	if (size > n->fn_cap) {
+		cap=n->fn_cap ? n->fn_cap : 4096;
+		while (cap < size)
+			cap*=2;
+		if (usedbytes+cap-n->fn_cap > capacity)
+			return NFS3ERR_NOSPC;
+		data=realloc(n->fn_data, cap);
+		if (data == NULL)
+			return NFS3ERR_NOSPC;
+		usedbytes+=cap-n->fn_cap;
+		n->fn_data=data;
+		n->fn_cap=cap;
+	}
+	if (size > n->fn_size)
+		memset(n->fn_data+n->fn_size, 0, size-n->fn_size);
+	n->fn_size=size;
+	return NFS3_OK;
+}
+
+void node_fh(struct fnode *n, nfs_fh3 *fh)
+{
+	u_int32_t *p;
+
+	p=scratch(FH_SIZE);
+	p[0]=htonl(FH_MAGIC);
+	p[1]=htonl(boottime);
+	p[2]=htonl(n->fn_id >> 32);
+	p[3]=htonl(n->fn_id & 0xffffffff);
+	fh->data.data_len=FH_SIZE;
+	fh->data.data_val=(char *)p;
+}
+
+nfsstat3 fh_node(nfs_fh3 *fh, struct fnode **np)
+{
+	u_int32_t p[4];
+	u_int64_t id;
+
+	if (fh->data.data_len != FH_SIZE)
+		return NFS3ERR_BADHANDLE;
+	memcpy(p, fh->data.data_val, FH_SIZE);
+	if (ntohl(p[0]) != FH_MAGIC)
+		return NFS3ERR_BADHANDLE;
+	id=((u_int64_t)ntohl(p[2]) << 32) | ntohl(p[3]);
+	if (ntohl(p[1]) != boottime || id >= nextid || nodes[id] == NULL)
+		return NFS3ERR_STALE;
+	*np=nodes[id];
+	return NFS3_OK;
+}
+
+nfsstat3 fh_dir(nfs_fh3 *fh, struct fnode **np)
+{
+	nfsstat3 stat;
+
+	if ((stat=fh_node(fh, np)) != NFS3_OK)
+		return stat;
+	if ((*np)->fn_type != NF3DIR)
+		return NFS3ERR_NOTDIR;
+	return NFS3_OK;
+}
+
+void node_attr(struct fnode *n, fattr3 *a)
+{
+	memset(a, 0, sizeof(fattr3));
+	a->type=n->fn_type;
+	a->mode=n->fn_mode & 07777;
+	a->nlink=n->fn_nlink;
+	a->uid=n->fn_uid;
+	a->gid=n->fn_gid;
+	a->size=n->fn_size;
+	a->used=(n->fn_size+4095) & ~4095ULL;
+	a->fsid=FAKE_FSID;
+	a->fileid=n->fn_id;
+	a->atime=n->fn_atime;
+	a->mtime=n->fn_mtime;
+	a->ctime=n->fn_ctime;
+}
+
+void post_attr(struct fnode *n, post_op_attr *p)
+{
+	if (n == NULL) {
+		p->attributes_follow=FALSE;
+		return;
+	}
+	p->attributes_follow=TRUE;
+	node_attr(n, &p->post_op_attr_u.attributes);
+}
+
+void pre_attr(struct fnode *n, pre_op_attr *p)
+{
+	if (n == NULL) {
+		p->attributes_follow=FALSE;
+		return;
+	}
+	p->attributes_follow=TRUE;
+	p->pre_op_attr_u.attributes.size=n->fn_size;
+	p->pre_op_attr_u.attributes.mtime=n->fn_mtime;
+	p->pre_op_attr_u.attributes.ctime=n->fn_ctime;
+}
+
+void modified(struct fnode *n)
+{
+	now(&n->fn_mtime);
+	n->fn_ctime=n->fn_mtime;
+}
+
+struct fdirent *dir_find(struct fnode *dir, char *name)
+{
+	struct fdirent *de;
+
+	for (de=dir->fn_entries; de != NULL; de=de->de_next)
+		if (strcmp(de->de_name, name) == 0)
+			return de;
+	return NULL;
+}
+
+int dir_empty(struct fnode *dir)
+{
+	return dir->fn_entries == NULL;
+}
+
+nfsstat3 dir_add(struct fnode *dir, char *name, struct fnode *n)
+{
+	struct fdirent *de;
+
+	de=calloc(1, sizeof(struct fdirent));
+	if (de == NULL || (de->de_name=strdup(name)) == NULL) {
+		free(de);
+		return NFS3ERR_NOSPC;
+	}
+	de->de_node=n;
+	de->de_cookie=dir->fn_nextcookie++;
+	if (dir->fn_last != NULL)
+		dir->fn_last->de_next=de;
+	else
+		dir->fn_entries=de;
+	dir->fn_last=de;
+	if (n->fn_type == NF3DIR) {
+		n->fn_parent=dir;
+		dir->fn_nlink++;
+	}
+	modified(dir);
+	return NFS3_OK;
+}
+
+/* Removes the entry from dir. The node is freed when this was its
+ * last link, unless keep is set.
+ */
+void dir_remove(struct fnode *dir, struct fdirent *de, int keep)
+{
+	struct fdirent **pp, *prev=NULL;
+	struct fnode *n=de->de_node;
+
+	for (pp=&dir->fn_entries; *pp != de; pp=&(*pp)->de_next)
+		prev=*pp;
+	*pp=de->de_next;
+	if (dir->fn_last == de)
+		dir->fn_last=prev;
+	free(de->de_name);
+	free(de);
+	modified(dir);
+
+	if (n->fn_type == NF3DIR) {
+		dir->fn_nlink--;
+		if (!keep)
+			node_free(n);
+	} else {
+		n->fn_nlink--;
+		now(&n->fn_ctime);
+		if (n->fn_nlink == 0 && !keep)
+			node_free(n);
+	}
+}
+
+nfsstat3 check_name(char *name)
+{
+	if (name == NULL || *name == '\0' || strchr(name, '/') != NULL)
+		return NFS3ERR_INVAL;
+	if (strlen(name) > MNTNAMLEN)
+		return NFS3ERR_NAMETOOLONG;
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+		return NFS3ERR_EXIST;
+	return NFS3_OK;
+}
+
+void apply_sattr(struct fnode *n, sattr3 *s)
+{
+	if (s->mode.set_it)
+		n->fn_mode=s->mode.set_mode3_u.mode & 07777;
+	if (s->uid.set_it)
+		n->fn_uid=s->uid.set_uid3_u.uid;
+	if (s->gid.set_it)
+		n->fn_gid=s->gid.set_gid3_u.gid;
+	if (s->atime.set_it == SET_TO_SERVER_TIME)
+		now(&n->fn_atime);
+	else if (s->atime.set_it == SET_TO_CLIENT_TIME)
+		n->fn_atime=s->atime.set_atime_u.atime;
+	if (s->mtime.set_it == SET_TO_SERVER_TIME)
+		now(&n->fn_mtime);
+	else if (s->mtime.set_it == SET_TO_CLIENT_TIME)
+		n->fn_mtime=s->mtime.set_mtime_u.mtime;
+	now(&n->fn_ctime);
+}
+
+/* Creates a node named name in dir, for CREATE, MKDIR and SYMLINK */
+nfsstat3 create_node(struct fnode *dir, char *name, ftype3 type,
+		u_int32_t mode, struct fnode **np)
+{
+	struct fnode *n;
+	nfsstat3 stat;
+
+	if ((stat=check_name(name)) != NFS3_OK)
+		return stat;
+	if (dir_find(dir, name) != NULL)
+		return NFS3ERR_EXIST;
+	if ((n=node_new(type, mode)) == NULL)
+		return NFS3ERR_NOSPC;
+	if ((stat=dir_add(dir, name, n)) != NFS3_OK) {
+		node_free(n);
+		return stat;
+	}
+	*np=n;
+	return NFS3_OK;
+}
+
+
+/*
+ * NFS procedures. Results are zeroed before the call, which makes
+ * every failure arm valid as it stands, so a procedure only needs to
+ * fill in what it has.
+ */
+void nfs_null(void *args, void *res)
+{
+}
+
+void nfs_getattr(GETATTR3args *args, GETATTR3res *res)
+{
+	struct fnode *n;
+
+	if ((res->status=fh_node(&args->object, &n)) != NFS3_OK)
+		return;
+	node_attr(n, &res->GETATTR3res_u.resok.obj_attributes);
+}
+
+void nfs_setattr(SETATTR3args *args, SETATTR3res *res)
+{
+	struct fnode *n;
+	wcc_data *wcc=&res->SETATTR3res_u.resok.obj_wcc;
+	nfstime3 *guard=&args->guard.sattrguard3_u.obj_ctime;
+
+	if ((res->status=fh_node(&args->object, &n)) != NFS3_OK)
+		return;
+	pre_attr(n, &wcc->before);
+	if (args->guard.check && (guard->seconds != n->fn_ctime.seconds
+			|| guard->nseconds != n->fn_ctime.nseconds))
+		res->status=NFS3ERR_NOT_SYNC;
+	else if (args->new_attributes.size.set_it && n->fn_type != NF3REG)
+		res->status=(n->fn_type == NF3DIR) ? NFS3ERR_ISDIR
+			: NFS3ERR_INVAL;
+	else if (args->new_attributes.size.set_it)
+		res->status=node_resize(n,
+			args->new_attributes.size.set_size3_u.size);
+	if (res->status == NFS3_OK)
+		apply_sattr(n, &args->new_attributes);
+	post_attr(n, &wcc->after);
+}
+
+void nfs_lookup(LOOKUP3args *args, LOOKUP3res *res)
+{
+	struct fnode *dir, *n=NULL;
+	struct fdirent *de;
+	char *name=args->what.name;
+	LOOKUP3resok *ok=&res->LOOKUP3res_u.resok;
+
+	if ((res->status=fh_dir(&args->what.dir, &dir)) != NFS3_OK) {
+		if (res->status == NFS3ERR_NOTDIR)
+			post_attr(dir, &res->LOOKUP3res_u.resfail.dir_attributes);
+		return;
+	}
+	if (strcmp(name, ".") == 0)
+		n=dir;
+	else if (strcmp(name, "..") == 0)
+		n=dir->fn_parent;
+	else if (strlen(name) > MNTNAMLEN)
+		res->status=NFS3ERR_NAMETOOLONG;
+	else if ((de=dir_find(dir, name)) != NULL)
+		n=de->de_node;
+	else
+		res->status=NFS3ERR_NOENT;
+
+	if (res->status != NFS3_OK) {
+		post_attr(dir, &res->LOOKUP3res_u.resfail.dir_attributes);
+		return;
+	}
+	node_fh(n, &ok->object);
+	post_attr(n, &ok->obj_attributes);
+	post_attr(dir, &ok->dir_attributes);
+}
+
+void nfs_access(ACCESS3args *args, ACCESS3res *res)
+{
+	struct fnode *n;
+
+	if ((res->status=fh_node(&args->object, &n)) != NFS3_OK)
+		return;
+	post_attr(n, &res->ACCESS3res_u.resok.obj_attributes);
+	res->ACCESS3res_u.resok.access=args->access;
+}
+
+void nfs_readlink(READLINK3args *args, READLINK3res *res)
+{
+	struct fnode *n;
+
+	if ((res->status=fh_node(&args->symlink, &n)) != NFS3_OK)
+		return;
+	if (n->fn_type != NF3LNK) {
+		res->status=NFS3ERR_INVAL;
+		post_attr(n, &res->READLINK3res_u.resfail.symlink_attributes);
+		return;
+	}
+	post_attr(n, &res->READLINK3res_u.resok.symlink_attributes);
+	res->READLINK3res_u.resok.data=n->fn_data;
+}
+
+void nfs_read(READ3args *args, READ3res *res)
+{
+	struct fnode *n;
+	READ3resok *ok=&res->READ3res_u.resok;
+	u_int32_t count=(u_int32_t)args->count;
+	u_int32_t max=cur_udp ? MAXUDPXFER : MAXXFER;
+
+	if ((res->status=fh_node(&args->file, &n)) != NFS3_OK)
+		return;
+	if (n->fn_type != NF3REG) {
+		res->status=(n->fn_type == NF3DIR) ? NFS3ERR_ISDIR
+			: NFS3ERR_INVAL;
+		post_attr(n, &res->READ3res_u.resfail.file_attributes);
+		return;
+	}
+	if (count > max)
+		count=max;
+	if (args->offset >= n->fn_size)
+		count=0;
+	else if (args->offset+count > n->fn_size)
+		count=n->fn_size-args->offset;
+	now(&n->fn_atime);
+
+	post_attr(n, &ok->file_attributes);
+	ok->count=count;
+	ok->eof=(args->offset+count >= n->fn_size);
+	ok->data.data_len=count;
+	ok->data.data_val=count ? n->fn_data+args->offset : "";
+}
+
+void nfs_write(WRITE3args *args, WRITE3res *res)
+{
+	struct fnode *n;
+	WRITE3resok *ok=&res->WRITE3res_u.resok;
+	u_int32_t count=(u_int32_t)args->count;
+	u_int32_t verf[2];
+
+	if ((res->status=fh_node(&args->file, &n)) != NFS3_OK)
+		return;
+	pre_attr(n, &ok->file_wcc.before);
+	if (n->fn_type != NF3REG)
+		res->status=(n->fn_type == NF3DIR) ? NFS3ERR_ISDIR
+			: NFS3ERR_INVAL;
+	else if (count > args->data.data_len || count > MAXXFER)
+		res->status=NFS3ERR_INVAL;
+	/* Checked without adding, a huge offset would wrap around */
+	else if (args->offset > (u_int64_t)capacity
+			|| count > (u_int64_t)capacity-args->offset)
+		res->status=NFS3ERR_FBIG;
+	else if (args->offset+count > n->fn_size)
+		res->status=node_resize(n, args->offset+count);
+	if (res->status != NFS3_OK) {
+		post_attr(n, &ok->file_wcc.after);
+		return;
+	}
+	memcpy(n->fn_data+args->offset, args->data.data_val, count);
+	modified(n);
+	post_attr(n, &ok->file_wcc.after);
+	ok->count=count;
+	ok->committed=args->stable;
+	verf[0]=htonl(boottime);
+	verf[1]=htonl(getpid());
+	memcpy(ok->verf, verf, NFS3_WRITEVERFSIZE);
+}
+
+void nfs_create(CREATE3args *args, CREATE3res *res)
+{
+	struct fnode *dir, *n=NULL;
+	struct fdirent *de;
+	CREATE3resok *ok=&res->CREATE3res_u.resok;
+	createhow3 *how=&args->how;
+	char *name=args->where.name;
+
+	if ((res->status=fh_dir(&args->where.dir, &dir)) != NFS3_OK)
+		return;
+	pre_attr(dir, &ok->dir_wcc.before);
+
+	de=dir_find(dir, name);
+	if (de != NULL && how->mode == GUARDED)
+		res->status=NFS3ERR_EXIST;
+	else if (de != NULL && how->mode == EXCLUSIVE) {
+		/* A retransmitted exclusive create succeeds */
+		n=de->de_node;
+		if (n->fn_type != NF3REG || memcmp(n->fn_verf,
+				how->createhow3_u.verf, NFS3_CREATEVERFSIZE))
+			res->status=NFS3ERR_EXIST;
+	} else if (de != NULL) {
+		n=de->de_node;
+		if (n->fn_type != NF3REG)
+			res->status=NFS3ERR_EXIST;
+		else if (how->createhow3_u.obj_attributes.size.set_it)
+			res->status=node_resize(n,
+			    how->createhow3_u.obj_attributes.size.set_size3_u.size);
+	} else if ((res->status=create_node(dir, name, NF3REG, 0644,
+					&n)) == NFS3_OK) {
+		if (how->mode == EXCLUSIVE)
+			memcpy(n->fn_verf, how->createhow3_u.verf,
+					NFS3_CREATEVERFSIZE);
+		else if (how->createhow3_u.obj_attributes.size.set_it)
+			res->status=node_resize(n,
+			    how->createhow3_u.obj_attributes.size.set_size3_u.size);
+	}
+	if (res->status == NFS3_OK && how->mode != EXCLUSIVE)
+		apply_sattr(n, &how->createhow3_u.obj_attributes);
+
+	post_attr(dir, &ok->dir_wcc.after);
+	if (res->status != NFS3_OK)
+		return;
+	ok->obj.handle_follows=TRUE;
+	node_fh(n, &ok->obj.post_op_fh3_u.handle);
+	post_attr(n, &ok->obj_attributes);
+}
+
+void nfs_mkdir(MKDIR3args *args, MKDIR3res *res)
+{
+	struct fnode *dir, *n;
+	MKDIR3resok *ok=&res->MKDIR3res_u.resok;
+
+	if ((res->status=fh_dir(&args->where.dir, &dir)) != NFS3_OK)
+		return;
+	pre_attr(dir, &ok->dir_wcc.before);
+	res->status=create_node(dir, args->where.name, NF3DIR, 0755, &n);
+	post_attr(dir, &ok->dir_wcc.after);
+	if (res->status != NFS3_OK)
+		return;
+	apply_sattr(n, &args->attributes);
+	ok->obj.handle_follows=TRUE;
+	node_fh(n, &ok->obj.post_op_fh3_u.handle);
+	post_attr(n, &ok->obj_attributes);
+}
+
+void nfs_symlink(SYMLINK3args *args, SYMLINK3res *res)
+{
+	struct fnode *dir, *n;
+	SYMLINK3resok *ok=&res->SYMLINK3res_u.resok;
+	char *target=args->symlink.symlink_data;
+
+	if ((res->status=fh_dir(&args->where.dir, &dir)) != NFS3_OK)
+		return;
+	pre_attr(dir, &ok->dir_wcc.before);
+	if (strlen(target) >= MNTPATHLEN)
+		res->status=NFS3ERR_NAMETOOLONG;
+	else
+		res->status=create_node(dir, args->where.name, NF3LNK, 0777,
+				&n);
+	if (res->status == NFS3_OK && (n->fn_data=strdup(target)) == NULL) {
+		dir_remove(dir, dir_find(dir, args->where.name), 0);
+		res->status=NFS3ERR_NOSPC;
+	}
+	post_attr(dir, &ok->dir_wcc.after);
+	if (res->status != NFS3_OK)
+		return;
+	n->fn_size=strlen(target);
+	apply_sattr(n, &args->symlink.symlink_attributes);
+	ok->obj.handle_follows=TRUE;
+	node_fh(n, &ok->obj.post_op_fh3_u.handle);
+	post_attr(n, &ok->obj_attributes);
+}
+
+void nfs_mknod(MKNOD3args *args, MKNOD3res *res)
+{
+	struct fnode *dir;
+
+	if ((res->status=fh_dir(&args->where.dir, &dir)) != NFS3_OK)
+		return;
+	res->status=NFS3ERR_NOTSUPP;
+	pre_attr(dir, &res->MKNOD3res_u.resfail.dir_wcc.before);
+	post_attr(dir, &res->MKNOD3res_u.resfail.dir_wcc.after);
+}
+
+void nfs_remove(REMOVE3args *args, REMOVE3res *res)
+{
+	struct fnode *dir;
+	struct fdirent *de;
+	wcc_data *wcc=&res->REMOVE3res_u.resok.dir_wcc;
+
+	if ((res->status=fh_dir(&args->object.dir, &dir)) != NFS3_OK)
+		return;
+	pre_attr(dir, &wcc->before);
+	if ((de=dir_find(dir, args->object.name)) == NULL)
+		res->status=NFS3ERR_NOENT;
+	else if (de->de_node->fn_type == NF3DIR)
+		res->status=NFS3ERR_ISDIR;
+	else
+		dir_remove(dir, de, 0);
+	post_attr(dir, &wcc->after);
+}
+
+void nfs_rmdir(RMDIR3args *args, RMDIR3res *res)
+{
+	struct fnode *dir;
+	struct fdirent *de=NULL;
+	char *name=args->object.name;
+	wcc_data *wcc=&res->RMDIR3res_u.resok.dir_wcc;
+
+	if ((res->status=fh_dir(&args->object.dir, &dir)) != NFS3_OK)
+		return;
+	pre_attr(dir, &wcc->before);
+	if (strcmp(name, ".") == 0)
+		res->status=NFS3ERR_INVAL;
+	else if (strcmp(name, "..") == 0)
+		res->status=NFS3ERR_EXIST;
+	else if ((de=dir_find(dir, name)) == NULL)
+		res->status=NFS3ERR_NOENT;
+	else if (de->de_node->fn_type != NF3DIR)
+		res->status=NFS3ERR_NOTDIR;
+	else if (!dir_empty(de->de_node))
+		res->status=NFS3ERR_NOTEMPTY;
+	else
+		dir_remove(dir, de, 0);
+	post_attr(dir, &wcc->after);
+}
+
+nfsstat3 do_rename(struct fnode *from, char *fname, struct fnode *to,
+		char *tname)
+{
+	struct fdirent *src, *dst;
+	struct fnode *n, *d;
+	nfsstat3 stat;
+
+	if ((src=dir_find(from, fname)) == NULL)
+		return NFS3ERR_NOENT;
+	if ((stat=check_name(tname)) != NFS3_OK)
+		return stat;
+	n=src->de_node;
+
+	/* A directory cannot move below itself */
+	if (n->fn_type == NF3DIR)
+		for (d=to; ; d=d->fn_parent) {
+			if (d == n)
+				return NFS3ERR_INVAL;
+			if (d == root)
+				break;
+		}
+
+	if ((dst=dir_find(to, tname)) != NULL) {
+		if (dst->de_node == n)
+			return NFS3_OK;
+		if (n->fn_type == NF3DIR && dst->de_node->fn_type != NF3DIR)
+			return NFS3ERR_NOTDIR;
+		if (n->fn_type != NF3DIR && dst->de_node->fn_type == NF3DIR)
+			return NFS3ERR_ISDIR;
+		if (dst->de_node->fn_type == NF3DIR
+				&& !dir_empty(dst->de_node))
+			return NFS3ERR_NOTEMPTY;
+	}
+	/* Add the new name first, so running out of memory leaves the
+	 * old one in place.
+	 */
+	n->fn_nlink++;
+	if ((stat=dir_add(to, tname, n)) != NFS3_OK) {
+		n->fn_nlink--;
+		return stat;
+	}
+	if (dst != NULL)
+		dir_remove(to, dst, 0);
+	dir_remove(from, src, 1);
+	if (n->fn_type == NF3DIR)
+		n->fn_nlink--;
+	return NFS3_OK;
+}
+
+void nfs_rename(RENAME3args *args, RENAME3res *res)
+{
+	struct fnode *from, *to;
+	RENAME3resok *ok=&res->RENAME3res_u.resok;
+
+	if ((res->status=fh_dir(&args->from.dir, &from)) != NFS3_OK)
+		return;
+	if ((res->status=fh_dir(&args->to.dir, &to)) != NFS3_OK)
+		return;
+	pre_attr(from, &ok->fromdir_wcc.before);
+	pre_attr(to, &ok->todir_wcc.before);
+	res->status=do_rename(from, args->from.name, to, args->to.name);
+	post_attr(from, &ok->fromdir_wcc.after);
+	post_attr(to, &ok->todir_wcc.after);
+}
+
+void nfs_link(LINK3args *args, LINK3res *res)
+{
+	struct fnode *n, *dir;
+	LINK3resok *ok=&res->LINK3res_u.resok;
+
+	if ((res->status=fh_node(&args->file, &n)) != NFS3_OK)
+		return;
+	if ((res->status=fh_dir(&args->link.dir, &dir)) != NFS3_OK) {
+		post_attr(n, &ok->file_attributes);
+		return;
+	}
+	pre_attr(dir, &ok->linkdir_wcc.before);
+	if (n->fn_type == NF3DIR)
+		res->status=NFS3ERR_ISDIR;
+	else if ((res->status=check_name(args->link.name)) != NFS3_OK)
+		;
+	else if (dir_find(dir, args->link.name) != NULL)
+		res->status=NFS3ERR_EXIST;
+	else if ((res->status=dir_add(dir, args->link.name, n)) == NFS3_OK) {
+		n->fn_nlink++;
+		now(&n->fn_ctime);
+	}
+	post_attr(n, &ok->file_attributes);
+	post_attr(dir, &ok->linkdir_wcc.after);
+}
+
+/* Returns the directory entries after cookie, including "." and ".."
+ * as cookies 1 and 2, one at a time. *pos keeps the position.
+ */
+int dir_next(struct fnode *dir, u_int64_t cookie, struct fdirent **pos,
+		struct fdirent *out)
+{
+	struct fdirent *de;
+
+	if (cookie < 2) {
+		out->de_name=(cookie == 0) ? "." : "..";
+		out->de_node=(cookie == 0) ? dir : dir->fn_parent;
+		out->de_cookie=cookie+1;
+		*pos=NULL;
+		return 1;
+	}
+	de=*pos;
+	if (de == NULL)
+		for (de=dir->fn_entries; de != NULL
+				&& de->de_cookie <= cookie; de=de->de_next)
+			;
+	else
+		de=de->de_next;
+	if (de == NULL)
+		return 0;
+	*out=*de;
+	*pos=de;
+	return 1;
+}
+
+/* Size of an entry in the reply */
+#define ENTRY_SIZE(name) (24+((strlen(name)+3) & ~3))
+#define ATTR_SIZE 88
+#define DIRREPLY_SIZE (4+ATTR_SIZE+8+8)
+
+void nfs_readdir(READDIR3args *args, READDIR3res *res)
+{
+	struct fnode *dir;
+	struct fdirent *pos=NULL, de;
+	READDIR3resok *ok=&res->READDIR3res_u.resok;
+	entry3 *e, **tail=&ok->reply.entries;
+	u_int64_t cookie=args->cookie;
+	u_int32_t size=DIRREPLY_SIZE;
+	int n=0;
+
+	if ((res->status=fh_dir(&args->dir, &dir)) != NFS3_OK)
+		return;
+	post_attr(dir, &ok->dir_attributes);
+	ok->reply.eof=TRUE;
+	while (dir_next(dir, cookie, &pos, &de)) {
+		size+=ENTRY_SIZE(de.de_name);
+		if (size > args->count) {
+			ok->reply.eof=FALSE;
+			break;
+		}
+		e=scratch(sizeof(entry3));
+		e->fileid=de.de_node->fn_id;
+		e->name=de.de_name;
+		e->cookie=de.de_cookie;
+		*tail=e;
+		tail=&e->nextentry;
+		cookie=de.de_cookie;
+		n++;
+	}
+	if (n == 0 && !ok->reply.eof) {
+		res->status=NFS3ERR_TOOSMALL;
+		post_attr(dir, &res->READDIR3res_u.resfail.dir_attributes);
+	}
+}
+
+void nfs_readdirplus(READDIRPLUS3args *args, READDIRPLUS3res *res)
+{
+	struct fnode *dir;
+	struct fdirent *pos=NULL, de;
+	READDIRPLUS3resok *ok=&res->READDIRPLUS3res_u.resok;
+	entryplus3 *e, **tail=&ok->reply.entries;
+	u_int64_t cookie=args->cookie;
+	u_int32_t size=DIRREPLY_SIZE, dsize=0;
+	int n=0;
+
+	if ((res->status=fh_dir(&args->dir, &dir)) != NFS3_OK)
+		return;
+	post_attr(dir, &ok->dir_attributes);
+	ok->reply.eof=TRUE;
+	while (dir_next(dir, cookie, &pos, &de)) {
+		size+=ENTRY_SIZE(de.de_name)+4+ATTR_SIZE+8+FH_SIZE;
+		dsize+=ENTRY_SIZE(de.de_name);
+		if (size > args->maxcount || dsize > args->dircount) {
+			ok->reply.eof=FALSE;
+			break;
+		}
+		e=scratch(sizeof(entryplus3));
+		e->fileid=de.de_node->fn_id;
+		e->name=de.de_name;
+		e->cookie=de.de_cookie;
+		post_attr(de.de_node, &e->name_attributes);
+		e->name_handle.handle_follows=TRUE;
+		node_fh(de.de_node, &e->name_handle.post_op_fh3_u.handle);
+		*tail=e;
+		tail=&e->nextentry;
+		cookie=de.de_cookie;
+		n++;
+	}
+	if (n == 0 && !ok->reply.eof) {
+		res->status=NFS3ERR_TOOSMALL;
+		post_attr(dir,
+			&res->READDIRPLUS3res_u.resfail.dir_attributes);
+	}
+}
+
+void nfs_fsstat(FSSTAT3args *args, FSSTAT3res *res)
+{
+	struct fnode *n;
+	FSSTAT3resok *ok=&res->FSSTAT3res_u.resok;
+
+	if ((res->status=fh_node(&args->fsroot, &n)) != NFS3_OK)
+		return;
+	post_attr(n, &ok->obj_attributes);
+	ok->tbytes=capacity;
+	ok->fbytes=ok->abytes=capacity-usedbytes;
+	ok->tfiles=TOTAL_FILES;
+	ok->ffiles=ok->afiles=TOTAL_FILES-nfiles;
+	ok->invarsec=0;
+}
+
+void nfs_fsinfo(FSINFOargs *args, FSINFO3res *res)
+{
+	struct fnode *n;
+	FSINFO3resok *ok=&res->FSINFO3res_u.resok;
+
+	if ((res->status=fh_node(&args->fsroot, &n)) != NFS3_OK)
+		return;
+	post_attr(n, &ok->obj_attributes);
+	ok->rtmax=ok->wtmax=MAXXFER;
+	ok->rtpref=ok->wtpref=xfer_pref;
+	ok->rtmult=ok->wtmult=4096;
+	ok->dtpref=8192;
+	ok->maxfilesize=capacity;
+	ok->time_delta.seconds=0;
+	ok->time_delta.nseconds=1000;
+	ok->properties=FSF3_LINK|FSF3_SYMLINK|FSF3_HOMOGENEOUS|FSF3_CANSETTIME;
+}
+
+void nfs_pathconf(PATHCONF3args *args, PATHCONF3res *res)
+{
+	struct fnode *n;
+	PATHCONF3resok *ok=&res->PATHCONF3res_u.resok;
+
+	if ((res->status=fh_node(&args->object, &n)) != NFS3_OK)
+		return;
+	post_attr(n, &ok->obj_attributes);
+	ok->linkmax=32000;
+	ok->name_max=MNTNAMLEN;
+	ok->no_trunc=TRUE;
+	ok->chown_restricted=TRUE;
+	ok->case_insensitive=FALSE;
+	ok->case_preserving=TRUE;
+}
+
+void nfs_commit(COMMIT3args *args, COMMIT3res *res)
+{
+	struct fnode *n;
+	COMMIT3resok *ok=&res->COMMIT3res_u.resok;
+	u_int32_t verf[2];
+
+	if ((res->status=fh_node(&args->file, &n)) != NFS3_OK)
+		return;
+	pre_attr(n, &ok->file_wcc.before);
+	post_attr(n, &ok->file_wcc.after);
+	if (n->fn_type != NF3REG) {
+		res->status=(n->fn_type == NF3DIR) ? NFS3ERR_ISDIR
+			: NFS3ERR_INVAL;
+		return;
+	}
+	verf[0]=htonl(boottime);
+	verf[1]=htonl(getpid());
+	memcpy(ok->verf, verf, NFS3_WRITEVERFSIZE);
+}
+
+
+/*
+ * MOUNT procedures
+ */
+int auth_flavors[]={ AUTH_UNIX };
+
+void mnt_null(void *args, void *res)
+{
+}
+
+void mnt_mnt(dirpath *args, mountres3 *res)
+{
+	struct fnode *n=root;
+	struct fdirent *de;
+	struct mountent *me;
+	char *path=*args, *comp, *next;
+
+	if (strncmp(path, export, exportlen) != 0
+			|| (path[exportlen] != '\0' && path[exportlen] != '/')) {
+		res->fhs_status=MNT3ERR_NOENT;
+		return;
+	}
+
+	/* Mounting below the export is allowed, like most servers do */
+	comp=scratch(strlen(path)+1);
+	strcpy(comp, path+exportlen);
+	for (; comp != NULL; comp=next) {
+		while (*comp == '/')
+			comp++;
+		if (*comp == '\0')
+			break;
+		if ((next=strchr(comp, '/')) != NULL)
+			*next++='\0';
+		if (n->fn_type != NF3DIR) {
+			res->fhs_status=MNT3ERR_NOTDIR;
+			return;
+		}
+		if ((de=dir_find(n, comp)) == NULL) {
+			res->fhs_status=MNT3ERR_NOENT;
+			return;
+		}
+		n=de->de_node;
+	}
+	if (n->fn_type != NF3DIR) {
+		res->fhs_status=MNT3ERR_NOTDIR;
+		return;
+	}
+
+	for (me=mounts; me != NULL; me=me->me_next)
+		if (strcmp(me->me_host, cur_peer) == 0
+				&& strcmp(me->me_dir, path) == 0)
+			break;
+	if (me == NULL && (me=calloc(1, sizeof(struct mountent))) != NULL) {
+		me->me_host=strdup(cur_peer);
+		me->me_dir=strdup(path);
+		me->me_next=mounts;
+		mounts=me;
+	}
+
+	res->fhs_status=MNT3_OK;
+	node_fh(n, (nfs_fh3 *)&res->mountres3_u.mountinfo.fhandle);
+	res->mountres3_u.mountinfo.auth_flavors.auth_flavors_len=1;
+	res->mountres3_u.mountinfo.auth_flavors.auth_flavors_val=auth_flavors;
+}
+
+void mnt_dump(void *args, mountlist *res)
+{
+	struct mountent *me;
+	struct mountbody *mb;
+
+	for (me=mounts; me != NULL; me=me->me_next) {
+		mb=scratch(sizeof(struct mountbody));
+		mb->ml_hostname=me->me_host;
+		mb->ml_directory=me->me_dir;
+		mb->ml_next=*res;
+		*res=mb;
+	}
+}
+
+/* Forgets the mounts of the calling client, of dir or of everything */
+void unmount(char *dir)
+{
+	struct mountent **pp, *me;
+
+	for (pp=&mounts; (me=*pp) != NULL; ) {
+		if (strcmp(me->me_host, cur_peer) == 0
+				&& (dir == NULL || strcmp(me->me_dir, dir) == 0)) {
+			*pp=me->me_next;
+			free(me->me_host);
+			free(me->me_dir);
+			free(me);
+		} else
+			pp=&me->me_next;
+	}
+}
+
+void mnt_umnt(dirpath *args, void *res)
+{
+	unmount(*args);
+}
+
+void mnt_umntall(void *args, void *res)
+{
+	unmount(NULL);
+}
+
+void mnt_export(void *args, exports *res)
+{
+	struct exportnode *ex;
+
+	ex=scratch(sizeof(struct exportnode));
+	ex->ex_dir=export;
+	*res=ex;
+}
+
+
+/*
+ * Portmapper, only GETPORT. Everything we serve is on one port.
+ */
+int port;
+
+void pmap_null(void *args, void *res)
+{
+}
+
+void pmap_lookup(struct pmap *args, u_long *res)
+{
+	if ((args->pm_prog == NFS_PROGRAM && args->pm_vers == NFS_V3)
+			|| (args->pm_prog == MOUNT_PROGRAM
+				&& args->pm_vers == MOUNT_V3))
+		*res=port;
+	else
+		*res=0;
+}
+
+
+/*
+ * Dispatch
+ */
+typedef void (*procfn)(void *, void *);
+
+struct proc {
+	char *p_name;
+	xdrproc_t p_args;
+	size_t p_argsize;
+	xdrproc_t p_res;
+	size_t p_ressize;
+	procfn p_fn;
+};
+
+#define PROC(name, fn, argt, rest) { name, (xdrproc_t)xdr_##argt, \
+	sizeof(argt), (xdrproc_t)xdr_##rest, sizeof(rest), (procfn)fn }
+#define VOIDPROC(name, fn) { name, (xdrproc_t)xdr_void, 0, \
+	(xdrproc_t)xdr_void, 0, (procfn)fn }
+
+struct proc nfs_procs[]={
+	VOIDPROC("null", nfs_null),
+	PROC("getattr", nfs_getattr, GETATTR3args, GETATTR3res),
+	PROC("setattr", nfs_setattr, SETATTR3args, SETATTR3res),
+	PROC("lookup", nfs_lookup, LOOKUP3args, LOOKUP3res),
+	PROC("access", nfs_access, ACCESS3args, ACCESS3res),
+	PROC("readlink", nfs_readlink, READLINK3args, READLINK3res),
+	PROC("read", nfs_read, READ3args, READ3res),
+	PROC("write", nfs_write, WRITE3args, WRITE3res),
+	PROC("create", nfs_create, CREATE3args, CREATE3res),
+	PROC("mkdir", nfs_mkdir, MKDIR3args, MKDIR3res),
+	PROC("symlink", nfs_symlink, SYMLINK3args, SYMLINK3res),
+	PROC("mknod", nfs_mknod, MKNOD3args, MKNOD3res),
+	PROC("remove", nfs_remove, REMOVE3args, REMOVE3res),
+	PROC("rmdir", nfs_rmdir, RMDIR3args, RMDIR3res),
+	PROC("rename", nfs_rename, RENAME3args, RENAME3res),
+	PROC("link", nfs_link, LINK3args, LINK3res),
+	PROC("readdir", nfs_readdir, READDIR3args, READDIR3res),
+	PROC("readdirplus", nfs_readdirplus, READDIRPLUS3args,
+			READDIRPLUS3res),
+	PROC("fsstat", nfs_fsstat, FSSTAT3args, FSSTAT3res),
+	PROC("fsinfo", nfs_fsinfo, FSINFOargs, FSINFO3res),
+	PROC("pathconf", nfs_pathconf, PATHCONF3args, PATHCONF3res),
+	PROC("commit", nfs_commit, COMMIT3args, COMMIT3res),
+};
+
+struct proc mnt_procs[]={
+	VOIDPROC("mnt_null", mnt_null),
+	{ "mnt", (xdrproc_t)xdr_dirpath, sizeof(dirpath),
+		(xdrproc_t)xdr_mountres3, sizeof(mountres3), (procfn)mnt_mnt },
+	{ "dump", (xdrproc_t)xdr_void, 0,
+		(xdrproc_t)xdr_mountlist, sizeof(mountlist), (procfn)mnt_dump },
+	{ "umnt", (xdrproc_t)xdr_dirpath, sizeof(dirpath),
+		(xdrproc_t)xdr_void, 0, (procfn)mnt_umnt },
+	VOIDPROC("umntall", mnt_umntall),
+	{ "export", (xdrproc_t)xdr_void, 0,
+		(xdrproc_t)xdr_exports, sizeof(exports), (procfn)mnt_export },
+};
+
+struct proc pmap_procs[]={
+	VOIDPROC("pmap_null", pmap_null),
+	VOIDPROC("pmap_set", NULL),
+	VOIDPROC("pmap_unset", NULL),
+	{ "getport", (xdrproc_t)xdr_pmap, sizeof(struct pmap),
+		(xdrproc_t)xdr_u_long, sizeof(u_long), (procfn)pmap_lookup },
+};
+
+struct program {
+	u_long pg_prog;
+	u_long pg_vers;
+	struct proc *pg_procs;
+	int pg_nprocs;
+} programs[]={
+	{ NFS_PROGRAM, NFS_V3, nfs_procs,
+		sizeof(nfs_procs)/sizeof(struct proc) },
+	{ MOUNT_PROGRAM, MOUNT_V3, mnt_procs,
+		sizeof(mnt_procs)/sizeof(struct proc) },
+	{ PMAPPROG, PMAPVERS, pmap_procs,
+		sizeof(pmap_procs)/sizeof(struct proc) },
+};
+#define NPROGRAMS (sizeof(programs)/sizeof(struct program))
+
+/* xdr_free() leaves x_public uninitialized, which the WRITE3args
+ * routine looks at.
+ */
+void free_args(xdrproc_t proc, void *args)
+{
+	XDR xdrs;
+
+	memset(&xdrs, 0, sizeof xdrs);
+	xdrs.x_op=XDR_FREE;
+	proc(&xdrs, args);
+}
+
+double random_pct(void)
+{
+	return erand48(rnd)*100;
+}
+
+/* Decodes and runs one call in msg. The reply is encoded into out.
+ * Returns the length of the reply, or 0 if none should be sent.
+ */
+int handle_call(char *msg, int len, char *out, int outlen)
+{
+	XDR xdrs;
+	struct rpc_msg call, reply;
+	char credbuf[MAX_AUTH_BYTES], verfbuf[MAX_AUTH_BYTES];
+	struct program *pg=NULL;
+	struct proc *p=NULL;
+	void *args=NULL, *res=NULL;
+	u_long prog, vers, proc;
+	int i, rlen;
+
+	memset(&call, 0, sizeof call);
+	call.rm_call.cb_cred.oa_base=credbuf;
+	call.rm_call.cb_verf.oa_base=verfbuf;
+	xdrmem_create(&xdrs, msg, len, XDR_DECODE);
+	xdrs.x_public=NULL;
+	if (!xdr_callmsg(&xdrs, &call) || call.rm_direction != CALL) {
+		xdr_destroy(&xdrs);
+		return 0;
+	}
+	prog=call.rm_call.cb_prog;
+	vers=call.rm_call.cb_vers;
+	proc=call.rm_call.cb_proc;
+
+	memset(&reply, 0, sizeof reply);
+	reply.rm_xid=call.rm_xid;
+	reply.rm_direction=REPLY;
+	reply.rm_reply.rp_stat=MSG_ACCEPTED;
+	reply.acpted_rply.ar_verf=_null_auth;
+	reply.acpted_rply.ar_stat=SUCCESS;
+	reply.acpted_rply.ar_results.where=NULL;
+	reply.acpted_rply.ar_results.proc=(xdrproc_t)xdr_void;
+
+	for (i=0; i<NPROGRAMS; i++)
+		if (programs[i].pg_prog == prog)
+			pg=&programs[i];
+
+	if (call.rm_call.cb_rpcvers != RPC_MSG_VERSION) {
+		reply.rm_reply.rp_stat=MSG_DENIED;
+		reply.rjcted_rply.rj_stat=RPC_MISMATCH;
+		reply.rjcted_rply.rj_vers.low=RPC_MSG_VERSION;
+		reply.rjcted_rply.rj_vers.high=RPC_MSG_VERSION;
+	} else if (pg == NULL) {
+		reply.acpted_rply.ar_stat=PROG_UNAVAIL;
+	} else if (pg->pg_vers != vers) {
+		reply.acpted_rply.ar_stat=PROG_MISMATCH;
+		reply.acpted_rply.ar_vers.low=pg->pg_vers;
+		reply.acpted_rply.ar_vers.high=pg->pg_vers;
+	} else if (proc >= pg->pg_nprocs || pg->pg_procs[proc].p_fn == NULL) {
+		reply.acpted_rply.ar_stat=PROC_UNAVAIL;
+	} else {
+		p=&pg->pg_procs[proc];
+		args=calloc(1, p->p_argsize+1);
+		res=calloc(1, p->p_ressize+1);
+		if (args == NULL || res == NULL) {
+			reply.acpted_rply.ar_stat=SYSTEM_ERR;
+		} else if (!p->p_args(&xdrs, args)) {
+			reply.acpted_rply.ar_stat=GARBAGE_ARGS;
+		} else {
+			if (verbose)
+				fprintf(stderr, "%s: %s %s\n", progname,
+						cur_peer, p->p_name);
+			if (prog == NFS_PROGRAM && proc != NFS3_NULL
+					&& error_pct > 0
+					&& random_pct() < error_pct)
+				*(nfsstat3 *)res=error_stat;
+			else
+				p->p_fn(args, res);
+			reply.acpted_rply.ar_results.where=res;
+			reply.acpted_rply.ar_results.proc=p->p_res;
+		}
+	}
+	xdr_destroy(&xdrs);
+
+	xdrmem_create(&xdrs, out, outlen, XDR_ENCODE);
+	xdrs.x_public=NULL;
+	if (!xdr_replymsg(&xdrs, &reply)) {
+		/* Did not fit */
+		xdr_destroy(&xdrs);
+		xdrmem_create(&xdrs, out, outlen, XDR_ENCODE);
+		xdrs.x_public=NULL;
+		reply.acpted_rply.ar_stat=SYSTEM_ERR;
+		reply.acpted_rply.ar_results.where=NULL;
+		reply.acpted_rply.ar_results.proc=(xdrproc_t)xdr_void;
+		xdr_replymsg(&xdrs, &reply);
+	}
+	rlen=xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	if (args != NULL) {
+		if (p != NULL)
+			free_args(p->p_args, args);
+		free(args);
+	}
+	free(res);
+	scratch_free();
+
+	if (prog != PMAPPROG && drop_pct > 0 && random_pct() < drop_pct)
+		return 0;
+	return rlen;
+}
+
+
+/*
+ * Connections and delayed replies
+ */
+struct outbuf {
+	char *ob_buf;
+	int ob_len;
+	int ob_off;
+	struct outbuf *ob_next;
+};
+
+struct conn {
+	int c_fd;
+	char c_peer[INET6_ADDRSTRLEN];
+
+	/* Bytes read, and the record assembled from fragments so far */
+	char *c_in;
+	int c_inlen;
+	int c_incap;
+	char *c_rec;
+	int c_reclen;
+	int c_reccap;
+
+	/* Replies not yet written */
+	struct outbuf *c_out;
+	struct outbuf *c_outlast;
+
+	int c_dead;
+	struct conn *c_next;
+};
+struct conn *conns;
+int nconns=0;
+
+struct pending {
+	struct timespec pd_due;
+	struct conn *pd_conn;
+	int pd_fd;
+	struct sockaddr_storage pd_addr;
+	socklen_t pd_addrlen;
+	char *pd_buf;
+	int pd_len;
+	struct pending *pd_next;
+};
+struct pending *pendings;
+
+char *replybuf;
+
+void ts_now(struct timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+int ts_before(struct timespec *a, struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec
+		|| (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* Delay for the next reply, in microseconds */
+long reply_delay(void)
+{
+	long delay=latency_us;
+
+	if (jitter_us > 0)
+		delay+=(long)(erand48(rnd)*(2*jitter_us+1))-jitter_us;
+	return delay > 0 ? delay : 0;
+}
+
+void conn_close(struct conn *c)
+{
+	struct outbuf *ob;
+	struct pending **pp, *pd;
+
+	if (c->c_dead)
+		return;
+	close(c->c_fd);
+	c->c_dead=1;
+	while ((ob=c->c_out) != NULL) {
+		c->c_out=ob->ob_next;
+		free(ob->ob_buf);
+		free(ob);
+	}
+	for (pp=&pendings; (pd=*pp) != NULL; ) {
+		if (pd->pd_conn == c) {
+			*pp=pd->pd_next;
+			free(pd->pd_buf);
+			free(pd);
+		} else
+			pp=&pd->pd_next;
+	}
+}
+
+/* Writes as much of the queued output as the socket takes */
+void conn_flush(struct conn *c)
+{
+	struct outbuf *ob;
+	int n;
+
+	while ((ob=c->c_out) != NULL) {
+		n=write(c->c_fd, ob->ob_buf+ob->ob_off, ob->ob_len-ob->ob_off);
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				conn_close(c);
+			return;
+		}
+		ob->ob_off+=n;
+		if (ob->ob_off < ob->ob_len)
+			return;
+		c->c_out=ob->ob_next;
+		if (c->c_out == NULL)
+			c->c_outlast=NULL;
+		free(ob->ob_buf);
+		free(ob);
+	}
+}
+
+/* Sends a record marked reply. buf may be replybuf, so it is copied
+ * if it cannot be written at once.
+ */
+void conn_send(struct conn *c, char *buf, int len)
+{
+	struct outbuf *ob;
+	int n=0;
+
+	if (c->c_out == NULL) {
+		n=write(c->c_fd, buf, len);
+		if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			conn_close(c);
+			return;
+		}
+		if (n < 0)
+			n=0;
+		if (n == len)
+			return;
+	}
+	ob=calloc(1, sizeof(struct outbuf));
+	if (ob == NULL || (ob->ob_buf=malloc(len-n)) == NULL) {
+		free(ob);
+		conn_close(c);
+		return;
+	}
+	memcpy(ob->ob_buf, buf+n, len-n);
+	ob->ob_len=len-n;
+	if (c->c_outlast != NULL)
+		c->c_outlast->ob_next=ob;
+	else
+		c->c_out=ob;
+	c->c_outlast=ob;
+}
+
+void deliver(struct conn *c, int fd, struct sockaddr *addr,
+		socklen_t addrlen, char *buf, int len)
+{
+	if (c != NULL)
+		conn_send(c, buf, len);
+	else
+		sendto(fd, buf, len, 0, addr, addrlen);
+}
+
+/* Sends the reply now, or queues it for later if there is latency */
+void reply(struct conn *c, int fd, struct sockaddr *addr,
+		socklen_t addrlen, char *buf, int len)
+{
+	struct pending *pd, **pp;
+	long delay=reply_delay();
+
+	if (delay == 0) {
+		deliver(c, fd, addr, addrlen, buf, len);
+		return;
+	}
+	pd=calloc(1, sizeof(struct pending));
+	if (pd == NULL || (pd->pd_buf=malloc(len)) == NULL) {
+		free(pd);
+		return;
+	}
+	memcpy(pd->pd_buf, buf, len);
+	pd->pd_len=len;
+	pd->pd_conn=c;
+	pd->pd_fd=fd;
+	if (addr != NULL)
+		memcpy(&pd->pd_addr, addr, addrlen);
+	pd->pd_addrlen=addrlen;
+	ts_now(&pd->pd_due);
+	pd->pd_due.tv_sec+=delay/1000000;
+	pd->pd_due.tv_nsec+=(delay%1000000)*1000;
+	if (pd->pd_due.tv_nsec >= 1000000000) {
+		pd->pd_due.tv_sec++;
+		pd->pd_due.tv_nsec-=1000000000;
+	}
+	for (pp=&pendings; *pp != NULL
+			&& !ts_before(&pd->pd_due, &(*pp)->pd_due);
+			pp=&(*pp)->pd_next)
+		;
+	pd->pd_next=*pp;
+	*pp=pd;
+}
+
+void run_pending(void)
+{
+	struct pending *pd;
+	struct timespec ts;
+
+	ts_now(&ts);
+	while ((pd=pendings) != NULL && !ts_before(&ts, &pd->pd_due)) {
+		pendings=pd->pd_next;
+		deliver(pd->pd_conn, pd->pd_fd, (struct sockaddr *)&pd->pd_addr,
+				pd->pd_addrlen, pd->pd_buf, pd->pd_len);
+		free(pd->pd_buf);
+		free(pd);
+	}
+}
+
+void peer_name(struct sockaddr *sa, char *buf, int len)
+{
+	if (sa->sa_family == AF_INET)
+		inet_ntop(AF_INET, &((struct sockaddr_in *)sa)->sin_addr,
+				buf, len);
+	else
+		inet_ntop(AF_INET6, &((struct sockaddr_in6 *)sa)->sin6_addr,
+				buf, len);
+}
+
+int grow(char **buf, int *cap, int need)
+{
+	char *p;
+	int ncap=*cap ? *cap : 65536;
+
+	if (need <= *cap)
+		return 0;
+	while (ncap < need)
+		ncap*=2;
+	if ((p=realloc(*buf, ncap)) == NULL)
+		return -1;
+	*buf=p;
+	*cap=ncap;
+	return 0;
+}
+
+void conn_record(struct conn *c)
+{
+	int len;
+
+	cur_peer=c->c_peer;
+	cur_udp=0;
+	len=handle_call(c->c_rec, c->c_reclen, replybuf+4, MAXMSG);
+	if (len == 0)
+		return;
+	*(u_int32_t *)replybuf=htonl(0x80000000 | len);
+	reply(c, -1, NULL, 0, replybuf, len+4);
+}
+
+/* Reads from the connection and handles every complete record */
+void conn_read(struct conn *c)
+{
+	u_int32_t hdr, flen;
+	int n, off=0;
+
+	if (grow(&c->c_in, &c->c_incap, c->c_inlen+65536) < 0) {
+		conn_close(c);
+		return;
+	}
+	n=read(c->c_fd, c->c_in+c->c_inlen, c->c_incap-c->c_inlen);
+	if (n <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EINTR))
+			conn_close(c);
+		return;
+	}
+	c->c_inlen+=n;
+
+	while (!c->c_dead && c->c_inlen-off >= 4) {
+		memcpy(&hdr, c->c_in+off, 4);
+		hdr=ntohl(hdr);
+		flen=hdr & 0x7fffffff;
+		if (c->c_reclen+flen > MAXMSG) {
+			conn_close(c);
+			return;
+		}
+		if (c->c_inlen-off-4 < flen) {
+			if (grow(&c->c_in, &c->c_incap, flen+4) < 0)
+				conn_close(c);
+			break;
+		}
+		if (grow(&c->c_rec, &c->c_reccap, c->c_reclen+flen) < 0) {
+			conn_close(c);
+			return;
+		}
+		memcpy(c->c_rec+c->c_reclen, c->c_in+off+4, flen);
+		c->c_reclen+=flen;
+		off+=4+flen;
+		if (hdr & 0x80000000) {
+			conn_record(c);
+			c->c_reclen=0;
+		}
+	}
+	if (!c->c_dead && off > 0) {
+		memmove(c->c_in, c->c_in+off, c->c_inlen-off);
+		c->c_inlen-=off;
+	}
+}
+
+void udp_read(int fd)
+{
+	static char buf[MAXUDPMSG];
+	struct sockaddr_storage addr;
+	socklen_t addrlen=sizeof addr;
+	char peer[INET6_ADDRSTRLEN];
+	int n;
+
+	n=recvfrom(fd, buf, sizeof buf, 0, (struct sockaddr *)&addr,
+			&addrlen);
+	if (n <= 0)
+		return;
+	peer_name((struct sockaddr *)&addr, peer, sizeof peer);
+	cur_peer=peer;
+	cur_udp=1;
+	n=handle_call(buf, n, replybuf, MAXUDPMSG);
+	if (n > 0)
+		reply(NULL, fd, (struct sockaddr *)&addr, addrlen, replybuf, n);
+}
+
+void tcp_accept(int lfd)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen=sizeof addr;
+	struct conn *c;
+	int fd, on=1;
+
+	fd=accept(lfd, (struct sockaddr *)&addr, &addrlen);
+	if (fd < 0)
+		return;
+	c=calloc(1, sizeof(struct conn));
+	if (c == NULL) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+	c->c_fd=fd;
+	peer_name((struct sockaddr *)&addr, c->c_peer, sizeof c->c_peer);
+	c->c_next=conns;
+	conns=c;
+	nconns++;
+	if (verbose)
+		fprintf(stderr, "%s: connection from %s\n", progname,
+				c->c_peer);
+}
+
+int open_socket(struct in_addr *bindaddr, int port, int type)
+{
+	struct sockaddr_in sin;
+	int fd, on=1;
+
+	fd=socket(PF_INET, type, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+	memset(&sin, 0, sizeof sin);
+	sin.sin_family=AF_INET;
+	sin.sin_port=htons(port);
+	sin.sin_addr=*bindaddr;
+	if (bind(fd, (struct sockaddr *)&sin, sizeof sin) < 0
+			|| (type == SOCK_STREAM && listen(fd, 64) < 0)) {
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+void serve(int *tcpfds, int *udpfds, int nfds)
+{
+	struct pollfd *pfd=NULL;
+	struct conn *c, **cp, *first;
+	struct timespec ts, due, *timeout;
+	int npfd=0, n, i;
+
+	for (;;) {
+		if (npfd < 2*nfds+nconns) {
+			npfd=2*nfds+nconns+64;
+			free(pfd);
+			pfd=calloc(npfd, sizeof(struct pollfd));
+			if (pfd == NULL) {
+				fprintf(stderr, "%s: out of memory\n", progname);
+				exit(1);
+			}
+		}
+		n=0;
+		for (i=0; i<nfds; i++) {
+			pfd[n].fd=tcpfds[i];
+			pfd[n++].events=POLLIN;
+			pfd[n].fd=udpfds[i];
+			pfd[n++].events=POLLIN;
+		}
+		for (c=conns; c != NULL; c=c->c_next) {
+			pfd[n].fd=c->c_fd;
+			pfd[n++].events=POLLIN | (c->c_out ? POLLOUT : 0);
+		}
+
+		timeout=NULL;
+		if (pendings != NULL) {
+			ts_now(&ts);
+			due=pendings->pd_due;
+			if (ts_before(&ts, &due)) {
+				due.tv_sec-=ts.tv_sec;
+				due.tv_nsec-=ts.tv_nsec;
+				if (due.tv_nsec < 0) {
+					due.tv_sec--;
+					due.tv_nsec+=1000000000;
+				}
+			} else
+				due.tv_sec=due.tv_nsec=0;
+			timeout=&due;
+		}
+		if (ppoll(pfd, n, timeout, NULL) < 0 && errno != EINTR) {
+			perror("ppoll");
+			exit(1);
+		}
+		/* Connections accepted below are added at the head, and
+		 * are not in the poll array yet.
+		 */
+		first=conns;
+		run_pending();
+
+		n=0;
+		for (i=0; i<nfds; i++) {
+			if (pfd[n++].revents & POLLIN)
+				tcp_accept(tcpfds[i]);
+			if (pfd[n++].revents & POLLIN)
+				udp_read(udpfds[i]);
+		}
+		for (c=first; c != NULL; c=c->c_next, n++) {
+			if (!c->c_dead
+				&& (pfd[n].revents & (POLLIN | POLLHUP | POLLERR)))
+				conn_read(c);
+			if (!c->c_dead && (pfd[n].revents & POLLOUT))
+				conn_flush(c);
+		}
+
+		for (cp=&conns; (c=*cp) != NULL; ) {
+			if (c->c_dead) {
+				if (verbose)
+					fprintf(stderr, "%s: %s disconnected\n",
+							progname, c->c_peer);
+				*cp=c->c_next;
+				free(c->c_in);
+				free(c->c_rec);
+				free(c);
+				nconns--;
+			} else
+				cp=&c->c_next;
+		}
+	}
+}
+
+
+/*
+ * Filesystem setup
+ */
+
+/* Copies the directory tree at path into dir */
+void seed_dir(struct fnode *dir, char *path)
+{
+	DIR *d;
+	struct dirent *ent;
+	struct stat st;
+	struct fnode *n;
+	char *sub;
+	int fd, len;
+	ssize_t got;
+
+	if ((d=opendir(path)) == NULL) {
+		perror(path);
+		return;
+	}
+	while ((ent=readdir(d)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0
+				|| strcmp(ent->d_name, "..") == 0)
+			continue;
+		len=strlen(path)+strlen(ent->d_name)+2;
+		sub=malloc(len);
+		if (sub == NULL)
+			break;
+		snprintf(sub, len, "%s/%s", path, ent->d_name);
+		if (lstat(sub, &st) < 0) {
+			perror(sub);
+			free(sub);
+			continue;
+		}
+		n=NULL;
+		if (S_ISDIR(st.st_mode)) {
+			if (create_node(dir, ent->d_name, NF3DIR, st.st_mode,
+						&n) == NFS3_OK)
+				seed_dir(n, sub);
+		} else if (S_ISLNK(st.st_mode)) {
+			if (create_node(dir, ent->d_name, NF3LNK, st.st_mode,
+						&n) == NFS3_OK
+					&& (n->fn_data=calloc(1,
+						st.st_size+1)) != NULL
+					&& (got=readlink(sub, n->fn_data,
+						st.st_size)) > 0)
+				n->fn_size=got;
+		} else if (S_ISREG(st.st_mode)) {
+			if (create_node(dir, ent->d_name, NF3REG, st.st_mode,
+						&n) == NFS3_OK
+					&& node_resize(n, st.st_size) == NFS3_OK
+					&& (fd=open(sub, O_RDONLY)) >= 0) {
+				for (got=0; got < st.st_size; got+=len)
+					if ((len=read(fd, n->fn_data+got,
+						st.st_size-got)) <= 0)
+						break;
+				close(fd);
+			} else
+				fprintf(stderr, "%s: %s not copied\n",
+						progname, sub);
+		}
+		if (n != NULL) {
+			n->fn_mode=st.st_mode & 07777;
+			n->fn_uid=st.st_uid;
+			n->fn_gid=st.st_gid;
+			n->fn_atime.seconds=st.st_atime;
+			n->fn_mtime.seconds=st.st_mtime;
+			n->fn_ctime.seconds=st.st_ctime;
+		}
+		free(sub);
+	}
+	closedir(d);
+}
+
+/* Creates a file filled with a pattern that makes misplaced reads
+ * easy to spot: every 8 byte word holds its own offset.
+ */
+int make_file(char *name, long long size)
+{
+	struct fnode *n;
+	u_int64_t off, v;
+
+	if (create_node(root, name, NF3REG, 0644, &n) != NFS3_OK
+			|| node_resize(n, size) != NFS3_OK)
+		return -1;
+	for (off=0; off+8 <= size; off+=8) {
+		v=off;
+		memcpy(n->fn_data+off, &v, 8);
+	}
+	return 0;
+}
+
+long long argtonum(char *str)
+{
+	char *end;
+	long long result;
+
+	result=strtoll(str, &end, 10);
+	switch (*end) {
+	case 'K': case 'k': result*=1024; break;
+	case 'M': case 'm': result*=1024*1024; break;
+	case 'G': case 'g': result*=1024LL*1024*1024; break;
+	}
+	return result;
+}
+
+struct {
+	char *name;
+	nfsstat3 stat;
+} errnames[]={
+	{ "io", NFS3ERR_IO },
+	{ "jukebox", NFS3ERR_JUKEBOX },
+	{ "stale", NFS3ERR_STALE },
+	{ "serverfault", NFS3ERR_SERVERFAULT },
+	{ "acces", NFS3ERR_ACCES },
+	{ "nospc", NFS3ERR_NOSPC },
+	{ NULL, 0 }
+};
+
+int usage(void)
+{
+	fprintf(stderr, "USAGE: %s [-p port] [-b address] [-m] [-x export] "
+			"[-d directory]\n"
+			"\t[-f size] [-s capacity] [-r xfersize] "
+			"[-L latency_ms] [-J jitter_ms]\n"
+			"\t[-E error_pct] [-S status] [-D drop_pct] "
+			"[-R seed] [-v]\n", progname);
+	return 3;
+}
+
+int main(int argc, char *argv[])
+{
+	struct in_addr bindaddr;
+	int tcpfds[2], udpfds[2], nfds=0;
+	int pmap=0, i;
+	char *seeddir=NULL;
+	long long filesize=-1;
+	long seed;
+
+	progname=argv[0];
+	if (strrchr(progname, '/')!=NULL)
+		progname=strrchr(progname, '/')+1;
+
+	port=DEFAULT_PORT;
+	bindaddr.s_addr=htonl(INADDR_LOOPBACK);
+	seed=time(NULL) ^ getpid();
+
+	while (argc>1 && argv[1][0] == '-') {
+		if (argv[1][1] == 'm' || argv[1][1] == 'v') {
+			if (argv[1][1] == 'm')
+				pmap=1;
+			else
+				verbose=1;
+			argc--;
+			argv++;
+			continue;
+		}
+		if (argc < 3)
+			return usage();
+		switch (argv[1][1]) {
+		case 'p': port=atoi(argv[2]); break;
+		case 'b':
+			if (inet_aton(argv[2], &bindaddr) == 0)
+				return usage();
+			break;
+		case 'x': export=argv[2]; break;
+		case 'd': seeddir=argv[2]; break;
+		case 'f': filesize=argtonum(argv[2]); break;
+		case 's': capacity=argtonum(argv[2]); break;
+		case 'r': xfer_pref=argtonum(argv[2]); break;
+		case 'L': latency_us=atof(argv[2])*1000; break;
+		case 'J': jitter_us=atof(argv[2])*1000; break;
+		case 'E': error_pct=atof(argv[2]); break;
+		case 'D': drop_pct=atof(argv[2]); break;
+		case 'R': seed=atol(argv[2]); break;
+		case 'S':
+			for (i=0; errnames[i].name != NULL; i++)
+				if (strcasecmp(argv[2], errnames[i].name) == 0)
+					break;
+			if (errnames[i].name != NULL)
+				error_stat=errnames[i].stat;
+			else if ((error_stat=atoi(argv[2])) == 0)
+				return usage();
+			break;
+		default:
+			return usage();
+		}
+		argc-=2;
+		argv+=2;
+	}
+	if (argc > 1 || port <= 0 || export[0] != '/' || xfer_pref < 4096
+			|| xfer_pref > MAXXFER || latency_us < 0
+			|| jitter_us < 0)
+		return usage();
+	exportlen=strlen(export);
+	while (exportlen > 1 && export[exportlen-1] == '/')
+		export[--exportlen]='\0';
+
+	rnd[0]=0x330e;
+	rnd[1]=seed & 0xffff;
+	rnd[2]=(seed >> 16) & 0xffff;
+	boottime=time(NULL);
+
+	replybuf=malloc(MAXMSG+4);
+	root=node_new(NF3DIR, 0755);
+	if (replybuf == NULL || root == NULL) {
+		fprintf(stderr, "%s: out of memory\n", progname);
+		return 1;
+	}
+	root->fn_parent=root;
+	if (seeddir != NULL)
+		seed_dir(root, seeddir);
+	if (filesize >= 0 && make_file("testfile", filesize) < 0) {
+		fprintf(stderr, "%s: cannot create a file of %lld bytes\n",
+				progname, filesize);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	tcpfds[nfds]=open_socket(&bindaddr, port, SOCK_STREAM);
+	udpfds[nfds]=open_socket(&bindaddr, port, SOCK_DGRAM);
+	if (tcpfds[nfds] < 0 || udpfds[nfds] < 0) {
+		perror("bind");
+		return 1;
+	}
+	nfds++;
+	if (pmap) {
+		tcpfds[nfds]=open_socket(&bindaddr, PMAPPORT, SOCK_STREAM);
+		udpfds[nfds]=open_socket(&bindaddr, PMAPPORT, SOCK_DGRAM);
+		if (tcpfds[nfds] < 0 || udpfds[nfds] < 0) {
+			perror("bind portmapper");
+			return 1;
+		}
+		nfds++;
+	}
+	if (verbose)
+		fprintf(stderr, "%s: serving %s on port %d\n", progname,
+				export, port);
+
+	serve(tcpfds, udpfds, nfds);
+	return 0;
+}
@@ -49,6 +49,10 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 /* User callback type */
 typedef void (*user_cb)(void *msg_buf, int bufsz, void *priv);
@@ -61,8 +65,10 @@ typedef void (*user_cb)(void *msg_buf, int bufsz, void *priv);
 /* Default size for read and write syscalls */
 #define ASYNC_READ_BUF 4096
 	
-/* Size of the bucket for the xid to user callback map */
-#define BUCKET_XID 100000
+/* Calls in flight the xid to user callback map has room for at first,
+ * it grows when more are sent.
+ */
+#define BUCKET_XID 1024
 /* Bucket size for the file descriptor to ctdata map */
 #define BUCKET_FD 10
 
@@ -91,6 +97,87 @@ typedef void (*user_cb)(void *msg_buf, int bufsz, void *priv);
 #define read_rpc_response(flag) (!((flag) & RPC_NO_RX))
 
 
+/* Per procedure call statistics.
+ *
+ * Latencies are measured from the moment a call is handed to the
+ * transport until its reply has been decoded, in microseconds, and
+ * kept in a log-linear histogram: values below CLNT_HIST_SUB have a
+ * bucket each, above that every power of two is split into
+ * CLNT_HIST_SUB buckets. The relative error of a percentile is then
+ * at most 1/CLNT_HIST_SUB, whatever the scale.
+ */
+#define CLNT_HIST_SUB 8
+#define CLNT_HIST_BUCKETS ((32 - 2) * CLNT_HIST_SUB)
+
+/* Procedures numbered at or above this are not recorded. NFSv3 has 22,
+ * MOUNT 6.
+ */
+#define CLNT_MAXPROC 32
+
+/* Reconnecting as turned on by NFSC_CFL_RECONNECT, see
+ * clnttcp_nb_set_reconnect(). It is off for a new handle.
+ */
+#define CLNT_RECONNECT_ATTEMPTS 8
+#define CLNT_RECONNECT_MIN_MS 100
+#define CLNT_RECONNECT_MAX_MS 5000
+
+/* Retransmission as turned on by NFSC_CFL_RETRANS, see
+ * clnttcp_nb_set_retrans(). It is off for a new handle. The timeout
+ * before the first reply is CLNT_RTO_INIT_MS; the timeouts are long
+ * since a server that is merely slow gets non-idempotent calls twice.
+ */
+#define CLNT_RETRANS 4
+#define CLNT_RTO_MIN_MS 10000
+#define CLNT_RTO_MAX_MS 60000
+#define CLNT_RTO_INIT_MS 20000
+
+struct clnt_proc_stats {
+	/* Replies received */
+	unsigned long ps_calls;
+
+	/* Replies that were denied, or accepted with a status other
+	 * than SUCCESS. Errors returned by the program itself, like an
+	 * NFS3ERR_NOENT, are not seen at this level.
+	 */
+	unsigned long ps_errors;
+
+	/* Bytes of complete calls handed to the socket, and of replies
+	 * received, including the RPC headers.
+	 */
+	unsigned long long ps_txbytes;
+	unsigned long long ps_rxbytes;
+
+	/* Latency in microseconds */
+	unsigned long long ps_sum_us;
+	u_int32_t ps_min_us;
+	u_int32_t ps_max_us;
+	u_int32_t ps_hist[CLNT_HIST_BUCKETS];
+
+	/* Calls sent again after a timeout, and calls failed after
+	 * their last one.
+	 */
+	unsigned long ps_retrans;
+	unsigned long ps_timeouts;
+};
+
+/* Round trip times of a connection, estimated as by Jacobson and
+ * Karels from the replies to calls that were sent once only.
+ */
+struct clnt_rtt_stats {
+	/* Smoothed round trip time and its mean deviation */
+	u_int32_t rs_srtt_us;
+	u_int32_t rs_rttvar_us;
+
+	/* Retransmission timeout: srtt + 4 * rttvar, within the limits
+	 * given to clnttcp_nb_set_retrans().
+	 */
+	u_int32_t rs_rto_us;
+
+	unsigned long rs_samples;
+	unsigned long rs_retrans;
+	unsigned long rs_timeouts;
+};
+
 /* Creates a non-blcking RPC handle. */
 extern CLIENT *clnttcp_nb_create(struct sockaddr_in *raddr, u_long prog,
 		u_long vers, int *sockp, u_int sbufsz, u_int rbufsz);
@@ -99,14 +186,165 @@ extern CLIENT *clnttcp_nb_create(struct sockaddr_in *raddr, u_long prog,
 extern CLIENT * clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 		u_long vers, int *sockp, u_int sbufsz, u_int rbufsz);
 
+/* Creates a non-blocking RPC handle that is not connected yet. The
+ * first call connects without blocking, the way a broken connection
+ * is made again, so reconnecting must be turned on with
+ * clnttcp_nb_set_reconnect() before it; until connected
+ * clnttcp_nb_fd() is -1. Only the portmapper lookup, if raddr has no
+ * port, still blocks here.
+ */
+extern CLIENT *clnttcp_nb_create_deferred(struct sockaddr_in *raddr,
+		u_long prog, u_long vers, u_int sbufsz, u_int rbufsz);
+
 extern enum clnt_stat clnttcp_nb_call(CLIENT *handle, u_long proc,
 		xdrproc_t inproc, caddr_t inargs, user_cb callback,
 		void * usercb_priv);
    
 extern int clnttcp_nb_receive(CLIENT * handle, int flag);
+extern int clnttcp_nb_setbufsz(CLIENT *handle, u_int sbufsz, u_int rbufsz);
 extern unsigned long clnttcp_datatx(CLIENT * handle);
 extern unsigned long clnttcp_datarx(CLIENT * handle);
 
 extern void clnttcp_nb_destroy (CLIENT *h);
 
+/* Socket of the handle, for callers that want to wait for replies
+ * with their own select() or poll(), e.g. to apply a timeout.
+ */
+extern int clnttcp_nb_fd(CLIENT *handle);
+
+/* Calls awaiting a reply, and bytes of calls not written to the
+ * socket yet. An event loop waits for the socket to be readable
+ * while the first is non-zero, and writable while the second is.
+ */
+extern int clnttcp_nb_pending(CLIENT *handle);
+extern unsigned long clnttcp_nb_unsent(CLIENT *handle);
+
+/* Gives up on all pending calls, calling their callbacks with a NULL
+ * message. Returns the number of calls failed, -1 if out of memory.
+ */
+extern int clnttcp_nb_fail(CLIENT *handle);
+
+/* Calls made between clnttcp_nb_batch_begin() and
+ * clnttcp_nb_batch_end() are encoded and queued, but not written to
+ * the socket, and no replies are read meanwhile. batch_end() then
+ * writes them all out with one sendmsg() where the socket takes
+ * them, and reads the replies already in, returning the number of
+ * callbacks called like a non-blocking clnttcp_nb_receive(). Pairs
+ * nest, only the outermost end sends.
+ */
+extern void clnttcp_nb_batch_begin(CLIENT *handle);
+extern int clnttcp_nb_batch_end(CLIENT *handle);
+
+/* Cork mode: with bytes other than 0, calls are queued until that
+ * many bytes are, and then sent together, instead of one by one as
+ * they are made. Whatever is queued is also sent by
+ * clnttcp_nb_flush() and by every clnttcp_nb_receive(), so an event
+ * loop sends the calls made in one round at the start of the next:
+ * clnttcp_nb_events() asks for POLLOUT while any are queued. Turning
+ * it off (bytes 0) sends what is queued. The latency of a call is
+ * counted from when it was made, time spent queued included.
+ * clnttcp_nb_flush() returns the bytes the socket did not take.
+ */
+extern int clnttcp_nb_set_cork(CLIENT *handle, unsigned long bytes);
+extern unsigned long clnttcp_nb_flush(CLIENT *handle);
+
+/* Withdraws a pending call: its callback is not called, a reply that
+ * still comes is ignored, and if nothing of it has been written to
+ * the socket yet it is not sent at all. clnttcp_nb_xid() is the xid
+ * of the last call made on the handle. clnttcp_nb_cancel() returns
+ * 0, or -1 if no call with that xid is pending;
+ * clnttcp_nb_cancel_priv() withdraws all calls made with priv as
+ * the argument for their callback and returns their number, -1 if
+ * out of memory. Either may be called from a callback, also from
+ * one of a call failed with the connection: the calls failed with
+ * it that were not called back yet can still be withdrawn.
+ */
+extern u_int32_t clnttcp_nb_xid(CLIENT *handle);
+extern int clnttcp_nb_cancel(CLIENT *handle, u_int32_t xid);
+extern int clnttcp_nb_cancel_priv(CLIENT *handle, void *priv);
+
+/* For event loops: the poll() events to wait for on clnttcp_nb_fd(),
+ * which is -1 while reconnecting, and the milliseconds until
+ * clnttcp_nb_receive() is due even without any, or -1.
+ */
+extern int clnttcp_nb_events(CLIENT *handle);
+extern int clnttcp_nb_timeout(CLIENT *handle);
+
+/* When the connection breaks, up to attempts tries to connect again
+ * are made from a reserved port, the first right away and the next
+ * after min_ms, doubling up to max_ms. Once connected, the pending
+ * calls are sent again with their original xids, so that the
+ * server's duplicate request cache answers those it has executed
+ * already. Calls made meanwhile wait for the new connection. When
+ * the attempts run out the pending calls fail, their callbacks get
+ * a NULL message, and clnt_geterr() reports RPC_CANTRECV; the next
+ * call starts over. Blocking waits in clnttcp_nb_receive() wait for
+ * all this, non-blocking ones go as far as they can without waiting.
+ *
+ * Every call is kept as sent until its reply arrives, for sending it
+ * again. attempts of 0, the default, turns that off: the pending
+ * calls fail as soon as the connection breaks, and later calls with
+ * RPC_CANTSEND. It can only be turned on while no calls are pending,
+ * or while retransmission keeps copies anyway.
+ * Returns 0, or -1 if not possible.
+ */
+extern int clnttcp_nb_set_reconnect(CLIENT *handle, int attempts,
+		int min_ms, int max_ms);
+extern unsigned long clnttcp_nb_reconnects(CLIENT *handle);
+
+/* Sets TCP_NODELAY on the connection and on every one made again
+ * later, also on a deferred handle that is not connected yet.
+ * Returns 0, or -1 if setting it failed.
+ */
+extern int clnttcp_nb_set_nodelay(CLIENT *handle, int on);
+
+/* A call without a reply after the retransmission timeout is sent
+ * again with the same xid, up to retries times, each time waiting
+ * twice as long as before, up to max_ms. When the last timeout
+ * expires the call fails: its callback gets a NULL message and
+ * clnt_geterr() reports RPC_TIMEDOUT.
+ *
+ * Over TCP the server gets every call, so a timeout only counts
+ * when there are signs it dropped the call: it answered a later
+ * one, or nothing at all since the timer started. While it answers
+ * earlier calls it is taken to be working through a backlog, and
+ * while calls wait to be written to the socket it is not reading;
+ * then the timer just starts over. When nothing comes back, one
+ * call per timeout is sent again as a probe, the timeouts of the
+ * others back off and count all the same.
+ *
+ * The timeout adapts to the round trip times seen, between min_ms
+ * and max_ms, see struct clnt_rtt_stats. Timers only run inside
+ * clnttcp_nb_receive(); clnttcp_nb_timeout() tells event loops when
+ * the next one is due. retries of 0, the default, turns
+ * retransmission off, calls then wait for their reply forever.
+ * Turning it on or off is only possible while no calls are pending.
+ * Returns 0, or -1 if not possible.
+ */
+extern int clnttcp_nb_set_retrans(CLIENT *handle, int retries, int min_ms,
+		int max_ms);
+
+/* Returns the statistics of proc, or NULL if no call to it has been
+ * sent yet. The returned struct is updated in place as replies come in.
+ */
+extern struct clnt_proc_stats *clnttcp_proc_stats(CLIENT *handle,
+		u_long proc);
+extern void clnttcp_reset_stats(CLIENT *handle);
+
+/* Round trip time statistics of the connection, updated in place.
+ * clnttcp_reset_stats() clears the counters, but not the estimates.
+ */
+extern struct clnt_rtt_stats *clnttcp_rtt_stats(CLIENT *handle);
+
+/* Latency in microseconds below which p percent of the replies
+ * arrived. Accurate to the width of the histogram bucket, and never
+ * more than the largest latency seen.
+ */
+extern u_int32_t clnt_stats_percentile(struct clnt_proc_stats *ps,
+		double p);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
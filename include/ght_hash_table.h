@@ -94,7 +94,8 @@ typedef struct s_hash_key
 /*
  * The structure for hash entries.
  *
- * LOCK: Should be possible to do somewhat atomically
+ * Tables are not thread safe, except those made by
+ * ght_create_sharded().
  */
 typedef struct s_hash_entry
 {
@@ -117,6 +118,9 @@ typedef struct
 {
   ght_hash_entry_t *p_entry; /* The current entry */
   ght_hash_entry_t *p_next;  /* The next entry */
+  int i_slot;                /* The current slot of a flat table, or
+			      * shard of a sharded one */
+  int i_next;                /* The next slot of a flat table */
 } ght_iterator_t;
 
 /**
@@ -185,6 +189,15 @@ typedef struct
 
   ght_hash_entry_t *p_oldest;        /* The entry inserted the earliest. */
   ght_hash_entry_t *p_newest;        /* The entry inserted the latest. */
+
+  /* The buckets being rehashed from, NULL if no rehash is going on */
+  ght_hash_entry_t **pp_old_entries;
+  int *p_old_nr;
+  unsigned int i_old_size;
+  unsigned int i_migrated;           /* Old buckets moved so far */
+
+  struct ght_flat *p_flat;           /* Set for ght_create_flat() tables */
+  struct ght_shards *p_shards;       /* Set for ght_create_sharded() tables */
 } ght_hash_table_t;
 
 /**
@@ -193,9 +206,9 @@ typedef struct
  * good performance. The number of buckets is rounded to the next
  * higher power of two.
  *
- * The hash table is created with @c ght_one_at_a_time_hash() as hash
- * function, automatic rehashing disabled, @c malloc() as the memory
- * allocator and no heuristics.
+ * The hash table is created with the hash function returned by
+ * @c ght_fastest_hash(), automatic rehashing disabled, @c malloc() as
+ * the memory allocator and no heuristics.
  *
  * @param i_size the number of buckets in the hash table. Giving a
  *        non-power of two here will round the size up to the next
@@ -208,6 +221,73 @@ typedef struct
  */
 ght_hash_table_t *ght_create(unsigned int i_size);
 
+/**
+ * The largest key ght_create_flat() tables can hold.
+ */
+#define GHT_FLAT_MAX_KEY 255
+
+/**
+ * Create a new hash table using open addressing instead of chained
+ * buckets. Keys of up to @a i_key_max bytes are kept in the table
+ * itself, next to the data pointers, and a lookup compares a group of
+ * one byte tags at once (16 with SSE2, 8 otherwise) before looking at
+ * any key. For small keys such as integers this avoids the allocation
+ * per entry and the pointer chasing of ght_create() tables.
+ *
+ * The table is used through the same functions as other tables, with
+ * these differences:
+ *
+ * - ght_insert() returns -2 for keys longer than @a i_key_max.
+ * - The table always grows as needed; ght_set_rehash(),
+ *   ght_set_heuristics(), ght_set_alloc() and
+ *   ght_set_bounded_buckets() have no effect.
+ * - ght_table_size() returns the number of slots, which is kept at
+ *   least 8/7 of the number of entries.
+ * - Entries may be removed while iterating, but not inserted.
+ *
+ * The hash function is the one of ght_create() and can be changed
+ * with ght_set_hash() while the table is empty.
+ *
+ * @param i_size the number of entries to make room for. The table
+ *        grows beyond it if needed.
+ * @param i_key_max the largest key size, at most @c GHT_FLAT_MAX_KEY.
+ * @param b_ordered TRUE if iterations should return the entries in
+ *        the order they were inserted, which costs two ints per slot.
+ *        Otherwise the order is unspecified.
+ *
+ * @return a pointer to the hash table or NULL upon error.
+ */
+ght_hash_table_t *ght_create_flat(unsigned int i_size, unsigned int i_key_max, int b_ordered);
+
+/**
+ * Create a new hash table that can be used by several threads at
+ * once. It is made of @a i_shards tables like those of ght_create(),
+ * each with its own mutex; an operation locks only the shard its key
+ * hashes to, so threads working on different keys rarely wait for
+ * each other. A few times as many shards as threads is a good start.
+ *
+ * ght_insert(), ght_get(), ght_replace(), ght_remove(), ght_size(),
+ * ght_table_size(), ght_remove_all() and ght_rehash() may be called
+ * from any thread at any time. Note that ght_get() only returns the
+ * data pointer; keeping the data alive while other threads may
+ * remove it is up to the caller. ght_insert() returning -1 tells
+ * which of two threads inserting the same key won.
+ *
+ * The ght_set_*() functions apply to all shards and should be called
+ * before the table is shared. The fn_bucket_free callback of
+ * ght_set_bounded_buckets() is called with the shard locked and must
+ * not use the table. Iterating with ght_first() and ght_next(), and
+ * ght_finalize(), must not overlap with other operations on the
+ * table; iterations visit one shard after the other.
+ *
+ * @param i_size the number of buckets in all, divided among the
+ *        shards.
+ * @param i_shards the number of shards, at least 1.
+ *
+ * @return a pointer to the hash table or NULL upon error.
+ */
+ght_hash_table_t *ght_create_sharded(unsigned int i_size, unsigned int i_shards);
+
 /**
  * Set the allocation/freeing functions to use for a hash table. The
  * allocation function will only be called when a new entry is
@@ -265,10 +345,11 @@ void ght_set_heuristics(ght_hash_table_t *p_ht, int i_heuristics);
  *
  * With automatic rehashing, the table will rehash itself when the
  * number of elements in the table are twice as many as the number of
- * buckets. You should note that automatic rehashing will cause your
- * application to be really slow when the table is rehashing (which
- * might happen at times when you need speed), you should therefore be
- * careful with this in time-constrainted applications.
+ * buckets. The bucket array is doubled at once, but the entries are
+ * moved to it a few buckets at a time by the following calls to
+ * ght_insert(), ght_get(), ght_replace() and ght_remove(), so no
+ * single call has to move the whole table. Until that is done the
+ * table uses the memory of both bucket arrays.
  *
  * @param p_ht the hash table to set rehashing for.
  * @param b_rehash TRUE if rehashing should be used or FALSE if it
@@ -517,10 +598,10 @@ void *ght_next_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, const
  * Rehash the hash table.
  *
  * Rehashing will change the size of the hash table, retaining all
- * elements. This is very costly and should be avoided unless really
- * needed. If <TT>GHT_AUTOMATIC_REHASH</TT> is specified in the flag
- * parameter when ght_create() is called, the hash table is
- * automatically rehashed when the number of stored elements exceeds
+ * elements. This moves every element before returning, which is very
+ * costly and should be avoided unless really needed. With automatic
+ * rehashing enabled by ght_set_rehash(), the hash table is
+ * rehashed incrementally when the number of stored elements exceeds
  * two times the number of buckets in the table (making calls to this
  * function unessessary).
  *
@@ -572,9 +653,8 @@ void ght_remove_all(ght_hash_table_t *p_ht);
 /* exported hash functions */
 
 /**
- * One-at-a-time-hash. One-at-a-time-hash is a good hash function, and
- * is the default when ght_create() is called with NULL as the
- * fn_hash parameter. This was found in a DrDobbs article, see
+ * One-at-a-time-hash. One-at-a-time-hash is a good hash function,
+ * but hashes one byte at a time. This was found in a DrDobbs article, see
  * http://burtleburtle.net/bob/hash/doobs.html
  *
  * @warning Don't call this function directly, it is only meant to be
@@ -609,6 +689,43 @@ ght_uint32_t ght_rotating_hash(ght_hash_key_t *p_key);
  */
 ght_uint32_t ght_crc_hash(ght_hash_key_t *p_key);
 
+/**
+ * CRC32C hash. Uses the SSE4.2 crc32 instruction, eight bytes at a
+ * time, if the CPU has it and a table otherwise. Both give the same
+ * values.
+ *
+ * @warning Don't call this function directly, it is only meant to be
+ * used as a callback for the hash table.
+ *
+ * @see ght_fn_hash_t
+ * @see ght_wy_hash(), ght_fastest_hash()
+ */
+ght_uint32_t ght_crc32c_hash(ght_hash_key_t *p_key);
+
+/**
+ * Word at a time hash after wyhash. Mixes eight bytes at a time with
+ * 64 bit multiplies, fast without any special instructions and of good
+ * quality in all bits.
+ *
+ * @warning Don't call this function directly, it is only meant to be
+ * used as a callback for the hash table.
+ *
+ * @see ght_fn_hash_t
+ * @see ght_crc32c_hash(), ght_fastest_hash()
+ */
+ght_uint32_t ght_wy_hash(ght_hash_key_t *p_key);
+
+/**
+ * Return the fastest hash function on this CPU: @c ght_wy_hash() if
+ * the library was compiled with optimization for a CPU with cheap 64
+ * bit multiplies, otherwise @c ght_crc32c_hash() if the CPU has SSE4.2,
+ * which is checked at run time, and @c ght_wy_hash() if not. This is
+ * the default of ght_create().
+ *
+ * @return the hash function.
+ */
+ght_fn_hash_t ght_fastest_hash(void);
+
 #ifdef USE_PROFILING
 /**
  * Print some statistics about the table. Only available if the
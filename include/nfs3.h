@@ -37,10 +37,16 @@
 
 #include <nfs_ctx.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define NFS3_FHSIZE 64
 #define NFS3_COOKIEVERFSIZE 8
 #define NFS3_CREATEVERFSIZE 8
 #define NFS3_WRITEVERFSIZE 8
+#define NFS3_MAXPATHLEN 4096
+#define NFS3_MAXDATA 16777216
 
 #ifdef _AIX
 /* /usr/include/sys/inttypes.h defines int32 and int64, and u_intxx */
@@ -966,6 +972,7 @@ typedef struct COMMIT3res COMMIT3res;
 #define MNTPATHLEN 1024
 #define MNTNAMLEN 255
 #define FHSIZE3 64
+#define MNTMAXFLAVORS 64
 
 typedef struct {
 	u_int fhandle3_len;
@@ -1113,6 +1120,13 @@ extern mountlist xdr_to_mountlist(char * msg, int len);
 extern exports xdr_to_exports(char * msg, int len);
 extern void free_groups(groups gr);
 
+/* Frees whatever a failed decode of obj left behind. The xdr_to_
+ * functions zero obj before decoding, so that everything the decode
+ * did not get to is NULL. The stream that did the decoding is passed,
+ * its x_public tells whether READ and WRITE data was decoded.
+ */
+extern void xdr_free_decoded(XDR *xdrs, xdrproc_t proc, void *obj);
+
 /* the xdr functions */
 
 extern GETATTR3res * xdr_to_GETATTR3res(char *msg, int len);
@@ -1398,4 +1412,8 @@ extern  bool_t xdr_groupnode (XDR *, groupnode*);
 extern  bool_t xdr_exports (XDR *, exports*);
 extern  bool_t xdr_exportnode (XDR *, exportnode*);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* !_NFS3_H_RPCGEN */
@@ -32,11 +32,37 @@
 #include <sys/socket.h>
 
 #include <clnt_tcp_nb.h>
+#include <ght_hash_table.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define NFSC_CFL_NONBLOCKING 0x01
 #define NFSC_CFL_BLOCKING 0x02
 #define NFSC_CFL_DISABLE_NAGLE 0x04
 
+/* Make broken connections again and send the pending calls again,
+ * see clnttcp_nb_set_reconnect(). Off by default, it keeps a copy of
+ * every call until its reply arrives. With NFSC_CFL_NONBLOCKING the
+ * first NFS connection is made that way too, without blocking.
+ */
+#define NFSC_CFL_RECONNECT 0x08
+
+/* Send calls without a reply again after a timeout, see
+ * clnttcp_nb_set_retrans(). Off by default, a server slower than
+ * the timeout gets those calls twice.
+ */
+#define NFSC_CFL_RETRANS 0x10
+
+/* Room for the RPC and NFS headers around a READ or WRITE payload */
+#define NFSC_HDR_SLACK 512
+
+/* Socket buffer size needed for a transfer size, 0 for the default */
+#define NFSC_BUFSZ(xfer) ((xfer) ? (xfer) + NFSC_HDR_SLACK : 0)
+
+struct _nfs_dnlc;
+
 /* Stores the state of each remote NFS mount
  * performed by the client
  */
@@ -58,13 +84,35 @@ typedef struct _nfs_ctx {
 	/* Connection flags */
 	int nfs_connflags;
 
-	/* Read frag size */
+	/* Read transfer size, 0 until known. Set by nfs_mount(). */
 	int nfs_rsize;
 
-	/* Write frag size */
+	/* Write transfer size, 0 until known. Set by nfs_mount(). */
 	int nfs_wsize;
 
+	/* Byte threshold of the cork mode of nfsd connections, 0 if
+	 * off. Set by nfs_set_cork().
+	 */
+	unsigned long nfs_cork;
+
+	/* FSINFO results per export, keyed by the root file handle.
+	 * See nfs_fsinfo_get().
+	 */
+	ght_hash_table_t *nfs_fsinfo_cache;
+
+	/* Directory name lookup cache, created on first use.
+	 * See nfs_dnlc.h.
+	 */
+	struct _nfs_dnlc *nfs_dnlc;
+
 }nfs_ctx;
 
 extern int check_ctx(nfs_ctx *);
+
+/* Sets up a new connection of ctx as its connflags ask for */
+extern void ctx_setup_client(nfs_ctx *ctx, CLIENT *cl);
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,156 @@
+/*
+ *    libnfsclient, library for NFS operations from user space.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * Directory name lookup cache and multi-component path resolution.
+ *
+ * The cache maps a (directory file handle, name) pair to the file
+ * handle of the child. Failed lookups are remembered as negative
+ * entries, so repeatedly probing a missing file does not cost a
+ * round trip each time. Entries expire after a fixed time, since
+ * NFSv3 gives us no way to learn about changes on the server.
+ */
+
+#ifndef _NFS_DNLC_H_
+#define _NFS_DNLC_H_
+
+#include <time.h>
+#include <sys/time.h>
+#include <ght_hash_table.h>
+#include <nfs3.h>
+#include <nfs_ctx.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default lifetime in seconds of positive and negative entries */
+#define DNLC_DEFAULT_TTL 30
+#define DNLC_DEFAULT_NEG_TTL 3
+
+/* Default number of buckets, and entries kept per bucket before the
+ * oldest one is dropped. Together these bound the cache size.
+ */
+#define DNLC_BUCKETS 1024
+#define DNLC_BUCKET_LIMIT 8
+
+/* Longest name we cache. Longer names are always looked up. */
+#define DNLC_NAMELEN 255
+
+typedef struct _nfs_dnlc {
+	ght_hash_table_t *dc_table;
+
+	/* Lifetime of positive and negative entries, in seconds */
+	int dc_ttl;
+	int dc_negttl;
+
+	/* Statistics */
+	unsigned long dc_hits;
+	unsigned long dc_neghits;
+	unsigned long dc_misses;
+} nfs_dnlc;
+
+/* Creates the cache for ctx. ttl and negttl of 0 select the defaults,
+ * a negttl < 0 disables negative entries.
+ * Returns 0 on success, -1 on failure.
+ */
+extern int nfs_dnlc_init(nfs_ctx *ctx, unsigned int size, int ttl,
+		int negttl);
+extern void nfs_dnlc_destroy(nfs_ctx *ctx);
+
+/* Looks up name in dir. Returns -1 if there is no valid entry,
+ * otherwise the cached status. For NFS3_OK, the handle is copied
+ * into fh->data.data_val, which must have room for NFS3_FHSIZE bytes,
+ * and the file type (or 0 if unknown) is stored in type if not NULL.
+ */
+extern int nfs_dnlc_lookup(nfs_ctx *ctx, nfs_fh3 *dir, char *name,
+		nfs_fh3 *fh, ftype3 *type);
+
+/* type may be 0 if the attributes were not returned. */
+extern void nfs_dnlc_enter(nfs_ctx *ctx, nfs_fh3 *dir, char *name,
+		nfs_fh3 *fh, ftype3 type);
+extern void nfs_dnlc_enter_negative(nfs_ctx *ctx, nfs_fh3 *dir,
+		char *name, nfsstat3 stat);
+extern void nfs_dnlc_purge(nfs_ctx *ctx, nfs_fh3 *dir, char *name);
+
+/* Enters every entry of a READDIRPLUS reply for which the server sent
+ * a handle. Returns the number of entries added.
+ */
+extern int nfs_dnlc_enter_readdirplus(nfs_ctx *ctx, nfs_fh3 *dir,
+		READDIRPLUS3res *res);
+
+
+/* Path resolution. Components are separated by one or more '/'.
+ * Components found in the cache are resolved without a round trip,
+ * the rest need one LOOKUP each, and the results are entered into the
+ * cache.
+ *
+ * Symbolic links are followed with READLINK, with the target taken
+ * relative to the directory holding the link. Absolute targets fail
+ * with NFS3ERR_NOTSUPP, since they refer to the client namespace of
+ * whoever created the link. More than NFS_RESOLVE_MAXLINKS links fail
+ * with NFS3ERR_INVAL. If a LOOKUP reply comes without attributes, a
+ * GETATTR is sent to learn the file type.
+ *
+ * The callback gets the final handle with stat == NFS3_OK, an NFS
+ * error from the failing call, or -1 if a call could not be sent
+ * or its reply not decoded. The handle is only valid during the
+ * callback.
+ */
+typedef void (*nfs_resolve_cb)(int stat, nfs_fh3 *fh, void *priv);
+
+/* Called once per component when it has been resolved, or has failed.
+ * how is a combination of the NFS_STEP_ flags telling which calls were
+ * needed, elapsed the time it took. A followed symlink reports the
+ * link itself; the components of its target are reported separately.
+ */
+typedef void (*nfs_resolve_step_cb)(char *name, int how,
+		struct timeval *elapsed, void *priv);
+
+#define NFS_STEP_CACHED		0x01
+#define NFS_STEP_LOOKUP		0x02
+#define NFS_STEP_GETATTR	0x04
+#define NFS_STEP_READLINK	0x08
+
+/* Dont consult the cache, but still fill it */
+#define NFS_RESOLVE_NOCACHE 0x01
+/* Dont follow a symlink in the last component */
+#define NFS_RESOLVE_NOFOLLOW 0x02
+
+#define NFS_RESOLVE_MAXLINKS 16
+
+/* Returns 0 if the resolution was started, -1 otherwise. The callback
+ * may be invoked before this returns if no call was needed. step may
+ * be NULL.
+ */
+extern int nfs_resolve_path_async(nfs_ctx *ctx, nfs_fh3 *root, char *path,
+		int flags, nfs_resolve_cb cb, nfs_resolve_step_cb step,
+		void *priv);
+
+/* Blocking version. On NFS3_OK, fh->data.data_val is allocated with
+ * mem_alloc and has to be freed by the caller.
+ */
+extern int nfs_resolve_path(nfs_ctx *ctx, nfs_fh3 *root, char *path,
+		nfs_fh3 *fh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
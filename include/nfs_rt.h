@@ -0,0 +1,111 @@
+/*
+ *    libnfsclient, library for NFS operations from user space.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * A runtime of worker threads, one per core, for talking to many
+ * servers at once.
+ *
+ * An nfs_ctx and everything hanging off it is used by one thread
+ * only. The runtime keeps it that way: every target, a server
+ * address plus a connection number, is hashed to one worker, which
+ * owns the nfs_ctx for it, its connections, FSINFO cache and DNLC,
+ * and runs an event loop over the sockets of all its targets. Work
+ * is handed to a worker as a function to call with the nfs_ctx of a
+ * target, through a lock-free queue any thread may add to. That
+ * function, and the callbacks of the calls it makes, run on the
+ * worker, and they should not block: the blocking helpers like
+ * nfs_mount() and nfs_resolve_path() hold up every other target of
+ * the worker while they wait.
+ *
+ * The NFS connection of a target is made without blocking when the
+ * first call is sent, see clnttcp_nb_create_deferred(). Give the
+ * server address a port: a portmapper lookup, done when the first
+ * call of a target is made, blocks the worker. So does every MOUNT
+ * call, mount3_mnt() included; the MOUNT client is a blocking one
+ * and the worker only waits on the NFS connections.
+ *
+ * When a connection breaks, the worker reconnects and sends the
+ * pending calls again as described at clnttcp_nb_set_reconnect():
+ * NFSC_CFL_RECONNECT is implied. So is NFSC_CFL_RETRANS, calls
+ * without a reply are sent again as described at
+ * clnttcp_nb_set_retrans(). Calls it gives up on are called back
+ * with a NULL message, which the xdr_to_ functions turn into a NULL
+ * result.
+ *
+ * Workers block all signals, so that SIGPIPE from a server closing
+ * a connection does not kill the process and other signals go to
+ * the threads of the program.
+ */
+
+#ifndef _NFS_RT_H_
+#define _NFS_RT_H_
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <nfs_ctx.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pin worker i to the i-th online CPU, modulo their number */
+#define NFS_RT_PIN 0x01
+
+typedef struct _nfs_rt nfs_rt;
+
+/* Called on the worker owning the target. ctx is NULL if it could
+ * not be allocated.
+ */
+typedef void (*nfs_rt_fn)(nfs_ctx *ctx, void *arg);
+
+/* Starts nworkers threads, one per online CPU if nworkers <= 0.
+ * connflags are those of nfs_init(), NFSC_CFL_NONBLOCKING,
+ * NFSC_CFL_RECONNECT and NFSC_CFL_RETRANS are implied. Returns NULL
+ * on failure.
+ */
+extern nfs_rt *nfs_rt_create(int nworkers, int flags, int connflags);
+
+extern int nfs_rt_workers(nfs_rt *rt);
+
+/* The worker that owns the target. conn tells apart several
+ * connections to the same server, which may land on different
+ * workers.
+ */
+extern int nfs_rt_shard(nfs_rt *rt, struct sockaddr_in *srv, int conn);
+
+/* Has fn(ctx, arg) called on the worker owning the target, after
+ * the work submitted before it for the same worker. May be called
+ * from any thread, including the workers. Returns 0, or -1 if out
+ * of memory.
+ */
+extern int nfs_rt_submit(nfs_rt *rt, struct sockaddr_in *srv, int conn,
+		nfs_rt_fn fn, void *arg);
+
+/* Stops the workers once they have run what was submitted so far,
+ * and destroys all their nfs_ctxs. Calls still pending then are
+ * dropped without calling back. Nothing may be submitted while or
+ * after this runs.
+ */
+extern void nfs_rt_destroy(nfs_rt *rt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
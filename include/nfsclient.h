@@ -38,10 +38,107 @@
 #include <nfs3.h>
 #include <nfs_ctx.h>
 #include <clnt_tcp_nb.h>
+#include <nfs_dnlc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Server limits and preferences from FSINFO */
+typedef struct _nfs_fsinfo {
+	u_int32_t fi_rtmax;
+	u_int32_t fi_rtpref;
+	u_int32_t fi_rtmult;
+	u_int32_t fi_wtmax;
+	u_int32_t fi_wtpref;
+	u_int32_t fi_wtmult;
+	u_int32_t fi_dtpref;
+	u_int64_t fi_maxfilesize;
+	u_int32_t fi_properties;
+} nfs_fsinfo;
+
+/* Bounds for the transfer sizes chosen by nfs_mount() */
+#define NFS_MIN_XFER 4096
+#define NFS_MAX_XFER (1024 * 1024)
+
+/* Used when the server does not state a preference */
+#define NFS_DEFAULT_XFER 32768
+
+/* One call of a batch, see nfs_submit_batch() */
+typedef struct _nfs_op {
+	u_long op_proc;		/* NFS3_GETATTR etc. */
+	void *op_args;		/* GETATTR3args etc., NULL for NFS3_NULL */
+	user_cb op_cb;
+	void *op_priv;
+	enum clnt_stat op_stat;	/* Set by nfs_submit_batch() */
+} nfs_op;
 
 extern nfs_ctx *nfs_init(struct sockaddr_in *srv, int proto, int connflags);
+
+/* Mounts export and fetches FSINFO for it, then sets nfs_rsize and
+ * nfs_wsize from the preferred sizes, bounded by the maximum sizes and
+ * NFS_MIN_XFER/NFS_MAX_XFER. Blocks until done.
+ * On success, fh->data.data_val is allocated with mem_alloc and 0 is
+ * returned. Otherwise the MOUNT status, or -1 if the call failed.
+ * A failing FSINFO is not an error, the default sizes are kept then.
+ */
+extern int nfs_mount(nfs_ctx *ctx, char *exp, nfs_fh3 *fh);
+
+/* Returns the FSINFO of the export with the given root handle,
+ * sending the call only the first time. Blocks until done.
+ * Returns NULL if the call fails.
+ */
+extern nfs_fsinfo *nfs_fsinfo_get(nfs_ctx *ctx, nfs_fh3 *root);
+
+/* Sets the transfer sizes, and resizes the buffers of an existing
+ * connection to match. 0 keeps the current size.
+ */
+extern int nfs_set_xfer_size(nfs_ctx *ctx, int rsize, int wsize);
+
+/* Puts the connection to nfsd in cork mode, see
+ * clnttcp_nb_set_cork(): calls are held back until bytes of them are
+ * queued, nfs_flush() is called or the next nfs_complete(). 0 turns
+ * it off and sends what is held back.
+ */
+extern int nfs_set_cork(nfs_ctx *ctx, unsigned long bytes);
+
+/* Sends what is queued on either connection of ctx without waiting.
+ * Returns the bytes the sockets did not take.
+ */
+extern unsigned long nfs_flush(nfs_ctx *ctx);
+/* Closes the connections and frees ctx along with its caches.
+ * Callbacks of calls still outstanding are never invoked.
+ */
+extern void nfs_destroy(nfs_ctx *ctx);
+
+/* Makes the n NFSv3 calls in ops, as the nfs3_ functions would, but
+ * encodes them all before sending any, and then sends them with as
+ * few system calls as possible, see clnttcp_nb_batch_begin(). The
+ * status of each call goes to its op_stat. Returns the number of
+ * calls made.
+ */
+extern int nfs_submit_batch(nfs_ctx *ctx, nfs_op *ops, int n);
 extern void mnt_complete(nfs_ctx * ctx);
 extern int nfs_complete(nfs_ctx * ctx, int flag);
+
+/* Withdraws the calls on either connection of ctx whose callback
+ * would get priv, see clnttcp_nb_cancel_priv(). Returns their number,
+ * -1 if out of memory.
+ */
+extern int nfs_cancel(nfs_ctx *ctx, void *priv);
 extern char * nfsstat3_strerror(int stat);
+
+/* Call and round trip time statistics of the NFS (prog ==
+ * NFS_PROGRAM) or MOUNT (prog == MOUNT_PROGRAM) connection of ctx,
+ * NULL if there is none yet. See clnt_tcp_nb.h.
+ */
+extern struct clnt_proc_stats *nfs_proc_stats(nfs_ctx *ctx, u_long prog,
+		u_long proc);
+extern struct clnt_rtt_stats *nfs_rtt_stats(nfs_ctx *ctx, u_long prog);
+extern void nfs_reset_stats(nfs_ctx *ctx);
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
@@ -0,0 +1,738 @@
+/*
+ *    libnfsclient, library for NFS operations from user space.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * A C++20 front end to the asynchronous client, header only.
+ *
+ * An nfs::client owns an nfs_ctx. Its methods, one per NFSv3 and
+ * MOUNT procedure, send the call right away and return an nfs::call,
+ * which a coroutine co_awaits for the reply:
+ *
+ *	nfs::task<int> size(nfs::client &c, nfs_fh3 fh)
+ *	{
+ *		GETATTR3args args;
+ *
+ *		args.object = fh;
+ *		auto res = co_await c.getattr(args);
+ *		if(!res || (res->status != NFS3_OK))
+ *			co_return -1;
+ *		co_return res->GETATTR3res_u.resok.obj_attributes.size;
+ *	}
+ *
+ * Since calls go out before they are awaited, a coroutine keeps
+ * several in flight by making them first and awaiting them after.
+ * nfs::executor runs the coroutines: while they wait it polls the
+ * connections of its clients and calls clnttcp_nb_receive() on
+ * them, and it resumes a coroutine once the reply it waits for has
+ * been decoded. Replies are always decoded in the callback, so the
+ * xdr_to_ function sees the message while it is valid, but the
+ * coroutine runs from the executor, not from inside the callback.
+ *
+ * nfs::result owns the decoded reply and frees it with the matching
+ * free_ function. It converts to false if the call failed, stat()
+ * tells why, as clnt_geterr() would. A call destroyed before its
+ * reply came, e.g. with a coroutine that was abandoned, is withdrawn
+ * with nfs_cancel(). Clients must not outlive their executor.
+ * Everything here belongs to the thread running the executor.
+ */
+
+#ifndef _NFSCLIENT_HPP_
+#define _NFSCLIENT_HPP_
+
+#if __cplusplus < 202002L
+#error "nfsclient.hpp needs C++20"
+#endif
+
+#include <poll.h>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <nfsclient.h>
+
+namespace nfs {
+
+class executor;
+
+/* A decoded reply of type T, or why there is none */
+template <typename T>
+class result {
+public:
+	typedef void (*deleter)(T *);
+
+	result() : r_res(nullptr), r_free(nullptr), r_stat(RPC_FAILED) {}
+	result(T *res, deleter del, enum clnt_stat stat)
+		: r_res(res), r_free(del), r_stat(stat) {}
+	result(result &&o) noexcept
+		: r_res(o.r_res), r_free(o.r_free), r_stat(o.r_stat)
+	{
+		o.r_res = nullptr;
+	}
+	result &operator=(result &&o) noexcept
+	{
+		if(this != &o) {
+			reset();
+			r_res = std::exchange(o.r_res, nullptr);
+			r_free = o.r_free;
+			r_stat = o.r_stat;
+		}
+		return *this;
+	}
+	result(const result &) = delete;
+	result &operator=(const result &) = delete;
+	~result() { reset(); }
+
+	/* The lists of MOUNT DUMP and EXPORT may be empty, then get()
+	 * is NULL for a successful call.
+	 */
+	explicit operator bool() const { return r_stat == RPC_SUCCESS; }
+	enum clnt_stat stat() const { return r_stat; }
+	T *get() const { return r_res; }
+	T *operator->() const { return r_res; }
+	T &operator*() const { return *r_res; }
+
+	/* The caller frees it with the free_ function then */
+	T *release() { return std::exchange(r_res, nullptr); }
+
+	void reset()
+	{
+		if(r_res != nullptr)
+			r_free(r_res);
+		r_res = nullptr;
+	}
+
+private:
+	T *r_res;
+	deleter r_free;
+	enum clnt_stat r_stat;
+};
+
+/* For the procedures without results: NULL, UMNT and UMNTALL */
+template <>
+class result<void> {
+public:
+	result() : r_stat(RPC_FAILED) {}
+	result(void *, void (*)(void *), enum clnt_stat stat) : r_stat(stat) {}
+
+	explicit operator bool() const { return r_stat == RPC_SUCCESS; }
+	enum clnt_stat stat() const { return r_stat; }
+
+private:
+	enum clnt_stat r_stat;
+};
+
+namespace detail {
+
+/* How replies of each type are decoded and freed. data is the
+ * NFS3_DATA_ flag of READ, unused by the others.
+ */
+template <typename T>
+struct reply;
+
+#define NFSCPP_REPLY(T)							\
+	template <>							\
+	struct reply<T> {						\
+		static T *decode(char *msg, int len, int)		\
+		{							\
+			return xdr_to_##T(msg, len);			\
+		}							\
+		static void free(T *res) { free_##T(res); }		\
+		static result<T>::deleter deleter(int) { return free; }	\
+		static const bool may_be_empty = false;			\
+	};
+
+NFSCPP_REPLY(GETATTR3res)
+NFSCPP_REPLY(SETATTR3res)
+NFSCPP_REPLY(LOOKUP3res)
+NFSCPP_REPLY(ACCESS3res)
+NFSCPP_REPLY(READLINK3res)
+NFSCPP_REPLY(WRITE3res)
+NFSCPP_REPLY(CREATE3res)
+NFSCPP_REPLY(MKDIR3res)
+NFSCPP_REPLY(SYMLINK3res)
+NFSCPP_REPLY(MKNOD3res)
+NFSCPP_REPLY(REMOVE3res)
+NFSCPP_REPLY(RMDIR3res)
+NFSCPP_REPLY(RENAME3res)
+NFSCPP_REPLY(LINK3res)
+NFSCPP_REPLY(READDIR3res)
+NFSCPP_REPLY(READDIRPLUS3res)
+NFSCPP_REPLY(FSSTAT3res)
+NFSCPP_REPLY(FSINFO3res)
+NFSCPP_REPLY(PATHCONF3res)
+NFSCPP_REPLY(COMMIT3res)
+
+#undef NFSCPP_REPLY
+
+template <>
+struct reply<READ3res> {
+	static READ3res *decode(char *msg, int len, int data)
+	{
+		return xdr_to_READ3res(msg, len, data);
+	}
+	static void free_data(READ3res *res)
+	{
+		free_READ3res(res, NFS3_DATA_DEXDR);
+	}
+	static void free_nodata(READ3res *res)
+	{
+		free_READ3res(res, NFS3_DATA_NO_DEXDR);
+	}
+	static result<READ3res>::deleter deleter(int data)
+	{
+		return (data == NFS3_DATA_DEXDR) ? free_data : free_nodata;
+	}
+	static const bool may_be_empty = false;
+};
+
+template <>
+struct reply<mountres3> {
+	static mountres3 *decode(char *msg, int len, int)
+	{
+		return xdr_to_mntres3(msg, len);
+	}
+	static void free(mountres3 *res) { free_mntres3(res); }
+	static result<mountres3>::deleter deleter(int) { return free; }
+	static const bool may_be_empty = false;
+};
+
+template <>
+struct reply<mountbody> {
+	static mountbody *decode(char *msg, int len, int)
+	{
+		return xdr_to_mountlist(msg, len);
+	}
+	static void free(mountbody *res) { free_mountlist(res); }
+	static result<mountbody>::deleter deleter(int) { return free; }
+	static const bool may_be_empty = true;
+};
+
+template <>
+struct reply<exportnode> {
+	static exportnode *decode(char *msg, int len, int)
+	{
+		return xdr_to_exports(msg, len);
+	}
+	static void free(exportnode *res) { free_exports(res); }
+	static result<exportnode>::deleter deleter(int) { return free; }
+	static const bool may_be_empty = true;
+};
+
+template <>
+struct reply<void> {
+	static void *decode(char *, int, int) { return nullptr; }
+	static void (*deleter(int))(void *) { return nullptr; }
+	static const bool may_be_empty = true;
+};
+
+/* Sends a call with the C function F, see nfs::call */
+typedef enum clnt_stat (*issuer)(void *args, nfs_ctx *ctx, user_cb cb,
+		void *priv);
+
+template <typename A, enum clnt_stat (*F)(A *, nfs_ctx *, user_cb, void *)>
+enum clnt_stat
+issue(void *args, nfs_ctx *ctx, user_cb cb, void *priv)
+{
+	return F((A *)args, ctx, cb, priv);
+}
+
+template <enum clnt_stat (*F)(nfs_ctx *, user_cb, void *)>
+enum clnt_stat
+issue_noargs(void *, nfs_ctx *ctx, user_cb cb, void *priv)
+{
+	return F(ctx, cb, priv);
+}
+
+/* What task<T> and task<void> have in common: the coroutine to
+ * continue when done, and an exception that escaped.
+ */
+struct promise_base {
+	std::coroutine_handle<> p_cont;
+	std::exception_ptr p_exc;
+
+	struct final_awaiter {
+		bool await_ready() const noexcept { return false; }
+		template <typename P>
+		std::coroutine_handle<>
+		await_suspend(std::coroutine_handle<P> h) noexcept
+		{
+			std::coroutine_handle<> cont = h.promise().p_cont;
+
+			return cont ? cont : std::noop_coroutine();
+		}
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	final_awaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() { p_exc = std::current_exception(); }
+};
+
+} /* namespace detail */
+
+/* A coroutine returning T. It starts when awaited by another task,
+ * or when given to executor::spawn() or executor::run().
+ */
+template <typename T = void>
+class task {
+public:
+	struct promise_type : detail::promise_base {
+		std::optional<T> p_value;
+
+		task get_return_object()
+		{
+			return task(std::coroutine_handle<promise_type>::
+					from_promise(*this));
+		}
+		template <typename V>
+		void return_value(V &&v) { p_value.emplace(std::forward<V>(v)); }
+
+		T take()
+		{
+			if(p_exc)
+				std::rethrow_exception(p_exc);
+			return std::move(*p_value);
+		}
+	};
+
+	explicit task(std::coroutine_handle<promise_type> h) : t_h(h) {}
+	task(task &&o) noexcept : t_h(std::exchange(o.t_h, nullptr)) {}
+	task &operator=(task &&o) noexcept
+	{
+		if(this != &o) {
+			if(t_h)
+				t_h.destroy();
+			t_h = std::exchange(o.t_h, nullptr);
+		}
+		return *this;
+	}
+	task(const task &) = delete;
+	task &operator=(const task &) = delete;
+	~task()
+	{
+		if(t_h)
+			t_h.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<>
+	await_suspend(std::coroutine_handle<> cont) noexcept
+	{
+		t_h.promise().p_cont = cont;
+		return t_h;
+	}
+	T await_resume() { return t_h.promise().take(); }
+
+	std::coroutine_handle<promise_type> handle() const { return t_h; }
+	std::coroutine_handle<promise_type> release()
+	{
+		return std::exchange(t_h, nullptr);
+	}
+
+private:
+	std::coroutine_handle<promise_type> t_h;
+};
+
+template <>
+struct task<void>::promise_type : detail::promise_base {
+	task get_return_object()
+	{
+		return task(std::coroutine_handle<promise_type>::
+				from_promise(*this));
+	}
+	void return_void() {}
+
+	void take()
+	{
+		if(p_exc)
+			std::rethrow_exception(p_exc);
+	}
+};
+
+/* Runs tasks, and drives the connections of the clients made with it
+ * while they wait.
+ */
+class executor {
+public:
+	executor() {}
+	executor(const executor &) = delete;
+	executor &operator=(const executor &) = delete;
+	~executor()
+	{
+		for(auto h : e_spawned)
+			h.destroy();
+	}
+
+	/* Runs t alongside the others, to its end. An exception that
+	 * escapes it comes out of run().
+	 */
+	void spawn(task<> t)
+	{
+		auto h = t.release();
+
+		e_spawned.push_back(h);
+		schedule(h);
+	}
+
+	/* Runs until t is done, along with the tasks spawned, and
+	 * returns what t returned. Throws std::logic_error if t waits
+	 * for something other than calls.
+	 */
+	template <typename T>
+	T run(task<T> t)
+	{
+		auto h = t.handle();
+
+		schedule(h);
+		while(!h.done()) {
+			if(!step())
+				throw std::logic_error("nfs::executor: task "
+						"waits for nothing");
+		}
+		reap();
+		return h.promise().take();
+	}
+
+	/* Runs until all tasks spawned are done */
+	void run()
+	{
+		while(!e_spawned.empty()) {
+			if(!step())
+				throw std::logic_error("nfs::executor: task "
+						"waits for nothing");
+			reap();
+		}
+	}
+
+	/* Resumes h from the executor, as soon as it gets to it */
+	void schedule(std::coroutine_handle<> h) { e_ready.push_back(h); }
+
+	/* Done by client */
+	void attach(nfs_ctx *ctx) { e_ctxs.push_back(ctx); }
+	void detach(nfs_ctx *ctx)
+	{
+		for(auto it = e_ctxs.begin(); it != e_ctxs.end(); ++it)
+			if(*it == ctx) {
+				e_ctxs.erase(it);
+				break;
+			}
+	}
+	bool attached(nfs_ctx *ctx) const
+	{
+		for(nfs_ctx *c : e_ctxs)
+			if(c == ctx)
+				return true;
+		return false;
+	}
+
+	/* Resumes the tasks that can go on, or waits for the
+	 * connections until some can. Returns false if none ever will.
+	 */
+	bool step()
+	{
+		std::deque<std::coroutine_handle<>> ready;
+		int timeout = -1, ms, events;
+		size_t i;
+
+		if(!e_ready.empty()) {
+			ready.swap(e_ready);
+			for(auto h : ready)
+				h.resume();
+			return true;
+		}
+
+		e_pfd.clear();
+		e_pcl.clear();
+		for(nfs_ctx *ctx : e_ctxs) {
+			CLIENT *cls[2] = { ctx->nfs_cl, ctx->nfs_mnt_cl };
+
+			for(CLIENT *cl : cls) {
+				if(cl == NULL)
+					continue;
+				events = clnttcp_nb_events(cl);
+				ms = clnttcp_nb_timeout(cl);
+				if((events == 0) && (ms < 0))
+					continue;
+				if((ms >= 0) && ((timeout < 0) || (ms < timeout)))
+					timeout = ms;
+				e_pfd.push_back({ events ? clnttcp_nb_fd(cl) : -1,
+						(short)events, 0 });
+				e_pcl.push_back(cl);
+			}
+		}
+		if(e_pfd.empty())
+			return false;
+
+		if(poll(e_pfd.data(), e_pfd.size(), timeout) < 0)
+			return true;
+
+		/* The callbacks only schedule, no client goes away here */
+		for(i = 0; i < e_pfd.size(); i++) {
+			if((e_pfd[i].revents == 0)
+					&& (clnttcp_nb_timeout(e_pcl[i]) != 0))
+				continue;
+			clnttcp_nb_receive(e_pcl[i], RPC_NONBLOCK_WAIT);
+		}
+
+		return true;
+	}
+
+private:
+	/* Frees the spawned tasks that are done */
+	void reap()
+	{
+		std::exception_ptr exc;
+
+		for(size_t i = 0; i < e_spawned.size(); ) {
+			auto h = e_spawned[i];
+
+			if(!h.done()) {
+				i++;
+				continue;
+			}
+			if(h.promise().p_exc && !exc)
+				exc = h.promise().p_exc;
+			h.destroy();
+			e_spawned[i] = e_spawned.back();
+			e_spawned.pop_back();
+		}
+		if(exc)
+			std::rethrow_exception(exc);
+	}
+
+	std::deque<std::coroutine_handle<>> e_ready;
+	std::vector<std::coroutine_handle<task<>::promise_type>> e_spawned;
+	std::vector<nfs_ctx *> e_ctxs;
+	std::vector<struct pollfd> e_pfd;
+	std::vector<CLIENT *> e_pcl;
+};
+
+/* A call in flight, to be co_awaited for its result<T>. It cannot be
+ * moved, the library has its address. See client for making them.
+ */
+template <typename T>
+class call {
+public:
+	call(executor &ex, nfs_ctx *ctx, u_long prog, detail::issuer fn,
+			void *args, int data = 0)
+		: c_ex(ex), c_ctx(ctx), c_prog(prog), c_data(data),
+		c_res(nullptr), c_stat(RPC_SUCCESS), c_pending(true)
+	{
+		enum clnt_stat stat;
+
+		/* The client could not be made, see client::ctx() */
+		if(ctx == NULL) {
+			c_pending = false;
+			c_stat = RPC_SYSTEMERROR;
+			return;
+		}
+
+		/* The reply may be in and decoded before this returns */
+		stat = fn(args, ctx, reply_cb, this);
+		if(stat != RPC_SUCCESS) {
+			c_pending = false;
+			c_stat = stat;
+		}
+	}
+	call(const call &) = delete;
+	call &operator=(const call &) = delete;
+	~call()
+	{
+		/* nfs_destroy() dropped it already if the client is gone */
+		if(c_pending && c_ex.attached(c_ctx))
+			nfs_cancel(c_ctx, this);
+		if(c_res != nullptr)
+			detail::reply<T>::deleter(c_data)(c_res);
+	}
+
+	/* Awaited through this, so that the call itself is never copied
+	 * into the coroutine frame.
+	 */
+	struct awaiter {
+		call *a_call;
+
+		bool await_ready() const noexcept { return !a_call->c_pending; }
+		void await_suspend(std::coroutine_handle<> h) noexcept
+		{
+			a_call->c_waiter = h;
+		}
+		result<T> await_resume()
+		{
+			return result<T>(std::exchange(a_call->c_res, nullptr),
+					detail::reply<T>::deleter(a_call->c_data),
+					a_call->c_stat);
+		}
+	};
+	awaiter operator co_await() { return awaiter{ this }; }
+
+private:
+	static void reply_cb(void *msg, int len, void *priv)
+	{
+		call *c = (call *)priv;
+		CLIENT *cl = (c->c_prog == MOUNT_PROGRAM) ? c->c_ctx->nfs_mnt_cl
+			: c->c_ctx->nfs_cl;
+		struct rpc_err err;
+
+		c->c_pending = false;
+		if(msg == NULL) {
+			/* Gave up on it, see clnttcp_nb_set_retrans() */
+			clnt_geterr(cl, &err);
+			c->c_stat = (err.re_status != RPC_SUCCESS)
+				? err.re_status : RPC_FAILED;
+		} else {
+			c->c_res = detail::reply<T>::decode((char *)msg, len,
+					c->c_data);
+			if((c->c_res == nullptr) && !detail::reply<T>::may_be_empty)
+				c->c_stat = RPC_CANTDECODERES;
+		}
+		if(c->c_waiter)
+			c->c_ex.schedule(c->c_waiter);
+	}
+
+	executor &c_ex;
+	nfs_ctx *c_ctx;
+	u_long c_prog;
+	int c_data;
+	T *c_res;
+	enum clnt_stat c_stat;
+	bool c_pending;
+	std::coroutine_handle<> c_waiter;
+};
+
+/* An nfs_ctx, made with nfs_init() and run by ex. Arguments are
+ * encoded when the call is made, they need not outlive it. Add
+ * NFSC_CFL_RECONNECT to connflags to ride out server restarts.
+ */
+class client {
+public:
+	client(executor &ex, struct sockaddr_in *srv,
+			int connflags = NFSC_CFL_DISABLE_NAGLE)
+		: cl_ex(ex)
+	{
+		cl_ctx = nfs_init(srv, IPPROTO_TCP,
+				connflags | NFSC_CFL_NONBLOCKING);
+		if(cl_ctx != NULL)
+			cl_ex.attach(cl_ctx);
+	}
+	client(const client &) = delete;
+	client &operator=(const client &) = delete;
+	~client()
+	{
+		if(cl_ctx != NULL) {
+			cl_ex.detach(cl_ctx);
+			nfs_destroy(cl_ctx);
+		}
+	}
+
+	/* NULL if nfs_init() failed. Calls then complete right away,
+	 * with RPC_SYSTEMERROR.
+	 */
+	nfs_ctx *ctx() const { return cl_ctx; }
+	explicit operator bool() const { return cl_ctx != NULL; }
+
+#define NFSCPP_CALL(name, A, R)						\
+	call<R> name(A &args)						\
+	{								\
+		return call<R>(cl_ex, cl_ctx, NFS_PROGRAM,		\
+				detail::issue<A, nfs3_##name>, &args);	\
+	}
+
+	call<void> null()
+	{
+		return call<void>(cl_ex, cl_ctx, NFS_PROGRAM,
+				detail::issue_noargs<nfs3_null>, nullptr);
+	}
+	NFSCPP_CALL(getattr, GETATTR3args, GETATTR3res)
+	NFSCPP_CALL(setattr, SETATTR3args, SETATTR3res)
+	NFSCPP_CALL(lookup, LOOKUP3args, LOOKUP3res)
+	NFSCPP_CALL(access, ACCESS3args, ACCESS3res)
+	NFSCPP_CALL(readlink, READLINK3args, READLINK3res)
+	NFSCPP_CALL(write, WRITE3args, WRITE3res)
+	NFSCPP_CALL(create, CREATE3args, CREATE3res)
+	NFSCPP_CALL(mkdir, MKDIR3args, MKDIR3res)
+	NFSCPP_CALL(symlink, SYMLINK3args, SYMLINK3res)
+	NFSCPP_CALL(mknod, MKNOD3args, MKNOD3res)
+	NFSCPP_CALL(remove, REMOVE3args, REMOVE3res)
+	NFSCPP_CALL(rmdir, RMDIR3args, RMDIR3res)
+	NFSCPP_CALL(rename, RENAME3args, RENAME3res)
+	NFSCPP_CALL(link, LINK3args, LINK3res)
+	NFSCPP_CALL(readdir, READDIR3args, READDIR3res)
+	NFSCPP_CALL(readdirplus, READDIRPLUS3args, READDIRPLUS3res)
+	NFSCPP_CALL(fsstat, FSSTAT3args, FSSTAT3res)
+	NFSCPP_CALL(fsinfo, FSINFOargs, FSINFO3res)
+	NFSCPP_CALL(pathconf, PATHCONF3args, PATHCONF3res)
+	NFSCPP_CALL(commit, COMMIT3args, COMMIT3res)
+
+#undef NFSCPP_CALL
+
+	/* data is NFS3_DATA_NO_DEXDR to skip copying the data out */
+	call<READ3res> read(READ3args &args, int data = NFS3_DATA_DEXDR)
+	{
+		return call<READ3res>(cl_ex, cl_ctx, NFS_PROGRAM,
+				detail::issue<READ3args, nfs3_read>, &args,
+				data);
+	}
+
+	/* MOUNT. dump() and exports() return the head of the list. */
+	call<void> mnt_null()
+	{
+		return call<void>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue_noargs<mount3_null>, nullptr);
+	}
+	call<mountres3> mnt(const char *path)
+	{
+		dirpath dp = (dirpath)path;
+
+		return call<mountres3>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue<dirpath, mount3_mnt>, &dp);
+	}
+	call<mountbody> dump()
+	{
+		return call<mountbody>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue_noargs<mount3_dump>, nullptr);
+	}
+	call<void> umnt(const char *path)
+	{
+		dirpath dp = (dirpath)path;
+
+		return call<void>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue<dirpath, mount3_umnt>, &dp);
+	}
+	call<void> umntall()
+	{
+		return call<void>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue_noargs<mount3_umntall>, nullptr);
+	}
+	call<exportnode> exports()
+	{
+		return call<exportnode>(cl_ex, cl_ctx, MOUNT_PROGRAM,
+				detail::issue_noargs<mount3_export>, nullptr);
+	}
+
+private:
+	executor &cl_ex;
+	nfs_ctx *cl_ctx;
+};
+
+} /* namespace nfs */
+
+#endif
@@ -55,10 +55,13 @@
 #include <signal.h>
 #include <sys/uio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
 #include <queue.h>
 #include <ght_hash_table.h>
 #include <sys/select.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 
 #ifdef sun
 
@@ -70,6 +73,14 @@ typedef uint32_t        u_int32_t;
 #endif
 
 #include <clnt_tcp_nb.h>
+#include <limits.h>
+
+/* Buffers handed to one sendmsg() */
+#if defined(IOV_MAX) && (IOV_MAX < 1024)
+#define SEND_IOV IOV_MAX
+#else
+#define SEND_IOV 1024
+#endif
 
 /* writetcp registers this function as the callback for asynchronous
  * event on the TCP socket. It in turn calls an upper layer function
@@ -81,10 +92,11 @@ static int readtcp_nb(char *, char *, int);
 /* XDR Records layer calls this */
 static int writetcp_nb(char *, char *, int);
 
+static void clnttcp_nb_geterr(CLIENT *handle, struct rpc_err *err);
+
 /*
 
 static void clnttcp_nb_abort(void);
-static void clnttcp_nb_geterr(CLIENT *handle, struct rpc_err *err);
 static bool_t clnttcp_nb_freeres(CLIENT *handle, xdrproc_t xdr_op , caddr_t args);
 static bool_t clnttcp_nb_control(CLIENT *handle, int option, char *val);
 */
@@ -92,7 +104,7 @@ static struct clnt_ops tcp_nb_ops =
 {
 	clnttcp_nb_call,
 	NULL /*clnttcp_nb_abort*/,
-	NULL /*clnttcp_nb_geterr*/,
+	clnttcp_nb_geterr,
 	NULL /*clnttcp_nb_freeres*/,
 	clnttcp_nb_destroy,
 	NULL /*clnttcp_nb_control*/
@@ -111,6 +123,12 @@ struct frag_buffer {
 	char *fb_base;
 	char *fb_current;
 	int fb_len;
+
+	/* Outgoing only: the xid of the call the buffer belongs to, and
+	 * whether it starts the record of the call.
+	 */
+	u_int32_t fb_xid;
+	int fb_start;
 };
 
 TAILQ_HEAD(buf_list_head, frag_buffer);
@@ -183,8 +201,55 @@ struct rpc_record_state {
 struct callback_info {
 	user_cb callback;
 	void * cb_private;
+
+	/* For the statistics: the procedure, when the call was handed
+	 * to the transport and how many bytes it took.
+	 */
+	u_long cb_proc;
+	struct timespec cb_sent;
+	unsigned long cb_txbytes;
+
+	/* The record as sent, kept for sending again on a new
+	 * connection when reconnecting is enabled.
+	 */
+	char *cb_msg;
+	u_int cb_msglen;
+	u_int cb_msgsz;
+
+	/* Retransmission: the order calls were made in, the timer
+	 * list entry, when the timer was started and when it expires,
+	 * the times sent again after one and whether it was sent again
+	 * for any reason, which makes its round trip time useless for
+	 * the estimate.
+	 */
+	u_int32_t cb_xid;
+	unsigned long cb_seq;
+	TAILQ_ENTRY(callback_info) cb_timer;
+	struct timespec cb_armed;
+	struct timespec cb_due;
+	int cb_retries;
+	int cb_resent;
+};
+
+TAILQ_HEAD(cbi_list_head, callback_info);
+
+/* The calls fail_pending() is calling back. Those from fl_next on
+ * have not been called yet and can still be cancelled; cancelled
+ * ones are NULL. Nested when a callback fails the calls it made.
+ */
+struct fail_list {
+	struct callback_info **fl_cbis;
+	int fl_n;
+	int fl_next;
+	struct fail_list *fl_up;
 };
 
+/* Connection states */
+#define CT_CONNECTED	0
+#define CT_WAITING	1	/* Broken, next attempt at ct_retry_at */
+#define CT_CONNECTING	2	/* Attempt in progress until ct_retry_at */
+#define CT_FAILED	3	/* Gave up, the next call starts over */
+
 /* Socket specific data */
 struct ct_data
 {
@@ -243,21 +308,108 @@ struct ct_data
 	/* Number of outstanding calls */
 	int ct_pendingcalls;
 
+	/* Set while rpc_cb() is processing ct_readbuf. Callbacks
+	 * that issue new calls end up in clnttcp_nb_receive() again,
+	 * and must not read into the buffer we are still parsing.
+	 */
+	int ct_rx_busy;
+
+	/* Bytes handed to writetcp_nb() by the record layer, whether
+	 * sent yet or not. Used to find the size of each call.
+	 */
+	unsigned long ct_datasubmitted;
+
+	/* Call statistics per procedure, allocated on first use */
+	struct clnt_proc_stats *ct_stats[CLNT_MAXPROC];
+
+	/* Bytes in ct_sndlist */
+	unsigned long ct_unsent;
+
+	/* The call being encoded, whose record writetcp_nb() keeps */
+	struct callback_info *ct_capture;
+	int ct_capture_failed;
+
+	/* The calls being failed, no longer in ct_xid_to_ucb */
+	struct fail_list *ct_failing;
+
+	/* The xid of the call being encoded, and whether nothing of it
+	 * has been handed to writetcp_nb() yet.
+	 */
+	u_int32_t ct_txxid;
+	int ct_txstart;
+
+	/* Calls are only queued while non-zero, see
+	 * clnttcp_nb_batch_begin().
+	 */
+	int ct_batch;
+
+	/* Calls are queued until this many bytes are, if not 0. See
+	 * clnttcp_nb_set_cork().
+	 */
+	unsigned long ct_cork;
+
+	/* Reconnecting. ct_sock is -1 unless CT_CONNECTED or
+	 * CT_CONNECTING. See clnttcp_nb_set_reconnect().
+	 */
+	int ct_state;
+	int ct_broken;
+	int ct_rc_attempts;
+	int ct_rc_min_ms;
+	int ct_rc_max_ms;
+	int ct_attempts;
+	struct timespec ct_retry_at;
+	int ct_nodelay;
+	unsigned long ct_reconnects;
+
+	/* Not connected yet, see clnttcp_nb_create_deferred() */
+	int ct_deferred;
+
+	/* Retransmission, see clnttcp_nb_set_retrans(). The pending
+	 * calls are on ct_timers in the order their timeouts expire,
+	 * if ct_rt_retries is not 0. The round trip time estimates are
+	 * kept scaled as in 4.3BSD, the mean by 8 and the deviation by 4.
+	 */
+	struct cbi_list_head ct_timers;
+	unsigned long ct_seq;
+	int ct_rt_retries;
+	int ct_rt_min_ms;
+	int ct_rt_max_ms;
+	long long ct_srtt8;
+	long long ct_rttvar4;
+	struct clnt_rtt_stats ct_rtt;
+
+	/* When the last reply came, the latest made call answered, and
+	 * when another call may be sent again while no replies come.
+	 */
+	struct timespec ct_last_rx;
+	unsigned long ct_rx_seq;
+	struct timespec ct_probe_due;
 };
 
 /* glibc has a function like this but its internal
- * to glibc so we need to define one for us here.
+ * to glibc so we need to define one for us here. Clients may be
+ * created by several threads at once, so no srand48(), whose state
+ * is global; the counter keeps two clients made within the same
+ * microsecond apart.
  */
 unsigned long
 create_xid (void)
 {
-	unsigned long res;
+	static unsigned long count = 0;
 	struct timeval now;
+	u_int64_t x;
+
 	gettimeofday(&now, NULL);
-	srand48(now.tv_sec ^ now.tv_usec);
-	res = lrand48();
+	x = ((u_int64_t)now.tv_sec << 20) ^ now.tv_usec
+		^ ((u_int64_t)getpid() << 40)
+		^ (__sync_fetch_and_add(&count, 1) * 0x9e3779b97f4a7c15ULL);
 
-	return res;
+	/* splitmix64 finalizer */
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+
+	return (unsigned long)(x & 0x7fffffff);
 }
 
 
@@ -277,10 +429,10 @@ set_fd_nonblocking(int fd)
 }
 
 
-CLIENT *
-clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
-		u_long vers, int *sockp, u_int sbufsz, 
-		u_int rbufsz)
+/* Connects now unless deferred, then the first call does */
+static CLIENT *
+tcp_create(struct sockaddr_in *raddr, u_long prog, u_long vers,
+		int *sockp, u_int sbufsz, u_int rbufsz, int deferred)
 {
 	CLIENT *handle = NULL;
 	struct ct_data *ct = NULL;
@@ -306,7 +458,7 @@ clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 		raddr->sin_port = htons(port);
 	}
 
-	if(*sockp < 0) {
+	if(!deferred && (*sockp < 0)) {
 		*sockp = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
 		if(*sockp <= 0)
 			goto set_create_err_return;
@@ -337,6 +489,43 @@ clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 	ct->ct_datatx = 0;
 	ct->ct_datarx = 0;
 	ct->ct_pendingcalls = 0;
+	ct->ct_rx_busy = 0;
+	ct->ct_datasubmitted = 0;
+	memset(&ct->ct_error, 0, sizeof(ct->ct_error));
+	ct->ct_error.re_status = RPC_SUCCESS;
+	ct->ct_unsent = 0;
+	ct->ct_capture = NULL;
+	ct->ct_capture_failed = 0;
+	ct->ct_failing = NULL;
+	ct->ct_txxid = 0;
+	ct->ct_txstart = 0;
+	ct->ct_batch = 0;
+	ct->ct_cork = 0;
+	ct->ct_state = CT_CONNECTED;
+	ct->ct_deferred = deferred;
+	if(deferred) {
+		ct->ct_state = CT_FAILED;
+		ct->ct_sockflags |= RPC_NONBLOCK_WAIT;
+	}
+	ct->ct_broken = 0;
+	ct->ct_rc_attempts = 0;
+	ct->ct_rc_min_ms = CLNT_RECONNECT_MIN_MS;
+	ct->ct_rc_max_ms = CLNT_RECONNECT_MAX_MS;
+	ct->ct_attempts = 0;
+	ct->ct_nodelay = 0;
+	ct->ct_reconnects = 0;
+	ct->ct_rt_retries = 0;
+	ct->ct_rt_min_ms = CLNT_RTO_MIN_MS;
+	ct->ct_rt_max_ms = CLNT_RTO_MAX_MS;
+	ct->ct_seq = 0;
+	ct->ct_rx_seq = 0;
+	memset(&ct->ct_last_rx, 0, sizeof(ct->ct_last_rx));
+	memset(&ct->ct_probe_due, 0, sizeof(ct->ct_probe_due));
+	ct->ct_srtt8 = 0;
+	ct->ct_rttvar4 = 0;
+	memset(&ct->ct_rtt, 0, sizeof(ct->ct_rtt));
+	ct->ct_rtt.rs_rto_us = CLNT_RTO_INIT_MS * 1000;
+	memset(ct->ct_stats, 0, sizeof(ct->ct_stats));
 
 	/* Used as a condition to determine first frag */
 	ct->ct_record_state.rs_frag_remaining = -1;
@@ -345,10 +534,11 @@ clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 	ct->ct_record_state.rs_frag_offset = 0;
 	ct->ct_record_state.rs_fh_remaining = 4;
 	ct->ct_record_state.rs_recordsize = 0;
-	ct->ct_xid_to_ucb = ght_create(BUCKET_XID);
+	ct->ct_xid_to_ucb = ght_create_flat(BUCKET_XID, sizeof(u_int32_t), FALSE);
 
 	TAILQ_INIT(&ct->ct_sndlist);
 	TAILQ_INIT(&ct->ct_record_state.rs_frag_list);
+	TAILQ_INIT(&ct->ct_timers);
 
 	static_cmsg.rm_xid = create_xid();
 	static_cmsg.rm_direction = CALL;
@@ -360,7 +550,8 @@ clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 			XDR_ENCODE);
 
 	if(!xdr_callhdr(&(ct->ct_xdrs), &static_cmsg)) {
-		close(*sockp);
+		if(*sockp >= 0)
+			close(*sockp);
 		goto mem_free_return;
 	}
 
@@ -369,6 +560,11 @@ clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
 
 	xdrrec_create(&(ct->ct_xdrs), sbufsz, rbufsz, 
 			(caddr_t)ct, readtcp_nb, writetcp_nb);
+	/* x_public is not touched by xdrrec_create, but the NFS XDR
+	 * routines check it to decide whether to encode READ/WRITE
+	 * payloads. Make sure they always do on the way out.
+	 */
+	ct->ct_xdrs.x_public = NULL;
 
 	handle->cl_ops = &tcp_nb_ops;
 	handle->cl_private = (caddr_t)ct;
@@ -402,6 +598,25 @@ mem_free_return:
 }
 
 
+CLIENT *
+clnttcp_b_create(struct sockaddr_in *raddr, u_long prog,
+		u_long vers, int *sockp, u_int sbufsz, 
+		u_int rbufsz)
+{
+	return tcp_create(raddr, prog, vers, sockp, sbufsz, rbufsz, 0);
+}
+
+
+CLIENT *
+clnttcp_nb_create_deferred(struct sockaddr_in *raddr, u_long prog,
+		u_long vers, u_int sbufsz, u_int rbufsz)
+{
+	int sock = RPC_ANYSOCK;
+
+	return tcp_create(raddr, prog, vers, &sock, sbufsz, rbufsz, 1);
+}
+
+
 CLIENT *
 clnttcp_nb_create(struct sockaddr_in *raddr, u_long prog,
 		u_long vers, int *sockp, u_int sbufsz, 
@@ -430,6 +645,160 @@ clnttcp_nb_create(struct sockaddr_in *raddr, u_long prog,
 
 
 
+static void
+free_cbi(struct callback_info *cbi)
+{
+	if(cbi->cb_msg != NULL)
+		mem_free(cbi->cb_msg, cbi->cb_msgsz);
+	free(cbi);
+}
+
+
+/* Appends to the copy of the record of the call being encoded */
+static void
+capture_record(struct ct_data *ct, char *buf, int len)
+{
+	struct callback_info *cbi = ct->ct_capture;
+	char *msg = NULL;
+	u_int sz;
+
+	if(cbi->cb_msglen + len > cbi->cb_msgsz) {
+		/* Usually the whole record comes at once */
+		sz = cbi->cb_msglen + len;
+		if(sz < 2 * cbi->cb_msgsz)
+			sz = 2 * cbi->cb_msgsz;
+		msg = (char *)mem_alloc(sz);
+		if(msg == NULL) {
+			ct->ct_capture_failed = 1;
+			return;
+		}
+		if(cbi->cb_msg != NULL) {
+			memcpy(msg, cbi->cb_msg, cbi->cb_msglen);
+			mem_free(cbi->cb_msg, cbi->cb_msgsz);
+		}
+		cbi->cb_msg = msg;
+		cbi->cb_msgsz = sz;
+	}
+
+	memcpy(cbi->cb_msg + cbi->cb_msglen, buf, len);
+	cbi->cb_msglen += len;
+}
+
+
+/* Whether calls are kept as sent, for sending them again */
+static int
+keeps_copies(struct ct_data *ct)
+{
+	return (ct->ct_rc_attempts > 0) || (ct->ct_rt_retries > 0);
+}
+
+
+static int
+ts_before(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec < b->tv_sec)
+		|| ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+
+static int
+ms_until(struct timespec *t)
+{
+	struct timespec now;
+	long long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (long long)(t->tv_sec - now.tv_sec) * 1000
+		+ (t->tv_nsec - now.tv_nsec + 999999) / 1000000;
+
+	return (ms > 0) ? (int)ms : 0;
+}
+
+
+static void
+ms_from_now(struct timespec *t, int ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, t);
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (long)(ms % 1000) * 1000000;
+	if(t->tv_nsec >= 1000000000) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000;
+	}
+}
+
+
+/* Starts the timeout of a call sent at now, doubled for every time
+ * it was sent again.
+ */
+static void
+arm_timer(struct ct_data *ct, struct callback_info *cbi,
+		struct timespec *now)
+{
+	struct callback_info *prev = NULL;
+	long long us;
+
+	us = ct->ct_rtt.rs_rto_us;
+	if(cbi->cb_retries < 16)
+		us <<= cbi->cb_retries;
+	else
+		us = (long long)ct->ct_rt_max_ms * 1000;
+	if(us > (long long)ct->ct_rt_max_ms * 1000)
+		us = (long long)ct->ct_rt_max_ms * 1000;
+
+	cbi->cb_armed = *now;
+	cbi->cb_due = *now;
+	cbi->cb_due.tv_sec += us / 1000000;
+	cbi->cb_due.tv_nsec += (us % 1000000) * 1000;
+	if(cbi->cb_due.tv_nsec >= 1000000000) {
+		cbi->cb_due.tv_sec++;
+		cbi->cb_due.tv_nsec -= 1000000000;
+	}
+
+	/* Usually it expires last, look from the end */
+	prev = TAILQ_LAST(&ct->ct_timers, cbi_list_head);
+	while((prev != NULL) && ts_before(&cbi->cb_due, &prev->cb_due))
+		prev = TAILQ_PREV(prev, cbi_list_head, cb_timer);
+	if(prev == NULL)
+		TAILQ_INSERT_HEAD(&ct->ct_timers, cbi, cb_timer);
+	else
+		TAILQ_INSERT_AFTER(&ct->ct_timers, prev, cbi, cb_timer);
+}
+
+
+/* Feeds a round trip time into the estimates, as in Jacobson and
+ * Karels, "Congestion Avoidance and Control".
+ */
+static void
+rtt_sample(struct ct_data *ct, long long us)
+{
+	struct clnt_rtt_stats *rs = &ct->ct_rtt;
+	long long delta, rto;
+
+	if(rs->rs_samples++ == 0) {
+		ct->ct_srtt8 = us << 3;
+		ct->ct_rttvar4 = us << 1;
+	} else {
+		delta = us - (ct->ct_srtt8 >> 3);
+		ct->ct_srtt8 += delta;
+		if(delta < 0)
+			delta = -delta;
+		delta -= ct->ct_rttvar4 >> 2;
+		ct->ct_rttvar4 += delta;
+	}
+
+	rto = (ct->ct_srtt8 >> 3) + ct->ct_rttvar4;
+	if(rto < (long long)ct->ct_rt_min_ms * 1000)
+		rto = (long long)ct->ct_rt_min_ms * 1000;
+	if(rto > (long long)ct->ct_rt_max_ms * 1000)
+		rto = (long long)ct->ct_rt_max_ms * 1000;
+
+	rs->rs_srtt_us = ct->ct_srtt8 >> 3;
+	rs->rs_rttvar_us = ct->ct_rttvar4 >> 2;
+	rs->rs_rto_us = rto;
+}
+
+
 enum clnt_stat 
 clnttcp_nb_call(CLIENT *handle, u_long proc,
 		xdrproc_t inproc, caddr_t inargs, user_cb callback,
@@ -452,14 +821,53 @@ clnttcp_nb_call(CLIENT *handle, u_long proc,
 		return RPC_SYSTEMERROR;
 	cbi->callback = callback;
 	cbi->cb_private = usercb_priv;
+	cbi->cb_proc = proc;
+	cbi->cb_txbytes = ct->ct_datasubmitted;
+	cbi->cb_msg = NULL;
+	cbi->cb_msglen = 0;
+	cbi->cb_msgsz = 0;
+	cbi->cb_retries = 0;
+	cbi->cb_resent = 0;
+	clock_gettime(CLOCK_MONOTONIC, &cbi->cb_sent);
+
+	/* Calls made after giving up on the connection start over */
+	if(ct->ct_state == CT_FAILED) {
+		if(ct->ct_rc_attempts == 0) {
+			free(cbi);
+			ct->ct_error.re_status = RPC_CANTSEND;
+			return RPC_CANTSEND;
+		}
+		ct->ct_state = CT_WAITING;
+		ct->ct_attempts = 0;
+		ct->ct_retry_at = cbi->cb_sent;
+	}
+
+	/* Allocate here rather than when the reply comes in, so that
+	 * callers can tell which procedures have been used.
+	 */
+	if((proc < CLNT_MAXPROC) && (ct->ct_stats[proc] == NULL)) {
+		ct->ct_stats[proc] = (struct clnt_proc_stats *)
+			mem_alloc(sizeof(struct clnt_proc_stats));
+		if(ct->ct_stats[proc] != NULL) {
+			memset(ct->ct_stats[proc], 0,
+					sizeof(struct clnt_proc_stats));
+			ct->ct_stats[proc]->ps_min_us = ~0U;
+		}
+	}
 
 	xdrs = &ct->ct_xdrs;
 	/* Keep a copy of the xid being sent */
 	xid = (u_int32_t *)ct->ct_mcall;
 	--(*xid);
 	xid_host = ntohl(*xid);
+	cbi->cb_xid = xid_host;
+	cbi->cb_seq = ++ct->ct_seq;
 	xdrs->x_op = XDR_ENCODE;
 	ct->ct_error.re_status = RPC_SUCCESS;
+	ct->ct_capture = keeps_copies(ct) ? cbi : NULL;
+	ct->ct_capture_failed = 0;
+	ct->ct_txxid = xid_host;
+	ct->ct_txstart = 1;
 
 	/* Insert the callback into the hashtable */
 	ght_insert(ct->ct_xid_to_ucb, (void *)cbi, sizeof(u_int32_t),
@@ -469,15 +877,29 @@ clnttcp_nb_call(CLIENT *handle, u_long proc,
 			|| (!XDR_PUTLONG (xdrs, (long *) &proc))
 			|| (!AUTH_MARSHALL (handle->cl_auth, xdrs))
 			|| (!(*inproc)(xdrs, inargs)) 
-			|| (!xdrrec_endofrecord(xdrs, TRUE))) {
+			|| (!xdrrec_endofrecord(xdrs, TRUE))
+			|| ct->ct_capture_failed) {
 		/* If previously set status is still RPC_SUCCESS then
 		 * the problem is in encoding of args, return that */
-		ct->ct_error.re_status = RPC_CANTENCODEARGS;
+		if(ct->ct_capture_failed)
+			ct->ct_error.re_status = RPC_SYSTEMERROR;
+		else if(ct->ct_error.re_status == RPC_SUCCESS)
+			ct->ct_error.re_status = RPC_CANTENCODEARGS;
+		/* No reply will come for it */
+		ct->ct_capture = NULL;
+		ght_remove(ct->ct_xid_to_ucb, sizeof(u_int32_t),
+				(void *)&xid_host);
+		free_cbi(cbi);
 		return ct->ct_error.re_status;
 	}
+	ct->ct_capture = NULL;
 
+	cbi->cb_txbytes = ct->ct_datasubmitted - cbi->cb_txbytes;
+	if(ct->ct_rt_retries > 0)
+		arm_timer(ct, cbi, &cbi->cb_sent);
 	++ct->ct_pendingcalls;
-	clnttcp_nb_receive(handle, RPC_NONBLOCK_WAIT);
+	if((ct->ct_batch == 0) && (ct->ct_cork == 0))
+		clnttcp_nb_receive(handle, RPC_NONBLOCK_WAIT);
 	return RPC_SUCCESS;
 }
 
@@ -509,12 +931,33 @@ add_buffer_list(struct buf_list_head *head, char *buf, int len, bool_t nocopy)
 
 	new_frag->fb_len = len;
 	new_frag->fb_current = new_frag->fb_base;
+	new_frag->fb_xid = 0;
+	new_frag->fb_start = 0;
 
 	TAILQ_INSERT_TAIL(head, new_frag, fb_entries);
 
 	return 0;
 }
 
+/* Queues part of the record of call xid for sending, start if it is
+ * the first.
+ */
+static int
+queue_send(struct ct_data *ct, u_int32_t xid, char *buf, int len, int start)
+{
+	struct frag_buffer *fb = NULL;
+
+	if(add_buffer_list(&(ct->ct_sndlist), buf, len, FALSE) < 0)
+		return -1;
+
+	fb = TAILQ_LAST(&(ct->ct_sndlist), buf_list_head);
+	fb->fb_xid = xid;
+	fb->fb_start = start;
+	ct->ct_unsent += len;
+	ct->ct_datasubmitted += len;
+	return 0;
+}
+
 static int 
 update_new_frag_state(struct rpc_record_state *rs, char *buf, int bufsz)
 {
@@ -590,7 +1033,88 @@ collate_buf_list(struct rpc_record_state *rs, u_long *bsize)
 	return rpc_msg;
 }
 
+/* Index of the histogram bucket for a latency of us microseconds */
+static int
+hist_bucket(u_int32_t us)
+{
+	int p = 0;
+
+	if(us < CLNT_HIST_SUB)
+		return us;
+
+	/* Position of the highest bit set, at least 3 here */
+	while((us >> p) > 1)
+		p++;
+
+	return (p - 2) * CLNT_HIST_SUB + ((us >> (p - 3)) & (CLNT_HIST_SUB - 1));
+}
+
+/* Largest latency that falls into bucket b */
+static u_int32_t
+hist_bucket_max(int b)
+{
+	int p;
+
+	if(b < CLNT_HIST_SUB)
+		return b;
+
+	p = b / CLNT_HIST_SUB + 2;
+	return (((CLNT_HIST_SUB + (b % CLNT_HIST_SUB)) << (p - 3))
+			+ (1U << (p - 3)) - 1);
+}
+
+/* Accounts for the reply to cbi, in the statistics and the round
+ * trip time estimates.
+ */
 static void
+record_stats(struct ct_data *ct, struct callback_info *cbi,
+		struct rpc_msg *msg, u_long rxbytes)
+{
+	struct clnt_proc_stats *ps = NULL;
+	struct timespec now;
+	long long us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - cbi->cb_sent.tv_sec) * 1000000LL
+		+ (now.tv_nsec - cbi->cb_sent.tv_nsec) / 1000;
+	if(us < 0)
+		us = 0;
+	if(us > 0xffffffffLL)
+		us = 0xffffffffLL;
+
+	ct->ct_last_rx = now;
+	if(cbi->cb_seq > ct->ct_rx_seq)
+		ct->ct_rx_seq = cbi->cb_seq;
+
+	/* Karn: the reply may be to any of the copies sent */
+	if((cbi->cb_retries == 0) && !cbi->cb_resent)
+		rtt_sample(ct, us);
+
+	if(cbi->cb_proc >= CLNT_MAXPROC)
+		return;
+
+	ps = ct->ct_stats[cbi->cb_proc];
+	if(ps == NULL)
+		return;
+
+	ps->ps_calls++;
+	if((msg->rm_reply.rp_stat != MSG_ACCEPTED)
+			|| (msg->acpted_rply.ar_stat != SUCCESS))
+		ps->ps_errors++;
+	ps->ps_txbytes += cbi->cb_txbytes;
+	ps->ps_rxbytes += rxbytes;
+	ps->ps_sum_us += us;
+	if(us < ps->ps_min_us)
+		ps->ps_min_us = us;
+	if(us > ps->ps_max_us)
+		ps->ps_max_us = us;
+	ps->ps_hist[hist_bucket(us)]++;
+}
+
+/* Returns 1 if the reply was to a pending call, whose callback was
+ * called, else 0. Replies to calls sent again may come twice.
+ */
+static int
 call_user_cb(struct ct_data *ct)
 {
 	XDR xdr;
@@ -601,11 +1125,11 @@ call_user_cb(struct ct_data *ct)
 	struct callback_info * cbi = NULL;
 
 	if(ct == NULL)
-		return;
+		return 0;
 
 	rs = &(ct->ct_record_state);
 	if(rs == NULL)
-		return;
+		return 0;
 
 	msg.acpted_rply.ar_verf = _null_auth;
 	msg.acpted_rply.ar_results.where = NULL;
@@ -613,12 +1137,12 @@ call_user_cb(struct ct_data *ct)
 
 	/* Aggregate the frag buffers into a contiguous area */
 	if((rpc_msg = collate_buf_list(rs, &bufsize)) == NULL)
-		return;
+		return 0;
 	
 	xdrmem_create(&xdr, rpc_msg, bufsize, XDR_DECODE);
 	if(!xdr_replymsg(&xdr, &msg)) {
 		mem_free(rpc_msg, bufsize);
-		return;
+		return 0;
 	}
 
 	ct->ct_datarx += bufsize;
@@ -633,10 +1157,13 @@ call_user_cb(struct ct_data *ct)
 	cbi = ght_get(ct->ct_xid_to_ucb, sizeof(u_int32_t), (void *)&msg.rm_xid);
 	if(cbi == NULL) {
 		mem_free(rpc_msg, bufsize);
-		return;
+		return 0;
 	}
 
 	ght_remove(ct->ct_xid_to_ucb, sizeof(u_int32_t), (void *)&msg.rm_xid);
+	if(ct->ct_rt_retries > 0)
+		TAILQ_REMOVE(&ct->ct_timers, cbi, cb_timer);
+	record_stats(ct, cbi, &msg, bufsize);
 
 	/* This is very xdrmem specific. I need the pointer to
 	 * location from which NFS data is located, right after the
@@ -647,9 +1174,9 @@ call_user_cb(struct ct_data *ct)
 		cbi->callback(xdr.x_private, xdr.x_handy, cbi->cb_private);
 
 	mem_free(rpc_msg, bufsize);
-	free(cbi);
+	free_cbi(cbi);
 
-	return;
+	return 1;
 }
 
 static int
@@ -677,8 +1204,8 @@ update_record_state(struct ct_data *ct)
 	 * message.
 	 */
 	if(rs->rs_last_frag) {
-		call_user_cb(ct);
-		called_back = 1;
+		called_back = call_user_cb(ct);
+		rs->rs_recordsize = 0;
 	}
 
 	/* The first thing functions that follow, will look for is a
@@ -686,7 +1213,6 @@ update_record_state(struct ct_data *ct)
 	 */
 	rs->rs_fh_remaining = 4;
 	rs->rs_frag_remaining = -1;
-	rs->rs_recordsize = 0;
 
 	return called_back;
 }
@@ -735,14 +1261,28 @@ update_frag_state(struct ct_data *ct, char *buf, int bufsz)
 	return called_back;
 }
 
-/* Returns the count of callbacks executed. */
+/* Milliseconds until the first retransmission timeout, or -1 */
+static int
+next_timer(struct ct_data *ct)
+{
+	struct callback_info *cbi = TAILQ_FIRST(&ct->ct_timers);
+
+	if((ct->ct_rt_retries == 0) || (cbi == NULL))
+		return -1;
+
+	return ms_until(&cbi->cb_due);
+}
+
+/* Returns the count of callbacks executed. A blocking wait also
+ * returns when a retransmission timeout expires.
+ */
 static int 
 rpc_cb(int fd, struct ct_data *ct, int flag)
 {
 	char *rbuf = NULL;
 	int toread, read_len = 0;
 	int called_back = 0;
-	fd_set rset;
+	struct pollfd pfd;
 	int fd_count;
 
 	if(ct == NULL)
@@ -751,16 +1291,16 @@ rpc_cb(int fd, struct ct_data *ct, int flag)
 	toread = ct->ct_rbufsz;
 	rbuf = ct->ct_readbuf;
 
-	if((is_nonblocking(ct->ct_sockflags)) && (is_blocking(flag))) {
+	if(is_blocking(flag)) {
 block_again:
-		FD_ZERO(&rset);
-		FD_SET(fd, &rset);
-		fd_count = select(fd + 1, &rset, NULL, NULL, NULL);
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		fd_count = poll(&pfd, 1, next_timer(ct));
 		if(fd_count < 0)
 			goto block_again;
 
-		if(!FD_ISSET(fd, &rset))
-			goto block_again;
+		if(fd_count == 0)
+			return called_back;
 	}
 
 	/* Read the buffer and simply pass it onto the fragment and
@@ -777,16 +1317,24 @@ block_again:
 		if(called_back)
 			break;
 		
-		/* if socket is non-blocking but in this instance, it
-		 * needs blocking behaviour, we should use select to
-		 * wait and not loop in this read loop.
+		/* if this instance needs blocking behaviour, we should
+		 * use poll to wait and not loop in this read loop, so
+		 * that the timers keep running.
 		 */
-		if(is_nonblocking(ct->ct_sockflags)) {
-			if(is_blocking(flag))
-				goto block_again;
-			else
-				break;
-		}
+		if(is_blocking(flag))
+			goto block_again;
+		if(is_nonblocking(ct->ct_sockflags))
+			break;
+	}
+
+	/* The server closed the connection, or it broke. Noted for
+	 * clnt_geterr(), no reply will come for the pending calls.
+	 */
+	if((read_len == 0) || ((read_len < 0) && (errno != EAGAIN)
+				&& (errno != EWOULDBLOCK) && (errno != EINTR))) {
+		ct->ct_error.re_status = RPC_CANTRECV;
+		ct->ct_error.re_errno = (read_len == 0) ? ECONNRESET : errno;
+		ct->ct_broken = 1;
 	}
 
 	return called_back;
@@ -799,13 +1347,16 @@ readtcp_nb(char *ct_handle, char *buf, int len)
 	return 0;
 }
 
+/* Writes what is queued, as many buffers per sendmsg() as allowed */
 static int
 send_buffers(int sockfd, struct ct_data * ct, int flag)
 {
 	struct frag_buffer *buf, *tvar;
-	int written;
+	struct iovec iov[SEND_IOV];
+	struct msghdr msg;
+	ssize_t written, total, left;
 	fd_set wset;
-	int fd_count;
+	int fd_count, n, more;
 	struct buf_list_head * head = NULL;
 
 	if(ct == NULL)
@@ -815,7 +1366,7 @@ send_buffers(int sockfd, struct ct_data * ct, int flag)
 	if(head == NULL)
 		return -1;
 	
-	TAILQ_FOREACH_SAFE(buf, head, fb_entries, tvar) {
+	while(!TAILQ_EMPTY(head)) {
 
 		/* If the socket is non-blocking but for this
 		 * invocation we need a blocking.
@@ -831,13 +1382,39 @@ write_block_again:
 			if(!FD_ISSET(sockfd, &wset))
 				goto write_block_again;
 		}
-	
+
+		n = 0;
+		total = 0;
+		more = 0;
+		TAILQ_FOREACH(buf, head, fb_entries) {
+			if(n == SEND_IOV) {
+				more = 1;
+				break;
+			}
+			iov[n].iov_base = buf->fb_current;
+			iov[n].iov_len = buf->fb_len;
+			total += buf->fb_len;
+			n++;
+		}
+
+		/* With more to come, let TCP fill the segments up */
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
 		errno = 0;
-		written = write(sockfd, buf->fb_current, buf->fb_len);
+#ifdef MSG_MORE
+		written = sendmsg(sockfd, &msg, more ? MSG_MORE : 0);
+#else
+		written = sendmsg(sockfd, &msg, 0);
+#endif
 
 		if(written < 0) {
-			if(errno != EAGAIN)
+			if(errno != EAGAIN) {
+				ct->ct_error.re_status = RPC_CANTSEND;
+				ct->ct_error.re_errno = errno;
+				ct->ct_broken = 1;
 				return -1;
+			}
 			/* EAGAIN with written < 0 should only happen when
 			 * socket is O_NONBLOCK. Now if this 
 			 * invocation of send_buffers requires blocking	
@@ -850,98 +1427,525 @@ write_block_again:
 		}
 
 		ct->ct_datatx += written;
-		/* Write returned after writing partial
-		 * buffer. Update the buffer state now.
+		ct->ct_unsent -= written;
+
+		/* Free what went out, and update the state of the
+		 * buffer it stopped in, if any.
 		 */
-		if(written < buf->fb_len) {
-			buf->fb_current += written;
-			buf->fb_len -= written;
-
-			/* Again, if partial write happens, we need to
-			 * know if blocking write is required. If it
-			 * is, then head back up and wait for for
-			 * readiness.
-			 */
+		left = written;
+		TAILQ_FOREACH_SAFE(buf, head, fb_entries, tvar) {
+			if(left < buf->fb_len) {
+				buf->fb_current += left;
+				buf->fb_len -= left;
+				break;
+			}
+			left -= buf->fb_len;
+			TAILQ_REMOVE(head, buf, fb_entries);
+			mem_free(buf->fb_base, buf->fb_len);
+			mem_free(buf, sizeof(struct frag_buffer));
+		}
+
+		/* Again, if partial write happens, we need to
+		 * know if blocking write is required. If it
+		 * is, then head back up and wait for for
+		 * readiness.
+		 */
+		if(written < total) {
 			if(is_blocking(flag))
 				goto write_block_again;
 			else
 				return 0;
 		}
-
-		TAILQ_REMOVE(head, buf, fb_entries);
-		mem_free(buf->fb_base, buf->fb_len);
-		mem_free(buf, sizeof(struct frag_buffer));
 	}
 
 	return 0;
 }
 
-int
-clnttcp_nb_receive(CLIENT * handle, int flag)
+/* Frees the buffers of the current record and fragment, and starts
+ * on a new record.
+ */
+static void
+reset_record_state(struct rpc_record_state *rs)
 {
-	struct ct_data * ct = NULL;
-	int called_back = 0;
-
-	if(handle == NULL)
-		return 0;
+	struct frag_buffer *fb, *tmp;
 
-	ct = (struct ct_data *)handle->cl_private;
-	if(ct == NULL)
-		return 0;
+	TAILQ_FOREACH_SAFE(fb, &(rs->rs_frag_list), fb_entries, tmp) {
+		TAILQ_REMOVE(&(rs->rs_frag_list), fb, fb_entries);
+		mem_free(fb->fb_base, fb->fb_len);
+		mem_free(fb, sizeof(struct frag_buffer));
+	}
 
-	/* Dont flush the buffer in this invocation if the flag
-	 * specifies so.
-	 */
-	if(flush_tx_buffer(flag))
-		send_buffers(ct->ct_sock, ct, flag);
-	/* If there are no pending calls, what am I supposed to
-	 * receive a reply for.
-	 */
-	if(ct->ct_pendingcalls == 0)
-		return 0;
+	/* A fragment still being read is not on the list yet */
+	if(rs->rs_frag_remaining > 0)
+		mem_free(rs->rs_frag_buf_base, rs->rs_frag_bufsz);
 
-	/* Dont go reading from the socket if the flag says so.
-	 */
-	if(read_rpc_response(flag)) {
-		called_back = rpc_cb(ct->ct_sock, ct, flag);
-		ct->ct_pendingcalls -= called_back;
-	}
-	return called_back;
+	rs->rs_frag_remaining = -1;
+	rs->rs_frag_buf_base = NULL;
+	rs->rs_frag_bufsz = 0;
+	rs->rs_frag_offset = 0;
+	rs->rs_fh_remaining = 4;
+	rs->rs_recordsize = 0;
 }
 
 
-static int 
-writetcp_nb(char *ct_handle, char *buf, int len)
+static void
+free_sndlist(struct ct_data *ct)
 {
-	struct ct_data *ct = (struct ct_data *)ct_handle;
+	struct frag_buffer *fb, *tmp;
 
-	if(ct == NULL)
-		return -1;
+	TAILQ_FOREACH_SAFE(fb, &(ct->ct_sndlist), fb_entries, tmp) {
+		TAILQ_REMOVE(&(ct->ct_sndlist), fb, fb_entries);
+		mem_free(fb->fb_base, fb->fb_len);
+		mem_free(fb, sizeof(struct frag_buffer));
+	}
+	ct->ct_unsent = 0;
+}
 
-	if((add_buffer_list(&(ct->ct_sndlist), buf, len, FALSE)) < 0)
-		return -1;
 
-	/* At this point there is at least one buffer pending in the
-	 * list.
-	 * We want the record stream layer above us to continue
-	 * normally, even though we might not have written all the
-	 * data given to us. But we have copied it in for sending at a 
-	 * time when we cant block.
+/* Calls the callbacks of all pending calls with a NULL message.
+ * Returns their number, -1 if out of memory.
+ */
+static int
+fail_pending(struct ct_data *ct)
+{
+	struct callback_info **cbis = NULL;
+	struct callback_info *cbi = NULL;
+	struct fail_list fl;
+	ght_iterator_t iter;
+	const void *key;
+	int i, n = 0;
+
+	/* Take them all out of the table first, the callbacks may
+	 * make new calls. Those cancelling calls still to be called
+	 * back find them on ct_failing.
 	 */
-	if((send_buffers(ct->ct_sock, ct, RPC_NONBLOCK_WAIT)) == 0)
-		return len;
-	else
+	cbis = (struct callback_info **)malloc((ght_size(ct->ct_xid_to_ucb)
+				+ 1) * sizeof(struct callback_info *));
+	if(cbis == NULL)
 		return -1;
+	for(cbi = ght_first(ct->ct_xid_to_ucb, &iter, &key); cbi != NULL;
+			cbi = ght_next(ct->ct_xid_to_ucb, &iter, &key))
+		cbis[n++] = cbi;
+	ght_remove_all(ct->ct_xid_to_ucb);
+	TAILQ_INIT(&ct->ct_timers);
+	ct->ct_pendingcalls = 0;
+
+	fl.fl_cbis = cbis;
+	fl.fl_n = n;
+	fl.fl_up = ct->ct_failing;
+	ct->ct_failing = &fl;
+	for(i = 0; i < n; i++) {
+		cbi = cbis[i];
+		fl.fl_next = i + 1;
+		if(cbi == NULL)
+			continue;
+		if(cbi->callback != NULL)
+			cbi->callback(NULL, 0, cbi->cb_private);
+		free_cbi(cbi);
+	}
+	ct->ct_failing = fl.fl_up;
+	free(cbis);
+
+	return n;
 }
 
 
-void
-clnttcp_nb_destroy (CLIENT *h)
+/* Returns the number of calls failed */
+static int
+give_up(struct ct_data *ct)
 {
-	struct ct_data *ct = NULL;
-	struct rpc_record_state *rs = NULL;
-	struct frag_buffer *fb, *tmp;
-	fb = tmp = NULL;
+	int n;
+
+	ct->ct_state = CT_FAILED;
+	ct->ct_error.re_status = RPC_CANTRECV;
+	ct->ct_error.re_errno = ECONNRESET;
+	n = fail_pending(ct);
+
+	return (n > 0) ? n : 0;
+}
+
+
+/* Drops the broken connection, and what was queued or half read on
+ * it. Returns the number of calls failed, if not reconnecting.
+ */
+static int
+disconnect(struct ct_data *ct)
+{
+	socklen_t len = sizeof(int);
+	int flag = 0;
+
+	if(getsockopt(ct->ct_sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag,
+				&len) == 0)
+		ct->ct_nodelay = flag;
+	close(ct->ct_sock);
+	ct->ct_sock = -1;
+	ct->ct_broken = 0;
+	free_sndlist(ct);
+	reset_record_state(&ct->ct_record_state);
+
+	if(ct->ct_rc_attempts == 0)
+		return give_up(ct);
+
+	/* Nothing to send again, connect when the next call comes */
+	if(ct->ct_pendingcalls == 0) {
+		ct->ct_state = CT_FAILED;
+		return 0;
+	}
+
+	ct->ct_state = CT_WAITING;
+	ct->ct_attempts = 0;
+	ms_from_now(&ct->ct_retry_at, 0);
+	return 0;
+}
+
+
+/* Returns the number of calls failed by giving up */
+static int
+attempt_failed(struct ct_data *ct)
+{
+	int ms;
+
+	if(ct->ct_sock >= 0) {
+		close(ct->ct_sock);
+		ct->ct_sock = -1;
+	}
+
+	if(++ct->ct_attempts >= ct->ct_rc_attempts)
+		return give_up(ct);
+
+	ms = ct->ct_rc_max_ms;
+	if((ct->ct_attempts <= 16)
+			&& ((ct->ct_rc_min_ms << (ct->ct_attempts - 1)) < ms))
+		ms = ct->ct_rc_min_ms << (ct->ct_attempts - 1);
+	ct->ct_state = CT_WAITING;
+	ms_from_now(&ct->ct_retry_at, ms);
+	return 0;
+}
+
+
+/* Queues the pending calls for sending again on the new connection */
+static void
+connected(struct ct_data *ct)
+{
+	struct callback_info *cbi = NULL;
+	struct timespec now;
+	ght_iterator_t iter;
+	const void *key;
+
+	ct->ct_state = CT_CONNECTED;
+	ct->ct_attempts = 0;
+	if(ct->ct_deferred)
+		ct->ct_deferred = 0;
+	else
+		ct->ct_reconnects++;
+	ct->ct_error.re_status = RPC_SUCCESS;
+
+	/* The timeouts start over from now */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	TAILQ_INIT(&ct->ct_timers);
+
+	for(cbi = ght_first(ct->ct_xid_to_ucb, &iter, &key); cbi != NULL;
+			cbi = ght_next(ct->ct_xid_to_ucb, &iter, &key)) {
+		cbi->cb_resent = 1;
+		if(ct->ct_rt_retries > 0)
+			arm_timer(ct, cbi, &now);
+		queue_send(ct, cbi->cb_xid, cbi->cb_msg, cbi->cb_msglen, 1);
+	}
+}
+
+
+/* Starts an attempt to connect. Returns the number of calls failed
+ * by giving up.
+ */
+static int
+start_connect(struct ct_data *ct)
+{
+	int flag = 1;
+
+	ct->ct_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(ct->ct_sock < 0)
+		return attempt_failed(ct);
+
+	/* we dont care if a reserved port was bound */
+	bindresvport(ct->ct_sock, (struct sockaddr_in *)0);
+	if(ct->ct_nodelay)
+		setsockopt(ct->ct_sock, IPPROTO_TCP, TCP_NODELAY,
+				(char *)&flag, sizeof(flag));
+	if(is_nonblocking(ct->ct_sockflags)
+			&& (set_fd_nonblocking(ct->ct_sock) < 0))
+		return attempt_failed(ct);
+
+	if(connect(ct->ct_sock, (struct sockaddr *)&ct->ct_addr,
+				sizeof(ct->ct_addr)) == 0) {
+		connected(ct);
+		return 0;
+	}
+
+	if(errno != EINPROGRESS)
+		return attempt_failed(ct);
+
+	/* The attempt may take as long as the longest wait between two */
+	ct->ct_state = CT_CONNECTING;
+	ms_from_now(&ct->ct_retry_at, ct->ct_rc_max_ms);
+	return 0;
+}
+
+
+/* Moves a broken connection towards a new one, waiting for it if the
+ * flag asks for blocking. Returns the number of calls failed by
+ * giving up.
+ */
+static int
+recover(struct ct_data *ct, int flag)
+{
+	struct pollfd pfd;
+	socklen_t len;
+	int ms, ret, err;
+
+	while((ct->ct_state == CT_WAITING) || (ct->ct_state == CT_CONNECTING)) {
+		ms = ms_until(&ct->ct_retry_at);
+
+		if(ct->ct_state == CT_WAITING) {
+			if(ms > 0) {
+				if(is_nonblocking(flag))
+					return 0;
+				poll(NULL, 0, ms);
+				continue;
+			}
+			if((ret = start_connect(ct)) > 0)
+				return ret;
+			continue;
+		}
+
+		pfd.fd = ct->ct_sock;
+		pfd.events = POLLOUT;
+		ret = poll(&pfd, 1, is_blocking(flag) ? ms : 0);
+		if(ret < 0) {
+			if(is_nonblocking(flag))
+				return 0;
+			continue;
+		}
+
+		if(ret == 0) {
+			if(ms > 0) {
+				if(is_nonblocking(flag))
+					return 0;
+				continue;
+			}
+			/* Took too long */
+			if((ret = attempt_failed(ct)) > 0)
+				return ret;
+			continue;
+		}
+
+		err = 0;
+		len = sizeof(err);
+		if((getsockopt(ct->ct_sock, SOL_SOCKET, SO_ERROR, (char *)&err,
+					&len) < 0) || (err != 0)) {
+			if((ret = attempt_failed(ct)) > 0)
+				return ret;
+			continue;
+		}
+		connected(ct);
+	}
+
+	return 0;
+}
+
+
+/* Sends the calls whose timeout expired again, and fails those that
+ * were sent again often enough already. Returns the number failed.
+ */
+static int
+retransmit(struct ct_data *ct)
+{
+	struct callback_info *cbi = NULL;
+	struct clnt_proc_stats *ps = NULL;
+	struct timespec now;
+	int failed = 0, backlog, quiet;
+
+	if((ct->ct_rt_retries == 0) || TAILQ_EMPTY(&ct->ct_timers))
+		return 0;
+
+	/* The server is not reading, the timers start over */
+	backlog = (ct->ct_unsent > 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while(((cbi = TAILQ_FIRST(&ct->ct_timers)) != NULL)
+			&& !ts_before(&now, &cbi->cb_due)) {
+		TAILQ_REMOVE(&ct->ct_timers, cbi, cb_timer);
+
+		/* Replies keep coming, but none to calls made after
+		 * this one: the server is working through a backlog
+		 * and has likely not got to it yet. Over TCP a call is
+		 * only lost when it dropped it, and then it answers
+		 * later ones, or when it stopped answering at all.
+		 */
+		quiet = !ts_before(&cbi->cb_armed, &ct->ct_last_rx);
+		if(backlog || ((ct->ct_rx_seq < cbi->cb_seq) && !quiet)) {
+			arm_timer(ct, cbi, &now);
+			continue;
+		}
+
+		ps = (cbi->cb_proc < CLNT_MAXPROC) ? ct->ct_stats[cbi->cb_proc]
+			: NULL;
+		if(cbi->cb_retries >= ct->ct_rt_retries) {
+			ght_remove(ct->ct_xid_to_ucb, sizeof(u_int32_t),
+					(void *)&cbi->cb_xid);
+			--ct->ct_pendingcalls;
+			ct->ct_rtt.rs_timeouts++;
+			if(ps != NULL)
+				ps->ps_timeouts++;
+			ct->ct_error.re_status = RPC_TIMEDOUT;
+			ct->ct_error.re_errno = 0;
+			if(cbi->callback != NULL)
+				cbi->callback(NULL, 0, cbi->cb_private);
+			free_cbi(cbi);
+			failed++;
+			continue;
+		}
+
+		/* A server that answers nothing may be stuck or just
+		 * slow, sending it all pending calls again would only
+		 * make that worse. One call per timeout probes it, the
+		 * others wait, their timeouts backing off all the same.
+		 */
+		cbi->cb_retries++;
+		if(quiet && ts_before(&now, &ct->ct_probe_due)) {
+			arm_timer(ct, cbi, &now);
+			continue;
+		}
+
+		if(queue_send(ct, cbi->cb_xid, cbi->cb_msg, cbi->cb_msglen,
+					1) == 0) {
+			ct->ct_rtt.rs_retrans++;
+			if(ps != NULL)
+				ps->ps_retrans++;
+		}
+		arm_timer(ct, cbi, &now);
+		if(quiet)
+			ct->ct_probe_due = cbi->cb_due;
+	}
+
+	return failed;
+}
+
+
+int
+clnttcp_nb_receive(CLIENT * handle, int flag)
+{
+	struct ct_data * ct = NULL;
+	int called_back = 0, n;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	/* When called from inside a user callback, only send. The outer
+	 * rpc_cb() will pick up the reply for the new call, and is
+	 * still using the connection.
+	 */
+	if(ct->ct_rx_busy) {
+		if(flush_tx_buffer(flag) && (ct->ct_state == CT_CONNECTED))
+			send_buffers(ct->ct_sock, ct, flag);
+		return 0;
+	}
+
+	for(;;) {
+		if(ct->ct_state != CT_CONNECTED) {
+			called_back += recover(ct, flag);
+			if(ct->ct_state != CT_CONNECTED)
+				break;
+		}
+
+		called_back += retransmit(ct);
+
+		/* Dont flush the buffer in this invocation if the flag
+		 * specifies so.
+		 */
+		if(flush_tx_buffer(flag))
+			send_buffers(ct->ct_sock, ct, flag);
+
+		/* If there are no pending calls, what am I supposed
+		 * to receive a reply for. Dont go reading from the
+		 * socket if the flag says so either. Calls failed by
+		 * their timeout count as replies for a blocking wait.
+		 */
+		if((ct->ct_pendingcalls > 0) && read_rpc_response(flag)
+				&& !ct->ct_broken && (called_back == 0)) {
+			ct->ct_rx_busy = 1;
+			n = rpc_cb(ct->ct_sock, ct, flag);
+			ct->ct_rx_busy = 0;
+			ct->ct_pendingcalls -= n;
+			called_back += n;
+		}
+
+		if(ct->ct_broken) {
+			called_back += disconnect(ct);
+			if(called_back > 0)
+				break;
+			continue;
+		}
+
+		/* A blocking wait that returned for a timeout goes on */
+		if(is_blocking(flag) && (called_back == 0)
+				&& (ct->ct_pendingcalls > 0)
+				&& read_rpc_response(flag))
+			continue;
+		break;
+	}
+
+	return called_back;
+}
+
+
+static int 
+writetcp_nb(char *ct_handle, char *buf, int len)
+{
+	struct ct_data *ct = (struct ct_data *)ct_handle;
+
+	if(ct == NULL)
+		return -1;
+
+	if(ct->ct_capture != NULL)
+		capture_record(ct, buf, len);
+
+	/* Sent from the copy once connected again */
+	if((ct->ct_state != CT_CONNECTED) || ct->ct_broken)
+		return (ct->ct_capture != NULL) ? len : -1;
+
+	if(queue_send(ct, ct->ct_txxid, buf, len, ct->ct_txstart) < 0)
+		return -1;
+	ct->ct_txstart = 0;
+	if((ct->ct_batch > 0) || (ct->ct_unsent < ct->ct_cork))
+		return len;
+
+	/* At this point there is at least one buffer pending in the
+	 * list.
+	 * We want the record stream layer above us to continue
+	 * normally, even though we might not have written all the
+	 * data given to us. But we have copied it in for sending at a 
+	 * time when we cant block.
+	 */
+	if((send_buffers(ct->ct_sock, ct, RPC_NONBLOCK_WAIT)) == 0)
+		return len;
+
+	/* The connection broke, see clnttcp_nb_receive() */
+	return (ct->ct_capture != NULL) ? len : -1;
+}
+
+
+void
+clnttcp_nb_destroy (CLIENT *h)
+{
+	struct ct_data *ct = NULL;
+	struct callback_info *cbi = NULL;
+	ght_iterator_t iter;
+	const void *key;
+	int i;
 
 	if(h == NULL)
 		return;
@@ -950,30 +1954,589 @@ clnttcp_nb_destroy (CLIENT *h)
 	if(ct == NULL)
 		goto hfree;
 
-	close(ct->ct_sock);
+	if(ct->ct_sock >= 0)
+		close(ct->ct_sock);
+
+	/* Calls that never got a reply */
+	for(cbi = ght_first(ct->ct_xid_to_ucb, &iter, &key); cbi != NULL;
+			cbi = ght_next(ct->ct_xid_to_ucb, &iter, &key))
+		free_cbi(cbi);
 	ght_finalize(ct->ct_xid_to_ucb);
 
-	rs = &(ct->ct_record_state);
-	if(rs != NULL) {
-		TAILQ_FOREACH_SAFE(fb, &(rs->rs_frag_list), fb_entries, tmp) {
-			TAILQ_REMOVE(&(rs->rs_frag_list), fb, fb_entries);
-			mem_free(fb->fb_base, fb->fb_len);
-			mem_free(fb, sizeof(struct frag_base));
-		}
-	}
+	for(i = 0; i < CLNT_MAXPROC; i++)
+		if(ct->ct_stats[i] != NULL)
+			mem_free(ct->ct_stats[i], sizeof(struct clnt_proc_stats));
 
-	TAILQ_FOREACH_SAFE(fb, &(ct->ct_sndlist), fb_entries, tmp) {
-			TAILQ_REMOVE(&(ct->ct_sndlist), fb, fb_entries);
-			mem_free(fb->fb_base, fb->fb_len);
-			mem_free(fb, sizeof(struct frag_base));
-		}
+	reset_record_state(&(ct->ct_record_state));
+	free_sndlist(ct);
 
+	XDR_DESTROY(&(ct->ct_xdrs));
+	mem_free(ct->ct_readbuf, ct->ct_rbufsz);
 	mem_free ((caddr_t)ct, sizeof(struct ct_data));
 
 hfree:
+	if(h->cl_auth != NULL)
+		AUTH_DESTROY(h->cl_auth);
 	mem_free ((caddr_t)h, sizeof(CLIENT));
 }
 
+static void
+clnttcp_nb_geterr(CLIENT *handle, struct rpc_err *err)
+{
+	struct ct_data *ct = (struct ct_data *)handle->cl_private;
+
+	*err = ct->ct_error;
+}
+
+
+int
+clnttcp_nb_pending(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	return ct->ct_pendingcalls;
+}
+
+
+unsigned long
+clnttcp_nb_unsent(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	return ct->ct_unsent;
+}
+
+
+int
+clnttcp_nb_fail(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	return fail_pending(ct);
+}
+
+
+/* Drops the records of call xid from the send list that nothing has
+ * been written of yet. A record partly written stays, or the stream
+ * would fall out of step.
+ */
+static void
+unqueue_send(struct ct_data *ct, u_int32_t xid)
+{
+	struct frag_buffer *fb, *tmp;
+	int drop = 0;
+
+	TAILQ_FOREACH_SAFE(fb, &(ct->ct_sndlist), fb_entries, tmp) {
+		if(fb->fb_start)
+			drop = (fb->fb_xid == xid)
+				&& (fb->fb_current == fb->fb_base);
+		else if(fb->fb_xid != xid)
+			drop = 0;
+		if(!drop)
+			continue;
+
+		TAILQ_REMOVE(&(ct->ct_sndlist), fb, fb_entries);
+		ct->ct_unsent -= fb->fb_len;
+		mem_free(fb->fb_base, fb->fb_len);
+		mem_free(fb, sizeof(struct frag_buffer));
+	}
+}
+
+
+/* Forgets a pending call without calling back */
+static void
+cancel_call(struct ct_data *ct, struct callback_info *cbi)
+{
+	ght_remove(ct->ct_xid_to_ucb, sizeof(u_int32_t),
+			(void *)&cbi->cb_xid);
+	if(ct->ct_rt_retries > 0)
+		TAILQ_REMOVE(&ct->ct_timers, cbi, cb_timer);
+	unqueue_send(ct, cbi->cb_xid);
+	--ct->ct_pendingcalls;
+	free_cbi(cbi);
+}
+
+
+/* Cancels calls fail_pending() has yet to call back: the one with
+ * xid if by_xid, else all made with priv. Returns their number.
+ */
+static int
+cancel_failing(struct ct_data *ct, int by_xid, u_int32_t xid, void *priv)
+{
+	struct fail_list *fl = NULL;
+	struct callback_info *cbi = NULL;
+	int i, n = 0;
+
+	for(fl = ct->ct_failing; fl != NULL; fl = fl->fl_up) {
+		for(i = fl->fl_next; i < fl->fl_n; i++) {
+			cbi = fl->fl_cbis[i];
+			if((cbi == NULL) || (by_xid ? (cbi->cb_xid != xid)
+						: (cbi->cb_private != priv)))
+				continue;
+
+			fl->fl_cbis[i] = NULL;
+			free_cbi(cbi);
+			n++;
+			if(by_xid)
+				return n;
+		}
+	}
+
+	return n;
+}
+
+
+void
+clnttcp_nb_batch_begin(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return;
+
+	ct->ct_batch++;
+}
+
+
+int
+clnttcp_nb_batch_end(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if((ct == NULL) || (ct->ct_batch == 0))
+		return 0;
+
+	if(--ct->ct_batch > 0)
+		return 0;
+
+	return clnttcp_nb_receive(handle, RPC_NONBLOCK_WAIT);
+}
+
+
+int
+clnttcp_nb_set_cork(CLIENT *handle, unsigned long bytes)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return -1;
+
+	ct->ct_cork = bytes;
+	if((ct->ct_unsent >= bytes) && (ct->ct_batch == 0))
+		clnttcp_nb_flush(handle);
+	return 0;
+}
+
+
+unsigned long
+clnttcp_nb_flush(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	if((ct->ct_state == CT_CONNECTED) && !ct->ct_broken)
+		send_buffers(ct->ct_sock, ct, RPC_NONBLOCK_WAIT);
+	return ct->ct_unsent;
+}
+
+
+u_int32_t
+clnttcp_nb_xid(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	return ntohl(*(u_int32_t *)ct->ct_mcall);
+}
+
+
+int
+clnttcp_nb_cancel(CLIENT *handle, u_int32_t xid)
+{
+	struct ct_data *ct = NULL;
+	struct callback_info *cbi = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return -1;
+
+	cbi = ght_get(ct->ct_xid_to_ucb, sizeof(u_int32_t), (void *)&xid);
+	if(cbi == NULL)
+		return (cancel_failing(ct, 1, xid, NULL) > 0) ? 0 : -1;
+
+	cancel_call(ct, cbi);
+	return 0;
+}
+
+
+int
+clnttcp_nb_cancel_priv(CLIENT *handle, void *priv)
+{
+	struct ct_data *ct = NULL;
+	struct callback_info **cbis = NULL;
+	struct callback_info *cbi = NULL;
+	ght_iterator_t iter;
+	const void *key;
+	int i, n = 0;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	/* Not while walking the table, removing may move entries */
+	cbis = (struct callback_info **)malloc((ght_size(ct->ct_xid_to_ucb)
+				+ 1) * sizeof(struct callback_info *));
+	if(cbis == NULL)
+		return -1;
+	for(cbi = ght_first(ct->ct_xid_to_ucb, &iter, &key); cbi != NULL;
+			cbi = ght_next(ct->ct_xid_to_ucb, &iter, &key))
+		if(cbi->cb_private == priv)
+			cbis[n++] = cbi;
+
+	for(i = 0; i < n; i++)
+		cancel_call(ct, cbis[i]);
+	free(cbis);
+
+	return n + cancel_failing(ct, 0, 0, priv);
+}
+
+
+int
+clnttcp_nb_events(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+	int events = 0;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	if(ct->ct_state == CT_CONNECTING)
+		return POLLOUT;
+	if(ct->ct_state != CT_CONNECTED)
+		return 0;
+
+	if(ct->ct_pendingcalls > 0)
+		events |= POLLIN;
+	if(ct->ct_unsent > 0)
+		events |= POLLOUT;
+
+	return events;
+}
+
+
+int
+clnttcp_nb_timeout(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return -1;
+
+	if((ct->ct_state == CT_WAITING) || (ct->ct_state == CT_CONNECTING))
+		return ms_until(&ct->ct_retry_at);
+	if(ct->ct_state == CT_CONNECTED)
+		return next_timer(ct);
+
+	return -1;
+}
+
+
+int
+clnttcp_nb_set_reconnect(CLIENT *handle, int attempts, int min_ms,
+		int max_ms)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if((ct == NULL) || (attempts < 0) || (min_ms < 1) || (max_ms < min_ms))
+		return -1;
+
+	/* The calls in flight have no copies to send again */
+	if((attempts > 0) && !keeps_copies(ct) && (ct->ct_pendingcalls > 0))
+		return -1;
+
+	ct->ct_rc_attempts = attempts;
+	ct->ct_rc_min_ms = min_ms;
+	ct->ct_rc_max_ms = max_ms;
+
+	return 0;
+}
+
+
+int
+clnttcp_nb_set_retrans(CLIENT *handle, int retries, int min_ms, int max_ms)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if((ct == NULL) || (retries < 0) || (min_ms < 1) || (max_ms < min_ms))
+		return -1;
+
+	/* Pending calls would lack timers or copies, or stay on the list */
+	if(((retries > 0) != (ct->ct_rt_retries > 0))
+			&& (ct->ct_pendingcalls > 0))
+		return -1;
+
+	ct->ct_rt_retries = retries;
+	ct->ct_rt_min_ms = min_ms;
+	ct->ct_rt_max_ms = max_ms;
+	if(ct->ct_rtt.rs_rto_us < (u_int32_t)min_ms * 1000)
+		ct->ct_rtt.rs_rto_us = min_ms * 1000;
+	if(ct->ct_rtt.rs_rto_us > (u_int32_t)max_ms * 1000)
+		ct->ct_rtt.rs_rto_us = max_ms * 1000;
+
+	return 0;
+}
+
+
+int
+clnttcp_nb_set_nodelay(CLIENT *handle, int on)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return -1;
+
+	ct->ct_nodelay = on;
+	if((ct->ct_sock >= 0) && (setsockopt(ct->ct_sock, IPPROTO_TCP,
+				TCP_NODELAY, (char *)&on, sizeof(on)) < 0))
+		return -1;
+
+	return 0;
+}
+
+
+unsigned long
+clnttcp_nb_reconnects(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return 0;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return 0;
+
+	return ct->ct_reconnects;
+}
+
+
+int
+clnttcp_nb_fd(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return -1;
+
+	return ct->ct_sock;
+}
+
+
+struct clnt_proc_stats *
+clnttcp_proc_stats(CLIENT *handle, u_long proc)
+{
+	struct ct_data *ct = NULL;
+
+	if((handle == NULL) || (proc >= CLNT_MAXPROC))
+		return NULL;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return NULL;
+
+	return ct->ct_stats[proc];
+}
+
+
+void
+clnttcp_reset_stats(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+	int i;
+
+	if(handle == NULL)
+		return;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return;
+
+	for(i = 0; i < CLNT_MAXPROC; i++) {
+		if(ct->ct_stats[i] == NULL)
+			continue;
+		memset(ct->ct_stats[i], 0, sizeof(struct clnt_proc_stats));
+		ct->ct_stats[i]->ps_min_us = ~0U;
+	}
+	ct->ct_rtt.rs_retrans = 0;
+	ct->ct_rtt.rs_timeouts = 0;
+}
+
+
+struct clnt_rtt_stats *
+clnttcp_rtt_stats(CLIENT *handle)
+{
+	struct ct_data *ct = NULL;
+
+	if(handle == NULL)
+		return NULL;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if(ct == NULL)
+		return NULL;
+
+	return &ct->ct_rtt;
+}
+
+
+u_int32_t
+clnt_stats_percentile(struct clnt_proc_stats *ps, double p)
+{
+	unsigned long long rank, seen = 0;
+	u_int32_t max;
+	int b;
+
+	if((ps == NULL) || (ps->ps_calls == 0))
+		return 0;
+
+	/* Rank of the wanted reply, counting from 1 */
+	rank = (unsigned long long)(p * ps->ps_calls / 100.0 + 0.999999);
+	if(rank < 1)
+		rank = 1;
+	if(rank > ps->ps_calls)
+		rank = ps->ps_calls;
+
+	for(b = 0; b < CLNT_HIST_BUCKETS; b++) {
+		seen += ps->ps_hist[b];
+		if(seen >= rank)
+			break;
+	}
+
+	max = hist_bucket_max(b);
+	return (max > ps->ps_max_us) ? ps->ps_max_us : max;
+}
+
+
+/* Changes the size of the buffers used for reading from and writing
+ * to the socket. Records already queued for sending are not affected.
+ * Fails while replies are being processed, since the read buffer is
+ * then still in use.
+ */
+int
+clnttcp_nb_setbufsz(CLIENT *handle, u_int sbufsz, u_int rbufsz)
+{
+	struct ct_data *ct = NULL;
+	char *rbuf = NULL;
+
+	if(handle == NULL)
+		return -1;
+
+	ct = (struct ct_data *)handle->cl_private;
+	if((ct == NULL) || ct->ct_rx_busy)
+		return -1;
+
+	rbufsz = (rbufsz) ? rbufsz : ASYNC_READ_BUF;
+	sbufsz = (sbufsz) ? sbufsz : ASYNC_READ_BUF;
+
+	if(rbufsz != ct->ct_rbufsz) {
+		rbuf = (char *)mem_alloc(rbufsz);
+		if(rbuf == NULL)
+			return -1;
+		mem_free(ct->ct_readbuf, ct->ct_rbufsz);
+		ct->ct_readbuf = rbuf;
+		ct->ct_rbufsz = rbufsz;
+	}
+
+	/* Every call ends its record with xdrrec_endofrecord(), which
+	 * hands the data to writetcp_nb(), so there is nothing left in
+	 * the record stream buffers between calls.
+	 */
+	if(sbufsz != ct->ct_sbufsz) {
+		XDR_DESTROY(&(ct->ct_xdrs));
+		xdrrec_create(&(ct->ct_xdrs), sbufsz, rbufsz,
+				(caddr_t)ct, readtcp_nb, writetcp_nb);
+		ct->ct_xdrs.x_public = NULL;
+		ct->ct_sbufsz = sbufsz;
+	}
+
+	return 0;
+}
+
+
 unsigned long 
 clnttcp_datatx(CLIENT * handle)
 {
@@ -0,0 +1,532 @@
+/*********************************************************************
+ *
+ * Filename:      hash_flat.c
+ * Description:   Open addressing variant of the hash table.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+/*
+ * The layout follows the "Swiss table": a control byte per slot, and
+ * the keys, their lengths and the data pointers in a second array. A
+ * control byte is EMPTY, DELETED, or holds the low 7 bits of the hash
+ * of a full slot. Lookups start at the group of slots picked by the
+ * rest of the hash and compare a whole group of control bytes at once
+ * (16 with SSE2, 8 in a 64 bit word otherwise); only slots whose bits
+ * match have their key compared. A group with an EMPTY slot ends the
+ * search. Groups are probed triangularly, which visits every group
+ * since their number is a power of two.
+ *
+ * Keys are stored inline, up to the size given to ght_create_flat().
+ * The table grows by itself when 7/8 of the slots are used (full or
+ * DELETED), so it is always possible to find an EMPTY slot.
+ */
+
+#include <stdlib.h> /* malloc */
+#include <stdio.h>  /* perror */
+#include <string.h> /* memcmp */
+#include <stddef.h> /* offsetof */
+#include <assert.h> /* assert */
+
+#include <ght_hash_table.h>
+#include "hash_flat.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define GROUP 16
+# define MASK_SHIFT 0   /* bit i of a match is slot i */
+typedef unsigned int group_mask_t;
+#else
+# define GROUP 8
+# define MASK_SHIFT 3   /* bit 8*i+7 of a match is slot i */
+typedef unsigned long long group_mask_t;
+# define LSB 0x0101010101010101ULL
+# define MSB 0x8080808080808080ULL
+#endif
+
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+#define IS_FULL(c)   (((c) & 0x80) == 0)
+
+#define MIN_CAPACITY 16 /* Slots, at least one group */
+#define NO_SLOT      -1
+
+struct ght_flat
+{
+  unsigned int i_capacity;   /* Number of slots, a power of two */
+  unsigned int i_used;       /* Full and DELETED slots */
+  unsigned int i_key_max;    /* Bytes of key storage per slot */
+  unsigned int i_stride;     /* Bytes per struct flat_slot */
+  unsigned char *p_ctrl;
+  unsigned char *p_slots;
+
+  /* Insertion order, if kept */
+  int b_ordered;
+  int *p_older;
+  int *p_newer;
+  int i_oldest;
+  int i_newest;
+};
+
+/* The entries, i_stride bytes apart so that the data pointers stay
+ * aligned. Everything a hit needs is in the control byte and here.
+ */
+struct flat_slot
+{
+  void *p_data;
+  unsigned char i_len;
+  unsigned char key[];       /* i_key_max bytes */
+};
+
+#define SLOT(p_fl, i) ((struct flat_slot *)((p_fl)->p_slots + (size_t)(i) * (p_fl)->i_stride))
+
+/* --- group operations --- */
+
+static inline group_mask_t match_byte(const unsigned char *p_group, unsigned char c)
+{
+#if defined(__SSE2__)
+  __m128i g = _mm_loadu_si128((const __m128i *)p_group);
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+  group_mask_t g, x;
+
+  memcpy(&g, p_group, sizeof(g));
+  x = g ^ (LSB * c);
+  /* Exact for the first match, bytes above one may match falsely.
+   * That only costs a key comparison, and cannot happen for
+   * CTRL_EMPTY since no control byte is CTRL_EMPTY+1.
+   */
+  return (x - LSB) & ~x & MSB;
+#endif
+}
+
+/* EMPTY or DELETED slots, the ones with the top bit set */
+static inline group_mask_t match_free(const unsigned char *p_group)
+{
+#if defined(__SSE2__)
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p_group));
+#else
+  group_mask_t g;
+
+  memcpy(&g, p_group, sizeof(g));
+  return g & MSB;
+#endif
+}
+
+static inline unsigned int lowest_slot(group_mask_t m)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(m) >> MASK_SHIFT;
+#else
+  unsigned int i = 0;
+
+  while (!(m & 1))
+    {
+      m >>= 1;
+      i++;
+    }
+  return i >> MASK_SHIFT;
+#endif
+}
+
+/* --- private methods --- */
+
+static inline ght_uint32_t flat_hash(ght_hash_table_t *p_ht, unsigned int i_key_size, const void *p_key_data)
+{
+  ght_hash_key_t key;
+
+  key.i_size = i_key_size;
+  key.p_key = p_key_data;
+  return p_ht->fn_hash(&key);
+}
+
+static inline int key_equal(const unsigned char *p_slot_key, const void *p_key_data,
+			    unsigned int i_key_size)
+{
+  ght_uint32_t a, b;
+
+  /* The xid table case, without a call to memcmp() */
+  if (i_key_size == sizeof(ght_uint32_t))
+    {
+      memcpy(&a, p_slot_key, sizeof(a));
+      memcpy(&b, p_key_data, sizeof(b));
+      return a == b;
+    }
+  return memcmp(p_slot_key, p_key_data, i_key_size) == 0;
+}
+
+/* The slot holding the key, or NO_SLOT */
+static inline int find_slot(struct ght_flat *p_fl, ght_uint32_t hash,
+		     unsigned int i_key_size, const void *p_key_data)
+{
+  unsigned int mask = p_fl->i_capacity - 1;
+  unsigned int pos = (hash >> 7) & mask & ~(GROUP - 1);
+  unsigned int step = 0;
+  group_mask_t m;
+  int i;
+
+  for (;;)
+    {
+      for (m = match_byte(p_fl->p_ctrl + pos, hash & 0x7f); m; m &= m - 1)
+	{
+	  i = pos + lowest_slot(m);
+	  if (SLOT(p_fl, i)->i_len == i_key_size &&
+	      key_equal(SLOT(p_fl, i)->key, p_key_data, i_key_size))
+	    return i;
+	}
+      if (match_byte(p_fl->p_ctrl + pos, CTRL_EMPTY))
+	return NO_SLOT;
+      step += GROUP;
+      pos = (pos + step) & mask;
+    }
+}
+
+/* The first EMPTY or DELETED slot in the probe sequence of hash */
+static int free_slot(struct ght_flat *p_fl, ght_uint32_t hash)
+{
+  unsigned int mask = p_fl->i_capacity - 1;
+  unsigned int pos = (hash >> 7) & mask & ~(GROUP - 1);
+  unsigned int step = 0;
+  group_mask_t m;
+
+  while (!(m = match_free(p_fl->p_ctrl + pos)))
+    {
+      step += GROUP;
+      pos = (pos + step) & mask;
+    }
+  return pos + lowest_slot(m);
+}
+
+static void link_newest(struct ght_flat *p_fl, int i)
+{
+  p_fl->p_older[i] = p_fl->i_newest;
+  p_fl->p_newer[i] = NO_SLOT;
+  if (p_fl->i_newest != NO_SLOT)
+    p_fl->p_newer[p_fl->i_newest] = i;
+  else
+    p_fl->i_oldest = i;
+  p_fl->i_newest = i;
+}
+
+static void unlink_slot(struct ght_flat *p_fl, int i)
+{
+  if (p_fl->p_older[i] != NO_SLOT)
+    p_fl->p_newer[p_fl->p_older[i]] = p_fl->p_newer[i];
+  else
+    p_fl->i_oldest = p_fl->p_newer[i];
+  if (p_fl->p_newer[i] != NO_SLOT)
+    p_fl->p_older[p_fl->p_newer[i]] = p_fl->p_older[i];
+  else
+    p_fl->i_newest = p_fl->p_older[i];
+}
+
+static void free_arrays(struct ght_flat *p_fl)
+{
+  free(p_fl->p_ctrl);
+  free(p_fl->p_slots);
+  free(p_fl->p_older);
+  free(p_fl->p_newer);
+}
+
+/* Allocate empty arrays for i_capacity slots. Returns -1 on failure,
+ * with nothing allocated.
+ */
+static int alloc_arrays(struct ght_flat *p_fl, unsigned int i_capacity)
+{
+  p_fl->i_capacity = i_capacity;
+  p_fl->i_used = 0;
+  p_fl->p_ctrl = malloc(i_capacity);
+  p_fl->p_slots = malloc((size_t)i_capacity * p_fl->i_stride);
+  p_fl->p_older = p_fl->b_ordered ? malloc(i_capacity * sizeof(int)) : NULL;
+  p_fl->p_newer = p_fl->b_ordered ? malloc(i_capacity * sizeof(int)) : NULL;
+  if (!p_fl->p_ctrl || !p_fl->p_slots ||
+      (p_fl->b_ordered && (!p_fl->p_older || !p_fl->p_newer)))
+    {
+      perror("malloc");
+      free_arrays(p_fl);
+      return -1;
+    }
+  memset(p_fl->p_ctrl, CTRL_EMPTY, i_capacity);
+  p_fl->i_oldest = p_fl->i_newest = NO_SLOT;
+  return 0;
+}
+
+/* Place a key known not to be in the table, returns its slot */
+static int place(struct ght_flat *p_fl, ght_uint32_t hash, void *p_entry_data,
+		 unsigned int i_key_size, const void *p_key_data)
+{
+  int i = free_slot(p_fl, hash);
+  struct flat_slot *p_slot = SLOT(p_fl, i);
+
+  if (p_fl->p_ctrl[i] == CTRL_EMPTY)
+    p_fl->i_used++;
+  p_fl->p_ctrl[i] = hash & 0x7f;
+  p_slot->i_len = i_key_size;
+  memcpy(p_slot->key, p_key_data, i_key_size);
+  p_slot->p_data = p_entry_data;
+  if (p_fl->b_ordered)
+    link_newest(p_fl, i);
+  return i;
+}
+
+/* Move everything into new arrays of i_capacity slots, which also
+ * drops the DELETED slots.
+ */
+static int resize(ght_hash_table_t *p_ht, unsigned int i_capacity)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  struct ght_flat old = *p_fl;
+  struct flat_slot *p_slot;
+  unsigned int n;
+  int i;
+
+  if (alloc_arrays(p_fl, i_capacity) < 0)
+    {
+      *p_fl = old;
+      return -1;
+    }
+
+  /* In insertion order if there is one, so that it is kept */
+  i = old.b_ordered ? old.i_oldest : 0;
+  for (n = 0; n < p_ht->i_items; n++)
+    {
+      if (!old.b_ordered)
+	while (!IS_FULL(old.p_ctrl[i]))
+	  i++;
+      p_slot = SLOT(&old, i);
+      place(p_fl, flat_hash(p_ht, p_slot->i_len, p_slot->key),
+	    p_slot->p_data, p_slot->i_len, p_slot->key);
+      i = old.b_ordered ? old.p_newer[i] : i + 1;
+    }
+
+  free_arrays(&old);
+  p_ht->i_size = i_capacity;
+  return 0;
+}
+
+/* The number of slots for i_items, at most 7/16 full */
+static unsigned int capacity_for(unsigned int i_items)
+{
+  unsigned int i_capacity = MIN_CAPACITY;
+
+  while (i_capacity / 16 * 7 < i_items)
+    i_capacity *= 2;
+  return i_capacity;
+}
+
+static void *iterate(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, int i,
+		     const void **pp_key, unsigned int *size)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  unsigned int j;
+
+  p_iterator->i_slot = i;
+  if (i == NO_SLOT)
+    {
+      p_iterator->i_next = NO_SLOT;
+      *pp_key = NULL;
+      if (size != NULL)
+	*size = 0;
+      return NULL;
+    }
+
+  /* Find the next one now, so that the current one can be removed */
+  if (p_fl->b_ordered)
+    p_iterator->i_next = p_fl->p_newer[i];
+  else
+    {
+      for (j = i + 1; j < p_fl->i_capacity && !IS_FULL(p_fl->p_ctrl[j]); j++)
+	;
+      p_iterator->i_next = (j == p_fl->i_capacity) ? NO_SLOT : (int)j;
+    }
+
+  *pp_key = SLOT(p_fl, i)->key;
+  if (size != NULL)
+    *size = SLOT(p_fl, i)->i_len;
+  return SLOT(p_fl, i)->p_data;
+}
+
+/* --- Exported methods --- */
+
+ght_hash_table_t *ght_create_flat(unsigned int i_size, unsigned int i_key_max, int b_ordered)
+{
+  ght_hash_table_t *p_ht;
+  struct ght_flat *p_fl;
+
+  if (i_key_max > GHT_FLAT_MAX_KEY)
+    return NULL;
+
+  if ( !(p_ht = (ght_hash_table_t*)malloc (sizeof(ght_hash_table_t))) ||
+       !(p_fl = (struct ght_flat*)malloc (sizeof(struct ght_flat))) )
+    {
+      perror("malloc");
+      free(p_ht);
+      return NULL;
+    }
+  memset(p_ht, 0, sizeof(ght_hash_table_t));
+  memset(p_fl, 0, sizeof(struct ght_flat));
+  p_fl->i_key_max = i_key_max;
+  p_fl->i_stride = (offsetof(struct flat_slot, key) + i_key_max + sizeof(void *) - 1) &
+    ~(sizeof(void *) - 1);
+  p_fl->b_ordered = b_ordered;
+  if (alloc_arrays(p_fl, capacity_for(i_size)) < 0)
+    {
+      free(p_fl);
+      free(p_ht);
+      return NULL;
+    }
+
+  p_ht->p_flat = p_fl;
+  p_ht->i_size = p_fl->i_capacity;
+  p_ht->fn_hash = ght_fastest_hash();
+  p_ht->fn_alloc = malloc;
+  p_ht->fn_free = free;
+  p_ht->i_heuristics = GHT_HEURISTICS_NONE;
+  p_ht->i_automatic_rehash = TRUE;
+
+  return p_ht;
+}
+
+int ght_flat_insert(ght_hash_table_t *p_ht, void *p_entry_data,
+		    unsigned int i_key_size, const void *p_key_data)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  ght_uint32_t hash;
+
+  if (i_key_size > p_fl->i_key_max)
+    return -2;
+
+  hash = flat_hash(p_ht, i_key_size, p_key_data);
+  if (find_slot(p_fl, hash, i_key_size, p_key_data) != NO_SLOT)
+    return -1;
+
+  if ((p_fl->i_used + 1) * 8 > p_fl->i_capacity * 7 &&
+      resize(p_ht, capacity_for(p_ht->i_items + 1)) < 0)
+    return -2;
+
+  place(p_fl, hash, p_entry_data, i_key_size, p_key_data);
+  p_ht->i_items++;
+  return 0;
+}
+
+void *ght_flat_get(ght_hash_table_t *p_ht, unsigned int i_key_size, const void *p_key_data)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  int i;
+
+  if (i_key_size > p_fl->i_key_max)
+    return NULL;
+  i = find_slot(p_fl, flat_hash(p_ht, i_key_size, p_key_data), i_key_size, p_key_data);
+  return i == NO_SLOT ? NULL : SLOT(p_fl, i)->p_data;
+}
+
+void *ght_flat_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+		       unsigned int i_key_size, const void *p_key_data)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  void *p_old;
+  int i;
+
+  if (i_key_size > p_fl->i_key_max)
+    return NULL;
+  i = find_slot(p_fl, flat_hash(p_ht, i_key_size, p_key_data), i_key_size, p_key_data);
+  if (i == NO_SLOT)
+    return NULL;
+  p_old = SLOT(p_fl, i)->p_data;
+  SLOT(p_fl, i)->p_data = p_entry_data;
+  return p_old;
+}
+
+void *ght_flat_remove(ght_hash_table_t *p_ht, unsigned int i_key_size, const void *p_key_data)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  int i;
+
+  if (i_key_size > p_fl->i_key_max)
+    return NULL;
+  i = find_slot(p_fl, flat_hash(p_ht, i_key_size, p_key_data), i_key_size, p_key_data);
+  if (i == NO_SLOT)
+    return NULL;
+
+  /* A group that has an EMPTY slot never made a lookup go on to the
+   * next group, so the slot can become EMPTY again. Otherwise it has
+   * to stay in the way as DELETED.
+   */
+  if (match_byte(p_fl->p_ctrl + (i & ~(GROUP - 1)), CTRL_EMPTY))
+    {
+      p_fl->p_ctrl[i] = CTRL_EMPTY;
+      p_fl->i_used--;
+    }
+  else
+    p_fl->p_ctrl[i] = CTRL_DELETED;
+  if (p_fl->b_ordered)
+    unlink_slot(p_fl, i);
+  p_ht->i_items--;
+  return SLOT(p_fl, i)->p_data;
+}
+
+void *ght_flat_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+  unsigned int j;
+  int i;
+
+  if (p_fl->b_ordered)
+    i = p_fl->i_oldest;
+  else
+    {
+      for (j = 0; j < p_fl->i_capacity && !IS_FULL(p_fl->p_ctrl[j]); j++)
+	;
+      i = (j == p_fl->i_capacity) ? NO_SLOT : (int)j;
+    }
+  return iterate(p_ht, p_iterator, i, pp_key, size);
+}
+
+void *ght_flat_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		    const void **pp_key, unsigned int *size)
+{
+  return iterate(p_ht, p_iterator, p_iterator->i_next, pp_key, size);
+}
+
+void ght_flat_remove_all(ght_hash_table_t *p_ht)
+{
+  struct ght_flat *p_fl = p_ht->p_flat;
+
+  memset(p_fl->p_ctrl, CTRL_EMPTY, p_fl->i_capacity);
+  p_fl->i_used = 0;
+  p_fl->i_oldest = p_fl->i_newest = NO_SLOT;
+  p_ht->i_items = 0;
+}
+
+void ght_flat_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  unsigned int i_capacity = capacity_for(i_size);
+
+  /* Never smaller than what the entries need */
+  if (i_capacity < capacity_for(p_ht->i_items))
+    i_capacity = capacity_for(p_ht->i_items);
+  resize(p_ht, i_capacity);
+}
+
+void ght_flat_finalize(ght_hash_table_t *p_ht)
+{
+  free_arrays(p_ht->p_flat);
+  free(p_ht->p_flat);
+  free(p_ht);
+}
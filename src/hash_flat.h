@@ -0,0 +1,46 @@
+/*********************************************************************
+ *
+ * Filename:      hash_flat.h
+ * Description:   Internal interface of the open addressing tables.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ ********************************************************************/
+
+/*
+ * The functions of hash_table.c pass tables made by ght_create_flat()
+ * on to these, which behave as described in ght_hash_table.h.
+ */
+#ifndef GHT_HASH_FLAT_H
+#define GHT_HASH_FLAT_H
+
+#include <ght_hash_table.h>
+
+int ght_flat_insert(ght_hash_table_t *p_ht, void *p_entry_data,
+		    unsigned int i_key_size, const void *p_key_data);
+void *ght_flat_get(ght_hash_table_t *p_ht, unsigned int i_key_size, const void *p_key_data);
+void *ght_flat_replace(ght_hash_table_t *p_ht, void *p_entry_data,
+		       unsigned int i_key_size, const void *p_key_data);
+void *ght_flat_remove(ght_hash_table_t *p_ht, unsigned int i_key_size, const void *p_key_data);
+void *ght_flat_first(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		     const void **pp_key, unsigned int *size);
+void *ght_flat_next(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator,
+		    const void **pp_key, unsigned int *size);
+void ght_flat_remove_all(ght_hash_table_t *p_ht);
+void ght_flat_rehash(ght_hash_table_t *p_ht, unsigned int i_size);
+void ght_flat_finalize(ght_hash_table_t *p_ht);
+
+#endif /* GHT_HASH_FLAT_H */
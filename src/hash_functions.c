@@ -24,9 +24,16 @@
  *
  ********************************************************************/
 #include <assert.h>
+#include <string.h>
+#include <stdint.h>
 
 #include <ght_hash_table.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <nmmintrin.h>
+# define HAVE_SSE42_CRC32 1
+#endif
+
 static ght_uint32_t crc32_table[256] =
 {
   0x00000000,0x04c11db7,0x09823b6e,0x0d4326d9,0x130476dc,0x17c56b6b,0x1a864db2,0x1e475005,
@@ -63,6 +70,42 @@ static ght_uint32_t crc32_table[256] =
   0xafb010b1,0xab710d06,0xa6322bdf,0xa2f33668,0xbcb4666d,0xb8757bda,0xb5365d03,0xb1f740b4
 };
 
+static ght_uint32_t crc32c_table[256] =
+{
+  0x00000000,0xf26b8303,0xe13b70f7,0x1350f3f4,0xc79a971f,0x35f1141c,0x26a1e7e8,0xd4ca64eb,
+  0x8ad958cf,0x78b2dbcc,0x6be22838,0x9989ab3b,0x4d43cfd0,0xbf284cd3,0xac78bf27,0x5e133c24,
+  0x105ec76f,0xe235446c,0xf165b798,0x030e349b,0xd7c45070,0x25afd373,0x36ff2087,0xc494a384,
+  0x9a879fa0,0x68ec1ca3,0x7bbcef57,0x89d76c54,0x5d1d08bf,0xaf768bbc,0xbc267848,0x4e4dfb4b,
+  0x20bd8ede,0xd2d60ddd,0xc186fe29,0x33ed7d2a,0xe72719c1,0x154c9ac2,0x061c6936,0xf477ea35,
+  0xaa64d611,0x580f5512,0x4b5fa6e6,0xb93425e5,0x6dfe410e,0x9f95c20d,0x8cc531f9,0x7eaeb2fa,
+  0x30e349b1,0xc288cab2,0xd1d83946,0x23b3ba45,0xf779deae,0x05125dad,0x1642ae59,0xe4292d5a,
+  0xba3a117e,0x4851927d,0x5b016189,0xa96ae28a,0x7da08661,0x8fcb0562,0x9c9bf696,0x6ef07595,
+  0x417b1dbc,0xb3109ebf,0xa0406d4b,0x522bee48,0x86e18aa3,0x748a09a0,0x67dafa54,0x95b17957,
+  0xcba24573,0x39c9c670,0x2a993584,0xd8f2b687,0x0c38d26c,0xfe53516f,0xed03a29b,0x1f682198,
+  0x5125dad3,0xa34e59d0,0xb01eaa24,0x42752927,0x96bf4dcc,0x64d4cecf,0x77843d3b,0x85efbe38,
+  0xdbfc821c,0x2997011f,0x3ac7f2eb,0xc8ac71e8,0x1c661503,0xee0d9600,0xfd5d65f4,0x0f36e6f7,
+  0x61c69362,0x93ad1061,0x80fde395,0x72966096,0xa65c047d,0x5437877e,0x4767748a,0xb50cf789,
+  0xeb1fcbad,0x197448ae,0x0a24bb5a,0xf84f3859,0x2c855cb2,0xdeeedfb1,0xcdbe2c45,0x3fd5af46,
+  0x7198540d,0x83f3d70e,0x90a324fa,0x62c8a7f9,0xb602c312,0x44694011,0x5739b3e5,0xa55230e6,
+  0xfb410cc2,0x092a8fc1,0x1a7a7c35,0xe811ff36,0x3cdb9bdd,0xceb018de,0xdde0eb2a,0x2f8b6829,
+  0x82f63b78,0x709db87b,0x63cd4b8f,0x91a6c88c,0x456cac67,0xb7072f64,0xa457dc90,0x563c5f93,
+  0x082f63b7,0xfa44e0b4,0xe9141340,0x1b7f9043,0xcfb5f4a8,0x3dde77ab,0x2e8e845f,0xdce5075c,
+  0x92a8fc17,0x60c37f14,0x73938ce0,0x81f80fe3,0x55326b08,0xa759e80b,0xb4091bff,0x466298fc,
+  0x1871a4d8,0xea1a27db,0xf94ad42f,0x0b21572c,0xdfeb33c7,0x2d80b0c4,0x3ed04330,0xccbbc033,
+  0xa24bb5a6,0x502036a5,0x4370c551,0xb11b4652,0x65d122b9,0x97baa1ba,0x84ea524e,0x7681d14d,
+  0x2892ed69,0xdaf96e6a,0xc9a99d9e,0x3bc21e9d,0xef087a76,0x1d63f975,0x0e330a81,0xfc588982,
+  0xb21572c9,0x407ef1ca,0x532e023e,0xa145813d,0x758fe5d6,0x87e466d5,0x94b49521,0x66df1622,
+  0x38cc2a06,0xcaa7a905,0xd9f75af1,0x2b9cd9f2,0xff56bd19,0x0d3d3e1a,0x1e6dcdee,0xec064eed,
+  0xc38d26c4,0x31e6a5c7,0x22b65633,0xd0ddd530,0x0417b1db,0xf67c32d8,0xe52cc12c,0x1747422f,
+  0x49547e0b,0xbb3ffd08,0xa86f0efc,0x5a048dff,0x8ecee914,0x7ca56a17,0x6ff599e3,0x9d9e1ae0,
+  0xd3d3e1ab,0x21b862a8,0x32e8915c,0xc083125f,0x144976b4,0xe622f5b7,0xf5720643,0x07198540,
+  0x590ab964,0xab613a67,0xb831c993,0x4a5a4a90,0x9e902e7b,0x6cfbad78,0x7fab5e8c,0x8dc0dd8f,
+  0xe330a81a,0x115b2b19,0x020bd8ed,0xf0605bee,0x24aa3f05,0xd6c1bc06,0xc5914ff2,0x37faccf1,
+  0x69e9f0d5,0x9b8273d6,0x88d28022,0x7ab90321,0xae7367ca,0x5c18e4c9,0x4f48173d,0xbd23943e,
+  0xf36e6f75,0x0105ec76,0x12551f82,0xe03e9c81,0x34f4f86a,0xc69f7b69,0xd5cf889d,0x27a40b9e,
+  0x79b737ba,0x8bdcb4b9,0x988c474d,0x6ae7c44e,0xbe2da0a5,0x4c4623a6,0x5f16d052,0xad7d5351
+};
+
 /* One-at-a-time hash (found in a web article from ddj), this is the
  * standard hash function.
  *
@@ -123,3 +166,210 @@ ght_uint32_t ght_rotating_hash(ght_hash_key_t *p_key)
 
   return i_hash;
 }
+
+/* CRC32C (Castagnoli), the polynomial SSE4.2 has an instruction for.
+ * The table version gives the same values, one byte at a time.
+ */
+static ght_uint32_t crc32c_sw(const unsigned char *p, unsigned int i_size)
+{
+  ght_uint32_t crc = 0xffffffff;
+
+  while (i_size--)
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ *p++) & 0xff];
+  return ~crc;
+}
+
+#ifdef HAVE_SSE42_CRC32
+__attribute__((target("sse4.2")))
+static ght_uint32_t crc32c_sse42(const unsigned char *p, unsigned int i_size)
+{
+# ifdef __x86_64__
+  uint64_t crc = 0xffffffff;
+  uint64_t w;
+
+  for (; i_size >= 8; i_size -= 8, p += 8)
+    {
+      memcpy(&w, p, 8);
+      crc = _mm_crc32_u64(crc, w);
+    }
+# else
+  ght_uint32_t crc = 0xffffffff;
+# endif
+  ght_uint32_t c = (ght_uint32_t)crc;
+  ght_uint32_t w4;
+
+  for (; i_size >= 4; i_size -= 4, p += 4)
+    {
+      memcpy(&w4, p, 4);
+      c = _mm_crc32_u32(c, w4);
+    }
+  while (i_size--)
+    c = _mm_crc32_u8(c, *p++);
+  return ~c;
+}
+#endif
+
+/* -1 until the CPU has been asked. Keys may be hashed from several
+ * threads, which may all ask at once and all get the same answer.
+ */
+static int have_sse42 = -1;
+
+static int cpu_has_sse42(void)
+{
+  int have = __atomic_load_n(&have_sse42, __ATOMIC_RELAXED);
+
+  if (have < 0)
+    {
+#ifdef HAVE_SSE42_CRC32
+      __builtin_cpu_init();
+      have = __builtin_cpu_supports("sse4.2") != 0;
+#else
+      have = 0;
+#endif
+      __atomic_store_n(&have_sse42, have, __ATOMIC_RELAXED);
+    }
+  return have;
+}
+
+ght_uint32_t ght_crc32c_hash(ght_hash_key_t *p_key)
+{
+  assert(p_key);
+
+#ifdef HAVE_SSE42_CRC32
+  if (cpu_has_sse42())
+    return crc32c_sse42(p_key->p_key, p_key->i_size);
+#endif
+  return crc32c_sw(p_key->p_key, p_key->i_size);
+}
+
+
+/* A word at a time hash after wyhash (final version 4) by Wang Yi,
+ * which is in the public domain. Keys are read as little endian
+ * words, so the values differ between big and little endian machines.
+ */
+#define WY_P0 0xa0761d6478bd642fULL
+#define WY_P1 0xe7037ed1a0b428dbULL
+#define WY_P2 0x8ebc6af09c88c6e3ULL
+#define WY_P3 0x589965cc75374cc3ULL
+
+/* 64x64->128 bit multiply, the halves are returned in *A and *B */
+static inline void wy_mum(uint64_t *A, uint64_t *B)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*A * *B;
+
+  *A = (uint64_t)r;
+  *B = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *A >> 32, hb = *B >> 32, la = (uint32_t)*A, lb = (uint32_t)*B;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+
+  lo = t + (rm1 << 32);
+  c += lo < t;
+  hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  *A = lo;
+  *B = hi;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t A, uint64_t B)
+{
+  wy_mum(&A, &B);
+  return A ^ B;
+}
+
+static inline uint64_t wy_r8(const unsigned char *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t wy_r4(const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t wy_r3(const unsigned char *p, unsigned int k)
+{
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+ght_uint32_t ght_wy_hash(ght_hash_key_t *p_key)
+{
+  const unsigned char *p;
+  unsigned int len, i;
+  uint64_t seed, a, b, see1, see2;
+
+  assert(p_key);
+
+  p = p_key->p_key;
+  len = p_key->i_size;
+  seed = wy_mix(WY_P0, WY_P1);
+  if (len <= 16)
+    {
+      if (len >= 4)
+	{
+	  a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+	  b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+	}
+      else if (len > 0)
+	{
+	  a = wy_r3(p, len);
+	  b = 0;
+	}
+      else
+	a = b = 0;
+    }
+  else
+    {
+      i = len;
+      if (i > 48)
+	{
+	  see1 = see2 = seed;
+	  do
+	    {
+	      seed = wy_mix(wy_r8(p) ^ WY_P1, wy_r8(p + 8) ^ seed);
+	      see1 = wy_mix(wy_r8(p + 16) ^ WY_P2, wy_r8(p + 24) ^ see1);
+	      see2 = wy_mix(wy_r8(p + 32) ^ WY_P3, wy_r8(p + 40) ^ see2);
+	      p += 48;
+	      i -= 48;
+	    }
+	  while (i > 48);
+	  seed ^= see1 ^ see2;
+	}
+      while (i > 16)
+	{
+	  seed = wy_mix(wy_r8(p) ^ WY_P1, wy_r8(p + 8) ^ seed);
+	  i -= 16;
+	  p += 16;
+	}
+      a = wy_r8(p + i - 16);
+      b = wy_r8(p + i - 8);
+    }
+  a ^= WY_P1;
+  b ^= seed;
+  wy_mum(&a, &b);
+  a = wy_mix(a ^ WY_P0 ^ len, b ^ WY_P1);
+  return (ght_uint32_t)(a ^ (a >> 32));
+}
+
+/* Compiled with optimization and a native 64x64->128 bit multiply,
+ * wyhash beats even the crc32 instruction, whose latency serializes
+ * it: on 64 byte file handles it takes half the time. Otherwise, and
+ * that includes the Makefiles' default of -g alone, the crc32
+ * instruction wins where there is one.
+ */
+ght_fn_hash_t ght_fastest_hash(void)
+{
+#if !defined(__SIZEOF_INT128__) || !defined(__OPTIMIZE__)
+  if (cpu_has_sse42())
+    return ght_crc32c_hash;
+#endif
+  return ght_wy_hash;
+}
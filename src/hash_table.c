@@ -29,8 +29,10 @@
 #include <errno.h>  /* errno */
 #include <string.h> /* memcmp */
 #include <assert.h> /* assert */
+#include <pthread.h> /* pthread_mutex_t */
 
 #include <ght_hash_table.h>
+#include "hash_flat.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -42,10 +44,10 @@
 #define FLAGS_INTERNAL 1 /* The item is internal to the hash table */
 
 /* Prototypes */
-static inline void              transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry);
-static inline void              move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry);
+static inline void              transpose(ght_hash_entry_t **pp_bucket, ght_hash_entry_t *p_entry);
+static inline void              move_to_front(ght_hash_entry_t **pp_bucket, ght_hash_entry_t *p_entry);
 static inline void              free_entry_chain(ght_hash_table_t *p_ht, ght_hash_entry_t *p_entry);
-static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_key_t *p_key, unsigned char i_heuristics);
+static inline ght_hash_entry_t *search_in_bucket(ght_hash_entry_t **pp_bucket, ght_hash_key_t *p_key, unsigned char i_heuristics);
 
 static inline void              hk_fill(ght_hash_key_t *p_hk, int i_size, const void *p_key);
 static inline ght_hash_entry_t *he_create(ght_hash_table_t *p_ht, void *p_data, unsigned int i_key_size, const void *p_key_data);
@@ -54,7 +56,7 @@ static inline void              he_finalize(ght_hash_table_t *p_ht, ght_hash_ent
 /* --- private methods --- */
 
 /* Move p_entry one up in its list. */
-static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry)
+static inline void transpose(ght_hash_entry_t **pp_bucket, ght_hash_entry_t *p_entry)
 {
   /*
    *  __    __    __    __
@@ -76,7 +78,7 @@ static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_
 	}
       else /* This element is now placed first */
 	{
-	  p_ht->pp_entries[l_bucket] = p_entry;
+	  *pp_bucket = p_entry;
 	}
 
       if (p_b)
@@ -94,7 +96,7 @@ static inline void transpose(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_
 }
 
 /* Move p_entry first */
-static inline void move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p_entry)
+static inline void move_to_front(ght_hash_entry_t **pp_bucket, ght_hash_entry_t *p_entry)
 {
   /*
    *  __    __    __
@@ -104,7 +106,7 @@ static inline void move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
    *  __/   __    __
    * |X_|->|A_|->|B_|
    */
-  if (p_entry == p_ht->pp_entries[l_bucket])
+  if (p_entry == *pp_bucket)
     {
       return;
     }
@@ -117,13 +119,13 @@ static inline void move_to_front(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
     }
 
   /* Place p_entry first */
-  p_entry->p_next = p_ht->pp_entries[l_bucket];
+  p_entry->p_next = *pp_bucket;
   p_entry->p_prev = NULL;
-  p_ht->pp_entries[l_bucket]->p_prev = p_entry;
-  p_ht->pp_entries[l_bucket] = p_entry;
+  (*pp_bucket)->p_prev = p_entry;
+  *pp_bucket = p_entry;
 }
 
-static inline void remove_from_chain(ght_hash_table_t *p_ht, ght_uint32_t l_bucket, ght_hash_entry_t *p)
+static inline void remove_from_chain(ght_hash_table_t *p_ht, ght_hash_entry_t **pp_bucket, ght_hash_entry_t *p)
 {
   if (p->p_prev)
     {
@@ -131,7 +133,7 @@ static inline void remove_from_chain(ght_hash_table_t *p_ht, ght_uint32_t l_buck
     }
   else /* first in list */
     {
-      p_ht->pp_entries[l_bucket] = p->p_next;
+      *pp_bucket = p->p_next;
     }
   if (p->p_next)
     {
@@ -157,12 +159,12 @@ static inline void remove_from_chain(ght_hash_table_t *p_ht, ght_uint32_t l_buck
 }
 
 /* Search for an element in a bucket */
-static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uint32_t l_bucket,
+static inline ght_hash_entry_t *search_in_bucket(ght_hash_entry_t **pp_bucket,
 						 ght_hash_key_t *p_key, unsigned char i_heuristics)
 {
   ght_hash_entry_t *p_e;
 
-  for (p_e = p_ht->pp_entries[l_bucket];
+  for (p_e = *pp_bucket;
        p_e;
        p_e = p_e->p_next)
     {
@@ -173,10 +175,10 @@ static inline ght_hash_entry_t *search_in_bucket(ght_hash_table_t *p_ht, ght_uin
 	  switch (i_heuristics)
 	    {
 	    case GHT_HEURISTICS_MOVE_TO_FRONT:
-	      move_to_front(p_ht, l_bucket, p_e);
+	      move_to_front(pp_bucket, p_e);
 	      break;
 	    case GHT_HEURISTICS_TRANSPOSE:
-	      transpose(p_ht, l_bucket, p_e);
+	      transpose(pp_bucket, p_e);
 	      break;
 	    default:
 	      break;
@@ -294,6 +296,168 @@ static inline ght_uint32_t get_hash_value(ght_hash_table_t *p_ht, ght_hash_key_t
 # define get_hash_value(p_ht, p_key) ( (p_ht)->fn_hash(p_key) )
 #endif
 
+/*
+ * Rehashing is done a few buckets at a time. While it is going on,
+ * the entries of the old buckets below i_migrated have been moved to
+ * the new bucket array and the rest are still in the old one, so
+ * every key has exactly one bucket to look in. Every operation moves
+ * GHT_REHASH_STEP more old buckets, which is plenty to be done before
+ * the table has doubled again.
+ */
+#define GHT_REHASH_STEP 4
+
+/* The bucket a key with the hash value l_hash belongs in */
+static inline ght_hash_entry_t **bucket_of(ght_hash_table_t *p_ht, ght_uint32_t l_hash, int **pp_nr)
+{
+  ght_uint32_t l_bucket;
+
+  if (p_ht->pp_old_entries)
+    {
+      l_bucket = l_hash & (p_ht->i_old_size - 1);
+      if (l_bucket >= p_ht->i_migrated)
+	{
+	  *pp_nr = &p_ht->p_old_nr[l_bucket];
+	  return &p_ht->pp_old_entries[l_bucket];
+	}
+    }
+  l_bucket = l_hash & p_ht->i_size_mask;
+  *pp_nr = &p_ht->p_nr[l_bucket];
+  return &p_ht->pp_entries[l_bucket];
+}
+
+/* Move up to i_buckets old buckets to the new array */
+static void migrate_buckets(ght_hash_table_t *p_ht, unsigned int i_buckets)
+{
+  ght_hash_entry_t *p_e, *p_next;
+  ght_uint32_t l_bucket;
+
+  while (i_buckets-- > 0 && p_ht->i_migrated < p_ht->i_old_size)
+    {
+      for (p_e = p_ht->pp_old_entries[p_ht->i_migrated]; p_e; p_e = p_next)
+	{
+	  p_next = p_e->p_next;
+	  l_bucket = get_hash_value(p_ht, &p_e->key) & p_ht->i_size_mask;
+
+	  p_e->p_prev = NULL;
+	  p_e->p_next = p_ht->pp_entries[l_bucket];
+	  if (p_e->p_next)
+	    {
+	      p_e->p_next->p_prev = p_e;
+	    }
+	  p_ht->pp_entries[l_bucket] = p_e;
+	  p_ht->p_nr[l_bucket]++;
+	}
+      p_ht->i_migrated++;
+    }
+
+  if (p_ht->i_migrated == p_ht->i_old_size)
+    {
+      free(p_ht->pp_old_entries);
+      free(p_ht->p_old_nr);
+      p_ht->pp_old_entries = NULL;
+      p_ht->p_old_nr = NULL;
+    }
+}
+
+/* Switch to a new bucket array of (about) i_size buckets, with all
+ * entries still in the current one, which becomes the old array. A
+ * rehash that is still going on is finished first. If there is no
+ * memory for the new array, the table stays as it is.
+ */
+static void start_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
+{
+  ght_hash_entry_t **pp_entries;
+  unsigned int i_new_size = 1;
+  int *p_nr;
+  int i=1;
+
+  if (p_ht->pp_old_entries)
+    migrate_buckets(p_ht, p_ht->i_old_size);
+
+  /* The nearest 2^i higher than i_size, like ght_create() */
+  while(i_new_size < i_size)
+    {
+      i_new_size = 1<<i++;
+    }
+
+  if ( !(pp_entries = (ght_hash_entry_t**)malloc(i_new_size*sizeof(ght_hash_entry_t*))) )
+    {
+      perror("malloc");
+      return;
+    }
+  if ( !(p_nr = (int*)malloc(i_new_size*sizeof(int))) )
+    {
+      perror("malloc");
+      free(pp_entries);
+      return;
+    }
+  memset(pp_entries, 0, i_new_size*sizeof(ght_hash_entry_t*));
+  memset(p_nr, 0, i_new_size*sizeof(int));
+
+  p_ht->pp_old_entries = p_ht->pp_entries;
+  p_ht->p_old_nr = p_ht->p_nr;
+  p_ht->i_old_size = p_ht->i_size;
+  p_ht->i_migrated = 0;
+
+  p_ht->pp_entries = pp_entries;
+  p_ht->p_nr = p_nr;
+  p_ht->i_size = i_new_size;
+  p_ht->i_size_mask = (1<<(i-1))-1;
+}
+
+
+/*
+ * A sharded table is a set of ordinary tables, each with a mutex. The
+ * top bits of the hash value pick the shard and the low bits the
+ * bucket in it, so the hash is computed once and the shards' buckets
+ * are still evenly used.
+ */
+#define GHT_CACHE_LINE 64
+
+struct ght_shard
+{
+  pthread_mutex_t mutex;
+  ght_hash_table_t *p_ht;
+  char pad[GHT_CACHE_LINE];          /* Keeps neighbouring mutexes apart */
+};
+
+struct ght_shards
+{
+  unsigned int i_shards;
+  struct ght_shard shard[];
+};
+
+static inline struct ght_shard *shard_lock(ght_hash_table_t *p_ht, ght_uint32_t l_hash)
+{
+  struct ght_shards *p_sh = p_ht->p_shards;
+  struct ght_shard *p_shard;
+
+  p_shard = &p_sh->shard[((unsigned long long)l_hash * p_sh->i_shards) >> 32];
+  pthread_mutex_lock(&p_shard->mutex);
+  return p_shard;
+}
+
+/* Copy the settings of a sharded table to its shards */
+static void shards_configure(ght_hash_table_t *p_ht)
+{
+  struct ght_shards *p_sh = p_ht->p_shards;
+  ght_hash_table_t *p_shard_ht;
+  unsigned int i;
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      pthread_mutex_lock(&p_sh->shard[i].mutex);
+      p_shard_ht = p_sh->shard[i].p_ht;
+      p_shard_ht->fn_hash = p_ht->fn_hash;
+      p_shard_ht->fn_alloc = p_ht->fn_alloc;
+      p_shard_ht->fn_free = p_ht->fn_free;
+      p_shard_ht->i_heuristics = p_ht->i_heuristics;
+      p_shard_ht->i_automatic_rehash = p_ht->i_automatic_rehash;
+      p_shard_ht->bucket_limit = p_ht->bucket_limit;
+      p_shard_ht->fn_bucket_free = p_ht->fn_bucket_free;
+      pthread_mutex_unlock(&p_sh->shard[i].mutex);
+    }
+}
 
 /* --- Exported methods --- */
 /* Create a new hash table */
@@ -318,7 +482,7 @@ ght_hash_table_t *ght_create(unsigned int i_size)
   p_ht->i_size_mask = (1<<(i-1))-1; /* Mask to & with */
   p_ht->i_items = 0;
 
-  p_ht->fn_hash = ght_one_at_a_time_hash;
+  p_ht->fn_hash = ght_fastest_hash();
 
   /* Standard values for allocations */
   p_ht->fn_alloc = malloc;
@@ -352,6 +516,61 @@ ght_hash_table_t *ght_create(unsigned int i_size)
 
   p_ht->p_oldest = NULL;
   p_ht->p_newest = NULL;
+  p_ht->pp_old_entries = NULL;
+  p_ht->p_old_nr = NULL;
+  p_ht->i_old_size = 0;
+  p_ht->i_migrated = 0;
+  p_ht->p_flat = NULL;
+  p_ht->p_shards = NULL;
+
+  return p_ht;
+}
+
+/* Create a new thread safe hash table */
+ght_hash_table_t *ght_create_sharded(unsigned int i_size, unsigned int i_shards)
+{
+  ght_hash_table_t *p_ht;
+  struct ght_shards *p_sh;
+  unsigned int i;
+
+  if (i_shards == 0)
+    return NULL;
+
+  if ( !(p_ht = (ght_hash_table_t*)malloc (sizeof(ght_hash_table_t))) ||
+       !(p_sh = (struct ght_shards*)malloc (sizeof(struct ght_shards) +
+					    i_shards*sizeof(struct ght_shard))) )
+    {
+      perror("malloc");
+      free(p_ht);
+      return NULL;
+    }
+  memset(p_ht, 0, sizeof(ght_hash_table_t));
+
+  p_sh->i_shards = i_shards;
+  for (i = 0; i < i_shards; i++)
+    {
+      if ( !(p_sh->shard[i].p_ht = ght_create((i_size + i_shards - 1) / i_shards)) )
+	{
+	  while (i-- > 0)
+	    {
+	      pthread_mutex_destroy(&p_sh->shard[i].mutex);
+	      ght_finalize(p_sh->shard[i].p_ht);
+	    }
+	  free(p_sh);
+	  free(p_ht);
+	  return NULL;
+	}
+      pthread_mutex_init(&p_sh->shard[i].mutex, NULL);
+      p_ht->i_size += p_sh->shard[i].p_ht->i_size;
+    }
+
+  /* The same defaults as ght_create(), which the shards got too */
+  p_ht->p_shards = p_sh;
+  p_ht->fn_hash = ght_fastest_hash();
+  p_ht->fn_alloc = malloc;
+  p_ht->fn_free = free;
+  p_ht->i_heuristics = GHT_HEURISTICS_NONE;
+  p_ht->i_automatic_rehash = FALSE;
 
   return p_ht;
 }
@@ -361,30 +580,40 @@ void ght_set_alloc(ght_hash_table_t *p_ht, ght_fn_alloc_t fn_alloc, ght_fn_free_
 {
   p_ht->fn_alloc = fn_alloc;
   p_ht->fn_free = fn_free;
+  if (p_ht->p_shards)
+    shards_configure(p_ht);
 }
 
 /* Set the hash function to use */
 void ght_set_hash(ght_hash_table_t *p_ht, ght_fn_hash_t fn_hash)
 {
   p_ht->fn_hash = fn_hash;
+  if (p_ht->p_shards)
+    shards_configure(p_ht);
 }
 
 /* Set the heuristics to use. */
 void ght_set_heuristics(ght_hash_table_t *p_ht, int i_heuristics)
 {
   p_ht->i_heuristics = i_heuristics;
+  if (p_ht->p_shards)
+    shards_configure(p_ht);
 }
 
 /* Set the rehashing status of the table. */
 void ght_set_rehash(ght_hash_table_t *p_ht, int b_rehash)
 {
   p_ht->i_automatic_rehash = b_rehash;
+  if (p_ht->p_shards)
+    shards_configure(p_ht);
 }
 
 void ght_set_bounded_buckets(ght_hash_table_t *p_ht, unsigned int limit, ght_fn_bucket_free_callback_t fn)
 {
   p_ht->bucket_limit = limit;
   p_ht->fn_bucket_free = fn;
+  if (p_ht->p_shards)
+    shards_configure(p_ht);
 
   if (limit > 0 && fn == NULL)
     {
@@ -393,62 +622,81 @@ void ght_set_bounded_buckets(ght_hash_table_t *p_ht, unsigned int limit, ght_fn_
 }
 
 
+/* Sum up the number of items or buckets of all shards */
+static unsigned int shards_sum(ght_hash_table_t *p_ht, int b_items)
+{
+  struct ght_shards *p_sh = p_ht->p_shards;
+  unsigned int i, i_sum = 0;
+
+  for (i = 0; i < p_sh->i_shards; i++)
+    {
+      pthread_mutex_lock(&p_sh->shard[i].mutex);
+      i_sum += b_items ? p_sh->shard[i].p_ht->i_items : p_sh->shard[i].p_ht->i_size;
+      pthread_mutex_unlock(&p_sh->shard[i].mutex);
+    }
+  return i_sum;
+}
+
 /* Get the number of items in the hash table */
 unsigned int ght_size(ght_hash_table_t *p_ht)
 {
+  if (p_ht->p_shards)
+    return shards_sum(p_ht, TRUE);
   return p_ht->i_items;
 }
 
 /* Get the size of the hash table */
 unsigned int ght_table_size(ght_hash_table_t *p_ht)
 {
+  if (p_ht->p_shards)
+    return shards_sum(p_ht, FALSE);
   return p_ht->i_size;
 }
 
-/* Insert an entry into the hash table */
-int ght_insert(ght_hash_table_t *p_ht,
-	       void *p_entry_data,
-	       unsigned int i_key_size, const void *p_key_data)
+/* Insert an entry with the hash value l_hash into the hash table */
+static int insert_hashed(ght_hash_table_t *p_ht, ght_uint32_t l_hash,
+			 void *p_entry_data, ght_hash_key_t *p_key)
 {
   ght_hash_entry_t *p_entry;
-  ght_uint32_t l_key;
-  ght_hash_key_t key;
+  ght_hash_entry_t **pp_bucket;
+  int *p_nr;
 
-  assert(p_ht);
+  if (p_ht->pp_old_entries)
+    migrate_buckets(p_ht, GHT_REHASH_STEP);
 
-  hk_fill(&key, i_key_size, p_key_data);
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
-  if (search_in_bucket(p_ht, l_key, &key, 0))
+  pp_bucket = bucket_of(p_ht, l_hash, &p_nr);
+  if (search_in_bucket(pp_bucket, p_key, 0))
     {
       /* Don't insert if the key is already present. */
       return -1;
     }
   if (!(p_entry = he_create(p_ht, p_entry_data,
-			    i_key_size, p_key_data)))
+			    p_key->i_size, p_key->p_key)))
     {
       return -2;
     }
 
-  /* Rehash if the number of items inserted is too high. */
+  /* Start rehashing if the number of items inserted is too high. The
+   * entries are moved over the following operations.
+   */
   if (p_ht->i_automatic_rehash && p_ht->i_items > 2*p_ht->i_size)
     {
-      ght_rehash(p_ht, 2*p_ht->i_size);
-      /* Recalculate l_key after ght_rehash has updated i_size_mask */
-      l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
+      start_rehash(p_ht, 2*p_ht->i_size);
+      pp_bucket = bucket_of(p_ht, l_hash, &p_nr);
     }
 
   /* Place the entry first in the list. */
-  p_entry->p_next = p_ht->pp_entries[l_key];
+  p_entry->p_next = *pp_bucket;
   p_entry->p_prev = NULL;
-  if (p_ht->pp_entries[l_key])
+  if (*pp_bucket)
     {
-      p_ht->pp_entries[l_key]->p_prev = p_entry;
+      (*pp_bucket)->p_prev = p_entry;
     }
-  p_ht->pp_entries[l_key] = p_entry;
+  *pp_bucket = p_entry;
 
   /* If this is a limited bucket hash table, potentially remove the last item */
   if (p_ht->bucket_limit != 0 &&
-      p_ht->p_nr[l_key] >= p_ht->bucket_limit)
+      *p_nr >= p_ht->bucket_limit)
     {
       ght_hash_entry_t *p;
 
@@ -456,22 +704,22 @@ int ght_insert(ght_hash_table_t *p_ht,
        *
        * FIXME: Better with a pointer to the last entry
        */
-      for (p = p_ht->pp_entries[l_key];
+      for (p = *pp_bucket;
 	   p->p_next != NULL;
 	   p = p->p_next);
 
       assert(p && p->p_next == NULL);
 
-      remove_from_chain(p_ht, l_key, p); /* To allow it to be reinserted in fn_bucket_free */
+      remove_from_chain(p_ht, pp_bucket, p); /* To allow it to be reinserted in fn_bucket_free */
       p_ht->fn_bucket_free(p->p_data, p->key.p_key);
 
       he_finalize(p_ht, p);
     }
   else
     {
-      p_ht->p_nr[l_key]++;
+      (*p_nr)++;
 
-      assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+      assert( *pp_bucket?(*pp_bucket)->p_prev == NULL:1 );
 
       p_ht->i_items++;
     }
@@ -492,27 +740,120 @@ int ght_insert(ght_hash_table_t *p_ht,
   return 0;
 }
 
+/* Find the entry with the hash value l_hash, or NULL */
+static ght_hash_entry_t *get_hashed(ght_hash_table_t *p_ht, ght_uint32_t l_hash,
+				    ght_hash_key_t *p_key)
+{
+  ght_hash_entry_t **pp_bucket;
+  int *p_nr;
+
+  if (p_ht->pp_old_entries)
+    migrate_buckets(p_ht, GHT_REHASH_STEP);
+
+  pp_bucket = bucket_of(p_ht, l_hash, &p_nr);
+
+  /* Check that the first element in the list really is the first. */
+  assert( *pp_bucket?(*pp_bucket)->p_prev == NULL:1 );
+
+  return search_in_bucket(pp_bucket, p_key, p_ht->i_heuristics);
+}
+
+/* Remove the entry with the hash value l_hash, returns its data or NULL */
+static void *remove_hashed(ght_hash_table_t *p_ht, ght_uint32_t l_hash,
+			   ght_hash_key_t *p_key)
+{
+  ght_hash_entry_t *p_out;
+  ght_hash_entry_t **pp_bucket;
+  void *p_ret=NULL;
+  int *p_nr;
+
+  if (p_ht->pp_old_entries)
+    migrate_buckets(p_ht, GHT_REHASH_STEP);
+
+  pp_bucket = bucket_of(p_ht, l_hash, &p_nr);
+
+  /* Check that the first element really is the first */
+  assert( (*pp_bucket?(*pp_bucket)->p_prev == NULL:1) );
+
+  p_out = search_in_bucket(pp_bucket, p_key, 0);
+
+  /* Link p_out out of the list. */
+  if (p_out)
+    {
+      remove_from_chain(p_ht, pp_bucket, p_out);
+
+      /* This should ONLY be done for normal items (for now all items) */
+      p_ht->i_items--;
+
+      (*p_nr)--;
+#if !defined(NDEBUG)
+      p_out->p_next = NULL;
+      p_out->p_prev = NULL;
+#endif /* NDEBUG */
+
+      p_ret = p_out->p_data;
+      he_finalize(p_ht, p_out);
+    }
+
+  return p_ret;
+}
+
+/* Insert an entry into the hash table */
+int ght_insert(ght_hash_table_t *p_ht,
+	       void *p_entry_data,
+	       unsigned int i_key_size, const void *p_key_data)
+{
+  struct ght_shard *p_shard;
+  ght_uint32_t l_hash;
+  ght_hash_key_t key;
+  int i_ret;
+
+  assert(p_ht);
+
+  if (p_ht->p_flat)
+    return ght_flat_insert(p_ht, p_entry_data, i_key_size, p_key_data);
+
+  hk_fill(&key, i_key_size, p_key_data);
+  l_hash = get_hash_value(p_ht, &key);
+
+  if (p_ht->p_shards)
+    {
+      p_shard = shard_lock(p_ht, l_hash);
+      i_ret = insert_hashed(p_shard->p_ht, l_hash, p_entry_data, &key);
+      pthread_mutex_unlock(&p_shard->mutex);
+      return i_ret;
+    }
+  return insert_hashed(p_ht, l_hash, p_entry_data, &key);
+}
+
 /* Get an entry from the hash table. The entry is returned, or NULL if it wasn't found */
 void *ght_get(ght_hash_table_t *p_ht,
 	      unsigned int i_key_size, const void *p_key_data)
 {
+  struct ght_shard *p_shard;
   ght_hash_entry_t *p_e;
+  ght_uint32_t l_hash;
   ght_hash_key_t key;
-  ght_uint32_t l_key;
+  void *p_ret;
 
   assert(p_ht);
 
-  hk_fill(&key, i_key_size, p_key_data);
+  if (p_ht->p_flat)
+    return ght_flat_get(p_ht, i_key_size, p_key_data);
 
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
-
-  /* Check that the first element in the list really is the first. */
-  assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+  hk_fill(&key, i_key_size, p_key_data);
+  l_hash = get_hash_value(p_ht, &key);
 
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_e = search_in_bucket(p_ht, l_key, &key, p_ht->i_heuristics);
-  /* UNLOCK: p_ht->pp_entries[l_key] */
+  if (p_ht->p_shards)
+    {
+      p_shard = shard_lock(p_ht, l_hash);
+      p_e = get_hashed(p_shard->p_ht, l_hash, &key);
+      p_ret = p_e?p_e->p_data:NULL;
+      pthread_mutex_unlock(&p_shard->mutex);
+      return p_ret;
+    }
 
+  p_e = get_hashed(p_ht, l_hash, &key);
   return (p_e?p_e->p_data:NULL);
 }
 
@@ -521,29 +862,36 @@ void *ght_replace(ght_hash_table_t *p_ht,
 		  void *p_entry_data,
 		  unsigned int i_key_size, const void *p_key_data)
 {
+  struct ght_shard *p_shard = NULL;
   ght_hash_entry_t *p_e;
+  ght_uint32_t l_hash;
   ght_hash_key_t key;
-  ght_uint32_t l_key;
-  void *p_old;
+  void *p_old = NULL;
 
   assert(p_ht);
 
-  hk_fill(&key, i_key_size, p_key_data);
-
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
+  if (p_ht->p_flat)
+    return ght_flat_replace(p_ht, p_entry_data, i_key_size, p_key_data);
 
-  /* Check that the first element in the list really is the first. */
-  assert( p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1 );
+  hk_fill(&key, i_key_size, p_key_data);
+  l_hash = get_hash_value(p_ht, &key);
 
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_e = search_in_bucket(p_ht, l_key, &key, p_ht->i_heuristics);
-  /* UNLOCK: p_ht->pp_entries[l_key] */
+  if (p_ht->p_shards)
+    {
+      p_shard = shard_lock(p_ht, l_hash);
+      p_e = get_hashed(p_shard->p_ht, l_hash, &key);
+    }
+  else
+    p_e = get_hashed(p_ht, l_hash, &key);
 
-  if ( !p_e )
-    return NULL;
+  if ( p_e )
+    {
+      p_old = p_e->p_data;
+      p_e->p_data = p_entry_data;
+    }
 
-  p_old = p_e->p_data;
-  p_e->p_data = p_entry_data;
+  if (p_shard)
+    pthread_mutex_unlock(&p_shard->mutex);
 
   return p_old;
 }
@@ -553,49 +901,50 @@ void *ght_replace(ght_hash_table_t *p_ht,
 void *ght_remove(ght_hash_table_t *p_ht,
 		 unsigned int i_key_size, const void *p_key_data)
 {
-  ght_hash_entry_t *p_out;
+  struct ght_shard *p_shard;
+  ght_uint32_t l_hash;
   ght_hash_key_t key;
-  ght_uint32_t l_key;
-  void *p_ret=NULL;
+  void *p_ret;
 
   assert(p_ht);
 
-  hk_fill(&key, i_key_size, p_key_data);
-  l_key = get_hash_value(p_ht, &key) & p_ht->i_size_mask;
-
-  /* Check that the first element really is the first */
-  assert( (p_ht->pp_entries[l_key]?p_ht->pp_entries[l_key]->p_prev == NULL:1) );
+  if (p_ht->p_flat)
+    return ght_flat_remove(p_ht, i_key_size, p_key_data);
 
-  /* LOCK: p_ht->pp_entries[l_key] */
-  p_out = search_in_bucket(p_ht, l_key, &key, 0);
+  hk_fill(&key, i_key_size, p_key_data);
+  l_hash = get_hash_value(p_ht, &key);
 
-  /* Link p_out out of the list. */
-  if (p_out)
+  if (p_ht->p_shards)
     {
-      remove_from_chain(p_ht, l_key, p_out);
-
-      /* This should ONLY be done for normal items (for now all items) */
-      p_ht->i_items--;
-
-      p_ht->p_nr[l_key]--;
-      /* UNLOCK: p_ht->pp_entries[l_key] */
-#if !defined(NDEBUG)
-      p_out->p_next = NULL;
-      p_out->p_prev = NULL;
-#endif /* NDEBUG */
-
-      p_ret = p_out->p_data;
-      he_finalize(p_ht, p_out);
+      p_shard = shard_lock(p_ht, l_hash);
+      p_ret = remove_hashed(p_shard->p_ht, l_hash, &key);
+      pthread_mutex_unlock(&p_shard->mutex);
+      return p_ret;
     }
-  /* else: UNLOCK: p_ht->pp_entries[l_key] */
-
-  return p_ret;
+  return remove_hashed(p_ht, l_hash, &key);
 }
 
 static void *first_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, const void **pp_key, unsigned int *size)
 {
   assert(p_ht && p_iterator);
 
+  if (p_ht->p_flat)
+    return ght_flat_first(p_ht, p_iterator, pp_key, size);
+
+  if (p_ht->p_shards)
+    {
+      void *p;
+
+      /* i_slot is the shard being iterated over */
+      for (p_iterator->i_slot = 0; p_iterator->i_slot < p_ht->p_shards->i_shards; p_iterator->i_slot++)
+	{
+	  p = first_keysize(p_ht->p_shards->shard[p_iterator->i_slot].p_ht, p_iterator, pp_key, size);
+	  if (p)
+	    return p;
+	}
+      return NULL;
+    }
+
   /* Fill the iterator */
   p_iterator->p_entry = p_ht->p_oldest;
 
@@ -635,6 +984,28 @@ static void *next_keysize(ght_hash_table_t *p_ht, ght_iterator_t *p_iterator, co
 {
   assert(p_ht && p_iterator);
 
+  if (p_ht->p_flat)
+    return ght_flat_next(p_ht, p_iterator, pp_key, size);
+
+  if (p_ht->p_shards)
+    {
+      struct ght_shards *p_sh = p_ht->p_shards;
+      void *p = NULL;
+
+      if (p_iterator->i_slot < p_sh->i_shards)
+	p = next_keysize(p_sh->shard[p_iterator->i_slot].p_ht, p_iterator, pp_key, size);
+      while (!p && ++p_iterator->i_slot < p_sh->i_shards)
+	p = first_keysize(p_sh->shard[p_iterator->i_slot].p_ht, p_iterator, pp_key, size);
+      if (!p)
+	{
+	  p_iterator->i_slot = p_sh->i_shards;
+	  *pp_key = NULL;
+	  if (size != NULL)
+	    *size = 0;
+	}
+      return p;
+    }
+
   if (p_iterator->p_next)
     {
       /* More entries */
@@ -687,6 +1058,19 @@ static void remove_all_entries(ght_hash_table_t *p_ht)
 	  p_ht->pp_entries[i] = NULL;
 	}
     }
+
+  /* And those not moved yet by a rehash, which is then over */
+  if (p_ht->pp_old_entries)
+    {
+      for (i=p_ht->i_migrated; i<p_ht->i_old_size; i++)
+	{
+	  free_entry_chain(p_ht, p_ht->pp_old_entries[i]);
+	}
+      free(p_ht->pp_old_entries);
+      free(p_ht->p_old_nr);
+      p_ht->pp_old_entries = NULL;
+      p_ht->p_old_nr = NULL;
+    }
 }
 
 /* Finalize (free) a hash table */
@@ -694,6 +1078,26 @@ void ght_finalize(ght_hash_table_t *p_ht)
 {
   assert(p_ht);
 
+  if (p_ht->p_flat)
+    {
+      ght_flat_finalize(p_ht);
+      return;
+    }
+
+  if (p_ht->p_shards)
+    {
+      unsigned int i;
+
+      for (i = 0; i < p_ht->p_shards->i_shards; i++)
+	{
+	  pthread_mutex_destroy(&p_ht->p_shards->shard[i].mutex);
+	  ght_finalize(p_ht->p_shards->shard[i].p_ht);
+	}
+      free(p_ht->p_shards);
+      free(p_ht);
+      return;
+    }
+
   remove_all_entries(p_ht);
   free (p_ht->pp_entries);
   p_ht->pp_entries = NULL;
@@ -713,6 +1117,25 @@ void ght_remove_all(ght_hash_table_t *p_ht)
 {
   assert(p_ht);
 
+  if (p_ht->p_flat)
+    {
+      ght_flat_remove_all(p_ht);
+      return;
+    }
+
+  if (p_ht->p_shards)
+    {
+      unsigned int i;
+
+      for (i = 0; i < p_ht->p_shards->i_shards; i++)
+	{
+	  pthread_mutex_lock(&p_ht->p_shards->shard[i].mutex);
+	  ght_remove_all(p_ht->p_shards->shard[i].p_ht);
+	  pthread_mutex_unlock(&p_ht->p_shards->shard[i].mutex);
+	}
+      return;
+    }
+
   /* Remove the entries but do not free the memory alloced
    * for the bucket array.
    */
@@ -728,70 +1151,36 @@ void ght_remove_all(ght_hash_table_t *p_ht)
 
 }
 
-/* Rehash the hash table (i.e. change its size and reinsert all
- * items). This operation is slow and should not be used frequently.
+/* Rehash the hash table (i.e. change its size and move all items)
+ * in one go. This operation is slow and should not be used
+ * frequently; automatic rehashing spreads the same work over the
+ * following operations instead.
  */
 void ght_rehash(ght_hash_table_t *p_ht, unsigned int i_size)
 {
-  ght_hash_table_t *p_tmp;
-  ght_iterator_t iterator;
-  const void *p_key;
-  void *p;
-  int i;
-
   assert(p_ht);
 
-  /* Recreate the hash table with the new size */
-  p_tmp = ght_create(i_size);
-  assert(p_tmp);
-
-  /* Set the flags for the new hash table */
-  ght_set_hash(p_tmp, p_ht->fn_hash);
-  ght_set_alloc(p_tmp, p_ht->fn_alloc, p_ht->fn_free);
-  ght_set_heuristics(p_tmp, GHT_HEURISTICS_NONE);
-  ght_set_rehash(p_tmp, FALSE);
-
-  /* Walk through all elements in the table and insert them into the temporary one. */
-  for (p = ght_first(p_ht, &iterator, &p_key); p; p = ght_next(p_ht, &iterator, &p_key))
+  if (p_ht->p_flat)
     {
-      assert(iterator.p_entry);
-
-      /* Insert the entry into the new table */
-      if (ght_insert(p_tmp,
-		     iterator.p_entry->p_data,
-		     iterator.p_entry->key.i_size, iterator.p_entry->key.p_key) < 0)
-	{
-	  fprintf(stderr, "hash_table.c ERROR: Out of memory error or entry already in hash table\n"
-		  "when rehashing (internal error)\n");
-	}
+      ght_flat_rehash(p_ht, i_size);
+      return;
     }
 
-  /* Remove the old table... */
-  for (i=0; i<p_ht->i_size; i++)
+  if (p_ht->p_shards)
     {
-      if (p_ht->pp_entries[i])
+      struct ght_shards *p_sh = p_ht->p_shards;
+      unsigned int i;
+
+      for (i = 0; i < p_sh->i_shards; i++)
 	{
-	  /* Delete the entries in the bucket */
-	  free_entry_chain (p_ht, p_ht->pp_entries[i]);
-	  p_ht->pp_entries[i] = NULL;
+	  pthread_mutex_lock(&p_sh->shard[i].mutex);
+	  ght_rehash(p_sh->shard[i].p_ht, (i_size + p_sh->i_shards - 1) / p_sh->i_shards);
+	  pthread_mutex_unlock(&p_sh->shard[i].mutex);
 	}
+      return;
     }
 
-  free (p_ht->pp_entries);
-  free (p_ht->p_nr);
-
-  /* ... and replace it with the new */
-  p_ht->i_size = p_tmp->i_size;
-  p_ht->i_size_mask = p_tmp->i_size_mask;
-  p_ht->i_items = p_tmp->i_items;
-  p_ht->pp_entries = p_tmp->pp_entries;
-  p_ht->p_nr = p_tmp->p_nr;
-
-  p_ht->p_oldest = p_tmp->p_oldest;
-  p_ht->p_newest = p_tmp->p_newest;
-
-  /* Clean up */
-  p_tmp->pp_entries = NULL;
-  p_tmp->p_nr = NULL;
-  free (p_tmp);
+  start_rehash(p_ht, i_size);
+  if (p_ht->pp_old_entries)
+    migrate_buckets(p_ht, p_ht->i_old_size);
 }
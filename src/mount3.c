@@ -35,6 +35,7 @@
 #include <nfs_ctx.h>
 #include <clnt_tcp_nb.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 /* Common internal interface to MOUNT protocol */
@@ -48,10 +49,12 @@ mount3_call(int proc, void *arg, xdrproc_t xdr_proc,
 	if(!check_ctx(ctx))
 		return RPC_SYSTEMERROR;
 
-	if(ctx->nfs_mnt_cl == NULL)
+	if(ctx->nfs_mnt_cl == NULL) {
 		ctx->nfs_mnt_cl = clnttcp_b_create(ctx->nfs_mnt,
 				MOUNT_PROGRAM, MOUNT_V3, &sockp,
 				0, 0);
+		ctx_setup_client(ctx, ctx->nfs_mnt_cl);
+	}
 
 	if(ctx->nfs_mnt_cl == NULL)
 		return RPC_SYSTEMERROR;
@@ -126,17 +129,13 @@ xdr_to_mntres3(char *msg, int len)
 	if(mntres == NULL)
 		return NULL;
 
-	/* xdr_mountres3 and subsequent xdr decoding calls assume this
-	 * to be NULL if we want them to do the memory allocation for
-	 * the auth array. Make sure this is NULL here, because
-	 * there's a bunch of embedded structs in mntres3, its
-	 * possible that this pointer ends up being non-NULL but
-	 * pointing to a memory we did not allocate.
+	/* Everything the decode allocates has to start out NULL, also
+	 * so that a failed decode can be cleaned up.
 	 */
-	mntres->mountres3_u.mountinfo.auth_flavors.auth_flavors_val = NULL;
-	mntres->mountres3_u.mountinfo.fhandle.fhandle3_val = NULL;
+	memset(mntres, 0, sizeof(mountres3));
 	if(!xdr_mountres3(&xdr, mntres)) {
-		mem_free(mntres, sizeof(mntres3));
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_mountres3, mntres);
+		mem_free(mntres, sizeof(mountres3));
 		return NULL;
 	}
 
@@ -148,46 +147,34 @@ mountlist
 xdr_to_mountlist(char * msg, int len)
 {
 	XDR xdr;
-	mountbody * mb = NULL;
+	mountlist ml = NULL;
 
-	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	mb = (mountbody *)mem_alloc(sizeof(mountbody));
-	if(mb == NULL)
+	if(msg == NULL)
 		return NULL;
 
-	mb->ml_hostname = NULL;
-	mb->ml_directory = NULL;
-	mb->ml_next = NULL;
-
-	if(!xdr_mountlist(&xdr, &mb)) {
-		mem_free(mb, sizeof(mountbody));
+	/* An empty list comes back as NULL, just like a failure */
+	xdrmem_create(&xdr, msg, len, XDR_DECODE);
+	if(!xdr_mountlist(&xdr, &ml)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_mountlist, &ml);
 		return NULL;
 	}
 
-	return mb;
+	return ml;
 }
 
 
 exports 
 xdr_to_exports(char * msg, int len)
 {
-	exportnode * ex = NULL;
+	exports ex = NULL;
 	XDR xdr;
 
 	if(msg == NULL)
 		return NULL;
 
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	ex = (exportnode *)mem_alloc(sizeof(exportnode));
-	if(ex == NULL)
-		return NULL;
-
-	ex->ex_dir = NULL;
-	ex->ex_groups = NULL;
-	ex->ex_next = NULL;
-
 	if(!xdr_exports(&xdr, &ex)) {
-		mem_free(ex, sizeof(exportnode));
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_exports, &ex);
 		return NULL;
 	}
 
@@ -204,6 +191,9 @@ free_mntres3(mountres3 *msg)
 	if(msg->fhs_status == MNT3_OK) {
 		mem_free(msg->mountres3_u.mountinfo.fhandle.fhandle3_val,
 				msg->mountres3_u.mountinfo.fhandle.fhandle3_len);
+		mem_free(msg->mountres3_u.mountinfo.auth_flavors.auth_flavors_val,
+				msg->mountres3_u.mountinfo.auth_flavors.auth_flavors_len
+				* sizeof(int));
 	}
 
 	mem_free(msg, sizeof(mountres3));
@@ -220,7 +210,7 @@ free_mountlist(mountlist msg)
 	while(list != NULL) {
 		msg = list->ml_next;
 		mem_free(list->ml_hostname, strlen(list->ml_hostname) + 1);
-		mem_free(list->ml_directory, strlen(list->ml_hostname) + 1);
+		mem_free(list->ml_directory, strlen(list->ml_directory) + 1);
 		mem_free(list, sizeof(mountbody));
 		list = msg;
 	}
@@ -258,6 +248,7 @@ free_exports(exports ex)
 		ex = en->ex_next;
 		mem_free(en->ex_dir, strlen(en->ex_dir) + 1);
 		free_groups(en->ex_groups);	
+		mem_free(en, sizeof(exportnode));
 		en = ex;
 	}
 
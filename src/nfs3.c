@@ -26,6 +26,7 @@
 
 
 #include "nfs3.h"
+#include "nfsclient.h"
 #include <string.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
@@ -85,32 +86,61 @@ nfsstat3_strerror(int stat)
 }
 
 
-static enum clnt_stat
-nfs3_call(int proc, void *arg, xdrproc_t xdr_proc,
-		nfs_ctx *ctx, user_cb u_cb, void * priv)
+void
+xdr_free_decoded(XDR *xdrs, xdrproc_t proc, void *obj)
 {
-	int sockp = RPC_ANYSOCK;
-	int flag = 1;
+	/* Not xdr_free(), that would lose x_public */
+	xdrs->x_op = XDR_FREE;
+	(*proc)(xdrs, obj);
+}
 
-	if(!check_ctx(ctx))
-		return RPC_SYSTEMERROR;
+
+/* Connects to nfsd on first use, or leaves it to the first call.
+ * Returns NULL if that fails.
+ */
+static CLIENT *
+nfs3_client(nfs_ctx *ctx)
+{
+	int sockp = RPC_ANYSOCK;
 
 	if(ctx->nfs_cl == NULL) {
-		if(ctx->nfs_connflags & NFSC_CFL_NONBLOCKING)
+		/* Reconnecting makes the first connection as well, so
+		 * that it does not block either.
+		 */
+		if((ctx->nfs_connflags & NFSC_CFL_NONBLOCKING)
+				&& (ctx->nfs_connflags & NFSC_CFL_RECONNECT))
+			ctx->nfs_cl = clnttcp_nb_create_deferred(ctx->nfs_srv,
+					NFS_PROGRAM, NFS_V3,
+					NFSC_BUFSZ(ctx->nfs_wsize),
+					NFSC_BUFSZ(ctx->nfs_rsize));
+		else if(ctx->nfs_connflags & NFSC_CFL_NONBLOCKING)
 			ctx->nfs_cl = clnttcp_nb_create(ctx->nfs_srv, NFS_PROGRAM,
-					NFS_V3, &sockp,	ctx->nfs_wsize,
-					ctx->nfs_rsize);
+					NFS_V3, &sockp,	NFSC_BUFSZ(ctx->nfs_wsize),
+					NFSC_BUFSZ(ctx->nfs_rsize));
 		else
 			ctx->nfs_cl = clnttcp_b_create(ctx->nfs_srv, NFS_PROGRAM,
-					NFS_V3, &sockp,	ctx->nfs_wsize,
-					ctx->nfs_rsize);
+					NFS_V3, &sockp,	NFSC_BUFSZ(ctx->nfs_wsize),
+					NFSC_BUFSZ(ctx->nfs_rsize));
 
 		if(ctx->nfs_connflags & NFSC_CFL_DISABLE_NAGLE)
-			setsockopt(sockp, IPPROTO_TCP, TCP_NODELAY, (char *)&flag,
-					sizeof(flag));
+			clnttcp_nb_set_nodelay(ctx->nfs_cl, 1);
+		if(ctx->nfs_cork > 0)
+			clnttcp_nb_set_cork(ctx->nfs_cl, ctx->nfs_cork);
+		ctx_setup_client(ctx, ctx->nfs_cl);
 	}
 
-	if(ctx->nfs_cl == NULL)
+	return ctx->nfs_cl;
+}
+
+
+static enum clnt_stat
+nfs3_call(int proc, void *arg, xdrproc_t xdr_proc,
+		nfs_ctx *ctx, user_cb u_cb, void * priv)
+{
+	if(!check_ctx(ctx))
+		return RPC_SYSTEMERROR;
+
+	if(nfs3_client(ctx) == NULL)
 		return RPC_SYSTEMERROR;
 
 	return clnttcp_nb_call(ctx->nfs_cl, proc, 
@@ -119,6 +149,65 @@ nfs3_call(int proc, void *arg, xdrproc_t xdr_proc,
 }
 
 
+/* Argument encoders, by procedure number */
+static xdrproc_t nfs3_args_xdr[] = {
+	(xdrproc_t)xdr_void,			/* NULL */
+	(xdrproc_t)xdr_GETATTR3args,
+	(xdrproc_t)xdr_SETATTR3args,
+	(xdrproc_t)xdr_LOOKUP3args,
+	(xdrproc_t)xdr_ACCESS3args,
+	(xdrproc_t)xdr_READLINK3args,
+	(xdrproc_t)xdr_READ3args,
+	(xdrproc_t)xdr_WRITE3args,
+	(xdrproc_t)xdr_CREATE3args,
+	(xdrproc_t)xdr_MKDIR3args,
+	(xdrproc_t)xdr_SYMLINK3args,
+	(xdrproc_t)xdr_MKNOD3args,
+	(xdrproc_t)xdr_REMOVE3args,
+	(xdrproc_t)xdr_RMDIR3args,
+	(xdrproc_t)xdr_RENAME3args,
+	(xdrproc_t)xdr_LINK3args,
+	(xdrproc_t)xdr_READDIR3args,
+	(xdrproc_t)xdr_READDIRPLUS3args,
+	(xdrproc_t)xdr_FSSTAT3args,
+	(xdrproc_t)xdr_FSINFOargs,
+	(xdrproc_t)xdr_PATHCONF3args,
+	(xdrproc_t)xdr_COMMIT3args,
+};
+
+#define NFS3_NPROCS (sizeof(nfs3_args_xdr) / sizeof(nfs3_args_xdr[0]))
+
+
+int
+nfs_submit_batch(nfs_ctx *ctx, nfs_op *ops, int n)
+{
+	int i, sent = 0;
+
+	if(!check_ctx(ctx) || (nfs3_client(ctx) == NULL)) {
+		for(i = 0; i < n; i++)
+			ops[i].op_stat = RPC_SYSTEMERROR;
+		return 0;
+	}
+
+	clnttcp_nb_batch_begin(ctx->nfs_cl);
+	for(i = 0; i < n; i++) {
+		if(ops[i].op_proc >= NFS3_NPROCS) {
+			ops[i].op_stat = RPC_PROCUNAVAIL;
+			continue;
+		}
+		ops[i].op_stat = clnttcp_nb_call(ctx->nfs_cl, ops[i].op_proc,
+				nfs3_args_xdr[ops[i].op_proc],
+				(caddr_t)ops[i].op_args, ops[i].op_cb,
+				ops[i].op_priv);
+		if(ops[i].op_stat == RPC_SUCCESS)
+			sent++;
+	}
+	clnttcp_nb_batch_end(ctx->nfs_cl);
+
+	return sent;
+}
+
+
 enum clnt_stat 
 nfs3_null(nfs_ctx *ctx, user_cb u_cb, void * priv)
 {
@@ -303,9 +392,10 @@ xdr_to_LOOKUP3res(char *msg, int len)
 	lres = (LOOKUP3res *)mem_alloc(sizeof(LOOKUP3res));
 	if(lres == NULL)
 		return NULL;
+	memset(lres, 0, sizeof(LOOKUP3res));
 
-	lres->LOOKUP3res_u.resok.object.data.data_val = NULL;
 	if(!xdr_LOOKUP3res(&xdr, lres)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_LOOKUP3res, lres);
 		mem_free(lres, sizeof(LOOKUP3res));
 		return NULL;
 	}
@@ -344,11 +434,10 @@ xdr_to_LOOKUP3args(char *msg, int len)
 	args = (LOOKUP3args *)mem_alloc(sizeof(LOOKUP3args));
 	if(args == NULL)
 		return NULL;
-
-	args->what.name = NULL;
-	args->what.dir.data.data_val = NULL;
+	memset(args, 0, sizeof(LOOKUP3args));
 
 	if(!xdr_LOOKUP3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_LOOKUP3args, args);
 		mem_free(args, sizeof(LOOKUP3args));
 		return NULL;
 	}
@@ -390,8 +479,10 @@ xdr_to_GETATTR3res(char *msg, int len)
 	res = (GETATTR3res *)mem_alloc(sizeof(GETATTR3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(GETATTR3res));
 
 	if(!xdr_GETATTR3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_GETATTR3res, res);
 		mem_free(res, sizeof(GETATTR3res));
 		return NULL;
 	}
@@ -425,9 +516,10 @@ xdr_to_GETATTR3args (char *msg, int len)
 	args = (GETATTR3args *)mem_alloc(sizeof(GETATTR3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(GETATTR3args));
 
-	args->object.data.data_val = NULL;
 	if(!xdr_GETATTR3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_GETATTR3args, args);
 		mem_free(args, sizeof(GETATTR3args));
 		return NULL;
 	}
@@ -463,10 +555,12 @@ xdr_to_SETATTR3res(char *msg, int len)
 	res = (SETATTR3res *)mem_alloc(sizeof(SETATTR3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(SETATTR3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
 	if(!xdr_SETATTR3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_SETATTR3res, res);
 		mem_free(res, sizeof(SETATTR3res));
 		return NULL;
 	}
@@ -501,11 +595,12 @@ xdr_to_SETATTR3args (char *msg, int len)
 	args = (SETATTR3args *)mem_alloc(sizeof(SETATTR3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(SETATTR3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->object.data.data_val = NULL;
 	if(!xdr_SETATTR3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_SETATTR3args, args);
 		mem_free(args, sizeof(SETATTR3args));
 		return NULL;
 	}
@@ -541,10 +636,12 @@ xdr_to_ACCESS3res(char *msg, int len)
 	res = (ACCESS3res *)mem_alloc(sizeof(ACCESS3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(ACCESS3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
 	if(!xdr_ACCESS3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_ACCESS3res, res);
 		mem_free(res, sizeof(ACCESS3res));
 		return NULL;
 	}
@@ -579,11 +676,12 @@ xdr_to_ACCESS3args(char *msg, int len)
 	args = (ACCESS3args *)mem_alloc(sizeof(ACCESS3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(ACCESS3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->object.data.data_val = NULL;
 	if(!xdr_ACCESS3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_ACCESS3args, args);
 		mem_free(args, sizeof(ACCESS3args));
 		return NULL;
 	}
@@ -619,11 +717,12 @@ xdr_to_READLINK3res(char *msg, int len)
 	res = (READLINK3res *)mem_alloc(sizeof(READLINK3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(READLINK3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	res->READLINK3res_u.resok.data = NULL;
 	if(!xdr_READLINK3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READLINK3res, res);
 		mem_free(res, sizeof(READLINK3res));
 		return NULL;
 	}
@@ -663,11 +762,12 @@ xdr_to_READLINK3args(char *msg, int len)
 	args = (READLINK3args *)mem_alloc(sizeof(READLINK3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(READLINK3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->symlink.data.data_val = NULL;
 	if(!xdr_READLINK3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READLINK3args, args);
 		mem_free(args, sizeof(READLINK3args));
 		return NULL;
 	}
@@ -703,6 +803,7 @@ xdr_to_READ3res(char *msg, int len, int data_xdr)
 	res = (READ3res *)mem_alloc(sizeof(READ3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(READ3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
@@ -711,8 +812,8 @@ xdr_to_READ3res(char *msg, int len, int data_xdr)
 	else
 		xdr.x_public = __ENABLE_DATA_DEXDR_INTERNAL;
 
-	res->READ3res_u.resok.data.data_val = NULL;
 	if(!xdr_READ3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READ3res, res);
 		mem_free(res, sizeof(READ3res));
 		return NULL;
 	}
@@ -752,11 +853,12 @@ xdr_to_READ3args(char *msg, int len)
 	args = (READ3args *)mem_alloc(sizeof(READ3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(READ3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->file.data.data_val = NULL;
 	if(!xdr_READ3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READ3args, args);
 		mem_free(args, sizeof(READ3args));
 		return NULL;
 	}
@@ -792,10 +894,12 @@ xdr_to_WRITE3res(char *msg, int len)
 	res = (WRITE3res *)mem_alloc(sizeof(WRITE3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(WRITE3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
 	if(!xdr_WRITE3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_WRITE3res, res);
 		mem_free(res, sizeof(WRITE3res));
 		return NULL;
 	}
@@ -830,6 +934,7 @@ xdr_to_WRITE3args(char *msg, int len, int data_xdr)
 	args = (WRITE3args *)mem_alloc(sizeof(WRITE3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(WRITE3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
@@ -838,8 +943,8 @@ xdr_to_WRITE3args(char *msg, int len, int data_xdr)
 	else
 		xdr.x_public = __ENABLE_DATA_DEXDR_INTERNAL;
 
-	args->file.data.data_val = NULL;
 	if(!xdr_WRITE3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_WRITE3args, args);
 		mem_free(args, sizeof(WRITE3args));
 		return NULL;
 	}
@@ -879,11 +984,12 @@ xdr_to_CREATE3res(char *msg, int len)
 	res = (CREATE3res *)mem_alloc(sizeof(CREATE3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(CREATE3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	res->CREATE3res_u.resok.obj.post_op_fh3_u.handle.data.data_val = NULL;
 	if(!xdr_CREATE3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_CREATE3res, res);
 		mem_free(res, sizeof(CREATE3res));
 		return NULL;
 	}
@@ -920,13 +1026,13 @@ xdr_to_CREATE3args(char *msg, int len)
 	args = (CREATE3args *)mem_alloc(sizeof(CREATE3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(CREATE3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->where.dir.data.data_val = NULL;
-	args->where.name = NULL;
 
 	if(!xdr_CREATE3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_CREATE3args, args);
 		mem_free(args, sizeof(CREATE3args));
 		return NULL;
 	}
@@ -964,11 +1070,12 @@ xdr_to_MKDIR3res(char *msg, int len)
 	res = (MKDIR3res *)mem_alloc(sizeof(MKDIR3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(MKDIR3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	res->MKDIR3res_u.resok.obj.post_op_fh3_u.handle.data.data_val = NULL;
 	if(!xdr_MKDIR3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_MKDIR3res, res);
 		mem_free(res, sizeof(MKDIR3res));
 		return NULL;
 	}
@@ -1007,13 +1114,13 @@ xdr_to_MKDIR3args(char *msg, int len)
 	args = (MKDIR3args *)mem_alloc(sizeof(MKDIR3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(MKDIR3args));
 
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->where.name = NULL;
-	args->where.dir.data.data_val = NULL;
 
 	if(!xdr_MKDIR3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_MKDIR3args, args);
 		mem_free(args, sizeof(MKDIR3args));
 		return NULL;
 	}
@@ -1049,11 +1156,12 @@ xdr_to_SYMLINK3res(char *msg, int len)
 	res = (SYMLINK3res *)mem_alloc(sizeof(SYMLINK3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(SYMLINK3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	res->SYMLINK3res_u.resok.obj.post_op_fh3_u.handle.data.data_val = NULL;
 	if(!xdr_SYMLINK3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_SYMLINK3res, res);
 		mem_free(res, sizeof(SYMLINK3res));
 		return NULL;
 	}
@@ -1091,14 +1199,13 @@ xdr_to_SYMLINK3args(char *msg, int len)
 	args = (SYMLINK3args *)mem_alloc(sizeof(SYMLINK3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(SYMLINK3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->where.dir.data.data_val = NULL;
-	args->where.name = NULL;
-	args->symlink.symlink_data = NULL;
 
 	if(!xdr_SYMLINK3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_SYMLINK3args, args);
 		mem_free(args, sizeof(SYMLINK3args));
 		return NULL;
 	}
@@ -1137,11 +1244,12 @@ xdr_to_MKNOD3res(char *msg, int len)
 	res = (MKNOD3res *)mem_alloc(sizeof(MKNOD3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(MKNOD3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	res->MKNOD3res_u.resok.obj.post_op_fh3_u.handle.data.data_val = NULL;
 	if(!xdr_MKNOD3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_MKNOD3res, res);
 		mem_free(res, sizeof(MKNOD3res));
 		return NULL;
 	}
@@ -1179,12 +1287,12 @@ xdr_to_MKNOD3args(char *msg, int len)
 	args = (MKNOD3args *)mem_alloc(sizeof(MKNOD3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(MKNOD3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->where.dir.data.data_val = NULL;
-	args->where.name = NULL;
 	if(!xdr_MKNOD3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_MKNOD3args, args);
 		mem_free(args, sizeof(MKNOD3args));
 		return NULL;
 	}
@@ -1202,6 +1310,7 @@ free_MKNOD3args(void *msg)
 	args = (MKNOD3args *)msg;
 	mem_free(args->where.dir.data.data_val, args->where.dir.data.data_len);
 	mem_free(args->where.name, strlen(args->where.name) + 1);
+	mem_free(args, sizeof(MKNOD3args));
 	
 	return;
 }
@@ -1220,10 +1329,12 @@ xdr_to_REMOVE3res(char *msg, int len)
 	res = (REMOVE3res *)mem_alloc(sizeof(REMOVE3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(REMOVE3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
 	if(!xdr_REMOVE3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_REMOVE3res, res);
 		mem_free(res, sizeof(REMOVE3res));
 		return NULL;
 	}
@@ -1258,12 +1369,12 @@ xdr_to_REMOVE3args(char *msg, int len)
 	args = (REMOVE3args *)mem_alloc(sizeof(REMOVE3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(REMOVE3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->object.dir.data.data_val = NULL;
-	args->object.name = NULL;
 	if(!xdr_REMOVE3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_REMOVE3args, args);
 		mem_free(args, sizeof(REMOVE3args));
 		return NULL;
 	}
@@ -1302,10 +1413,12 @@ xdr_to_RMDIR3res(char *msg, int len)
 	res = (RMDIR3res *)mem_alloc(sizeof(RMDIR3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(RMDIR3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
 	if(!xdr_RMDIR3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_RMDIR3res, res);
 		mem_free(res, sizeof(RMDIR3res));
 		return NULL;
 	}
@@ -1337,12 +1450,12 @@ xdr_to_RMDIR3args(char *msg, int len)
 	args = (RMDIR3args *)mem_alloc(sizeof(RMDIR3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(RMDIR3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->object.dir.data.data_val = NULL;
-	args->object.name = NULL;
 	if(!xdr_RMDIR3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_RMDIR3args, args);
 		mem_free(args, sizeof(RMDIR3args));
 		return NULL;
 	}
@@ -1380,10 +1493,12 @@ xdr_to_RENAME3res(char *msg, int len)
 	res = (RENAME3res *)mem_alloc(sizeof(RENAME3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(RENAME3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
 	if(!xdr_RENAME3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_RENAME3res, res);
 		mem_free(res, sizeof(RENAME3res));
 		return NULL;
 	}
@@ -1418,15 +1533,13 @@ xdr_to_RENAME3args(char *msg, int len)
 	args = (RENAME3args *)mem_alloc(sizeof(RENAME3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(RENAME3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
-	args->from.dir.data.data_val = NULL;
-	args->from.name = NULL;
-	args->to.dir.data.data_val = NULL;
-	args->to.name = NULL;
 
 	if(!xdr_RENAME3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_RENAME3args, args);
 		mem_free(args, sizeof(RENAME3args));
 		return NULL;
 	}
@@ -1468,10 +1581,12 @@ xdr_to_LINK3res(char *msg, int len)
 	res = (LINK3res *)mem_alloc(sizeof(LINK3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(LINK3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	
 	if(!xdr_LINK3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_LINK3res, res);
 		mem_free(res, sizeof(LINK3res));
 		return NULL;
 	}
@@ -1504,13 +1619,12 @@ LINK3args
 	args = (LINK3args *)mem_alloc(sizeof(LINK3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(LINK3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->file.data.data_val = NULL;
-	args->link.dir.data.data_val = NULL;
-	args->link.name = NULL;
 	if(!xdr_LINK3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_LINK3args, args);
 		mem_free(args, sizeof(LINK3args));
 		return NULL;
 	}
@@ -1550,10 +1664,11 @@ xdr_to_READDIR3res(char *msg, int len)
 	res = (READDIR3res *)mem_alloc(sizeof(READDIR3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(READDIR3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	res->READDIR3res_u.resok.reply.entries = NULL;
 	if(!xdr_READDIR3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READDIR3res, res);
 		mem_free(res, sizeof(READDIR3res));
 		return NULL;
 	}
@@ -1601,11 +1716,12 @@ xdr_to_READDIR3args(char *msg, int len)
 	args = (READDIR3args *)mem_alloc(sizeof(READDIR3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(READDIR3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->dir.data.data_val = NULL;
 	if(!xdr_READDIR3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READDIR3args, args);
 		mem_free(args, sizeof(READDIR3args));
 		return NULL;
 	}
@@ -1642,10 +1758,11 @@ xdr_to_READDIRPLUS3res(char *msg, int len)
 	res = (READDIRPLUS3res *)mem_alloc(sizeof(READDIRPLUS3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(READDIRPLUS3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	res->READDIRPLUS3res_u.resok.reply.entries = NULL;
 	if(!xdr_READDIRPLUS3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READDIRPLUS3res, res);
 		mem_free(res, sizeof(READDIRPLUS3res));
 		return NULL;
 	}
@@ -1694,11 +1811,12 @@ xdr_to_READDIRPLUS3args(char *msg, int len)
 	args = (READDIRPLUS3args *)mem_alloc(sizeof(READDIRPLUS3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(READDIRPLUS3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->dir.data.data_val = NULL;
 	if(!xdr_READDIRPLUS3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_READDIRPLUS3args, args);
 		mem_free(args, sizeof(READDIRPLUS3args));
 		return NULL;
 	}
@@ -1733,9 +1851,11 @@ xdr_to_FSSTAT3res(char *msg, int len)
 	res = (FSSTAT3res *)mem_alloc(sizeof(FSSTAT3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(FSSTAT3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	if(!xdr_FSSTAT3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_FSSTAT3res, res);
 		mem_free(res, sizeof(FSSTAT3res));
 		return NULL;
 	}
@@ -1771,11 +1891,12 @@ xdr_to_FSSTAT3args(char *msg, int len)
 	args = (FSSTAT3args *)mem_alloc(sizeof(FSSTAT3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(FSSTAT3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->fsroot.data.data_val = NULL;
 	if(!xdr_FSSTAT3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_FSSTAT3args, args);
 		mem_free(args, sizeof(FSSTAT3args));
 		return NULL;
 	}
@@ -1811,9 +1932,11 @@ xdr_to_FSINFO3res(char *msg, int len)
 	res = (FSINFO3res *)mem_alloc(sizeof(FSINFO3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(FSINFO3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	if(!xdr_FSINFO3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_FSINFO3res, res);
 		mem_free(res, sizeof(FSINFO3res));
 		return NULL;
 	}
@@ -1849,11 +1972,12 @@ xdr_to_FSINFOargs(char *msg, int len)
 	args = (FSINFOargs *)mem_alloc(sizeof(FSINFOargs));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(FSINFOargs));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	args->fsroot.data.data_val = NULL;
 
 	if(!xdr_FSINFOargs(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_FSINFOargs, args);
 		mem_free(args, sizeof(FSINFOargs));
 		return NULL;
 	}
@@ -1889,9 +2013,11 @@ xdr_to_PATHCONF3res(char *msg, int len)
 	res = (PATHCONF3res *)mem_alloc(sizeof(PATHCONF3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(PATHCONF3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	if(!xdr_PATHCONF3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_PATHCONF3res, res);
 		mem_free(res, sizeof(PATHCONF3res));
 		return NULL;
 	}
@@ -1927,11 +2053,12 @@ xdr_to_PATHCONF3args(char *msg, int len)
 	args = (PATHCONF3args *)mem_alloc(sizeof(PATHCONF3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(PATHCONF3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
-	args->object.data.data_val = NULL;
 
 	if(!xdr_PATHCONF3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_PATHCONF3args, args);
 		mem_free(args, sizeof(PATHCONF3args));
 		return NULL;
 	}
@@ -1966,9 +2093,11 @@ COMMIT3res
 	res = (COMMIT3res *)mem_alloc(sizeof(COMMIT3res));
 	if(res == NULL)
 		return NULL;
+	memset(res, 0, sizeof(COMMIT3res));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 	if(!xdr_COMMIT3res(&xdr, res)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_COMMIT3res, res);
 		mem_free(res, sizeof(COMMIT3res));
 		return NULL;
 	}
@@ -2003,11 +2132,12 @@ xdr_to_COMMIT3args(char *msg, int len)
 	args = (COMMIT3args *)mem_alloc(sizeof(COMMIT3args));
 	if(args == NULL)
 		return NULL;
+	memset(args, 0, sizeof(COMMIT3args));
 	
 	xdrmem_create(&xdr, msg, len, XDR_DECODE);
 
-	args->file.data.data_val = NULL;
 	if(!xdr_COMMIT3args(&xdr, args)) {
+		xdr_free_decoded(&xdr, (xdrproc_t)xdr_COMMIT3args, args);
 		mem_free(args, sizeof(COMMIT3args));
 		return NULL;
 	}
@@ -2,13 +2,20 @@ const NFS3_FHSIZE = 64;
 const NFS3_COOKIEVERFSIZE = 8;
 const NFS3_CREATEVERFSIZE = 8;
 const NFS3_WRITEVERFSIZE  = 8;
+
+/* Not in RFC 1813. The XDR routines allocate a counted item before
+ * reading it, so an unbounded length in a broken reply would make a
+ * client allocate up to 4GB.
+ */
+const NFS3_MAXPATHLEN = 4096;
+const NFS3_MAXDATA    = 16777216;
    
 typedef unsigned hyper uint64;
 typedef hyper int64;
 typedef unsigned long uint32;
 typedef long int32;
-typedef string filename3<>;
-typedef string nfspath3<>;
+typedef string filename3<NFS3_MAXPATHLEN>;
+typedef string nfspath3<NFS3_MAXPATHLEN>;
 typedef uint64 fileid3;
 typedef uint64 cookie3;
 typedef opaque cookieverf3[NFS3_COOKIEVERFSIZE];
@@ -384,7 +391,7 @@ struct wcc_data {
            post_op_attr   file_attributes;
            count3         count;
            bool           eof;
-           opaque         data<>;
+           opaque         data<NFS3_MAXDATA>;
       };
 
       struct READ3resfail {
@@ -409,7 +416,7 @@ struct wcc_data {
            offset3     offset;
            count3      count;
            stable_how  stable;
-           opaque      data<>;
+           opaque      data<NFS3_MAXDATA>;
       };
 
       struct WRITE3resok {
@@ -824,6 +831,7 @@ struct wcc_data {
    const MNTPATHLEN = 1024;  /* Maximum bytes in a path name */
    const MNTNAMLEN  = 255;   /* Maximum bytes in a name */
    const FHSIZE3    = 64;    /* Maximum bytes in a V3 file handle */
+   const MNTMAXFLAVORS = 64; /* Not in RFC 1813, bounds auth_flavors */
 
    typedef opaque fhandle3<FHSIZE3>;
    typedef string dirpath<MNTPATHLEN>;
@@ -855,7 +863,7 @@ struct wcc_data {
 
       struct mountres3_ok {
            fhandle3   fhandle;
-           int        auth_flavors<>;
+           int        auth_flavors<MNTMAXFLAVORS>;
       };
 
       union mountres3 switch (mountstat3 fhs_status) {
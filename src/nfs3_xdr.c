@@ -70,7 +70,7 @@ xdr_int32 (XDR *xdrs, int32 *objp)
 bool_t
 xdr_filename3 (XDR *xdrs, filename3 *objp)
 {
-	 if (!xdr_string (xdrs, objp, ~0))
+	 if (!xdr_string (xdrs, objp, NFS3_MAXPATHLEN))
 		 return FALSE;
 	return TRUE;
 }
@@ -78,7 +78,7 @@ xdr_filename3 (XDR *xdrs, filename3 *objp)
 bool_t
 xdr_nfspath3 (XDR *xdrs, nfspath3 *objp)
 {
-	 if (!xdr_string (xdrs, objp, ~0))
+	 if (!xdr_string (xdrs, objp, NFS3_MAXPATHLEN))
 		 return FALSE;
 	return TRUE;
 }
@@ -712,7 +712,7 @@ xdr_READ3resok (XDR *xdrs, READ3resok *objp)
 	 if(xdrs->x_public == __DISABLE_DATA_DEXDR_INTERNAL)
 		 return TRUE;
 
-	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, ~0))
+	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, NFS3_MAXDATA))
 		 return FALSE;
 
 	return TRUE;
@@ -767,7 +767,7 @@ xdr_WRITE3args (XDR *xdrs, WRITE3args *objp)
 	 if(xdrs->x_public == __DISABLE_DATA_DEXDR_INTERNAL)
 		 return TRUE;
 
-	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, ~0))
+	 if (!xdr_bytes (xdrs, (char **)&objp->data.data_val, (u_int *) &objp->data.data_len, NFS3_MAXDATA))
 		 return FALSE;
 
 	return TRUE;
@@ -1728,7 +1728,7 @@ xdr_mountres3_ok (XDR *xdrs, mountres3_ok *objp)
 {
 	 if (!xdr_fhandle3 (xdrs, &objp->fhandle))
 		 return FALSE;
-	 if (!xdr_array (xdrs, (char **)&objp->auth_flavors.auth_flavors_val, (u_int *) &objp->auth_flavors.auth_flavors_len, ~0,
+	 if (!xdr_array (xdrs, (char **)&objp->auth_flavors.auth_flavors_val, (u_int *) &objp->auth_flavors.auth_flavors_len, MNTMAXFLAVORS,
 		sizeof (int), (xdrproc_t) xdr_int))
 		 return FALSE;
 	return TRUE;
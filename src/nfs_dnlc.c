@@ -0,0 +1,758 @@
+/*
+ *    libnfsclient, library for NFS operations from user space.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <rpc/rpc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <nfsclient.h>
+
+/* Key is one byte of handle length, the handle and the name without
+ * the terminating NUL. The length byte keeps handles that are a
+ * prefix of another handle from colliding.
+ */
+#define DNLC_KEYMAX (1 + NFS3_FHSIZE + DNLC_NAMELEN)
+
+struct dnlc_entry {
+	/* NFS3_OK, or the error a negative entry stands for */
+	nfsstat3 de_status;
+	ftype3 de_type;
+	time_t de_expires;
+	u_int de_fhlen;
+	char de_fh[NFS3_FHSIZE];
+};
+
+
+static int
+dnlc_key(char *key, nfs_fh3 *dir, char *name)
+{
+	int namelen;
+
+	if((dir == NULL) || (name == NULL))
+		return -1;
+
+	if(dir->data.data_len > NFS3_FHSIZE)
+		return -1;
+
+	namelen = strlen(name);
+	if(namelen > DNLC_NAMELEN)
+		return -1;
+
+	key[0] = (char)dir->data.data_len;
+	memcpy(key + 1, dir->data.data_val, dir->data.data_len);
+	memcpy(key + 1 + dir->data.data_len, name, namelen);
+
+	return 1 + dir->data.data_len + namelen;
+}
+
+
+/* Called by the hash table when a bucket overflows */
+static void
+dnlc_evict(void *data, const void *key)
+{
+	mem_free(data, sizeof(struct dnlc_entry));
+}
+
+
+int
+nfs_dnlc_init(nfs_ctx *ctx, unsigned int size, int ttl, int negttl)
+{
+	nfs_dnlc *dc = NULL;
+
+	if(ctx == NULL)
+		return -1;
+
+	if(ctx->nfs_dnlc != NULL)
+		nfs_dnlc_destroy(ctx);
+
+	dc = (nfs_dnlc *)mem_alloc(sizeof(nfs_dnlc));
+	if(dc == NULL)
+		return -1;
+
+	dc->dc_table = ght_create((size) ? size : DNLC_BUCKETS);
+	if(dc->dc_table == NULL) {
+		mem_free(dc, sizeof(nfs_dnlc));
+		return -1;
+	}
+	ght_set_bounded_buckets(dc->dc_table, DNLC_BUCKET_LIMIT, dnlc_evict);
+
+	dc->dc_ttl = (ttl) ? ttl : DNLC_DEFAULT_TTL;
+	dc->dc_negttl = (negttl) ? negttl : DNLC_DEFAULT_NEG_TTL;
+	dc->dc_hits = 0;
+	dc->dc_neghits = 0;
+	dc->dc_misses = 0;
+
+	ctx->nfs_dnlc = dc;
+	return 0;
+}
+
+
+void
+nfs_dnlc_destroy(nfs_ctx *ctx)
+{
+	ght_iterator_t iter;
+	const void *key;
+	void *e;
+
+	if((ctx == NULL) || (ctx->nfs_dnlc == NULL))
+		return;
+
+	for(e = ght_first(ctx->nfs_dnlc->dc_table, &iter, &key); e != NULL;
+			e = ght_next(ctx->nfs_dnlc->dc_table, &iter, &key))
+		mem_free(e, sizeof(struct dnlc_entry));
+
+	ght_finalize(ctx->nfs_dnlc->dc_table);
+	mem_free(ctx->nfs_dnlc, sizeof(nfs_dnlc));
+	ctx->nfs_dnlc = NULL;
+}
+
+
+static nfs_dnlc *
+get_dnlc(nfs_ctx *ctx)
+{
+	if(ctx == NULL)
+		return NULL;
+
+	if(ctx->nfs_dnlc == NULL)
+		nfs_dnlc_init(ctx, 0, 0, 0);
+
+	return ctx->nfs_dnlc;
+}
+
+
+static void
+dnlc_insert(nfs_dnlc *dc, char *key, int keylen, struct dnlc_entry *de)
+{
+	void *old = NULL;
+
+	/* ght_insert refuses duplicate keys, drop the old entry first */
+	old = ght_remove(dc->dc_table, keylen, key);
+	if(old != NULL)
+		mem_free(old, sizeof(struct dnlc_entry));
+
+	if(ght_insert(dc->dc_table, de, keylen, key) < 0)
+		mem_free(de, sizeof(struct dnlc_entry));
+}
+
+
+int
+nfs_dnlc_lookup(nfs_ctx *ctx, nfs_fh3 *dir, char *name, nfs_fh3 *fh,
+		ftype3 *type)
+{
+	nfs_dnlc *dc = NULL;
+	struct dnlc_entry *de = NULL;
+	char key[DNLC_KEYMAX];
+	int keylen;
+
+	if((ctx == NULL) || ((dc = ctx->nfs_dnlc) == NULL))
+		return -1;
+
+	if((keylen = dnlc_key(key, dir, name)) < 0)
+		return -1;
+
+	de = (struct dnlc_entry *)ght_get(dc->dc_table, keylen, key);
+	if(de == NULL) {
+		dc->dc_misses++;
+		return -1;
+	}
+
+	if(de->de_expires <= time(NULL)) {
+		ght_remove(dc->dc_table, keylen, key);
+		mem_free(de, sizeof(struct dnlc_entry));
+		dc->dc_misses++;
+		return -1;
+	}
+
+	if(de->de_status != NFS3_OK) {
+		dc->dc_neghits++;
+		return de->de_status;
+	}
+
+	dc->dc_hits++;
+	if(fh != NULL) {
+		memcpy(fh->data.data_val, de->de_fh, de->de_fhlen);
+		fh->data.data_len = de->de_fhlen;
+	}
+	if(type != NULL)
+		*type = de->de_type;
+
+	return NFS3_OK;
+}
+
+
+void
+nfs_dnlc_enter(nfs_ctx *ctx, nfs_fh3 *dir, char *name, nfs_fh3 *fh,
+		ftype3 type)
+{
+	nfs_dnlc *dc = NULL;
+	struct dnlc_entry *de = NULL;
+	char key[DNLC_KEYMAX];
+	int keylen;
+
+	if((fh == NULL) || (fh->data.data_len > NFS3_FHSIZE))
+		return;
+
+	/* These dont name a child of dir */
+	if((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
+		return;
+
+	if((dc = get_dnlc(ctx)) == NULL)
+		return;
+
+	if((keylen = dnlc_key(key, dir, name)) < 0)
+		return;
+
+	de = (struct dnlc_entry *)mem_alloc(sizeof(struct dnlc_entry));
+	if(de == NULL)
+		return;
+
+	de->de_status = NFS3_OK;
+	de->de_type = type;
+	de->de_expires = time(NULL) + dc->dc_ttl;
+	de->de_fhlen = fh->data.data_len;
+	memcpy(de->de_fh, fh->data.data_val, fh->data.data_len);
+
+	dnlc_insert(dc, key, keylen, de);
+}
+
+
+void
+nfs_dnlc_enter_negative(nfs_ctx *ctx, nfs_fh3 *dir, char *name,
+		nfsstat3 stat)
+{
+	nfs_dnlc *dc = NULL;
+	struct dnlc_entry *de = NULL;
+	char key[DNLC_KEYMAX];
+	int keylen;
+
+	if((dc = get_dnlc(ctx)) == NULL)
+		return;
+
+	if(dc->dc_negttl < 0)
+		return;
+
+	if((keylen = dnlc_key(key, dir, name)) < 0)
+		return;
+
+	de = (struct dnlc_entry *)mem_alloc(sizeof(struct dnlc_entry));
+	if(de == NULL)
+		return;
+
+	de->de_status = stat;
+	de->de_type = 0;
+	de->de_expires = time(NULL) + dc->dc_negttl;
+	de->de_fhlen = 0;
+
+	dnlc_insert(dc, key, keylen, de);
+}
+
+
+void
+nfs_dnlc_purge(nfs_ctx *ctx, nfs_fh3 *dir, char *name)
+{
+	void *de = NULL;
+	char key[DNLC_KEYMAX];
+	int keylen;
+
+	if((ctx == NULL) || (ctx->nfs_dnlc == NULL))
+		return;
+
+	if((keylen = dnlc_key(key, dir, name)) < 0)
+		return;
+
+	de = ght_remove(ctx->nfs_dnlc->dc_table, keylen, key);
+	if(de != NULL)
+		mem_free(de, sizeof(struct dnlc_entry));
+}
+
+
+int
+nfs_dnlc_enter_readdirplus(nfs_ctx *ctx, nfs_fh3 *dir, READDIRPLUS3res *res)
+{
+	entryplus3 *entry = NULL;
+	ftype3 type;
+	int count = 0;
+
+	if((res == NULL) || (res->status != NFS3_OK))
+		return 0;
+
+	for(entry = res->READDIRPLUS3res_u.resok.reply.entries; entry != NULL;
+			entry = entry->nextentry) {
+		if(!entry->name_handle.handle_follows)
+			continue;
+
+		type = 0;
+		if(entry->name_attributes.attributes_follow)
+			type = entry->name_attributes.post_op_attr_u.attributes.type;
+
+		nfs_dnlc_enter(ctx, dir, entry->name,
+				&entry->name_handle.post_op_fh3_u.handle, type);
+		++count;
+	}
+
+	return count;
+}
+
+
+
+/* State of one path resolution. Lives until the user callback has
+ * been called.
+ */
+struct resolve_state {
+	nfs_ctx *rs_ctx;
+	int rs_flags;
+
+	/* Private copy of the path, split in place. Replaced when a
+	 * symlink is followed.
+	 */
+	char *rs_path;
+	int rs_pathlen;
+
+	/* Next component to resolve */
+	char *rs_next;
+
+	/* Component being resolved, and what it took so far */
+	char *rs_name;
+	int rs_how;
+	struct timeval rs_start;
+
+	/* Number of symlinks followed */
+	int rs_links;
+
+	/* Handle of the directory resolved so far */
+	nfs_fh3 rs_fh;
+	char rs_fhbuf[NFS3_FHSIZE];
+
+	/* Handle and type of rs_name, once known */
+	nfs_fh3 rs_child;
+	char rs_childbuf[NFS3_FHSIZE];
+	ftype3 rs_type;
+
+	nfs_resolve_cb rs_cb;
+	nfs_resolve_step_cb rs_step;
+	void *rs_priv;
+};
+
+static void resolve_walk(struct resolve_state *rs);
+static void resolve_child(struct resolve_state *rs);
+
+static void
+resolve_finish(struct resolve_state *rs, int stat)
+{
+	rs->rs_cb(stat, (stat == NFS3_OK) ? &rs->rs_fh : NULL, rs->rs_priv);
+
+	mem_free(rs->rs_path, rs->rs_pathlen + 1);
+	mem_free(rs, sizeof(struct resolve_state));
+}
+
+
+static void
+resolve_step_done(struct resolve_state *rs)
+{
+	struct timeval now;
+
+	if(rs->rs_step == NULL)
+		return;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &rs->rs_start, &now);
+	rs->rs_step(rs->rs_name, rs->rs_how, &now, rs->rs_priv);
+}
+
+
+static int
+resolve_set_child(struct resolve_state *rs, nfs_fh3 *fh)
+{
+	if(fh->data.data_len > NFS3_FHSIZE)
+		return -1;
+
+	memcpy(rs->rs_childbuf, fh->data.data_val, fh->data.data_len);
+	rs->rs_child.data.data_len = fh->data.data_len;
+	return 0;
+}
+
+
+static void
+resolve_lookup_cb(void *msg, int len, void *priv)
+{
+	struct resolve_state *rs = (struct resolve_state *)priv;
+	LOOKUP3res *res = NULL;
+	LOOKUP3resok *ok = NULL;
+
+	res = xdr_to_LOOKUP3res(msg, len);
+	if(res == NULL) {
+		resolve_finish(rs, -1);
+		return;
+	}
+
+	if(res->status != NFS3_OK) {
+		if(res->status == NFS3ERR_NOENT)
+			nfs_dnlc_enter_negative(rs->rs_ctx, &rs->rs_fh,
+					rs->rs_name, res->status);
+		resolve_step_done(rs);
+		resolve_finish(rs, res->status);
+		free_LOOKUP3res(res);
+		return;
+	}
+
+	ok = &res->LOOKUP3res_u.resok;
+	if(resolve_set_child(rs, &ok->object) < 0) {
+		free_LOOKUP3res(res);
+		resolve_finish(rs, NFS3ERR_BADHANDLE);
+		return;
+	}
+
+	rs->rs_type = 0;
+	if(ok->obj_attributes.attributes_follow)
+		rs->rs_type = ok->obj_attributes.post_op_attr_u.attributes.type;
+
+	nfs_dnlc_enter(rs->rs_ctx, &rs->rs_fh, rs->rs_name, &ok->object,
+			rs->rs_type);
+	free_LOOKUP3res(res);
+
+	resolve_child(rs);
+}
+
+
+static void
+resolve_getattr_cb(void *msg, int len, void *priv)
+{
+	struct resolve_state *rs = (struct resolve_state *)priv;
+	GETATTR3res *res = NULL;
+
+	res = xdr_to_GETATTR3res(msg, len);
+	if(res == NULL) {
+		resolve_finish(rs, -1);
+		return;
+	}
+
+	if(res->status != NFS3_OK) {
+		resolve_step_done(rs);
+		resolve_finish(rs, res->status);
+		free_GETATTR3res(res);
+		return;
+	}
+
+	rs->rs_type = res->GETATTR3res_u.resok.obj_attributes.type;
+	free_GETATTR3res(res);
+
+	/* Remember the type so the next walk does not need to ask */
+	nfs_dnlc_enter(rs->rs_ctx, &rs->rs_fh, rs->rs_name, &rs->rs_child,
+			rs->rs_type);
+
+	resolve_child(rs);
+}
+
+
+static void
+resolve_readlink_cb(void *msg, int len, void *priv)
+{
+	struct resolve_state *rs = (struct resolve_state *)priv;
+	READLINK3res *res = NULL;
+	char *target = NULL;
+	char *path = NULL;
+	int targetlen, restlen;
+
+	res = xdr_to_READLINK3res(msg, len);
+	if(res == NULL) {
+		resolve_finish(rs, -1);
+		return;
+	}
+
+	resolve_step_done(rs);
+	if(res->status != NFS3_OK) {
+		resolve_finish(rs, res->status);
+		free_READLINK3res(res);
+		return;
+	}
+
+	/* An absolute target names a path in the namespace of whoever
+	 * made the link, which we know nothing about.
+	 */
+	target = res->READLINK3res_u.resok.data;
+	if(target[0] == '/') {
+		free_READLINK3res(res);
+		resolve_finish(rs, NFS3ERR_NOTSUPP);
+		return;
+	}
+
+	/* Continue with the target, followed by whatever was left of
+	 * the original path, relative to the directory holding the link.
+	 */
+	targetlen = strlen(target);
+	restlen = strlen(rs->rs_next);
+	path = (char *)mem_alloc(targetlen + restlen + 2);
+	if(path == NULL) {
+		free_READLINK3res(res);
+		resolve_finish(rs, -1);
+		return;
+	}
+
+	memcpy(path, target, targetlen);
+	path[targetlen] = '/';
+	memcpy(path + targetlen + 1, rs->rs_next, restlen + 1);
+	free_READLINK3res(res);
+
+	mem_free(rs->rs_path, rs->rs_pathlen + 1);
+	rs->rs_path = path;
+	rs->rs_pathlen = targetlen + restlen + 1;
+	rs->rs_next = path;
+
+	resolve_walk(rs);
+}
+
+
+/* Called once the handle of rs_name is known. Finds out whether it is
+ * a symlink we have to follow before descending into it.
+ */
+static void
+resolve_child(struct resolve_state *rs)
+{
+	GETATTR3args gargs;
+	READLINK3args rargs;
+	char *p = NULL;
+	int last;
+
+	for(p = rs->rs_next; *p == '/'; p++)
+		;
+	last = (*p == '\0');
+
+	if(!last || !(rs->rs_flags & NFS_RESOLVE_NOFOLLOW)) {
+		if(rs->rs_type == 0) {
+			rs->rs_how |= NFS_STEP_GETATTR;
+			gargs.object = rs->rs_child;
+			if(nfs3_getattr(&gargs, rs->rs_ctx, resolve_getattr_cb,
+						rs) != RPC_SUCCESS)
+				resolve_finish(rs, -1);
+			return;
+		}
+
+		if(rs->rs_type == NF3LNK) {
+			if(++rs->rs_links > NFS_RESOLVE_MAXLINKS) {
+				resolve_finish(rs, NFS3ERR_INVAL);
+				return;
+			}
+
+			rs->rs_how |= NFS_STEP_READLINK;
+			rargs.symlink = rs->rs_child;
+			if(nfs3_readlink(&rargs, rs->rs_ctx, resolve_readlink_cb,
+						rs) != RPC_SUCCESS)
+				resolve_finish(rs, -1);
+			return;
+		}
+	}
+
+	resolve_step_done(rs);
+	memcpy(rs->rs_fhbuf, rs->rs_childbuf, rs->rs_child.data.data_len);
+	rs->rs_fh.data.data_len = rs->rs_child.data.data_len;
+
+	resolve_walk(rs);
+}
+
+
+/* Resolve as many components as possible from the cache, then send a
+ * LOOKUP for the first one that is not cached.
+ */
+static void
+resolve_walk(struct resolve_state *rs)
+{
+	LOOKUP3args args;
+	char *name = NULL;
+	int stat;
+
+	while(*rs->rs_next == '/')
+		rs->rs_next++;
+
+	if(*rs->rs_next == '\0') {
+		resolve_finish(rs, NFS3_OK);
+		return;
+	}
+
+	name = rs->rs_next;
+	while((*rs->rs_next != '/') && (*rs->rs_next != '\0'))
+		rs->rs_next++;
+	if(*rs->rs_next == '/')
+		*rs->rs_next++ = '\0';
+
+	rs->rs_name = name;
+	rs->rs_how = 0;
+	rs->rs_type = 0;
+	gettimeofday(&rs->rs_start, NULL);
+
+	if(strcmp(name, ".") == 0) {
+		rs->rs_how = NFS_STEP_CACHED;
+		resolve_step_done(rs);
+		resolve_walk(rs);
+		return;
+	}
+
+	if(!(rs->rs_flags & NFS_RESOLVE_NOCACHE)) {
+		stat = nfs_dnlc_lookup(rs->rs_ctx, &rs->rs_fh, name,
+				&rs->rs_child, &rs->rs_type);
+		if(stat == NFS3_OK) {
+			rs->rs_how = NFS_STEP_CACHED;
+			resolve_child(rs);
+			return;
+		}
+
+		if(stat != -1) {
+			rs->rs_how = NFS_STEP_CACHED;
+			resolve_step_done(rs);
+			resolve_finish(rs, stat);
+			return;
+		}
+	}
+
+	rs->rs_how = NFS_STEP_LOOKUP;
+	args.what.dir = rs->rs_fh;
+	args.what.name = name;
+
+	if(nfs3_lookup(&args, rs->rs_ctx, resolve_lookup_cb, rs) != RPC_SUCCESS)
+		resolve_finish(rs, -1);
+}
+
+
+int
+nfs_resolve_path_async(nfs_ctx *ctx, nfs_fh3 *root, char *path, int flags,
+		nfs_resolve_cb cb, nfs_resolve_step_cb step, void *priv)
+{
+	struct resolve_state *rs = NULL;
+
+	if((ctx == NULL) || (root == NULL) || (path == NULL) || (cb == NULL))
+		return -1;
+
+	if(root->data.data_len > NFS3_FHSIZE)
+		return -1;
+
+	rs = (struct resolve_state *)mem_alloc(sizeof(struct resolve_state));
+	if(rs == NULL)
+		return -1;
+
+	rs->rs_pathlen = strlen(path);
+	rs->rs_path = (char *)mem_alloc(rs->rs_pathlen + 1);
+	if(rs->rs_path == NULL) {
+		mem_free(rs, sizeof(struct resolve_state));
+		return -1;
+	}
+	memcpy(rs->rs_path, path, rs->rs_pathlen + 1);
+
+	rs->rs_ctx = ctx;
+	rs->rs_flags = flags;
+	rs->rs_next = rs->rs_path;
+	rs->rs_name = NULL;
+	rs->rs_how = 0;
+	rs->rs_links = 0;
+	rs->rs_fh.data.data_val = rs->rs_fhbuf;
+	rs->rs_fh.data.data_len = root->data.data_len;
+	memcpy(rs->rs_fhbuf, root->data.data_val, root->data.data_len);
+	rs->rs_child.data.data_val = rs->rs_childbuf;
+	rs->rs_child.data.data_len = 0;
+	rs->rs_type = 0;
+	rs->rs_cb = cb;
+	rs->rs_step = step;
+	rs->rs_priv = priv;
+
+	/* Make sure lookups get remembered even if the user did not
+	 * set up the cache.
+	 */
+	get_dnlc(ctx);
+
+	resolve_walk(rs);
+	return 0;
+}
+
+
+/* Allocated, since a resolve given up on may still finish later. Then
+ * the callback frees it instead of writing to the caller.
+ */
+struct resolve_sync {
+	int done;
+	int abandoned;
+	int stat;
+	nfs_fh3 *fh;
+};
+
+static void
+resolve_sync_cb(int stat, nfs_fh3 *fh, void *priv)
+{
+	struct resolve_sync *sync = (struct resolve_sync *)priv;
+
+	if(sync->abandoned) {
+		mem_free(sync, sizeof(struct resolve_sync));
+		return;
+	}
+
+	sync->done = 1;
+	sync->stat = stat;
+	if(stat != NFS3_OK)
+		return;
+
+	sync->fh->data.data_val = (char *)mem_alloc(fh->data.data_len);
+	if(sync->fh->data.data_val == NULL) {
+		sync->stat = -1;
+		return;
+	}
+	memcpy(sync->fh->data.data_val, fh->data.data_val, fh->data.data_len);
+	sync->fh->data.data_len = fh->data.data_len;
+}
+
+
+int
+nfs_resolve_path(nfs_ctx *ctx, nfs_fh3 *root, char *path, nfs_fh3 *fh)
+{
+	struct resolve_sync *sync = NULL;
+	int stat;
+
+	if(fh == NULL)
+		return -1;
+
+	sync = (struct resolve_sync *)mem_alloc(sizeof(struct resolve_sync));
+	if(sync == NULL)
+		return -1;
+
+	sync->done = 0;
+	sync->abandoned = 0;
+	sync->stat = -1;
+	sync->fh = fh;
+
+	if(nfs_resolve_path_async(ctx, root, path, 0, resolve_sync_cb, NULL,
+				sync) < 0) {
+		mem_free(sync, sizeof(struct resolve_sync));
+		return -1;
+	}
+
+	/* nfs_complete only returns 0 in blocking mode if there is
+	 * nothing to wait for, or the connection went away.
+	 */
+	while(!sync->done) {
+		if(nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	}
+
+	/* Still pending: the callback frees it if it ever comes */
+	if(!sync->done) {
+		sync->abandoned = 1;
+		return -1;
+	}
+
+	stat = sync->stat;
+	mem_free(sync, sizeof(struct resolve_sync));
+	return stat;
+}
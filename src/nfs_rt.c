@@ -0,0 +1,567 @@
+/*
+ *    libnfsclient, library for NFS operations from user space.
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License along
+ *    with this program; if not, write to the Free Software Foundation, Inc.,
+ *    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* For the CPU affinity calls */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <rpc/rpc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <nfsclient.h>
+#include <nfs_rt.h>
+
+/* Keeps what the submitting threads write off the cache lines the
+ * worker uses on its own.
+ */
+#define RT_CACHE_LINE 64
+
+/* Initial size of the per worker target table */
+#define RT_TARGETS 64
+
+/* A target. Zeroed before filling in, it is hashed as bytes. */
+struct rt_key {
+	u_int32_t k_addr;
+	u_int16_t k_port;
+	u_int16_t k_pad;
+	int32_t k_conn;
+};
+
+/* Work handed to a worker, a node of its queue */
+struct rt_work {
+	struct rt_work *rw_next;
+	struct rt_key rw_key;
+	struct sockaddr_in rw_srv;
+
+	/* NULL for the request to stop */
+	nfs_rt_fn rw_fn;
+	void *rw_arg;
+};
+
+struct rt_target {
+	struct rt_key t_key;
+	nfs_ctx *t_ctx;
+};
+
+struct rt_worker {
+	/* Written by the submitting threads. The queue is an intrusive
+	 * multi-producer single-consumer list: producers swap
+	 * themselves in at the head and then link the previous head
+	 * to themselves, the worker takes nodes off the tail.
+	 */
+	struct rt_work *w_head;
+
+	/* Set by the first producer since the worker last looked,
+	 * which then writes to the pipe.
+	 */
+	int w_wake;
+	char w_pad[RT_CACHE_LINE];
+
+	/* Only touched by the worker */
+	struct rt_work *w_tail;
+	struct rt_work w_stub;
+	ght_hash_table_t *w_targets;
+
+	/* The pipe first, then the sockets of the targets with calls
+	 * outstanding, w_pt[i] being the target of w_pfd[i].
+	 */
+	struct pollfd *w_pfd;
+	struct rt_target **w_pt;
+	int w_pfdsz;
+	int w_stop;
+
+	/* Set up by nfs_rt_create() */
+	int w_pipe[2];
+	int w_cpu;
+	pthread_t w_thread;
+	struct rt_work w_stopwork;
+	nfs_rt *w_rt;
+	char w_pad2[RT_CACHE_LINE];
+};
+
+struct _nfs_rt {
+	int rt_nworkers;
+	int rt_flags;
+	int rt_connflags;
+	ght_fn_hash_t rt_hash;
+	struct rt_worker *rt_workers;
+};
+
+
+static void
+rt_push(struct rt_worker *w, struct rt_work *rw)
+{
+	struct rt_work *prev = NULL;
+
+	rw->rw_next = NULL;
+	prev = __atomic_exchange_n(&w->w_head, rw, __ATOMIC_SEQ_CST);
+	/* Until this store the worker sees the queue end at prev */
+	__atomic_store_n(&prev->rw_next, rw, __ATOMIC_SEQ_CST);
+}
+
+
+/* Returns the oldest node, or NULL if there is none or a producer is
+ * half way through adding the only one. That producer wakes the
+ * worker once done. The loads are sequentially consistent, like the
+ * stores of rt_push() and w_wake, see rt_wake().
+ */
+static struct rt_work *
+rt_pop(struct rt_worker *w)
+{
+	struct rt_work *tail = w->w_tail;
+	struct rt_work *next = NULL;
+
+	next = __atomic_load_n(&tail->rw_next, __ATOMIC_SEQ_CST);
+	if(tail == &w->w_stub) {
+		if(next == NULL)
+			return NULL;
+		w->w_tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->rw_next, __ATOMIC_SEQ_CST);
+	}
+
+	if(next != NULL) {
+		w->w_tail = next;
+		return tail;
+	}
+
+	if(tail != __atomic_load_n(&w->w_head, __ATOMIC_SEQ_CST))
+		return NULL;
+
+	/* tail is the last node. Put the stub behind it, so that it
+	 * can be taken off without leaving the list empty.
+	 */
+	rt_push(w, &w->w_stub);
+	next = __atomic_load_n(&tail->rw_next, __ATOMIC_SEQ_CST);
+	if(next != NULL) {
+		w->w_tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+
+static void
+rt_wake(struct rt_worker *w)
+{
+	char c = 0;
+
+	/* Ordered after the link made by rt_push(). Either the worker
+	 * has not cleared w_wake yet and will find the node after it
+	 * does, or we see it clear and wake it.
+	 */
+	if(__atomic_load_n(&w->w_wake, __ATOMIC_SEQ_CST))
+		return;
+	if(__atomic_exchange_n(&w->w_wake, 1, __ATOMIC_SEQ_CST))
+		return;
+
+	/* A full pipe wakes the worker just as well */
+	while((write(w->w_pipe[1], &c, 1) < 0) && (errno == EINTR))
+		;
+}
+
+
+static void
+rt_make_key(struct rt_key *key, struct sockaddr_in *srv, int conn)
+{
+	memset(key, 0, sizeof(struct rt_key));
+	key->k_addr = srv->sin_addr.s_addr;
+	key->k_port = srv->sin_port;
+	key->k_conn = conn;
+}
+
+
+static void
+rt_run(struct rt_worker *w, struct rt_work *rw)
+{
+	struct rt_target *t = NULL;
+
+	t = ght_get(w->w_targets, sizeof(struct rt_key), &rw->rw_key);
+	if(t == NULL) {
+		t = (struct rt_target *)malloc(sizeof(struct rt_target));
+		if(t == NULL) {
+			rw->rw_fn(NULL, rw->rw_arg);
+			return;
+		}
+
+		t->t_key = rw->rw_key;
+		t->t_ctx = nfs_init(&rw->rw_srv, IPPROTO_TCP,
+				w->w_rt->rt_connflags | NFSC_CFL_NONBLOCKING
+				| NFSC_CFL_RECONNECT | NFSC_CFL_RETRANS);
+		if((t->t_ctx == NULL) || (ght_insert(w->w_targets, t,
+					sizeof(struct rt_key), &t->t_key) < 0)) {
+			nfs_destroy(t->t_ctx);
+			free(t);
+			rw->rw_fn(NULL, rw->rw_arg);
+			return;
+		}
+	}
+
+	rw->rw_fn(t->t_ctx, rw->rw_arg);
+}
+
+
+/* Fills in w_pfd and the poll() timeout, returns the number of
+ * entries. Targets reconnecting have an entry with an fd of -1, which
+ * poll() skips.
+ */
+static int
+rt_pollset(struct rt_worker *w, int *timeout)
+{
+	struct rt_target *t = NULL;
+	struct pollfd *pfd = NULL;
+	struct rt_target **pt = NULL;
+	ght_iterator_t iter;
+	const void *key;
+	CLIENT *cl = NULL;
+	int n, size, events, ms;
+
+	size = ght_size(w->w_targets) + 1;
+	if(size > w->w_pfdsz) {
+		pfd = (struct pollfd *)realloc(w->w_pfd,
+				size * sizeof(struct pollfd));
+		if(pfd != NULL)
+			w->w_pfd = pfd;
+		pt = (struct rt_target **)realloc(w->w_pt,
+				size * sizeof(struct rt_target *));
+		if(pt != NULL)
+			w->w_pt = pt;
+		/* Otherwise some targets wait for the next round */
+		if((pfd != NULL) && (pt != NULL))
+			w->w_pfdsz = size;
+	}
+
+	w->w_pfd[0].fd = w->w_pipe[0];
+	w->w_pfd[0].events = POLLIN;
+	*timeout = -1;
+	n = 1;
+	for(t = ght_first(w->w_targets, &iter, &key);
+			(t != NULL) && (n < w->w_pfdsz);
+			t = ght_next(w->w_targets, &iter, &key)) {
+		if((cl = t->t_ctx->nfs_cl) == NULL)
+			continue;
+		events = clnttcp_nb_events(cl);
+		ms = clnttcp_nb_timeout(cl);
+		if((events == 0) && (ms < 0))
+			continue;
+
+		if((ms >= 0) && ((*timeout < 0) || (ms < *timeout)))
+			*timeout = ms;
+		w->w_pfd[n].fd = events ? clnttcp_nb_fd(cl) : -1;
+		w->w_pfd[n].events = events;
+		w->w_pt[n] = t;
+		n++;
+	}
+
+	return n;
+}
+
+
+static void
+rt_pin(int cpu)
+{
+#ifdef CPU_SET
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+
+static void *
+rt_worker_main(void *arg)
+{
+	struct rt_worker *w = (struct rt_worker *)arg;
+	struct rt_work *rw = NULL;
+	struct rt_target *t = NULL;
+	ght_iterator_t iter;
+	const void *key;
+	char buf[64];
+	int i, n, timeout;
+	CLIENT *cl = NULL;
+
+	if(w->w_rt->rt_flags & NFS_RT_PIN)
+		rt_pin(w->w_cpu);
+
+	while(!w->w_stop) {
+		__atomic_store_n(&w->w_wake, 0, __ATOMIC_SEQ_CST);
+		while((rw = rt_pop(w)) != NULL) {
+			if(rw->rw_fn == NULL) {
+				w->w_stop = 1;
+				break;
+			}
+			rt_run(w, rw);
+			free(rw);
+		}
+		if(w->w_stop)
+			break;
+
+		n = rt_pollset(w, &timeout);
+		if(poll(w->w_pfd, n, timeout) < 0)
+			continue;
+
+		if(w->w_pfd[0].revents)
+			while(read(w->w_pipe[0], buf, sizeof(buf)) > 0)
+				;
+
+		for(i = 1; i < n; i++) {
+			cl = w->w_pt[i]->t_ctx->nfs_cl;
+			if((w->w_pfd[i].revents == 0)
+					&& (clnttcp_nb_timeout(cl) != 0))
+				continue;
+			/* Sends what is queued, then reads what arrived,
+			 * or takes the next step of reconnecting.
+			 */
+			nfs_complete(w->w_pt[i]->t_ctx, RPC_NONBLOCK_WAIT);
+		}
+	}
+
+	for(t = ght_first(w->w_targets, &iter, &key); t != NULL;
+			t = ght_next(w->w_targets, &iter, &key)) {
+		nfs_destroy(t->t_ctx);
+		free(t);
+	}
+	ght_finalize(w->w_targets);
+	w->w_targets = NULL;
+
+	return NULL;
+}
+
+
+static int
+rt_worker_init(nfs_rt *rt, struct rt_worker *w, int cpu)
+{
+	int i;
+
+	memset(w, 0, sizeof(struct rt_worker));
+	w->w_rt = rt;
+	w->w_cpu = cpu;
+	w->w_head = w->w_tail = &w->w_stub;
+	w->w_stopwork.rw_fn = NULL;
+
+	if(pipe(w->w_pipe) < 0)
+		return -1;
+	for(i = 0; i < 2; i++)
+		fcntl(w->w_pipe[i], F_SETFL,
+				fcntl(w->w_pipe[i], F_GETFL) | O_NONBLOCK);
+
+	w->w_targets = ght_create_flat(RT_TARGETS, sizeof(struct rt_key),
+			FALSE);
+	w->w_pfd = (struct pollfd *)malloc(sizeof(struct pollfd));
+	w->w_pt = (struct rt_target **)malloc(sizeof(struct rt_target *));
+	if((w->w_targets == NULL) || (w->w_pfd == NULL) || (w->w_pt == NULL)) {
+		if(w->w_targets != NULL)
+			ght_finalize(w->w_targets);
+		free(w->w_pfd);
+		free(w->w_pt);
+		close(w->w_pipe[0]);
+		close(w->w_pipe[1]);
+		return -1;
+	}
+	w->w_pfdsz = 1;
+
+	return 0;
+}
+
+
+/* Stops and frees the first n workers, whose threads are running */
+static void
+rt_stop(nfs_rt *rt, int n)
+{
+	struct rt_worker *w = NULL;
+	struct rt_work *rw = NULL;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		w = &rt->rt_workers[i];
+		rt_push(w, &w->w_stopwork);
+		rt_wake(w);
+	}
+
+	for(i = 0; i < n; i++) {
+		w = &rt->rt_workers[i];
+		pthread_join(w->w_thread, NULL);
+
+		/* Only what was submitted against the rules is left */
+		while((rw = rt_pop(w)) != NULL)
+			if(rw != &w->w_stopwork)
+				free(rw);
+
+		free(w->w_pfd);
+		free(w->w_pt);
+		close(w->w_pipe[0]);
+		close(w->w_pipe[1]);
+	}
+}
+
+
+nfs_rt *
+nfs_rt_create(int nworkers, int flags, int connflags)
+{
+	nfs_rt *rt = NULL;
+	sigset_t all, old;
+	int cpus[1024];
+	int ncpus = 0, i;
+#ifdef CPU_SET
+	cpu_set_t set;
+
+	if(sched_getaffinity(0, sizeof(set), &set) == 0)
+		for(i = 0; (i < CPU_SETSIZE) && (ncpus < 1024); i++)
+			if(CPU_ISSET(i, &set))
+				cpus[ncpus++] = i;
+#endif
+	if(ncpus == 0) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if(ncpus < 1)
+			ncpus = 1;
+		if(ncpus > 1024)
+			ncpus = 1024;
+		for(i = 0; i < ncpus; i++)
+			cpus[i] = i;
+	}
+
+	if(nworkers <= 0)
+		nworkers = ncpus;
+
+	rt = (nfs_rt *)malloc(sizeof(nfs_rt));
+	if(rt == NULL)
+		return NULL;
+
+	rt->rt_nworkers = nworkers;
+	rt->rt_flags = flags;
+	rt->rt_connflags = connflags;
+	rt->rt_hash = ght_fastest_hash();
+	if(posix_memalign((void **)&rt->rt_workers, RT_CACHE_LINE,
+				nworkers * sizeof(struct rt_worker)) != 0) {
+		free(rt);
+		return NULL;
+	}
+
+	/* The workers inherit the mask */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for(i = 0; i < nworkers; i++) {
+		if(rt_worker_init(rt, &rt->rt_workers[i], cpus[i % ncpus]) < 0)
+			break;
+		if(pthread_create(&rt->rt_workers[i].w_thread, NULL,
+					rt_worker_main, &rt->rt_workers[i]) != 0) {
+			ght_finalize(rt->rt_workers[i].w_targets);
+			free(rt->rt_workers[i].w_pfd);
+			free(rt->rt_workers[i].w_pt);
+			close(rt->rt_workers[i].w_pipe[0]);
+			close(rt->rt_workers[i].w_pipe[1]);
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(i < nworkers) {
+		rt_stop(rt, i);
+		free(rt->rt_workers);
+		free(rt);
+		return NULL;
+	}
+
+	return rt;
+}
+
+
+int
+nfs_rt_workers(nfs_rt *rt)
+{
+	if(rt == NULL)
+		return 0;
+
+	return rt->rt_nworkers;
+}
+
+
+static int
+rt_shard_of(nfs_rt *rt, struct rt_key *key)
+{
+	ght_hash_key_t hk;
+
+	hk.i_size = sizeof(struct rt_key);
+	hk.p_key = key;
+
+	return ((unsigned long long)rt->rt_hash(&hk) * rt->rt_nworkers) >> 32;
+}
+
+
+int
+nfs_rt_shard(nfs_rt *rt, struct sockaddr_in *srv, int conn)
+{
+	struct rt_key key;
+
+	if((rt == NULL) || (srv == NULL))
+		return -1;
+
+	rt_make_key(&key, srv, conn);
+	return rt_shard_of(rt, &key);
+}
+
+
+int
+nfs_rt_submit(nfs_rt *rt, struct sockaddr_in *srv, int conn,
+		nfs_rt_fn fn, void *arg)
+{
+	struct rt_worker *w = NULL;
+	struct rt_work *rw = NULL;
+
+	if((rt == NULL) || (srv == NULL) || (fn == NULL))
+		return -1;
+
+	rw = (struct rt_work *)malloc(sizeof(struct rt_work));
+	if(rw == NULL)
+		return -1;
+
+	rt_make_key(&rw->rw_key, srv, conn);
+	rw->rw_srv = *srv;
+	rw->rw_fn = fn;
+	rw->rw_arg = arg;
+
+	w = &rt->rt_workers[rt_shard_of(rt, &rw->rw_key)];
+	rt_push(w, rw);
+	rt_wake(w);
+
+	return 0;
+}
+
+
+void
+nfs_rt_destroy(nfs_rt *rt)
+{
+	if(rt == NULL)
+		return;
+
+	rt_stop(rt, rt->rt_nworkers);
+	free(rt->rt_workers);
+	free(rt);
+}
@@ -70,13 +70,47 @@ nfs_init(struct sockaddr_in *srv, int proto, int connflags)
 	ctx->nfs_connflags = connflags;
 	ctx->nfs_rsize = 0;
 	ctx->nfs_wsize = 0;
+	ctx->nfs_cork = 0;
 	ctx->nfs_cl = NULL;
 	ctx->nfs_mnt_cl = NULL;
+	ctx->nfs_dnlc = NULL;
+	ctx->nfs_fsinfo_cache = NULL;
 
 	return ctx;
 }
 
 
+void
+nfs_destroy(nfs_ctx *ctx)
+{
+	ght_iterator_t iter;
+	const void *key;
+	void *fi;
+
+	if(ctx == NULL)
+		return;
+
+	if(ctx->nfs_cl != NULL)
+		clnttcp_nb_destroy(ctx->nfs_cl);
+	if(ctx->nfs_mnt_cl != NULL)
+		clnttcp_nb_destroy(ctx->nfs_mnt_cl);
+
+	nfs_dnlc_destroy(ctx);
+
+	if(ctx->nfs_fsinfo_cache != NULL) {
+		for(fi = ght_first(ctx->nfs_fsinfo_cache, &iter, &key);
+				fi != NULL;
+				fi = ght_next(ctx->nfs_fsinfo_cache, &iter, &key))
+			mem_free(fi, sizeof(nfs_fsinfo));
+		ght_finalize(ctx->nfs_fsinfo_cache);
+	}
+
+	free(ctx->nfs_srv);
+	free(ctx->nfs_mnt);
+	free(ctx);
+}
+
+
 int 
 check_ctx(nfs_ctx *ctx)
 {
@@ -91,6 +125,21 @@ check_ctx(nfs_ctx *ctx)
 }
 
 
+void
+ctx_setup_client(nfs_ctx *ctx, CLIENT *cl)
+{
+	if(cl == NULL)
+		return;
+
+	if(ctx->nfs_connflags & NFSC_CFL_RECONNECT)
+		clnttcp_nb_set_reconnect(cl, CLNT_RECONNECT_ATTEMPTS,
+				CLNT_RECONNECT_MIN_MS, CLNT_RECONNECT_MAX_MS);
+	if(ctx->nfs_connflags & NFSC_CFL_RETRANS)
+		clnttcp_nb_set_retrans(cl, CLNT_RETRANS, CLNT_RTO_MIN_MS,
+				CLNT_RTO_MAX_MS);
+}
+
+
 void 
 mnt_complete(nfs_ctx * ctx)
 {
@@ -109,3 +158,292 @@ nfs_complete(nfs_ctx * ctx, int flag)
 	return clnttcp_nb_receive(ctx->nfs_cl, flag);
 }
 
+
+
+/* State shared between the blocking helpers below and their
+ * callbacks.
+ */
+struct nfsc_sync {
+	int done;
+	int stat;
+	nfs_fh3 *fh;
+	nfs_fsinfo *fi;
+};
+
+
+static void
+nfs_mount_cb(void *msg, int len, void *priv)
+{
+	struct nfsc_sync *sync = (struct nfsc_sync *)priv;
+	mountres3 *res = NULL;
+	fhandle3 *fh = NULL;
+
+	sync->done = 1;
+	res = xdr_to_mntres3(msg, len);
+	if(res == NULL)
+		return;
+
+	sync->stat = res->fhs_status;
+	if(res->fhs_status != MNT3_OK) {
+		free_mntres3(res);
+		return;
+	}
+
+	fh = &res->mountres3_u.mountinfo.fhandle;
+	sync->fh->data.data_val = (char *)mem_alloc(fh->fhandle3_len);
+	if(sync->fh->data.data_val == NULL) {
+		sync->stat = -1;
+		free_mntres3(res);
+		return;
+	}
+
+	memcpy(sync->fh->data.data_val, fh->fhandle3_val, fh->fhandle3_len);
+	sync->fh->data.data_len = fh->fhandle3_len;
+	free_mntres3(res);
+}
+
+
+static void
+nfs_fsinfo_cb(void *msg, int len, void *priv)
+{
+	struct nfsc_sync *sync = (struct nfsc_sync *)priv;
+	FSINFO3res *res = NULL;
+	FSINFO3resok *ok = NULL;
+
+	sync->done = 1;
+	res = xdr_to_FSINFO3res(msg, len);
+	if(res == NULL)
+		return;
+
+	sync->stat = res->status;
+	if(res->status != NFS3_OK) {
+		free_FSINFO3res(res);
+		return;
+	}
+
+	/* The uint32 fields are wider than what the decoder fills in
+	 * on some platforms, only the low 32 bits are valid.
+	 */
+	ok = &res->FSINFO3res_u.resok;
+	sync->fi->fi_rtmax = (u_int32_t)ok->rtmax;
+	sync->fi->fi_rtpref = (u_int32_t)ok->rtpref;
+	sync->fi->fi_rtmult = (u_int32_t)ok->rtmult;
+	sync->fi->fi_wtmax = (u_int32_t)ok->wtmax;
+	sync->fi->fi_wtpref = (u_int32_t)ok->wtpref;
+	sync->fi->fi_wtmult = (u_int32_t)ok->wtmult;
+	sync->fi->fi_dtpref = (u_int32_t)ok->dtpref;
+	sync->fi->fi_maxfilesize = ok->maxfilesize;
+	sync->fi->fi_properties = (u_int32_t)ok->properties;
+	free_FSINFO3res(res);
+}
+
+
+nfs_fsinfo *
+nfs_fsinfo_get(nfs_ctx *ctx, nfs_fh3 *root)
+{
+	struct nfsc_sync sync;
+	nfs_fsinfo *fi = NULL;
+	FSINFOargs args;
+
+	if((ctx == NULL) || (root == NULL))
+		return NULL;
+
+	if(ctx->nfs_fsinfo_cache == NULL) {
+		ctx->nfs_fsinfo_cache = ght_create(16);
+		if(ctx->nfs_fsinfo_cache == NULL)
+			return NULL;
+	}
+
+	fi = ght_get(ctx->nfs_fsinfo_cache, root->data.data_len,
+			root->data.data_val);
+	if(fi != NULL)
+		return fi;
+
+	fi = (nfs_fsinfo *)mem_alloc(sizeof(nfs_fsinfo));
+	if(fi == NULL)
+		return NULL;
+	memset(fi, 0, sizeof(nfs_fsinfo));
+
+	sync.done = 0;
+	sync.stat = -1;
+	sync.fi = fi;
+	args.fsroot = *root;
+	if(nfs3_fsinfo(&args, ctx, nfs_fsinfo_cb, &sync) != RPC_SUCCESS) {
+		mem_free(fi, sizeof(nfs_fsinfo));
+		return NULL;
+	}
+
+	while(!sync.done) {
+		if(nfs_complete(ctx, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	}
+
+	/* A reply coming later must not write to sync or fi */
+	if(!sync.done)
+		nfs_cancel(ctx, &sync);
+
+	if(sync.stat != NFS3_OK) {
+		mem_free(fi, sizeof(nfs_fsinfo));
+		return NULL;
+	}
+
+	if(ght_insert(ctx->nfs_fsinfo_cache, fi, root->data.data_len,
+				root->data.data_val) < 0) {
+		mem_free(fi, sizeof(nfs_fsinfo));
+		return NULL;
+	}
+
+	return fi;
+}
+
+
+int
+nfs_set_xfer_size(nfs_ctx *ctx, int rsize, int wsize)
+{
+	if(ctx == NULL)
+		return -1;
+
+	if(rsize > 0)
+		ctx->nfs_rsize = rsize;
+	if(wsize > 0)
+		ctx->nfs_wsize = wsize;
+
+	/* Otherwise the sizes are used when the connection is made */
+	if(ctx->nfs_cl == NULL)
+		return 0;
+
+	return clnttcp_nb_setbufsz(ctx->nfs_cl, NFSC_BUFSZ(ctx->nfs_wsize),
+			NFSC_BUFSZ(ctx->nfs_rsize));
+}
+
+
+int
+nfs_set_cork(nfs_ctx *ctx, unsigned long bytes)
+{
+	if(ctx == NULL)
+		return -1;
+
+	ctx->nfs_cork = bytes;
+
+	/* Otherwise it is set when the connection is made */
+	if(ctx->nfs_cl == NULL)
+		return 0;
+
+	return clnttcp_nb_set_cork(ctx->nfs_cl, bytes);
+}
+
+
+unsigned long
+nfs_flush(nfs_ctx *ctx)
+{
+	if(ctx == NULL)
+		return 0;
+
+	return clnttcp_nb_flush(ctx->nfs_cl) + clnttcp_nb_flush(ctx->nfs_mnt_cl);
+}
+
+
+/* Picks a transfer size from what the server prefers and allows */
+static int
+xfer_size(u_int32_t pref, u_int32_t max)
+{
+	u_int32_t size;
+
+	size = (pref) ? pref : NFS_DEFAULT_XFER;
+	if(max && (size > max))
+		size = max;
+	if(size > NFS_MAX_XFER)
+		size = NFS_MAX_XFER;
+	if(size < NFS_MIN_XFER)
+		size = NFS_MIN_XFER;
+
+	return size;
+}
+
+
+int
+nfs_mount(nfs_ctx *ctx, char *export, nfs_fh3 *fh)
+{
+	struct nfsc_sync sync;
+	nfs_fsinfo *fi = NULL;
+
+	if((ctx == NULL) || (export == NULL) || (fh == NULL))
+		return -1;
+
+	sync.done = 0;
+	sync.stat = -1;
+	sync.fh = fh;
+	if(mount3_mnt(&export, ctx, nfs_mount_cb, &sync) != RPC_SUCCESS)
+		return -1;
+
+	while(!sync.done) {
+		if(clnttcp_nb_receive(ctx->nfs_mnt_cl, RPC_BLOCKING_WAIT) <= 0)
+			break;
+	}
+	if(!sync.done)
+		nfs_cancel(ctx, &sync);
+
+	if(sync.stat != MNT3_OK)
+		return sync.stat;
+
+	fi = nfs_fsinfo_get(ctx, fh);
+	if(fi != NULL)
+		nfs_set_xfer_size(ctx, xfer_size(fi->fi_rtpref, fi->fi_rtmax),
+				xfer_size(fi->fi_wtpref, fi->fi_wtmax));
+
+	return MNT3_OK;
+}
+
+
+int
+nfs_cancel(nfs_ctx *ctx, void *priv)
+{
+	int n, m;
+
+	if(ctx == NULL)
+		return 0;
+
+	n = clnttcp_nb_cancel_priv(ctx->nfs_cl, priv);
+	m = clnttcp_nb_cancel_priv(ctx->nfs_mnt_cl, priv);
+	if((n < 0) || (m < 0))
+		return -1;
+
+	return n + m;
+}
+
+
+struct clnt_proc_stats *
+nfs_proc_stats(nfs_ctx *ctx, u_long prog, u_long proc)
+{
+	if(ctx == NULL)
+		return NULL;
+
+	if(prog == MOUNT_PROGRAM)
+		return clnttcp_proc_stats(ctx->nfs_mnt_cl, proc);
+
+	return clnttcp_proc_stats(ctx->nfs_cl, proc);
+}
+
+
+struct clnt_rtt_stats *
+nfs_rtt_stats(nfs_ctx *ctx, u_long prog)
+{
+	if(ctx == NULL)
+		return NULL;
+
+	if(prog == MOUNT_PROGRAM)
+		return clnttcp_rtt_stats(ctx->nfs_mnt_cl);
+
+	return clnttcp_rtt_stats(ctx->nfs_cl);
+}
+
+
+void
+nfs_reset_stats(nfs_ctx *ctx)
+{
+	if(ctx == NULL)
+		return;
+
+	clnttcp_reset_stats(ctx->nfs_mnt_cl);
+	clnttcp_reset_stats(ctx->nfs_cl);
+}